@@ -0,0 +1,265 @@
+/** \file command.h
+ *  \defgroup cnc_command
+ *
+ * Table-driven command line dispatcher.
+ *
+ * Each command is described once: name, the line shown in the options
+ * box, an argument schema and a handler. command_dispatch() splits the
+ * line in place, finds the command through a small open-addressed hash
+ * table built by command_table_init() (one probe for almost every
+ * lookup), parses each argument against its schema in the same pass and
+ * calls the handler with the values. Anything wrong with the line comes
+ * back as one precise message: which argument, what was expected and the
+ * syntax of the command.
+ *
+ * Nothing in here touches the hardware.
+ */
+
+#ifndef CC2511_COMMAND_H
+#define CC2511_COMMAND_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define COMMAND_MAX_ARGS  4
+#define COMMAND_HASH_SIZE 64    /* power of two, well above the command count */
+
+typedef enum arg_type {
+    ARG_INT,            /* decimal integer between min and max */
+    ARG_WORD,           /* one word */
+    ARG_TEXT            /* the rest of the line, spaces included */
+}   arg_type_T;
+
+typedef struct arg_spec {
+    const char *name;   /* NULL ends the list */
+    arg_type_T type;
+    bool optional;      /* this and every later argument may be left out */
+    int32_t min;        /* ARG_INT limits */
+    int32_t max;
+}   arg_spec_T;
+
+typedef struct command_args {
+    int count;                          /* arguments given */
+    int32_t value[COMMAND_MAX_ARGS];    /* ARG_INT values */
+    char *text[COMMAND_MAX_ARGS];       /* ARG_WORD and ARG_TEXT, NULL if not given */
+}   command_args_T;
+
+typedef void (*command_handler_T)(const command_args_T *args);
+
+typedef struct command {
+    const char *name;
+    const char *summary;                /* options box entry, NULL to leave it out */
+    arg_spec_T args[COMMAND_MAX_ARGS];
+    command_handler_T handler;
+}   command_T;
+
+typedef struct command_table {
+    const command_T *commands;
+    int count;
+    int8_t slots[COMMAND_HASH_SIZE];    /* index into commands, -1 = empty */
+}   command_table_T;
+
+/* FNV-1a over the name */
+static inline uint32_t command_hash(const char *name, size_t length) {
+    uint32_t hash = 2166136261U;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ (uint8_t)name[i]) * 16777619U;
+    }
+    return hash;
+}
+
+/*! \brief Index a list of commands for lookup.
+ *  \ingroup cnc_command
+ *
+ * \return false if there are too many commands or a name is repeated
+ */
+static inline bool command_table_init(command_table_T *t, const command_T *commands, int count) {
+    t->commands = commands;
+    t->count = count;
+    for (int i = 0; i < COMMAND_HASH_SIZE; i++) {
+        t->slots[i] = -1;
+    }
+    if (count > COMMAND_HASH_SIZE / 2) {
+        return false;
+    }
+    for (int i = 0; i < count; i++) {
+        size_t length = strlen(commands[i].name);
+        uint32_t slot = command_hash(commands[i].name, length) & (COMMAND_HASH_SIZE - 1);
+        while (t->slots[slot] >= 0) {
+            if (strcmp(commands[t->slots[slot]].name, commands[i].name) == 0) {
+                return false;
+            }
+            slot = (slot + 1) & (COMMAND_HASH_SIZE - 1);
+        }
+        t->slots[slot] = (int8_t)i;
+    }
+    return true;
+}
+
+/*! \brief Find a command by name (not necessarily terminated).
+ *  \ingroup cnc_command
+ *
+ * \return the command, or NULL if there is none by that name
+ */
+static inline const command_T *command_find(const command_table_T *t, const char *name, size_t length) {
+    uint32_t slot = command_hash(name, length) & (COMMAND_HASH_SIZE - 1);
+    while (t->slots[slot] >= 0) {
+        const command_T *c = &t->commands[t->slots[slot]];
+        if (strncmp(c->name, name, length) == 0 && c->name[length] == '\0') {
+            return c;
+        }
+        slot = (slot + 1) & (COMMAND_HASH_SIZE - 1);
+    }
+    return NULL;
+}
+
+/*! \brief Write the syntax of a command, e.g. "resize width height [x] [y]".
+ *  \ingroup cnc_command
+ */
+static inline void command_usage(const command_T *c, char *out, size_t size) {
+    int n = snprintf(out, size, "%s", c->name);
+    for (int i = 0; i < COMMAND_MAX_ARGS && c->args[i].name && n >= 0 && (size_t)n < size; i++) {
+        const char *format = c->args[i].optional ? " [%s]" : " %s";
+        n += snprintf(out + n, size - n, format, c->args[i].name);
+    }
+}
+
+static inline bool command_is_space(char ch) {
+    return ch == ' ' || ch == '\t';
+}
+
+/* Decimal integer with an optional sign, up to the end of the word */
+static inline bool command_parse_int(const char *word, int32_t *value) {
+    bool negative = *word == '-';
+    if (*word == '-' || *word == '+') {
+        word++;
+    }
+    if (*word == '\0') {
+        return false;
+    }
+    int64_t v = 0;
+    for (; *word; word++) {
+        if (*word < '0' || *word > '9') {
+            return false;
+        }
+        v = v * 10 + (*word - '0');
+        if (v > INT32_MAX) {
+            return false;
+        }
+    }
+    *value = (int32_t)(negative ? -v : v);
+    return true;
+}
+
+/* Cut the next word out of the line in place */
+static inline char *command_next_word(char **cursor) {
+    char *p = *cursor;
+    while (command_is_space(*p)) {
+        p++;
+    }
+    if (*p == '\0') {
+        *cursor = p;
+        return NULL;
+    }
+    char *word = p;
+    while (*p && !command_is_space(*p)) {
+        p++;
+    }
+    if (*p) {
+        *p++ = '\0';
+    }
+    *cursor = p;
+    return word;
+}
+
+/*! \brief Parse the arguments after the command name against its schema.
+ *  \ingroup cnc_command
+ *
+ * \param line  Rest of the line; split in place
+ * \param error Filled in with what is wrong when false is returned
+ */
+static inline bool command_parse(const command_T *c, char *line, command_args_T *args,
+  char *error, size_t size) {
+    char usage[40];
+    args->count = 0;
+    for (int i = 0; i < COMMAND_MAX_ARGS; i++) {
+        args->value[i] = 0;
+        args->text[i] = NULL;
+    }
+
+    int i = 0;
+    for (; i < COMMAND_MAX_ARGS && c->args[i].name; i++) {
+        const arg_spec_T *spec = &c->args[i];
+        char *word;
+        if (spec->type == ARG_TEXT) {
+            while (command_is_space(*line)) {
+                line++;
+            }
+            word = *line ? line : NULL;
+            line += strlen(line);
+        } else {
+            word = command_next_word(&line);
+        }
+        if (!word) {
+            if (spec->optional) {
+                return true;
+            }
+            command_usage(c, usage, sizeof(usage));
+            snprintf(error, size, "%s: missing %s. Syntax: \"%s\"", c->name, spec->name, usage);
+            return false;
+        }
+        if (spec->type == ARG_INT) {
+            if (!command_parse_int(word, &args->value[i])) {
+                snprintf(error, size, "%s: %s \"%.12s\" is not a number", c->name, spec->name, word);
+                return false;
+            }
+            if (args->value[i] < spec->min || args->value[i] > spec->max) {
+                snprintf(error, size, "%s: %s %ld out of range (%ld-%ld)", c->name, spec->name,
+                         (long)args->value[i], (long)spec->min, (long)spec->max);
+                return false;
+            }
+        }
+        args->text[i] = word;
+        args->count = i + 1;
+    }
+
+    char *extra = command_next_word(&line);
+    if (extra) {
+        command_usage(c, usage, sizeof(usage));
+        snprintf(error, size, "%s: unexpected \"%.12s\". Syntax: \"%s\"", c->name, extra, usage);
+        return false;
+    }
+    return true;
+}
+
+/*! \brief Run one command line.
+ *  \ingroup cnc_command
+ *
+ * An empty line does nothing.
+ *
+ * \param line  Split in place
+ * \param error Filled in when false is returned; the handler is not called
+ */
+static inline bool command_dispatch(const command_table_T *t, char *line, char *error, size_t size) {
+    char *cursor = line;
+    char *name = command_next_word(&cursor);
+    if (!name) {
+        return true;
+    }
+    const command_T *c = command_find(t, name, strlen(name));
+    if (!c) {
+        snprintf(error, size, "Invalid command \"%.16s\", try \"help\"", name);
+        return false;
+    }
+    command_args_T args;
+    if (!command_parse(c, cursor, &args, error, size)) {
+        return false;
+    }
+    c->handler(&args);
+    return true;
+}
+
+#endif //  CC2511_COMMAND_H
@@ -0,0 +1,184 @@
+/** \file dryrun.h
+ *  \defgroup cnc_dryrun
+ *
+ * Header-only dry run of the motion executor: how long a job takes and
+ * how far it goes, without moving anything.
+ *
+ * seg_walk_init()/seg_walk_next() turn one planned segment into pulse
+ * slots: the velocity profile from planner.h drives the line or arc walk
+ * from stepper.h. Core1 queues those slots for the step alarm; the dry
+ * run instead adds their intervals to a virtual clock. Commands go
+ * through the same look-ahead buffer either way, so the estimate is the
+ * time the pulses themselves take. It leaves out waits the executor
+ * cannot see: a stream running dry, spindle changes and feed holds.
+ * Homing depends on where the switches are and is only counted.
+ *
+ * Shared by the firmware and the host tools in host/.
+ */
+
+#ifndef CC2511_DRYRUN_H
+#define CC2511_DRYRUN_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "motion.h"
+#include "planner.h"
+#include "stepper.h"
+
+/* Pulse slots of one planned segment, in order */
+typedef struct seg_walk {
+    profile_T profile;
+    arc_T arc;
+    line_T line;
+    bool on_arc;            /* still walking round the circle */
+}   seg_walk_T;
+
+/*! \brief Start turning a planned segment into pulse slots.
+ *  \ingroup cnc_dryrun
+ *
+ * \param exit_speed Speed to hand over to the next segment (see planner_pop())
+ */
+static inline void seg_walk_init(seg_walk_T *w, const segment_T *seg, uint32_t exit_speed) {
+    // Speed ramp along the dominant axis
+    profile_init(&w->profile, seg->steps,
+                 planner_to_dominant(seg, seg->entry),
+                 planner_to_dominant(seg, seg->nominal),
+                 planner_to_dominant(seg, exit_speed),
+                 planner_to_dominant(seg, seg->accel));
+    w->on_arc = seg->arc;
+    if (seg->arc) {
+        int32_t start[2] = {-seg->center[0], -seg->center[1]};
+        int32_t end[2] = {seg->delta[0] - seg->center[0], seg->delta[1] - seg->center[1]};
+        arc_init(&w->arc, start, end, seg->delta[2], seg->clockwise, seg->arc_steps);
+    } else {
+        line_init(&w->line, seg->delta);
+    }
+}
+
+/*! \brief Next pulse slot.
+ *  \ingroup cnc_dryrun
+ *
+ * An arc walks round the circle, then closes the last fraction of a step
+ * with a line.
+ *
+ * \return false once the segment is finished
+ */
+static inline bool seg_walk_next(seg_walk_T *w, uint8_t *step_mask, uint8_t *dir_mask, uint32_t *interval_us) {
+    if (w->on_arc) {
+        if (arc_next(&w->arc, step_mask, dir_mask)) {
+            *interval_us = profile_next_interval(&w->profile);
+            return true;
+        }
+        int32_t remaining[STEPPER_NUM_AXES];
+        arc_remaining(&w->arc, remaining);
+        line_init(&w->line, remaining);
+        w->on_arc = false;
+    }
+    if (!line_next(&w->line, step_mask)) {
+        return false;
+    }
+    *dir_mask = w->line.dir_mask;
+    *interval_us = profile_next_interval(&w->profile);
+    return true;
+}
+
+/* Totals of a dry run */
+typedef struct dryrun {
+    planner_T planner;
+    bool rapid[PLANNER_BUFFER_SIZE];    /* per buffer slot: queued with feed 0 */
+    uint64_t time_us;                   /* virtual clock */
+    uint64_t rapid_us;                  /* part of it spent on rapids */
+    uint64_t cut_length;                /* path steps at a feed */
+    uint64_t rapid_length;              /* path steps at rapid */
+    uint64_t steps[STEPPER_NUM_AXES];   /* pulses per axis */
+    uint32_t segments;                  /* segments and arcs executed */
+    uint32_t homes;                     /* homing cycles, not timed */
+}   dryrun_T;
+
+/*! \brief Start a dry run with the clock at zero.
+ *  \ingroup cnc_dryrun
+ */
+static inline void dryrun_init(dryrun_T *d) {
+    planner_init(&d->planner);
+    d->time_us = 0;
+    d->rapid_us = 0;
+    d->cut_length = 0;
+    d->rapid_length = 0;
+    for (int i = 0; i < STEPPER_NUM_AXES; i++) {
+        d->steps[i] = 0;
+    }
+    d->segments = 0;
+    d->homes = 0;
+}
+
+/* Execute the oldest buffered segment against the virtual clock */
+static inline void dryrun_emit_next(dryrun_T *d) {
+    bool rapid = d->rapid[d->planner.tail % PLANNER_BUFFER_SIZE];
+    segment_T seg;
+    uint32_t exit_speed;
+    if (!planner_pop(&d->planner, &seg, &exit_speed)) {
+        return;
+    }
+    seg_walk_T walk;
+    uint8_t step_mask;
+    uint8_t dir_mask;
+    uint32_t interval;
+    uint64_t start = d->time_us;
+    seg_walk_init(&walk, &seg, exit_speed);
+    while (seg_walk_next(&walk, &step_mask, &dir_mask, &interval)) {
+        // As stepper_push() stores it
+        d->time_us += interval < STEPPER_MIN_INTERVAL_US ? STEPPER_MIN_INTERVAL_US : interval;
+        for (int i = 0; i < STEPPER_NUM_AXES; i++) {
+            d->steps[i] += (step_mask >> i) & 1U;
+        }
+    }
+    if (rapid) {
+        d->rapid_us += d->time_us - start;
+        d->rapid_length += seg.length;
+    } else {
+        d->cut_length += seg.length;
+    }
+    d->segments++;
+}
+
+/*! \brief Carry out one motion command as core1 would.
+ *  \ingroup cnc_dryrun
+ */
+static inline void dryrun_command(dryrun_T *d, const motion_cmd_T *cmd) {
+    switch (cmd->type) {
+        case MOTION_SEGMENT:
+        case MOTION_ARC:
+            // Make room by executing the oldest segment once the buffer is full
+            while (planner_full(&d->planner)) {
+                dryrun_emit_next(d);
+            }
+            d->rapid[d->planner.head % PLANNER_BUFFER_SIZE] = cmd->feed == 0;
+            if (cmd->type == MOTION_ARC) {
+                planner_push_arc(&d->planner, cmd->delta, cmd->center, cmd->clockwise,
+                                 cmd->max_velocity, cmd->max_accel, cmd->feed);
+            } else {
+                planner_push(&d->planner, cmd->delta, cmd->max_velocity, cmd->max_accel, cmd->feed);
+            }
+            break;
+        case MOTION_FLUSH:
+        case MOTION_HOME:
+            while (planner_count(&d->planner) > 0) {
+                dryrun_emit_next(d);
+            }
+            if (cmd->type == MOTION_HOME) {
+                d->homes++;
+            }
+            break;
+    }
+}
+
+/*! \brief Run out the look-ahead buffer at the end of a job.
+ *  \ingroup cnc_dryrun
+ */
+static inline void dryrun_finish(dryrun_T *d) {
+    motion_cmd_T flush;
+    flush.type = MOTION_FLUSH;
+    dryrun_command(d, &flush);
+}
+
+#endif //  CC2511_DRYRUN_H
@@ -0,0 +1,406 @@
+/** \file gcode.h
+ *  \defgroup cnc_gcode
+ *
+ * Header-only G-code interpreter for the three axis mill.
+ *
+ * Lines are interpreted one at a time into a short list of actions
+ * (move, arc, home, spindle, end) which the caller then executes. The
+ * interpreter keeps only its modal state between lines, so a program of
+ * any length can be streamed through it.
+ *
+ * Supported words:
+ *   G0 G1 G2 G3   rapid, feed, clockwise and counter-clockwise arc (I J or R)
+ *   G28           return to machine zero, optionally via X Y Z
+ *   G90 G91 G92   absolute, relative, set program position
+ *   G17 G21 G94   accepted, already the only mode
+ *   M3 M5 S F     spindle on/off, spindle speed, feed (units/min)
+ *   M2 M30        end of program
+ *   N, *checksum, ( comments ) and ; comments are ignored
+ *
+ * Numbers are parsed as fixed point thousandths and converted to
+ * machine steps with steps_per_unit. Nothing in here touches the
+ * hardware.
+ */
+
+#ifndef CC2511_GCODE_H
+#define CC2511_GCODE_H
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define GCODE_NUM_AXES    3
+#define GCODE_SCALE       1000    /* parsed values are in thousandths */
+#define GCODE_MAX_ACTIONS 3
+
+/* What the caller has to do for a line */
+typedef enum gcode_action_type {
+    GCODE_MOVE,         /* straight line to target */
+    GCODE_ARC,          /* arc to target around center */
+    GCODE_HOME,         /* go to machine zero, via target if has_via */
+    GCODE_SPINDLE,      /* set spindle to spindle_speed */
+    GCODE_END           /* program finished */
+}   gcode_action_type_T;
+
+typedef struct gcode_action {
+    gcode_action_type_T type;
+    int32_t target[GCODE_NUM_AXES];   /* machine steps */
+    int32_t center[2];                /* arc centre, machine steps (X, Y) */
+    bool clockwise;                   /* arc direction */
+    bool has_via;                     /* G28 intermediate point given */
+    uint32_t feed;                    /* path steps/s, 0 = rapid */
+    int spindle_speed;
+}   gcode_action_T;
+
+typedef struct gcode_result {
+    gcode_action_T actions[GCODE_MAX_ACTIONS];
+    int count;
+    const char *error;                /* NULL if the line was accepted */
+}   gcode_result_T;
+
+/* Modal state carried between lines */
+typedef struct gcode {
+    int motion;                           /* 0-3, current G0/G1/G2/G3 */
+    bool relative;                        /* G91 */
+    int32_t position[GCODE_NUM_AXES];     /* last commanded machine position */
+    int32_t offset[GCODE_NUM_AXES];       /* machine = program + offset */
+    int32_t steps_per_unit;
+    uint32_t feed;                        /* path steps/s */
+    int spindle_speed;
+    bool spindle_on;
+}   gcode_T;
+
+/*! \brief Reset the interpreter.
+ *  \ingroup cnc_gcode
+ *
+ * \param position      Current machine position (steps)
+ * \param steps_per_unit Steps per G-code unit
+ */
+static inline void gcode_init(gcode_T *gc, const int32_t position[GCODE_NUM_AXES],
+  int32_t steps_per_unit) {
+    gc->motion = 0;
+    gc->relative = false;
+    for (int i = 0; i < GCODE_NUM_AXES; i++) {
+        gc->position[i] = position[i];
+        gc->offset[i] = 0;
+    }
+    gc->steps_per_unit = steps_per_unit;
+    gc->feed = 0;
+    gc->spindle_speed = 0;
+    gc->spindle_on = false;
+}
+
+/* Parse a signed decimal into thousandths. Returns chars consumed, 0 if none. */
+static inline int gcode_parse_number(const char *s, int32_t *value) {
+    int i = 0;
+    bool negative = false;
+    bool digits = false;
+    int64_t result = 0;
+    if (s[i] == '-' || s[i] == '+') {
+        negative = s[i] == '-';
+        i++;
+    }
+    while (s[i] >= '0' && s[i] <= '9') {
+        if (result < INT32_MAX) {
+            result = result * 10 + (s[i] - '0');
+        }
+        digits = true;
+        i++;
+    }
+    result *= GCODE_SCALE;
+    if (s[i] == '.') {
+        int32_t place = GCODE_SCALE / 10;
+        i++;
+        while (s[i] >= '0' && s[i] <= '9') {
+            result += (s[i] - '0') * place;
+            place /= 10;
+            digits = true;
+            i++;
+        }
+    }
+    if (!digits) {
+        return 0;
+    }
+    if (result > INT32_MAX) {
+        result = INT32_MAX;
+    }
+    *value = (int32_t)(negative ? -result : result);
+    return i;
+}
+
+/* Thousandths of a unit to steps, rounded to nearest */
+static inline int32_t gcode_to_steps(const gcode_T *gc, int32_t value) {
+    int64_t scaled = (int64_t)value * gc->steps_per_unit;
+    scaled += scaled < 0 ? -GCODE_SCALE / 2 : GCODE_SCALE / 2;
+    return (int32_t)(scaled / GCODE_SCALE);
+}
+
+static inline gcode_action_T *gcode_add_action(gcode_result_T *out,
+  gcode_action_type_T type) {
+    gcode_action_T *a = &out->actions[out->count++];
+    a->type = type;
+    a->has_via = false;
+    a->clockwise = false;
+    a->feed = 0;
+    a->spindle_speed = 0;
+    return a;
+}
+
+/*! \brief Interpret one line of G-code.
+ *  \ingroup cnc_gcode
+ *
+ * The modal state is only updated if the whole line is valid.
+ *
+ * \param line NUL terminated line, without the newline
+ * \param out  Actions to execute in order, or an error message
+ * \return false if the line was rejected (see out->error)
+ */
+static inline bool gcode_parse_line(gcode_T *gc, const char *line,
+  gcode_result_T *out) {
+    // Words seen on this line
+    int32_t axis_value[GCODE_NUM_AXES];
+    bool axis_seen[GCODE_NUM_AXES] = {false, false, false};
+    int32_t ij[2] = {0, 0};
+    bool ij_seen = false;
+    int32_t r_value = 0;
+    bool r_seen = false;
+    int32_t f_value = 0;
+    bool f_seen = false;
+    int32_t s_value = 0;
+    bool s_seen = false;
+    int motion = gc->motion;
+    bool motion_seen = false;
+    bool relative = gc->relative;
+    bool g28 = false;
+    bool g92 = false;
+    int m_code = -1;
+
+    out->count = 0;
+    out->error = NULL;
+
+    for (int i = 0; line[i] != '\0';) {
+        char letter = line[i];
+        if (letter == ' ' || letter == '\t' || letter == '\r' || letter == '\n') {
+            i++;
+            continue;
+        }
+        if (letter == ';' || letter == '*' || letter == '%') {
+            break;
+        }
+        if (letter == '(') {
+            while (line[i] != '\0' && line[i] != ')') {
+                i++;
+            }
+            if (line[i] == ')') {
+                i++;
+            }
+            continue;
+        }
+        if (letter >= 'a' && letter <= 'z') {
+            letter -= 'a' - 'A';
+        }
+        if (letter < 'A' || letter > 'Z') {
+            out->error = "Unexpected character";
+            return false;
+        }
+
+        int32_t value;
+        int used = gcode_parse_number(&line[i + 1], &value);
+        if (used == 0) {
+            out->error = "Missing number after letter";
+            return false;
+        }
+        i += 1 + used;
+
+        switch (letter) {
+            case 'G':
+                if (value % GCODE_SCALE != 0) {
+                    out->error = "Unsupported G code";
+                    return false;
+                }
+                switch (value / GCODE_SCALE) {
+                    case 0: case 1: case 2: case 3:
+                        motion = value / GCODE_SCALE;
+                        motion_seen = true;
+                        break;
+                    case 17: case 21: case 94:
+                        break;
+                    case 28:
+                        g28 = true;
+                        break;
+                    case 90:
+                        relative = false;
+                        break;
+                    case 91:
+                        relative = true;
+                        break;
+                    case 92:
+                        g92 = true;
+                        break;
+                    default:
+                        out->error = "Unsupported G code";
+                        return false;
+                }
+                break;
+            case 'M':
+                m_code = value / GCODE_SCALE;
+                if (value % GCODE_SCALE != 0 || (m_code != 2 && m_code != 3
+                    && m_code != 5 && m_code != 30)) {
+                    out->error = "Unsupported M code";
+                    return false;
+                }
+                break;
+            case 'X': case 'Y': case 'Z':
+                axis_value[letter - 'X'] = value;
+                axis_seen[letter - 'X'] = true;
+                break;
+            case 'I': case 'J':
+                ij[letter - 'I'] = value;
+                ij_seen = true;
+                break;
+            case 'R':
+                r_value = value;
+                r_seen = true;
+                break;
+            case 'F':
+                if (value <= 0) {
+                    out->error = "Feed must be positive";
+                    return false;
+                }
+                f_value = value;
+                f_seen = true;
+                break;
+            case 'S':
+                if (value < 0) {
+                    out->error = "Spindle speed must not be negative";
+                    return false;
+                }
+                s_value = value;
+                s_seen = true;
+                break;
+            case 'N':
+                break;
+            default:
+                out->error = "Unsupported word";
+                return false;
+        }
+    }
+
+    bool any_axis = axis_seen[0] || axis_seen[1] || axis_seen[2];
+    if (g28 && g92) {
+        out->error = "G28 and G92 on the same line";
+        return false;
+    }
+    if (motion_seen && motion >= 2 && !any_axis && !g28 && !g92) {
+        // A bare G0/G1 just changes mode; arcs need somewhere to go
+        out->error = "Arc without end point";
+        return false;
+    }
+    if (motion >= 1 && any_axis && !g28 && !g92 && !f_seen && gc->feed == 0) {
+        out->error = "No feed rate set (F)";
+        return false;
+    }
+
+    // Resolve the target in machine steps
+    int32_t target[GCODE_NUM_AXES];
+    for (int i = 0; i < GCODE_NUM_AXES; i++) {
+        target[i] = gc->position[i];
+        if (axis_seen[i]) {
+            int32_t steps = gcode_to_steps(gc, axis_value[i]);
+            target[i] = (relative && !g92) ? gc->position[i] + steps : steps + gc->offset[i];
+        }
+    }
+
+    // Arc centre, checked before any state changes
+    int32_t center[2] = {0, 0};
+    bool is_arc = !g28 && !g92 && any_axis && motion >= 2;
+    if (is_arc) {
+        if (ij_seen) {
+            center[0] = gc->position[0] + gcode_to_steps(gc, ij[0]);
+            center[1] = gc->position[1] + gcode_to_steps(gc, ij[1]);
+        } else if (r_seen) {
+            // Centre from radius, see the R form in the NIST RS274NGC spec
+            double dx = target[0] - gc->position[0];
+            double dy = target[1] - gc->position[1];
+            double r = gcode_to_steps(gc, r_value);
+            double h = 4.0 * r * r - dx * dx - dy * dy;
+            if (h < 0 || (dx == 0 && dy == 0)) {
+                out->error = "Arc radius too small for end point";
+                return false;
+            }
+            double h_div_d = -sqrt(h) / sqrt(dx * dx + dy * dy);
+            if (motion == 3) {
+                h_div_d = -h_div_d;
+            }
+            if (r < 0) {
+                h_div_d = -h_div_d;
+            }
+            center[0] = gc->position[0] + (int32_t)lround(0.5 * (dx - dy * h_div_d));
+            center[1] = gc->position[1] + (int32_t)lround(0.5 * (dy + dx * h_div_d));
+        } else {
+            out->error = "Arc needs I J or R";
+            return false;
+        }
+    }
+
+    // Line accepted: update modal state and emit actions
+    gc->motion = motion;
+    gc->relative = relative;
+    if (f_seen) {
+        gc->feed = (uint32_t)(((int64_t)f_value * gc->steps_per_unit) / (60 * GCODE_SCALE));
+        if (gc->feed == 0) {
+            gc->feed = 1;
+        }
+    }
+
+    // Spindle changes happen before motion on the same line
+    bool spindle_changed = false;
+    if (s_seen) {
+        gc->spindle_speed = s_value / GCODE_SCALE;
+        spindle_changed = gc->spindle_on;
+    }
+    if (m_code == 3) {
+        gc->spindle_on = true;
+        spindle_changed = true;
+    } else if (m_code == 5) {
+        gc->spindle_on = false;
+        spindle_changed = true;
+    }
+    if (spindle_changed) {
+        gcode_action_T *a = gcode_add_action(out, GCODE_SPINDLE);
+        a->spindle_speed = gc->spindle_on ? gc->spindle_speed : 0;
+    }
+
+    if (g92) {
+        // Make the current position read as the given program coordinates
+        for (int i = 0; i < GCODE_NUM_AXES; i++) {
+            if (axis_seen[i]) {
+                gc->offset[i] = gc->position[i] - gcode_to_steps(gc, axis_value[i]);
+            }
+        }
+    } else if (g28) {
+        gcode_action_T *a = gcode_add_action(out, GCODE_HOME);
+        a->has_via = any_axis;
+        for (int i = 0; i < GCODE_NUM_AXES; i++) {
+            a->target[i] = target[i];
+            gc->position[i] = 0;
+        }
+    } else if (any_axis) {
+        gcode_action_T *a = gcode_add_action(out, is_arc ? GCODE_ARC : GCODE_MOVE);
+        a->feed = motion == 0 ? 0 : gc->feed;
+        a->clockwise = motion == 2;
+        a->center[0] = center[0];
+        a->center[1] = center[1];
+        for (int i = 0; i < GCODE_NUM_AXES; i++) {
+            a->target[i] = target[i];
+            gc->position[i] = target[i];
+        }
+    }
+
+    if (m_code == 2 || m_code == 30) {
+        gcode_add_action(out, GCODE_END);
+    }
+    return true;
+}
+
+#endif //  CC2511_GCODE_H
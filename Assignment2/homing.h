@@ -0,0 +1,140 @@
+/** \file homing.h
+ *  \defgroup cnc_homing
+ *
+ * Header-only homing cycle for one axis.
+ *
+ * The axis runs fast towards its limit switch, backs off until the
+ * switch releases plus pulloff_steps, comes back slowly so the trigger
+ * point is found at the same place every time, and finally pulls off
+ * again. The caller sets machine zero where the axis stops, so the
+ * switch is never pressed inside the working area. If the switch is
+ * already pressed at the start the axis first moves clear of it.
+ *
+ * homing_next() is called once per step with the current switch state
+ * and says which way to step and how long the step slot is. Time is
+ * counted from those intervals, so every phase has a timeout even if a
+ * switch is broken or unplugged. Nothing in here touches the hardware.
+ */
+
+#ifndef CC2511_HOMING_H
+#define CC2511_HOMING_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define HOMING_TICK_HZ 1000000U     /* interval units per second (us) */
+
+typedef enum homing_phase {
+    HOMING_CLEAR,       /* started on the switch: move off it first */
+    HOMING_SEEK,        /* fast approach */
+    HOMING_BACKOFF,     /* away until released, then pulloff_steps more */
+    HOMING_LOCATE,      /* slow approach */
+    HOMING_PULLOFF,     /* final move clear of the switch */
+    HOMING_DONE,        /* stopped at machine zero */
+    HOMING_TIMEOUT,     /* a phase ran out of time */
+    HOMING_ABORTED      /* set by the caller if motion was aborted */
+}   homing_phase_T;
+
+/* Per-axis homing settings */
+typedef struct homing_axis {
+    uint32_t seek_velocity;     /* steps/s towards the switch */
+    uint32_t locate_velocity;   /* steps/s for the slow re-approach */
+    uint32_t pulloff_steps;     /* clearance after the switch releases */
+    uint32_t timeout_ms;        /* longest any one phase may run */
+    bool forwards;              /* switch is at the positive end */
+}   homing_axis_T;
+
+typedef struct homing {
+    const homing_axis_T *cfg;
+    homing_phase_T phase;
+    uint32_t steps;             /* steps taken in this phase */
+    uint32_t released_at;       /* step count when the switch released */
+    uint64_t elapsed_us;        /* time spent in this phase */
+}   homing_T;
+
+/*! \brief Enter a phase with its counters cleared.
+ *  \ingroup cnc_homing
+ */
+static inline void homing_set_phase(homing_T *h, homing_phase_T phase) {
+    h->phase = phase;
+    h->steps = 0;
+    h->released_at = 0;
+    h->elapsed_us = 0;
+}
+
+/*! \brief Begin a homing cycle.
+ *  \ingroup cnc_homing
+ *
+ * \param triggered Switch state before the first step
+ */
+static inline void homing_start(homing_T *h, const homing_axis_T *cfg, bool triggered) {
+    h->cfg = cfg;
+    homing_set_phase(h, triggered ? HOMING_CLEAR : HOMING_SEEK);
+}
+
+/*! \brief True once the cycle has finished, successfully or not.
+ *  \ingroup cnc_homing
+ */
+static inline bool homing_finished(const homing_T *h) {
+    return h->phase >= HOMING_DONE;
+}
+
+/*! \brief Decide the next step of the cycle.
+ *  \ingroup cnc_homing
+ *
+ * \param triggered   Switch state after the previous step
+ * \param forwards    Set to the direction of the next step
+ * \param interval_us Set to the length of the next step slot
+ * \return false when no more steps are needed (see h->phase)
+ */
+static inline bool homing_next(homing_T *h, bool triggered, bool *forwards, uint32_t *interval_us) {
+    const homing_axis_T *cfg = h->cfg;
+
+    // Phase transitions driven by the switch
+    switch (h->phase) {
+        case HOMING_SEEK:
+            if (triggered) {
+                homing_set_phase(h, HOMING_BACKOFF);
+            }
+            break;
+        case HOMING_LOCATE:
+            if (triggered) {
+                homing_set_phase(h, HOMING_PULLOFF);
+            }
+            break;
+        case HOMING_CLEAR:
+        case HOMING_BACKOFF:
+        case HOMING_PULLOFF:
+            if (triggered) {
+                h->released_at = 0;
+            } else if (h->released_at == 0) {
+                h->released_at = h->steps + 1;
+            }
+            if (h->released_at != 0 && h->steps - h->released_at + 1 >= cfg->pulloff_steps) {
+                homing_set_phase(h, h->phase == HOMING_CLEAR ? HOMING_SEEK
+                                  : h->phase == HOMING_BACKOFF ? HOMING_LOCATE
+                                  : HOMING_DONE);
+            }
+            break;
+        default:
+            break;
+    }
+    if (homing_finished(h)) {
+        return false;
+    }
+    if (h->elapsed_us >= (uint64_t)cfg->timeout_ms * 1000U) {
+        h->phase = HOMING_TIMEOUT;
+        return false;
+    }
+
+    // Towards the switch while seeking or locating, away otherwise
+    bool towards = h->phase == HOMING_SEEK || h->phase == HOMING_LOCATE;
+    uint32_t velocity = h->phase == HOMING_SEEK ? cfg->seek_velocity : cfg->locate_velocity;
+    *forwards = towards ? cfg->forwards : !cfg->forwards;
+    *interval_us = HOMING_TICK_HZ / (velocity ? velocity : 1);
+    h->steps++;
+    h->elapsed_us += *interval_us;
+    return true;
+}
+
+#endif //  CC2511_HOMING_H
@@ -0,0 +1,435 @@
+/**************************************************************
+ * a2proto.c
+ * Assignment2 host tools
+ * ***********************************************************/
+
+/*
+  Reference client for the binary protocol in proto.h.
+
+  Switches the controller out of the text UI with the "binary" command,
+  talks frames, and sends PROTO_EXIT at the end so the UI comes back.
+
+  USAGE:
+    a2proto [-b baud] PORT ping [count]
+        Round-trip latency of PROTO_PING frames
+    a2proto [-b baud] PORT status
+    a2proto [-b baud] PORT move X Y Z [FEED]
+    a2proto [-b baud] [-w window] PORT gcode FILE
+        Sends every line as a PROTO_GCODE frame, keeping up to window
+        frames unacknowledged (default PROTO_QUEUE_SIZE)
+    a2proto -l [-b baud] [-n count]
+        Loopback: runs the controller's frame handling in a thread at the
+        other end of a socket pair and reports round-trip latency of the
+        encode, decode and dispatch path, plus the wire time the frames
+        would need at the baud rate. Also checks that a corrupted frame is
+        dropped and the next one still gets through.
+*/
+
+#define _DEFAULT_SOURCE
+#include <poll.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include "proto.h"
+#include "serial.h"
+
+#define PING_PAYLOAD 8
+#define REPLY_TIMEOUT_S 5.0
+
+// Options
+static int baud = 115200;
+static int window = PROTO_QUEUE_SIZE;
+static int count = 1000;
+
+static uint8_t next_seq = 0;
+static proto_decoder_T decoder;
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Wire time of some bytes at the baud rate (8N1), in seconds
+static double link_s(size_t bytes) {
+    return bytes * 10.0 / baud;
+}
+
+static bool send_frame(int fd, uint8_t type, uint8_t seq, const void *payload, size_t length) {
+    proto_frame_T frame;
+    frame.type = type;
+    frame.seq = seq;
+    frame.length = (uint8_t)length;
+    memcpy(frame.payload, payload, length);
+    uint8_t wire[PROTO_MAX_ENCODED];
+    return serial_write_all(fd, wire, proto_encode(&frame, wire));
+}
+
+// Wait for the next good frame. Returns false on timeout.
+static bool read_frame(int fd, proto_frame_T *frame, double timeout_s) {
+    static uint8_t data[256];
+    static size_t length = 0, used = 0;
+    double deadline = now_s() + timeout_s;
+    while (true) {
+        while (used < length) {
+            if (proto_decode_byte(&decoder, data[used++], frame) == PROTO_FRAME) {
+                return true;
+            }
+        }
+        double left = deadline - now_s();
+        struct pollfd p = {fd, POLLIN, 0};
+        if (left <= 0 || poll(&p, 1, (int)(left * 1000) + 1) < 0) {
+            return false;
+        }
+        if (!(p.revents & POLLIN)) {
+            continue;
+        }
+        ssize_t n = read(fd, data, sizeof(data));
+        length = n > 0 ? (size_t)n : 0;
+        used = 0;
+    }
+}
+
+// Send one frame and wait for the reply with the same seq
+static bool request(int fd, uint8_t type, const void *payload, size_t length, proto_frame_T *reply) {
+    uint8_t seq = next_seq++;
+    if (!send_frame(fd, type, seq, payload, length)) {
+        return false;
+    }
+    while (read_frame(fd, reply, REPLY_TIMEOUT_S)) {
+        if (reply->seq == seq) {
+            return true;
+        }
+    }
+    fprintf(stderr, "no reply to frame type 0x%02x\n", type);
+    return false;
+}
+
+static const char *result_text(uint8_t result) {
+    switch (result) {
+        case PROTO_OK: return "ok";
+        case PROTO_ERR_UNKNOWN: return "unknown message";
+        case PROTO_ERR_LENGTH: return "bad payload length";
+        case PROTO_ERR_BOUNDS: return "out of bounds";
+        case PROTO_ERR_GCODE: return "G-code error";
+        default: return "?";
+    }
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// Send count pings one at a time and print the round-trip times
+static int ping(int fd, int n) {
+    double *rtt = malloc(sizeof(double) * n);
+    uint8_t payload[PING_PAYLOAD];
+    proto_frame_T reply;
+    for (int i = 0; i < n; i++) {
+        for (int k = 0; k < PING_PAYLOAD; k++) {
+            payload[k] = (uint8_t)(i + k);
+        }
+        double t0 = now_s();
+        if (!request(fd, PROTO_PING, payload, sizeof(payload), &reply)) {
+            free(rtt);
+            return 1;
+        }
+        rtt[i] = now_s() - t0;
+        if (reply.type != PROTO_PONG || reply.length != PING_PAYLOAD
+            || memcmp(reply.payload, payload, PING_PAYLOAD) != 0) {
+            fprintf(stderr, "ping %d: bad pong\n", i);
+            free(rtt);
+            return 1;
+        }
+    }
+    qsort(rtt, n, sizeof(double), compare_double);
+    printf("%d pings: min %.1f us, median %.1f us, p99 %.1f us, max %.1f us\n", n,
+           rtt[0] * 1e6, rtt[n / 2] * 1e6, rtt[(n * 99) / 100] * 1e6, rtt[n - 1] * 1e6);
+    free(rtt);
+    return 0;
+}
+
+static int print_status(int fd) {
+    proto_frame_T reply;
+    proto_status_T status;
+    if (!request(fd, PROTO_STATUS, NULL, 0, &reply) || !proto_get_status(&reply, &status)) {
+        return 1;
+    }
+    printf("x %d y %d z %d  feed %u/s  queued %u  hold %u  spindle %u%s%s\n",
+           status.position[0], status.position[1], status.position[2],
+           status.feed, status.queued, status.hold_state, status.spindle,
+           status.flags & PROTO_FLAG_MOVING ? "  moving" : "",
+           status.flags & PROTO_FLAG_FAULT ? "  FAULT" : "");
+    return 0;
+}
+
+static int move(int fd, int32_t x, int32_t y, int32_t z, uint32_t feed) {
+    uint8_t payload[16];
+    proto_put_u32(&payload[0], (uint32_t)x);
+    proto_put_u32(&payload[4], (uint32_t)y);
+    proto_put_u32(&payload[8], (uint32_t)z);
+    proto_put_u32(&payload[12], feed);
+    proto_frame_T reply;
+    if (!request(fd, PROTO_MOVE, payload, sizeof(payload), &reply)) {
+        return 1;
+    }
+    uint8_t result = reply.payload[0];
+    if (!request(fd, PROTO_FLUSH, NULL, 0, &reply)) {
+        return 1;
+    }
+    printf("move: %s\n", result_text(result));
+    return result == PROTO_OK ? 0 : 2;
+}
+
+// Stream a G-code file with a window of unacknowledged frames
+static int send_gcode(int fd, FILE *in) {
+    char line[512];
+    size_t lines = 0, bytes = 0;
+    int in_flight = 0, errors = 0;
+    proto_frame_T reply;
+    double t0 = now_s();
+
+    while (fgets(line, sizeof(line), in)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        size_t len = strlen(line);
+        if (len == 0) {
+            continue;
+        }
+        if (len > PROTO_MAX_PAYLOAD) {
+            fprintf(stderr, "line %zu longer than %d characters, skipped\n", lines + 1, PROTO_MAX_PAYLOAD);
+            continue;
+        }
+        while (in_flight >= window) {
+            if (!read_frame(fd, &reply, 30.0)) {
+                fprintf(stderr, "timed out waiting for ack\n");
+                return 1;
+            }
+            if (reply.type == PROTO_ACK) {
+                in_flight--;
+                errors += reply.payload[0] != PROTO_OK;
+            }
+        }
+        if (!send_frame(fd, PROTO_GCODE, next_seq++, line, len)) {
+            return 1;
+        }
+        in_flight++;
+        lines++;
+        bytes += len;
+    }
+    while (in_flight > 0 && read_frame(fd, &reply, 30.0)) {
+        if (reply.type == PROTO_ACK) {
+            in_flight--;
+            errors += reply.payload[0] != PROTO_OK;
+        }
+    }
+    double elapsed = now_s() - t0;
+    printf("%zu lines, %zu bytes in %.2f s (%.0f lines/s), %d errors\n",
+           lines, bytes, elapsed, elapsed > 0 ? lines / elapsed : 0.0, errors);
+    return errors ? 2 : 0;
+}
+
+// Leave the text UI and check the controller answers frames
+static bool enter_binary(int fd) {
+    serial_write_all(fd, "binary\r", 7);
+    usleep(200000);
+    tcflush(fd, TCIFLUSH);
+    proto_decoder_init(&decoder);
+    proto_frame_T reply;
+    for (int attempt = 0; attempt < 3; attempt++) {
+        if (request(fd, PROTO_PING, NULL, 0, &reply) && reply.type == PROTO_PONG) {
+            return true;
+        }
+    }
+    fprintf(stderr, "controller did not enter binary mode\n");
+    return false;
+}
+
+static void leave_binary(int fd) {
+    proto_frame_T reply;
+    request(fd, PROTO_EXIT, NULL, 0, &reply);
+}
+
+/*
+  Loopback: the controller side of the protocol, answering like
+  run_frame() in main.c without any motion behind it.
+*/
+static void *loopback_device(void *arg) {
+    int fd = *(int *)arg;
+    proto_decoder_T d;
+    proto_frame_T frame;
+    proto_status_T status = {{0, 0, 0}, 0, 0, 0, 0, 0, 0};
+    proto_decoder_init(&d);
+    uint8_t data[256];
+    ssize_t n;
+    while ((n = read(fd, data, sizeof(data))) > 0) {
+        for (ssize_t i = 0; i < n; i++) {
+            if (proto_decode_byte(&d, data[i], &frame) != PROTO_FRAME) {
+                continue;
+            }
+            uint8_t result = PROTO_OK;
+            switch (frame.type) {
+                case PROTO_PING:
+                    frame.type = PROTO_PONG;
+                    break;
+                case PROTO_STATUS:
+                    frame.type = PROTO_STATUS_REPLY;
+                    proto_put_status(&frame, &status);
+                    break;
+                case PROTO_MOVE:
+                    if (frame.length != 16) {
+                        result = PROTO_ERR_LENGTH;
+                        break;
+                    }
+                    for (int k = 0; k < 3; k++) {
+                        status.position[k] = (int32_t)proto_get_u32(&frame.payload[4 * k]);
+                    }
+                    break;
+                case PROTO_FLUSH:
+                case PROTO_HOLD:
+                case PROTO_RESUME:
+                case PROTO_ABORT:
+                case PROTO_GCODE:
+                case PROTO_EXIT:
+                    break;
+                default:
+                    result = PROTO_ERR_UNKNOWN;
+                    break;
+            }
+            if (frame.type != PROTO_PONG && frame.type != PROTO_STATUS_REPLY) {
+                frame.type = PROTO_ACK;
+                frame.length = 1;
+                frame.payload[0] = result;
+            }
+            uint8_t wire[PROTO_MAX_ENCODED];
+            serial_write_all(fd, wire, proto_encode(&frame, wire));
+        }
+    }
+    return NULL;
+}
+
+static int loopback(void) {
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+        perror("socketpair");
+        return 1;
+    }
+    pthread_t device;
+    pthread_create(&device, NULL, loopback_device, &fds[1]);
+    proto_decoder_init(&decoder);
+
+    int result = ping(fds[0], count);
+
+    // Frame sizes on the wire for the link estimate
+    proto_frame_T frame = {PROTO_PING, 0, PING_PAYLOAD, {0}};
+    uint8_t wire[PROTO_MAX_ENCODED];
+    size_t ping_bytes = proto_encode(&frame, wire);
+    frame.type = PROTO_MOVE;
+    frame.length = 16;
+    size_t move_bytes = proto_encode(&frame, wire);
+    frame.type = PROTO_ACK;
+    frame.length = 1;
+    size_t ack_bytes = proto_encode(&frame, wire);
+    printf("at %d baud: ping and pong %zu bytes each, %.2f ms on the link per round trip\n",
+           baud, ping_bytes, 2 * link_s(ping_bytes) * 1e3);
+    printf("  move %zu bytes + ack %zu bytes, %.0f moves/s with a full window\n",
+           move_bytes, ack_bytes, 1.0 / link_s(move_bytes));
+
+    // A corrupted frame must be dropped without upsetting the next one
+    frame.type = PROTO_PING;
+    frame.seq = next_seq++;
+    frame.length = PING_PAYLOAD;
+    size_t n = proto_encode(&frame, wire);
+    wire[n / 2] ^= 0x20;
+    serial_write_all(fds[0], wire, n);
+    proto_frame_T reply;
+    bool dropped = !read_frame(fds[0], &reply, 0.2);
+    bool recovered = request(fds[0], PROTO_STATUS, NULL, 0, &reply) && reply.type == PROTO_STATUS_REPLY;
+    printf("corrupted frame %s, next frame %s\n", dropped ? "dropped" : "ANSWERED",
+           recovered ? "answered" : "LOST");
+    if (!dropped || !recovered) {
+        result = 1;
+    }
+
+    shutdown(fds[0], SHUT_WR);
+    pthread_join(device, NULL);
+    close(fds[0]);
+    close(fds[1]);
+    return result;
+}
+
+static void usage(void) {
+    fprintf(stderr,
+            "usage: a2proto [-b baud] PORT ping [count]\n"
+            "       a2proto [-b baud] PORT status\n"
+            "       a2proto [-b baud] PORT move X Y Z [FEED]\n"
+            "       a2proto [-b baud] [-w window] PORT gcode FILE\n"
+            "       a2proto -l [-b baud] [-n count]\n");
+}
+
+int main(int argc, char *argv[]) {
+    bool loop = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "b:w:n:l")) != -1) {
+        switch (opt) {
+            case 'b': baud = atoi(optarg); break;
+            case 'w': window = atoi(optarg); break;
+            case 'n': count = atoi(optarg); break;
+            case 'l': loop = true; break;
+            default: usage(); return 1;
+        }
+    }
+    if (serial_speed(baud) == 0 || window < 1 || window > (int)PROTO_QUEUE_SIZE || count < 1) {
+        fprintf(stderr, "unsupported baud rate, window (1-%u) or count\n", PROTO_QUEUE_SIZE);
+        return 1;
+    }
+    if (loop) {
+        return loopback();
+    }
+    if (argc - optind < 2) {
+        usage();
+        return 1;
+    }
+
+    const char *command = argv[optind + 1];
+    char **args = &argv[optind + 2];
+    int nargs = argc - optind - 2;
+    FILE *in = NULL;
+    if (strcmp(command, "gcode") == 0) {
+        if (nargs != 1) {
+            usage();
+            return 1;
+        }
+        in = fopen(args[0], "r");
+        if (!in) {
+            perror(args[0]);
+            return 1;
+        }
+    }
+
+    int fd = serial_open(argv[optind], baud, false);
+    if (fd < 0 || !enter_binary(fd)) {
+        return 1;
+    }
+    int result;
+    if (strcmp(command, "ping") == 0) {
+        result = ping(fd, nargs > 0 ? atoi(args[0]) : 100);
+    } else if (strcmp(command, "status") == 0) {
+        result = print_status(fd);
+    } else if (strcmp(command, "move") == 0 && (nargs == 3 || nargs == 4)) {
+        result = move(fd, atoi(args[0]), atoi(args[1]), atoi(args[2]), nargs == 4 ? atoi(args[3]) : 0);
+    } else if (in) {
+        result = send_gcode(fd, in);
+        fclose(in);
+    } else {
+        usage();
+        result = 1;
+    }
+    leave_binary(fd);
+    close(fd);
+    return result;
+}
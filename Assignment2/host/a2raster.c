@@ -0,0 +1,98 @@
+/**************************************************************
+ * a2raster.c
+ * Assignment2 host tools
+ * ***********************************************************/
+
+/*
+  Converts a PBM or PGM image into the hex rows the controller's
+  "raster" command engraves (see raster.h), bottom row first so the
+  picture is not mirrored as the rows step up Y.
+
+  USAGE:
+    a2raster [-t threshold] IMAGE [OUT]
+        -t      write 1-bit rows: grey values below threshold (0-255)
+                are cut, the rest left alone. Rows are a quarter of the
+                size of greyscale ones.
+      PBM images are always written as 1-bit rows. OUT defaults to
+      standard output. Stream the result with
+        a2send -a -c "raster WIDTH PITCH" PORT OUT
+*/
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "pnm.h"
+#include "raster.h"
+
+int main(int argc, char *argv[]) {
+    int threshold = -1;
+    int opt;
+    while ((opt = getopt(argc, argv, "t:")) != -1) {
+        switch (opt) {
+            case 't': threshold = atoi(optarg); break;
+            default:
+                fprintf(stderr, "usage: a2raster [-t threshold] IMAGE [OUT]\n");
+                return 1;
+        }
+    }
+    if (argc - optind < 1 || argc - optind > 2 || threshold > 256) {
+        fprintf(stderr, "usage: a2raster [-t threshold] IMAGE [OUT]\n");
+        return 1;
+    }
+    FILE *in = fopen(argv[optind], "rb");
+    if (!in) {
+        perror(argv[optind]);
+        return 1;
+    }
+    int width, height;
+    bool bitmap;
+    uint8_t *grey = pnm_read(in, &width, &height, &bitmap);
+    fclose(in);
+    if (!grey) {
+        return 1;
+    }
+    if (width > RASTER_MAX_WIDTH) {
+        fprintf(stderr, "image is %d pixels wide, the controller takes at most %d\n", width, RASTER_MAX_WIDTH);
+        free(grey);
+        return 1;
+    }
+    if (bitmap && threshold < 0) {
+        threshold = 128;
+    }
+
+    FILE *out = argc - optind == 2 ? fopen(argv[optind + 1], "w") : stdout;
+    if (!out) {
+        perror(argv[optind + 1]);
+        free(grey);
+        return 1;
+    }
+    size_t cut = 0;
+    for (int y = height - 1; y >= 0; y--) {
+        const uint8_t *row = &grey[(size_t)y * width];
+        if (threshold < 0) {
+            for (int x = 0; x < width; x++) {
+                fprintf(out, "%02X", row[x]);
+                cut += raster_level(row[x]) != 0;
+            }
+        } else {
+            for (int x = 0; x < width; x += 4) {
+                int bits = 0;
+                for (int b = 0; b < 4; b++) {
+                    bool dark = x + b < width && row[x + b] < threshold;
+                    bits |= dark << (3 - b);
+                    cut += dark;
+                }
+                fprintf(out, "%X", bits);
+            }
+        }
+        fputc('\n', out);
+    }
+    if (out != stdout) {
+        fclose(out);
+    }
+    fprintf(stderr, "%d x %d pixels, %s rows, %zu pixels cut\n", width, height,
+            threshold < 0 ? "greyscale" : "1-bit", cut);
+    free(grey);
+    return 0;
+}
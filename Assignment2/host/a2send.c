@@ -0,0 +1,293 @@
+/**************************************************************
+ * a2send.c
+ * Assignment2 host tools
+ * ***********************************************************/
+
+/*
+  Streams a G-code file to the mill over a serial port using the
+  controller's "stream" command.
+
+  USAGE:
+    a2send [-a] [-b baud] [-c command] PORT FILE
+        -a      ack mode: wait for "ok"/"error" replies and keep at most
+                STREAM_BUFFER_SIZE bytes in flight (character counting).
+                A G-code stream stops at the first "error", as the
+                controller does
+        -b      baud rate (default 115200)
+        -c      command that starts the stream instead of "stream", e.g.
+                "raster 200 10" for rows written by a2raster
+      Without -a the serial driver's XON/XOFF handling paces the writes.
+
+    a2send -s [-a] [-b baud] [-r lines_per_s] [-l latency_bytes] FILE
+        Loopback simulation: runs the controller's ring buffer and flow
+        control against a simulated link and reports throughput, peak
+        ring fill and dropped bytes. -r sets how fast the controller
+        consumes lines, -l how many bytes the host still sends after
+        XOFF.
+*/
+
+#define _DEFAULT_SOURCE
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "serial.h"
+#include "raster.h"
+#include "stream.h"
+
+// Options
+static bool ack_mode = false;
+static bool simulate = false;
+static int baud = 115200;
+static double consume_rate = 200.0;     // lines/s executed by the controller
+static int xoff_latency = 32;           // bytes sent after XOFF
+static const char *command = "stream";
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Read replies until one "ok"/"error" line arrives. Returns -1 on timeout.
+static int read_reply(int fd, int *errors) {
+    static char line[256];
+    static size_t len = 0;
+    double deadline = now_s() + 30.0;
+    while (now_s() < deadline) {
+        char ch;
+        ssize_t n = read(fd, &ch, 1);
+        if (n <= 0) {
+            continue;
+        }
+        if (ch != '\n') {
+            if (len < sizeof(line) - 1) {
+                line[len++] = ch;
+            }
+            continue;
+        }
+        while (len > 0 && line[len - 1] == '\r') {
+            len--;
+        }
+        line[len] = '\0';
+        len = 0;
+        // The TUI draws around the reply, so only look at the line ending
+        size_t l = strlen(line);
+        if (l >= 2 && strcmp(&line[l - 2], "ok") == 0) {
+            return 0;
+        }
+        if (l >= 5 && strcmp(&line[l - 5], "error") == 0) {
+            (*errors)++;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static int send_file(const char *port, FILE *in) {
+    int fd = serial_open(port, baud, true);
+    if (fd < 0) {
+        return 1;
+    }
+
+    char start[128];
+    snprintf(start, sizeof(start), "%s%s\r", command, ack_mode ? " ack" : "");
+    serial_write_all(fd, start, strlen(start));
+    usleep(200000);
+    tcflush(fd, TCIFLUSH);
+
+    // Bytes of each unacknowledged line, oldest first
+    static size_t in_flight[STREAM_BUFFER_SIZE];
+    size_t first = 0, count = 0, flight_bytes = 0;
+    size_t bytes = 0, lines = 0;
+    int errors = 0;
+    static char line[RASTER_LINE_SIZE + 1];
+    bool stop_on_error = strcmp(command, "stream") == 0;
+    size_t line_limit = stop_on_error ? STREAM_LINE_SIZE : RASTER_LINE_SIZE;
+    double t0 = now_s();
+
+    while (fgets(line, sizeof(line), in)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        size_t len = strlen(line);
+        if (len >= line_limit) {
+            fprintf(stderr, "line %zu longer than %zu characters, the controller will reject it\n",
+                    lines + 1, line_limit - 1);
+        }
+        line[len++] = '\n';
+
+        if (ack_mode) {
+            while (count > 0 && flight_bytes + len > STREAM_BUFFER_SIZE - STREAM_HIGH_WATER) {
+                if (read_reply(fd, &errors) < 0) {
+                    fprintf(stderr, "timed out waiting for ok\n");
+                    close(fd);
+                    return 1;
+                }
+                // A rejected G-code line ends the stream; the rest would go to the prompt
+                if (errors > 0 && stop_on_error) {
+                    fprintf(stderr, "line %zu rejected, the controller stopped the stream\n",
+                            lines - count + 1);
+                    close(fd);
+                    return 2;
+                }
+                flight_bytes -= in_flight[first];
+                first = (first + 1) % STREAM_BUFFER_SIZE;
+                count--;
+            }
+            in_flight[(first + count) % STREAM_BUFFER_SIZE] = len;
+            count++;
+            flight_bytes += len;
+        }
+        if (!serial_write_all(fd, line, len)) {
+            close(fd);
+            return 1;
+        }
+        bytes += len;
+        lines++;
+    }
+    while (ack_mode && count > 0 && read_reply(fd, &errors) == 0) {
+        count--;
+        if (errors > 0 && stop_on_error) {
+            fprintf(stderr, "line %zu rejected, the controller stopped the stream\n", lines - count);
+            close(fd);
+            return 2;
+        }
+    }
+    serial_write_all(fd, "exit\n", 5);
+    tcdrain(fd);
+    close(fd);
+
+    double elapsed = now_s() - t0;
+    printf("%zu lines, %zu bytes in %.2f s (%.0f bytes/s), %d errors\n",
+           lines, bytes, elapsed, elapsed > 0 ? bytes / elapsed : 0.0, errors);
+    return errors ? 2 : 0;
+}
+
+// Replay the file through the controller's ring and flow control
+static int simulate_file(FILE *in) {
+    static uint8_t storage[STREAM_BUFFER_SIZE];
+    ring_T ring;
+    ring_init(&ring, storage, STREAM_BUFFER_SIZE);
+
+    // Whole file in memory: the host side is not the constrained one
+    size_t size = 0, cap = 4096;
+    char *data = malloc(cap);
+    int c;
+    while ((c = fgetc(in)) != EOF) {
+        if (size == cap) {
+            cap *= 2;
+            data = realloc(data, cap);
+        }
+        data[size++] = (char)c;
+    }
+
+    double byte_time = 10.0 / baud;         // 8N1
+    double line_time = 1.0 / consume_rate;
+    double t = 0, next_consume = 0;
+    size_t sent = 0, consumed_lines = 0, total_lines = 0;
+    size_t lines_in = 0, max_fill = 0, dropped = 0, xoffs = 0;
+    size_t in_flight = 0;
+    bool paused = false;
+    int stop_after = -1;                    // bytes left before XOFF takes hold
+    bool host_stopped = false;
+
+    for (size_t i = 0; i < size; i++) {
+        if (data[i] == '\n') {
+            total_lines++;
+        }
+    }
+
+    while (consumed_lines < total_lines) {
+        // Host side: one byte per byte time unless held off
+        bool can_send = sent < size && !host_stopped;
+        if (ack_mode && can_send && in_flight >= STREAM_BUFFER_SIZE - STREAM_HIGH_WATER) {
+            can_send = false;
+        }
+        if (can_send) {
+            uint8_t ch = (uint8_t)data[sent++];
+            in_flight++;
+            if (!ring_push(&ring, ch)) {
+                dropped++;
+            } else if (ch == '\n') {
+                lines_in++;
+            }
+            if (!ack_mode && stream_should_pause(&ring, paused)) {
+                paused = true;
+                xoffs++;
+                stop_after = xoff_latency;
+            }
+            if (stop_after >= 0 && stop_after-- == 0) {
+                host_stopped = true;
+            }
+        }
+        if (ring_count(&ring) > max_fill) {
+            max_fill = ring_count(&ring);
+        }
+
+        // Controller side: one line per line time when one is complete
+        if (t >= next_consume && lines_in > consumed_lines) {
+            uint8_t ch;
+            while (ring_pop(&ring, &ch) && ch != '\n') {
+                in_flight--;
+            }
+            in_flight--;
+            consumed_lines++;
+            next_consume = t + line_time;
+            if (stream_should_resume(&ring, paused)) {
+                paused = false;
+                host_stopped = false;
+                stop_after = -1;
+            }
+        }
+        if (!can_send && sent >= size && lines_in == consumed_lines && dropped > 0) {
+            break;      // lost line ends, nothing more will complete
+        }
+        t += byte_time;
+    }
+    free(data);
+
+    printf("simulated %zu lines, %zu bytes at %d baud, %.0f lines/s consumer\n",
+           total_lines, size, baud, consume_rate);
+    printf("  time %.2f s, %.0f bytes/s, peak ring fill %zu/%u, %zu XOFF, %zu bytes dropped\n",
+           t, t > 0 ? size / t : 0.0, max_fill, STREAM_BUFFER_SIZE, xoffs, dropped);
+    return dropped ? 2 : 0;
+}
+
+static void usage(void) {
+    fprintf(stderr,
+            "usage: a2send [-a] [-b baud] [-c command] PORT FILE\n"
+            "       a2send -s [-a] [-b baud] [-r lines_per_s] [-l latency_bytes] FILE\n");
+}
+
+int main(int argc, char *argv[]) {
+    int opt;
+    while ((opt = getopt(argc, argv, "ab:c:sr:l:")) != -1) {
+        switch (opt) {
+            case 'a': ack_mode = true; break;
+            case 'b': baud = atoi(optarg); break;
+            case 'c': command = optarg; break;
+            case 's': simulate = true; break;
+            case 'r': consume_rate = atof(optarg); break;
+            case 'l': xoff_latency = atoi(optarg); break;
+            default: usage(); return 1;
+        }
+    }
+    if (serial_speed(baud) == 0 || consume_rate <= 0) {
+        fprintf(stderr, "unsupported baud rate or consume rate\n");
+        return 1;
+    }
+    if (argc - optind != (simulate ? 1 : 2)) {
+        usage();
+        return 1;
+    }
+
+    const char *path = argv[argc - 1];
+    FILE *in = fopen(path, "r");
+    if (!in) {
+        perror(path);
+        return 1;
+    }
+    int result = simulate ? simulate_file(in) : send_file(argv[optind], in);
+    fclose(in);
+    return result;
+}
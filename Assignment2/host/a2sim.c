@@ -0,0 +1,168 @@
+/**************************************************************
+ * a2sim.c
+ * Assignment2 host tools
+ * ***********************************************************/
+
+/*
+  Estimates how long G-code programs take on the mill, and how far they
+  travel, without a board. Each program is run through the controller's
+  own look-ahead planner and step generation (dryrun.h), so the figure
+  is the one the "estimate" command would give for the same motion.
+
+  The estimate assumes the stream never runs dry. Feed holds and spindle
+  changes are not timed. G28 is timed as the rapid to zero that the
+  controller makes for it.
+
+  USAGE:
+    a2sim [-l max_seconds] FILE...
+        -l      exit with status 2 if any program takes longer than
+                this, so a slower job fails a regression check
+      Programs start at machine zero, as after "home".
+*/
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "gcode.h"
+#include "dryrun.h"
+
+#define LINE_SIZE 256
+
+static const uint32_t max_velocity[MOTION_NUM_AXES] = {XY_MAX_VELOCITY, XY_MAX_VELOCITY, Z_MAX_VELOCITY};
+static const uint32_t max_accel[MOTION_NUM_AXES] = {XY_ACCELERATION, XY_ACCELERATION, Z_ACCELERATION};
+
+// Queue a straight move from pos to target and take it as the new position
+static void sim_move(dryrun_T *dry, int32_t pos[3], const int32_t target[3], uint32_t feed) {
+    motion_cmd_T cmd;
+    cmd.type = MOTION_SEGMENT;
+    cmd.feed = feed;
+    for (int i = 0; i < MOTION_NUM_AXES; i++) {
+        cmd.delta[i] = target[i] - pos[i];
+        cmd.max_velocity[i] = max_velocity[i];
+        cmd.max_accel[i] = max_accel[i];
+        pos[i] = target[i];
+    }
+    dryrun_command(dry, &cmd);
+}
+
+// Rapid to target the way plan_move() in main.c does: Z up first, XY, then Z down
+static void sim_rapid(dryrun_T *dry, int32_t pos[3], const int32_t target[3]) {
+    int32_t delta[3][MOTION_NUM_AXES];
+    int moves = motion_rapid_split(pos, target, delta);
+    for (int i = 0; i < moves; i++) {
+        const int32_t via[3] = {pos[0] + delta[i][0], pos[1] + delta[i][1], pos[2] + delta[i][2]};
+        sim_move(dry, pos, via, 0);
+    }
+}
+
+// Run one program; returns false if it could not be read or parsed
+static bool simulate(const char *path, dryrun_T *dry) {
+    FILE *in = fopen(path, "r");
+    if (!in) {
+        perror(path);
+        return false;
+    }
+    int32_t pos[3] = {0, 0, 0};
+    gcode_T gc;
+    gcode_init(&gc, pos, STEPS_PER_MM);
+    dryrun_init(dry);
+
+    char line[LINE_SIZE];
+    int number = 0;
+    bool ended = false;
+    while (!ended && fgets(line, sizeof(line), in)) {
+        number++;
+        line[strcspn(line, "\r\n")] = '\0';
+        gcode_result_T result;
+        if (!gcode_parse_line(&gc, line, &result)) {
+            fprintf(stderr, "%s:%d: %s\n", path, number, result.error);
+            fclose(in);
+            return false;
+        }
+        for (int i = 0; i < result.count; i++) {
+            const gcode_action_T *action = &result.actions[i];
+            motion_cmd_T cmd;
+            switch (action->type) {
+                case GCODE_MOVE:
+                    sim_move(dry, pos, action->target, action->feed);
+                    break;
+                case GCODE_ARC:
+                    cmd.type = MOTION_ARC;
+                    cmd.feed = action->feed;
+                    cmd.clockwise = action->clockwise;
+                    for (int a = 0; a < MOTION_NUM_AXES; a++) {
+                        cmd.delta[a] = action->target[a] - pos[a];
+                        cmd.max_velocity[a] = max_velocity[a];
+                        cmd.max_accel[a] = max_accel[a];
+                    }
+                    cmd.center[0] = action->center[0] - pos[0];
+                    cmd.center[1] = action->center[1] - pos[1];
+                    dryrun_command(dry, &cmd);
+                    memcpy(pos, action->target, 3 * sizeof(pos[0]));
+                    break;
+                case GCODE_HOME: {
+                    if (action->has_via) {
+                        sim_rapid(dry, pos, action->target);
+                    }
+                    const int32_t zero[3] = {0, 0, 0};
+                    sim_rapid(dry, pos, zero);
+                    break;
+                }
+                case GCODE_SPINDLE:
+                    // The spindle changes once queued motion has finished
+                    cmd.type = MOTION_FLUSH;
+                    dryrun_command(dry, &cmd);
+                    break;
+                case GCODE_END:
+                    ended = true;
+                    break;
+            }
+        }
+    }
+    fclose(in);
+    dryrun_finish(dry);
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    double limit = -1;
+    int opt;
+    while ((opt = getopt(argc, argv, "l:")) != -1) {
+        switch (opt) {
+            case 'l': limit = atof(optarg); break;
+            default:
+                fprintf(stderr, "usage: a2sim [-l max_seconds] FILE...\n");
+                return 1;
+        }
+    }
+    if (optind >= argc) {
+        fprintf(stderr, "usage: a2sim [-l max_seconds] FILE...\n");
+        return 1;
+    }
+
+    int status = 0;
+    for (int f = optind; f < argc; f++) {
+        static dryrun_T dry;
+        if (!simulate(argv[f], &dry)) {
+            status = 1;
+            continue;
+        }
+        double seconds = dry.time_us / 1e6;
+        printf("%s: %.1f s (%.1f s rapid), %llu steps cutting, %llu rapid, "
+               "pulses x %llu y %llu z %llu, %lu segments",
+               argv[f], seconds, dry.rapid_us / 1e6,
+               (unsigned long long)dry.cut_length, (unsigned long long)dry.rapid_length,
+               (unsigned long long)dry.steps[AXIS_X], (unsigned long long)dry.steps[AXIS_Y],
+               (unsigned long long)dry.steps[AXIS_Z], (unsigned long)dry.segments);
+        if (limit >= 0 && seconds > limit) {
+            printf(" - over %.1f s", limit);
+            if (status == 0) {
+                status = 2;
+            }
+        }
+        printf("\n");
+    }
+    return status;
+}
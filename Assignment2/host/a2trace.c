@@ -0,0 +1,359 @@
+/**************************************************************
+ * a2trace.c
+ * Assignment2 host tools
+ * ***********************************************************/
+
+/*
+  Traces the outlines of the dark shapes in a PBM or PGM image and
+  writes them as a job for the mill, instead of transcribing
+  coordinates by hand.
+
+  Outlines are found with marching squares on the thresholded image,
+  simplified with Douglas-Peucker and scaled to fit the machine's step
+  space with the aspect ratio kept. The contours are put in the order
+  that travels least between them (pathopt.h) when there are few
+  enough.
+
+  USAGE:
+    a2trace [-f gcode|table] [-t threshold] [-e tolerance] [-W width]
+            [-H height] [-u z_up] [-d z_down] [-F feed] [-n name] IMAGE [OUT]
+        -f      gcode (default): a program for "a2send" to stream
+                table: a const sequence table to paste into cmd_load()
+        -t      grey values below this are dark (default 128)
+        -e      simplification tolerance in steps (default 10); larger
+                gives fewer segments and a shorter job, smaller follows
+                the image more closely
+        -W -H   step space to fit (default 8000 x 5450, X_MAX and Y_MAX
+                in main.c)
+        -u -d   travel and cutting heights for G-code (default 150, 350);
+                tables use the firmware's z_up and z_down
+        -F      G-code cutting feed in steps/min (default 60000)
+        -n      name of the table (default traced)
+      OUT defaults to standard output.
+*/
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "pathopt.h"
+#include "pnm.h"
+
+// Options
+static const char *format = "gcode";
+static int threshold = 128;
+static double tolerance = 10.0;
+static int space_width = 8000;
+static int space_height = 5450;
+static int z_travel = 150;
+static int z_cut = 350;
+static int feed = 60000;
+static const char *name = "traced";
+
+typedef struct point {
+    double x;
+    double y;
+}   point_T;
+
+typedef struct contour {
+    point_T *point;
+    int count;
+}   contour_T;
+
+static contour_T *contours;
+static int contour_count;
+
+static void add_contour(point_T *point, int count) {
+    static int capacity = 0;
+    if (contour_count == capacity) {
+        capacity = capacity ? capacity * 2 : 64;
+        contours = realloc(contours, capacity * sizeof(*contours));
+    }
+    contours[contour_count].point = point;
+    contours[contour_count].count = count;
+    contour_count++;
+}
+
+/*
+  Marching squares. Samples sit at pixel centres, with a light border
+  around the image so every outline closes. Vertices are the midpoints
+  of the edges between samples, in half-pixel units. In each cell an
+  edge that goes from light to dark, walking clockwise round the cell,
+  is joined to the next edge that goes from dark to light; this keeps
+  dark on the same side of every outline, splits diagonal saddles, and
+  gives each vertex exactly one way out, so outlines are followed by
+  going from vertex to vertex.
+*/
+static int grid_width;      // vertex ids are (y2 + 1) * grid_width + x2 + 1
+
+static bool dark_at(const uint8_t *grey, int width, int height, int x, int y) {
+    return x >= 0 && y >= 0 && x < width && y < height && grey[(size_t)y * width + x] < threshold;
+}
+
+static void trace(const uint8_t *grey, int width, int height) {
+    grid_width = 2 * width + 3;
+    size_t vertices = (size_t)grid_width * (2 * height + 3);
+    int *next = malloc(vertices * sizeof(int));
+    for (size_t i = 0; i < vertices; i++) {
+        next[i] = -1;
+    }
+
+    for (int y = -1; y < height; y++) {
+        for (int x = -1; x < width; x++) {
+            // Corners and edges clockwise from the top left
+            bool corner[4] = {dark_at(grey, width, height, x, y), dark_at(grey, width, height, x + 1, y),
+                              dark_at(grey, width, height, x + 1, y + 1), dark_at(grey, width, height, x, y + 1)};
+            const int mid[4][2] = {{2 * x + 2, 2 * y + 1}, {2 * x + 3, 2 * y + 2},
+                                   {2 * x + 2, 2 * y + 3}, {2 * x + 1, 2 * y + 2}};
+            for (int e = 0; e < 4; e++) {
+                if (corner[e] || !corner[(e + 1) % 4]) {
+                    continue;       // not light to dark
+                }
+                for (int k = 1; k < 4; k++) {
+                    int f = (e + k) % 4;
+                    if (corner[f] && !corner[(f + 1) % 4]) {
+                        int from = (mid[e][1] + 1) * grid_width + mid[e][0] + 1;
+                        int to = (mid[f][1] + 1) * grid_width + mid[f][0] + 1;
+                        next[from] = to;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    // Follow every loop once, turning half pixels into steps
+    double scale = fmin((double)space_width / width, (double)space_height / height);
+    for (size_t start = 0; start < vertices; start++) {
+        if (next[start] < 0) {
+            continue;
+        }
+        int capacity = 64;
+        int count = 0;
+        point_T *point = malloc(capacity * sizeof(point_T));
+        int v = (int)start;
+        while (next[v] >= 0) {
+            if (count == capacity) {
+                capacity *= 2;
+                point = realloc(point, capacity * sizeof(point_T));
+            }
+            double x2 = v % grid_width - 1;
+            double y2 = v / grid_width - 1;
+            point[count].x = x2 / 2 * scale;
+            point[count].y = (height - y2 / 2) * scale;    // image rows go down, Y goes up
+            count++;
+            int after = next[v];
+            next[v] = -1;
+            v = after;
+        }
+        add_contour(point, count);
+    }
+    free(next);
+}
+
+/* Douglas-Peucker on point[first..last]: keep marks the points that stay */
+static void simplify(const point_T *point, int first, int last, bool *keep) {
+    if (last <= first + 1) {
+        return;
+    }
+    double dx = point[last].x - point[first].x;
+    double dy = point[last].y - point[first].y;
+    double length = hypot(dx, dy);
+    int farthest = first;
+    double worst = -1.0;
+    for (int i = first + 1; i < last; i++) {
+        double ex = point[i].x - point[first].x;
+        double ey = point[i].y - point[first].y;
+        double d = length > 0 ? fabs(dx * ey - dy * ex) / length : hypot(ex, ey);
+        if (d > worst) {
+            worst = d;
+            farthest = i;
+        }
+    }
+    if (worst <= tolerance) {
+        return;
+    }
+    keep[farthest] = true;
+    simplify(point, first, farthest, keep);
+    simplify(point, farthest, last, keep);
+}
+
+/* Simplify a closed outline into a list of steps that ends where it
+   starts. It is split at the point farthest from its first so both
+   halves are open lines. Returns the number of points, 0 if nothing of
+   it is left. */
+static int simplify_closed(const contour_T *c, int (*out)[2]) {
+    int n = c->count;
+    point_T *loop = malloc((n + 1) * sizeof(point_T));
+    bool *keep = calloc(n + 1, sizeof(bool));
+    memcpy(loop, c->point, n * sizeof(point_T));
+    loop[n] = loop[0];
+    int farthest = 0;
+    double worst = -1.0;
+    for (int i = 1; i < n; i++) {
+        double d = hypot(loop[i].x - loop[0].x, loop[i].y - loop[0].y);
+        if (d > worst) {
+            worst = d;
+            farthest = i;
+        }
+    }
+    keep[0] = keep[farthest] = keep[n] = true;
+    simplify(loop, 0, farthest, keep);
+    simplify(loop, farthest, n, keep);
+
+    int count = 0;
+    for (int i = 0; i <= n; i++) {
+        if (!keep[i]) {
+            continue;
+        }
+        int x = (int)lround(loop[i].x);
+        int y = (int)lround(loop[i].y);
+        if (count > 0 && out[count - 1][0] == x && out[count - 1][1] == y) {
+            continue;
+        }
+        out[count][0] = x;
+        out[count][1] = y;
+        count++;
+    }
+    free(loop);
+    free(keep);
+    // A loop needs at least three corners to enclose anything
+    return count >= 4 ? count : 0;
+}
+
+int main(int argc, char *argv[]) {
+    int opt;
+    while ((opt = getopt(argc, argv, "f:t:e:W:H:u:d:F:n:")) != -1) {
+        switch (opt) {
+            case 'f': format = optarg; break;
+            case 't': threshold = atoi(optarg); break;
+            case 'e': tolerance = atof(optarg); break;
+            case 'W': space_width = atoi(optarg); break;
+            case 'H': space_height = atoi(optarg); break;
+            case 'u': z_travel = atoi(optarg); break;
+            case 'd': z_cut = atoi(optarg); break;
+            case 'F': feed = atoi(optarg); break;
+            case 'n': name = optarg; break;
+            default: argc = 0; break;
+        }
+    }
+    bool table = strcmp(format, "table") == 0;
+    if (argc - optind < 1 || argc - optind > 2 || (!table && strcmp(format, "gcode") != 0)
+        || tolerance < 0 || space_width <= 0 || space_height <= 0 || feed <= 0 || z_travel == z_cut) {
+        fprintf(stderr,
+                "usage: a2trace [-f gcode|table] [-t threshold] [-e tolerance] [-W width] [-H height]\n"
+                "               [-u z_up] [-d z_down] [-F feed] [-n name] IMAGE [OUT]\n");
+        return 1;
+    }
+    FILE *in = fopen(argv[optind], "rb");
+    if (!in) {
+        perror(argv[optind]);
+        return 1;
+    }
+    int width, height;
+    bool bitmap;
+    uint8_t *grey = pnm_read(in, &width, &height, &bitmap);
+    fclose(in);
+    if (!grey) {
+        return 1;
+    }
+    trace(grey, width, height);
+    free(grey);
+
+    // The job as the firmware runs prefabs: hop, plunge, cut, ..., home
+    size_t points = 1;
+    for (int i = 0; i < contour_count; i++) {
+        points += contours[i].count + 2;
+    }
+    int (*job)[3] = malloc(points * sizeof(*job));
+    int (*loop)[2] = malloc(points * sizeof(*loop));
+    int length = 0;
+    int kept = 0;
+    for (int i = 0; i < contour_count; i++) {
+        int count = simplify_closed(&contours[i], loop);
+        free(contours[i].point);
+        if (count == 0) {
+            continue;
+        }
+        job[length][0] = loop[0][0];
+        job[length][1] = loop[0][1];
+        job[length][2] = z_travel;
+        length++;
+        for (int k = 0; k < count; k++) {
+            job[length][0] = loop[k][0];
+            job[length][1] = loop[k][1];
+            job[length][2] = z_cut;
+            length++;
+        }
+        kept++;
+    }
+    job[length][0] = 0;
+    job[length][1] = 0;
+    job[length][2] = z_travel;
+    length++;
+
+    // Least travel first, as "load" does for the prefabs
+    path_plan_T plan;
+    int origin[2] = {0, 0};
+    int (*ordered)[3] = malloc(length * sizeof(*ordered));
+    float written = 0;
+    float travel = 0;
+    bool reordered = path_split(&plan, (const int (*)[3])job, length, z_travel, origin);
+    if (reordered) {
+        written = path_travel(&plan);
+        travel = path_optimize(&plan);
+        reordered = path_emit(&plan, ordered, length) == length;
+    }
+    if (reordered) {
+        memcpy(job, ordered, length * sizeof(*job));
+    }
+
+    FILE *out = argc - optind == 2 ? fopen(argv[optind + 1], "w") : stdout;
+    if (!out) {
+        perror(argv[optind + 1]);
+        return 1;
+    }
+    if (table) {
+        fprintf(out, "    // Traced from %s by a2trace: %d contours, %d points, tolerance %g steps\n",
+                argv[optind], kept, length, tolerance);
+        fprintf(out, "    const int %s[][3] = {\n", name);
+        for (int i = 0; i < length; i++) {
+            fprintf(out, "        {%d, %d, %s}%s\n", job[i][0], job[i][1], job[i][2] == z_travel ? "z_up" : "z_down",
+                    i + 1 < length ? "," : "");
+        }
+        fprintf(out, "    };\n");
+    } else {
+        fprintf(out, "; Traced from %s by a2trace: %d contours, tolerance %g steps\n", argv[optind], kept, tolerance);
+        fprintf(out, "G90 G21\n");
+        for (int i = 0; i < length; i++) {
+            bool up = job[i][2] == z_travel;
+            bool plunge = !up && i > 0 && job[i - 1][2] == z_travel;
+            if (up) {
+                fprintf(out, "G0 Z%d\nG0 X%d Y%d\n", z_travel, job[i][0], job[i][1]);
+            } else if (plunge) {
+                fprintf(out, "G1 Z%d F%d\n", z_cut, feed);
+            } else {
+                fprintf(out, "G1 X%d Y%d\n", job[i][0], job[i][1]);
+            }
+        }
+        fprintf(out, "M2\n");
+    }
+    if (out != stdout) {
+        fclose(out);
+    }
+
+    fprintf(stderr, "%d contours, %d points, %d segments", kept, length, length - 2 * kept - 1);
+    if (reordered) {
+        fprintf(stderr, ", travel %.0f -> %.0f steps", written, travel);
+    } else {
+        fprintf(stderr, ", %d contours is too many to reorder", kept);
+    }
+    fputc('\n', stderr);
+    free(contours);
+    free(job);
+    free(loop);
+    free(ordered);
+    return 0;
+}
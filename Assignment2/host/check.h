@@ -0,0 +1,52 @@
+/**************************************************************
+ * check.h
+ * Assignment2 host tools
+ * ***********************************************************/
+
+/*
+  Assertions and timing shared by the host tests. A failed CHECK prints
+  where and why and the test carries on, so one run reports every
+  failure; main() returns check_status() for ctest.
+*/
+
+#ifndef A2_HOST_CHECK_H
+#define A2_HOST_CHECK_H
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <time.h>
+
+static int check_total = 0;
+static int check_failed = 0;
+
+static inline bool check_report(bool ok, const char *file, int line, const char *format, ...) {
+    check_total++;
+    if (!ok) {
+        check_failed++;
+        va_list args;
+        va_start(args, format);
+        fprintf(stderr, "%s:%d: ", file, line);
+        vfprintf(stderr, format, args);
+        fputc('\n', stderr);
+        va_end(args);
+    }
+    return ok;
+}
+
+// CHECK(condition, printf-style message shown when it fails)
+#define CHECK(cond, ...) check_report((cond), __FILE__, __LINE__, __VA_ARGS__)
+
+// Summary line; the exit status for main()
+static inline int check_status(const char *name) {
+    printf("%s: %d checks, %d failed\n", name, check_total, check_failed);
+    return check_failed == 0 ? 0 : 1;
+}
+
+static inline double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+#endif //  A2_HOST_CHECK_H
@@ -0,0 +1,283 @@
+/**************************************************************
+ * cmdbench.c
+ * Assignment2 host tools
+ * ***********************************************************/
+
+/*
+  Measures how fast command lines are parsed and dispatched.
+
+  Runs a corpus of command lines through two parsers: the old main loop
+  (option strings rebuilt per line, sscanf of the command and argument,
+  a strcmp chain and numeric sscanf with 9999 sentinels) and the
+  command.h table with the same commands and argument schemas as main.c.
+  Handlers do nothing, so only parsing and lookup are timed. The corpus
+  is generated (a mix of valid and broken lines) unless a file with one
+  command per line is given.
+
+  USAGE:
+    cmdbench [-n lines] [-f FILE] [-e]
+        -e  print the error each parser reports for a set of broken lines
+*/
+
+#define _DEFAULT_SOURCE
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "command.h"
+
+#define LEN(arr) ((int) (sizeof (arr) / sizeof (arr)[0]))
+#define LINE_SIZE 100       /* the firmware's input buffer */
+
+// Limits as in main.c
+#define X_MAX 8000
+#define Y_MAX 5450
+#define Z_MAX 1800
+#define SPIN_MAX 255
+#define TELEMETRY_MAX_HZ 100
+#define SCREEN_COLS 160
+#define SCREEN_ROWS 48
+
+static volatile long sink;
+
+static void count_args(const command_args_T *args) {
+    sink += args->count + args->value[0];
+}
+
+static const command_T commands[] = {
+    {"move", "move - manual control",
+        {{"x", ARG_INT, false, 0, X_MAX}, {"y", ARG_INT, false, 0, Y_MAX},
+         {"z", ARG_INT, false, 0, Z_MAX}}, count_args},
+    {"home", "home - run homing cycle", {{NULL}}, count_args},
+    {"load", "load - load prefab", {{"prefab", ARG_WORD, false, 0, 0}}, count_args},
+    {"zero", "zero - set to [0 0 0]", {{NULL}}, count_args},
+    {"setz", "setz - set spindle height", {{"depth", ARG_INT, false, -Z_MAX, Z_MAX}}, count_args},
+    {"resize", "resize - resize Window",
+        {{"width", ARG_INT, false, 20, SCREEN_COLS}, {"height", ARG_INT, false, 10, SCREEN_ROWS},
+         {"x", ARG_INT, true, 1, SCREEN_COLS}, {"y", ARG_INT, true, 1, SCREEN_ROWS}}, count_args},
+    {"spin", "spin - set spindle on/off", {{"speed", ARG_INT, false, 0, SPIN_MAX}}, count_args},
+    {"gcode", "gcode - run G-code", {{"line", ARG_TEXT, true, 0, 0}}, count_args},
+    {"stream", "stream - stream G-code", {{"ack", ARG_WORD, true, 0, 0}}, count_args},
+    {"stop", "stop - abort motion", {{NULL}}, count_args},
+    {"telemetry", "telemetry - panel rate", {{"hz", ARG_INT, false, 0, TELEMETRY_MAX_HZ}}, count_args},
+    {"binary", "binary - host protocol", {{NULL}}, count_args},
+    {"help", "help - command syntax", {{"command", ARG_WORD, true, 0, 0}}, count_args},
+};
+
+static command_table_T table;
+
+/*
+  The old main loop, minus the actions. Field widths are added to the
+  sscanf calls: the original had none and overflowed its 20-byte
+  argument buffer on long G-code lines.
+*/
+static const char *legacy_dispatch(const char *buffer) {
+    char option_move[20] = "move";
+    char option_load[20] = "load";
+    char option_zero[20] = "zero";
+    char option_resize[20] = "resize";
+    char option_home[20] = "home";
+    char option_setz[20] = "setz";
+    char option_spin[20] = "spin";
+    char option_gcode[20] = "gcode";
+    char option_stream[20] = "stream";
+    char option_stop[20] = "stop";
+    char option_telemetry[20] = "telemetry";
+    char option_binary[20] = "binary";
+    char command[20] = "\000";
+    char argument[20] = "\000";
+    sscanf(buffer, "%19s %19[^\t\n]", command, argument);
+
+    if (strcmp(command, option_move) == 0) {
+        int coords[3] = {9999, 9999, 9999};
+        sscanf(argument, "%d %d %d", &coords[0], &coords[1], &coords[2]);
+        if (coords[0] == 9999 || coords[1] == 9999 || coords[2] == 9999) {
+            return "Syntax: \"move [x] [y] [z]\"";
+        }
+        sink += coords[0];
+    } else if (strcmp(command, option_load) == 0) {
+        char sequence[20] = "";
+        sscanf(argument, "%19s", sequence);
+        sink += sequence[0];
+    } else if (strcmp(command, option_zero) == 0) {
+        sink++;
+    } else if (strcmp(command, option_resize) == 0) {
+        int width = 9999, height = 9999, x_origin = 9999, y_origin = 9999;
+        sscanf(argument, "%d %d %d %d", &width, &height, &x_origin, &y_origin);
+        if (width == 9999 || height == 9999) {
+            return "Syntax: \"resize [width] [height] [*x origin] [*y origin]\" *optional";
+        }
+        sink += width + x_origin + y_origin;
+    } else if (strcmp(command, option_home) == 0) {
+        sink++;
+    } else if (strcmp(command, option_setz) == 0) {
+        int depth = 9999;
+        sscanf(argument, "%d", &depth);
+        if (depth == 9999) {
+            return "Syntax: \"setz [depth]\"";
+        }
+        sink += depth;
+    } else if (strcmp(command, option_spin) == 0) {
+        int speed = 9999;
+        sscanf(argument, "%d", &speed);
+        if (speed == 9999) {
+            return "Syntax: \"spin [speed]\"";
+        }
+        if (speed < 0 || speed > SPIN_MAX) {
+            return "Error: spindle speed out of bounds (0-255)";
+        }
+        sink += speed;
+    } else if (strcmp(command, option_gcode) == 0) {
+        sink += strlen(argument);
+    } else if (strcmp(command, option_stream) == 0) {
+        sink += strcmp(argument, "ack") == 0;
+    } else if (strcmp(command, option_stop) == 0) {
+        sink++;
+    } else if (strcmp(command, option_telemetry) == 0) {
+        int rate = -1;
+        sscanf(argument, "%d", &rate);
+        if (rate < 0 || rate > TELEMETRY_MAX_HZ) {
+            return "Syntax: \"telemetry [0-100 Hz]\" (0 = off)";
+        }
+        sink += rate;
+    } else if (strcmp(command, option_binary) == 0) {
+        sink++;
+    } else {
+        return "Invalid command.";
+    }
+    return NULL;
+}
+
+static const char *table_dispatch(char *line) {
+    static char error[69];
+    return command_dispatch(&table, line, error, sizeof(error)) ? NULL : error;
+}
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// One generated line, about one in five of them broken
+static void generate_line(char *line, size_t size) {
+    int r = rand();
+    switch (r % 16) {
+        case 0: case 1: case 2: case 3:
+            snprintf(line, size, "move %d %d %d", rand() % X_MAX, rand() % Y_MAX, rand() % Z_MAX);
+            break;
+        case 4: snprintf(line, size, "spin %d", rand() % SPIN_MAX); break;
+        case 5: snprintf(line, size, "setz %d", rand() % 400); break;
+        case 6: snprintf(line, size, "gcode G1 X%d Y%d F%d", rand() % X_MAX, rand() % Y_MAX, 500 + rand() % 1000); break;
+        case 7: snprintf(line, size, "load %s", (r >> 8) & 1 ? "house" : "star"); break;
+        case 8: snprintf(line, size, "resize %d %d", 100 + rand() % 50, 20 + rand() % 20); break;
+        case 9: snprintf(line, size, "telemetry %d", rand() % TELEMETRY_MAX_HZ); break;
+        case 10: snprintf(line, size, "%s", (r >> 8) & 1 ? "stop" : "zero"); break;
+        case 11: snprintf(line, size, "%s", (r >> 8) & 1 ? "home" : "stream ack"); break;
+        case 12: snprintf(line, size, "help move"); break;
+        case 13: snprintf(line, size, "move %d %d", rand() % X_MAX, rand() % Y_MAX); break;
+        case 14: snprintf(line, size, "spin fast"); break;
+        default: snprintf(line, size, "mvoe %d 0 0", rand() % X_MAX); break;
+    }
+}
+
+static char (*load_file(const char *path, int *count))[LINE_SIZE] {
+    FILE *in = fopen(path, "r");
+    if (!in) {
+        perror(path);
+        return NULL;
+    }
+    int cap = 1024;
+    char (*lines)[LINE_SIZE] = malloc(sizeof(*lines) * cap);
+    *count = 0;
+    while (fgets(lines[*count], LINE_SIZE, in)) {
+        lines[*count][strcspn(lines[*count], "\r\n")] = '\0';
+        if (++*count == cap) {
+            cap *= 2;
+            lines = realloc(lines, sizeof(*lines) * cap);
+        }
+    }
+    fclose(in);
+    return lines;
+}
+
+static double run(char (*corpus)[LINE_SIZE], int count, bool use_table, int *errors) {
+    char line[LINE_SIZE];
+    *errors = 0;
+    double t0 = now_s();
+    for (int i = 0; i < count; i++) {
+        // The firmware parses its input buffer; both get a fresh copy
+        memcpy(line, corpus[i], LINE_SIZE);
+        const char *error = use_table ? table_dispatch(line) : legacy_dispatch(line);
+        *errors += error != NULL;
+    }
+    return now_s() - t0;
+}
+
+static void show_errors(void) {
+    const char *broken[] = {"move 100 200", "move 100 abc 300", "move 100 200 9000", "move 1 2 3 4",
+                            "spin 300", "spin", "resize 150", "telemetry 500", "mvoe 1 2 3",
+                            "move 9999 9999 9999", "setz 12x"};
+    for (int i = 0; i < LEN(broken); i++) {
+        char line[LINE_SIZE];
+        snprintf(line, sizeof(line), "%s", broken[i]);
+        const char *old_error = legacy_dispatch(line);
+        const char *new_error = table_dispatch(line);
+        printf("%-22s old: %s\n%-22s new: %s\n", broken[i], old_error ? old_error : "(accepted)",
+               "", new_error ? new_error : "(accepted)");
+    }
+}
+
+int main(int argc, char *argv[]) {
+    int count = 1000000;
+    const char *path = NULL;
+    bool errors_only = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:f:e")) != -1) {
+        switch (opt) {
+            case 'n': count = atoi(optarg); break;
+            case 'f': path = optarg; break;
+            case 'e': errors_only = true; break;
+            default:
+                fprintf(stderr, "usage: cmdbench [-n lines] [-f FILE] [-e]\n");
+                return 1;
+        }
+    }
+    if (!command_table_init(&table, commands, LEN(commands))) {
+        fprintf(stderr, "command table does not fit\n");
+        return 1;
+    }
+    if (errors_only) {
+        show_errors();
+        return 0;
+    }
+
+    char (*corpus)[LINE_SIZE];
+    if (path) {
+        corpus = load_file(path, &count);
+        if (!corpus) {
+            return 1;
+        }
+    } else {
+        srand(1);
+        corpus = malloc(sizeof(*corpus) * count);
+        for (int i = 0; i < count; i++) {
+            generate_line(corpus[i], LINE_SIZE);
+        }
+    }
+    if (count < 1) {
+        fprintf(stderr, "empty corpus\n");
+        return 1;
+    }
+
+    int old_errors, new_errors;
+    double old_s = run(corpus, count, false, &old_errors);
+    double new_s = run(corpus, count, true, &new_errors);
+    printf("%d lines\n", count);
+    printf("strcmp chain  %7.1f ns/line  %d rejected\n", old_s * 1e9 / count, old_errors);
+    printf("command table %7.1f ns/line  %d rejected\n", new_s * 1e9 / count, new_errors);
+    free(corpus);
+    return 0;
+}
@@ -0,0 +1,227 @@
+/**************************************************************
+ * commandtest.c
+ * Assignment2 host tools
+ * ***********************************************************/
+
+/*
+  Unit tests for the command dispatcher (command.h):
+    - lookup: every name is found, including through hash collisions,
+      and prefixes, extensions and unknown names are not; repeated names
+      and overfull tables are refused
+    - integers: bounds, signs, and words that are not numbers or
+      overflow
+    - missing and optional arguments, the rest-of-line text argument
+    - extra arguments
+  and the exact messages a user sees for each mistake. A line that is
+  refused must never reach the handler.
+
+  USAGE:
+    commandtest
+*/
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include "check.h"
+#include "command.h"
+
+#define LINE_SIZE  100      /* the firmware's input buffer */
+#define ERROR_SIZE 69       /* main.c's message buffer */
+
+// What the last handler call saw
+static int calls;
+static command_args_T last;
+static char last_text[COMMAND_MAX_ARGS][LINE_SIZE];
+
+static void record(const command_args_T *args) {
+    calls++;
+    last = *args;
+    for (int i = 0; i < COMMAND_MAX_ARGS; i++) {
+        last_text[i][0] = '\0';
+        if (args->text[i]) {
+            snprintf(last_text[i], LINE_SIZE, "%s", args->text[i]);
+        }
+    }
+}
+
+// A few of main.c's commands, one of each argument shape
+static const command_T commands[] = {
+    {"move", "move - manual control",
+        {{"x", ARG_INT, false, 0, 8000}, {"y", ARG_INT, false, 0, 5450},
+         {"z", ARG_INT, false, 0, 1800}}, record},
+    {"home", "home - run homing cycle", {{NULL}}, record},
+    {"load", "load - load prefab", {{"prefab", ARG_WORD, false, 0, 0}}, record},
+    {"setz", "setz - set spindle height", {{"depth", ARG_INT, false, -1800, 1800}}, record},
+    {"resize", "resize - resize Window",
+        {{"width", ARG_INT, false, 20, 160}, {"height", ARG_INT, false, 10, 48},
+         {"x", ARG_INT, true, 1, 160}, {"y", ARG_INT, true, 1, 48}}, record},
+    {"g", "g - run one line of G-code", {{"line", ARG_TEXT, false, 0, 0}}, record},
+    {"log", NULL, {{"lines", ARG_INT, true, 1, 100}}, record},
+};
+
+static command_table_T table;
+
+// Dispatch a copy of line; returns what command_dispatch() did
+static bool run(const char *line, char *error) {
+    char copy[LINE_SIZE];
+    snprintf(copy, sizeof(copy), "%s", line);
+    error[0] = '\0';
+    return command_dispatch(&table, copy, error, ERROR_SIZE);
+}
+
+// The line must run its handler once with these integer arguments
+static void expect_ints(const char *line, int count, int32_t a, int32_t b, int32_t c, int32_t d) {
+    char error[ERROR_SIZE];
+    int before = calls;
+    bool ok = run(line, error);
+    CHECK(ok, "\"%s\" refused: %s", line, error);
+    CHECK(calls == before + 1, "\"%s\": handler ran %d times", line, calls - before);
+    const int32_t want[COMMAND_MAX_ARGS] = {a, b, c, d};
+    CHECK(last.count == count, "\"%s\": %d arguments, %d expected", line, last.count, count);
+    for (int i = 0; i < count; i++) {
+        CHECK(last.value[i] == want[i], "\"%s\": argument %d is %ld, %ld expected", line, i + 1,
+              (long)last.value[i], (long)want[i]);
+    }
+}
+
+// The line must be refused with exactly this message, handler untouched
+static void expect_error(const char *line, const char *message) {
+    char error[ERROR_SIZE];
+    int before = calls;
+    bool ok = run(line, error);
+    CHECK(!ok, "\"%s\" accepted", line);
+    CHECK(calls == before, "\"%s\": refused but the handler ran", line);
+    CHECK(strcmp(error, message) == 0, "\"%s\": message \"%s\", expected \"%s\"", line, error, message);
+}
+
+static void test_lookup(void) {
+    for (size_t i = 0; i < sizeof(commands) / sizeof(commands[0]); i++) {
+        const char *name = commands[i].name;
+        CHECK(command_find(&table, name, strlen(name)) == &commands[i], "\"%s\" not found", name);
+    }
+    // The name need not be terminated where it ends
+    CHECK(command_find(&table, "movex", 4) == &commands[0], "\"move\" inside \"movex\" not found");
+    CHECK(command_find(&table, "mov", 3) == NULL, "prefix \"mov\" found");
+    CHECK(command_find(&table, "moves", 5) == NULL, "\"moves\" found");
+    CHECK(command_find(&table, "", 0) == NULL, "empty name found");
+    CHECK(command_find(&table, "MOVE", 4) == NULL, "lookup ignores case");
+
+    // A full table: half the slots, so most names share a probe run
+    static command_T many[COMMAND_HASH_SIZE / 2 + 1];
+    static char names[COMMAND_HASH_SIZE / 2 + 1][8];
+    for (int i = 0; i < COMMAND_HASH_SIZE / 2 + 1; i++) {
+        snprintf(names[i], sizeof(names[i]), "c%d", i);
+        many[i].name = names[i];
+        many[i].summary = NULL;
+        many[i].args[0].name = NULL;
+        many[i].handler = record;
+    }
+    command_table_T full;
+    CHECK(command_table_init(&full, many, COMMAND_HASH_SIZE / 2), "table of %d refused", COMMAND_HASH_SIZE / 2);
+    int home_slots = 0;
+    bool seen[COMMAND_HASH_SIZE] = {false};
+    for (int i = 0; i < COMMAND_HASH_SIZE / 2; i++) {
+        uint32_t slot = command_hash(names[i], strlen(names[i])) & (COMMAND_HASH_SIZE - 1);
+        home_slots += !seen[slot];
+        seen[slot] = true;
+        CHECK(command_find(&full, names[i], strlen(names[i])) == &many[i], "\"%s\" lost in a full table", names[i]);
+    }
+    CHECK(home_slots < COMMAND_HASH_SIZE / 2, "no hash collisions to test");
+    CHECK(command_find(&full, "c99", 3) == NULL, "\"c99\" found in a full table");
+    CHECK(!command_table_init(&full, many, COMMAND_HASH_SIZE / 2 + 1), "overfull table accepted");
+
+    // Repeated names
+    static command_T twice[2];
+    twice[0] = commands[0];
+    twice[1] = commands[0];
+    CHECK(!command_table_init(&full, twice, 2), "repeated name accepted");
+
+    expect_error("jump 1 2 3", "Invalid command \"jump\", try \"help\"");
+    expect_error("averyveryverylongcommandname", "Invalid command \"averyveryverylon\", try \"help\"");
+    expect_error("Move 1 2 3", "Invalid command \"Move\", try \"help\"");
+
+    // Blank lines do nothing
+    char error[ERROR_SIZE];
+    int before = calls;
+    CHECK(run("", error) && run("   \t ", error), "blank line refused");
+    CHECK(calls == before, "blank line ran a handler");
+}
+
+static void test_ints(void) {
+    expect_ints("move 1 2 3", 3, 1, 2, 3, 0);
+    expect_ints("  move\t0   0 \t 0  ", 3, 0, 0, 0, 0);
+    expect_ints("move 8000 5450 1800", 3, 8000, 5450, 1800, 0);
+    expect_ints("move +10 +20 +30", 3, 10, 20, 30, 0);
+    expect_ints("setz -1800", 1, -1800, 0, 0, 0);
+    expect_ints("setz -0", 1, 0, 0, 0, 0);
+
+    expect_error("move 8001 0 0", "move: x 8001 out of range (0-8000)");
+    expect_error("move 0 -1 0", "move: y -1 out of range (0-5450)");
+    expect_error("setz 1801", "setz: depth 1801 out of range (-1800-1800)");
+    expect_error("move 1.5 0 0", "move: x \"1.5\" is not a number");
+    expect_error("move 0 0x10 0", "move: y \"0x10\" is not a number");
+    expect_error("move - 0 0", "move: x \"-\" is not a number");
+    expect_error("move 1 2 +", "move: z \"+\" is not a number");
+    expect_error("move 99999999999 0 0", "move: x \"99999999999\" is not a number");
+    expect_error("setz 2147483648", "setz: depth \"2147483648\" is not a number");
+    expect_error("move abcdefghijklmnop 0 0", "move: x \"abcdefghijkl\" is not a number");
+
+    // The first bad argument is the one reported
+    expect_error("move 9000 x 0", "move: x 9000 out of range (0-8000)");
+}
+
+static void test_missing(void) {
+    expect_error("move", "move: missing x. Syntax: \"move x y z\"");
+    expect_error("move 1 2", "move: missing z. Syntax: \"move x y z\"");
+    expect_error("load", "load: missing prefab. Syntax: \"load prefab\"");
+    expect_error("g   ", "g: missing line. Syntax: \"g line\"");
+    expect_error("resize 80", "resize: missing height. Syntax: \"resize width height [x] [y]\"");
+
+    // Optional arguments may stop anywhere
+    expect_ints("resize 80 24", 2, 80, 24, 0, 0);
+    expect_ints("resize 80 24 5", 3, 80, 24, 5, 0);
+    expect_ints("resize 80 24 5 6", 4, 80, 24, 5, 6);
+    expect_ints("log", 0, 0, 0, 0, 0);
+    expect_ints("log 20", 1, 20, 0, 0, 0);
+    expect_error("log 0", "log: lines 0 out of range (1-100)");
+    expect_ints("home", 0, 0, 0, 0, 0);
+
+    // Words and text
+    char error[ERROR_SIZE];
+    CHECK(run("load   house  ", error) && strcmp(last_text[0], "house") == 0,
+          "load house gave \"%s\"", last_text[0]);
+    CHECK(run("g  G1 X10  Y20 ; cut", error) && strcmp(last_text[0], "G1 X10  Y20 ; cut") == 0,
+          "text argument gave \"%s\"", last_text[0]);
+    CHECK(last.count == 1, "text argument counted %d", last.count);
+}
+
+static void test_extra(void) {
+    expect_error("home now", "home: unexpected \"now\". Syntax: \"home\"");
+    expect_error("move 1 2 3 4", "move: unexpected \"4\". Syntax: \"move x y z\"");
+    expect_error("load house star", "load: unexpected \"star\". Syntax: \"load prefab\"");
+    expect_error("resize 80 24 5 6 7", "resize: unexpected \"7\". Syntax: \"resize width height [x] [y]\"");
+    expect_error("log 5 somethingverylong", "log: unexpected \"somethingver\". Syntax: \"log [lines]\"");
+}
+
+static void test_usage(void) {
+    char usage[40];
+    command_usage(&commands[4], usage, sizeof(usage));
+    CHECK(strcmp(usage, "resize width height [x] [y]") == 0, "usage \"%s\"", usage);
+    command_usage(&commands[1], usage, sizeof(usage));
+    CHECK(strcmp(usage, "home") == 0, "usage \"%s\"", usage);
+    // Cut short, never overrun
+    char small[8];
+    memset(small, 'x', sizeof(small));
+    command_usage(&commands[4], small, sizeof(small));
+    CHECK(strcmp(small, "resize ") == 0, "short usage \"%s\"", small);
+}
+
+int main(void) {
+    CHECK(command_table_init(&table, commands, sizeof(commands) / sizeof(commands[0])), "table refused");
+    test_lookup();
+    test_ints();
+    test_missing();
+    test_extra();
+    test_usage();
+    return check_status("commandtest");
+}
@@ -0,0 +1,334 @@
+/**************************************************************
+ * gcodetest.c
+ * Assignment2 host tools
+ * ***********************************************************/
+
+/*
+  Runs recorded G-code files through gcode_parse_line() (gcode.h) and
+  compares the actions of every line with the ones written after it:
+
+    G1 X10 Y5 F600
+    ;> move 10 5 0 feed 10
+    G2 X20 I5
+    ;> arc 20 5 0 center 15 5 cw feed 10
+    G7
+    ;> error Unsupported G code
+
+  Each ";>" line is one action in order: "move X Y Z feed F",
+  "arc X Y Z center X Y cw|ccw feed F", "home" or "home via X Y Z",
+  "spindle S", "end", or "error MESSAGE" for a rejected line. Targets
+  are machine steps at STEPS_PER_MM (motion.h) and feeds steps/s. A line
+  with no ";>" after it must produce no actions. ";>" lines are
+  comments to the controller, so the files stream unchanged with
+  a2send.
+
+  Then fuzzes the interpreter with the corpus lines cut, spliced and
+  sprinkled with random bytes. Every line must either be rejected with
+  a message and leave the modal state as it was, or be accepted with at
+  most GCODE_MAX_ACTIONS actions and the position on the last target.
+
+  USAGE:
+    gcodetest [-f lines] [-s seed] FILE...
+        -f  lines to fuzz (default 200000, 0 to skip)
+
+  With -DGCODETEST_LIBFUZZER the same checks become a libFuzzer target
+  instead of main(), each input fed through the interpreter line by line:
+    clang -g -O1 -fsanitize=fuzzer,address,undefined -DGCODETEST_LIBFUZZER \
+        -I.. gcodetest.c -lm -o gcodefuzz
+    ./gcodefuzz testdata/
+*/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "check.h"
+#include "gcode.h"
+#include "motion.h"
+
+#define EXPECT_MARK     ";>"
+#define LINE_SIZE       256
+#define MAX_CORPUS      4096
+
+// Field by field, so padding does not count
+static bool same_state(const gcode_T *a, const gcode_T *b) {
+    return a->motion == b->motion && a->relative == b->relative
+        && memcmp(a->position, b->position, sizeof(a->position)) == 0
+        && memcmp(a->offset, b->offset, sizeof(a->offset)) == 0
+        && a->steps_per_unit == b->steps_per_unit && a->feed == b->feed
+        && a->spindle_speed == b->spindle_speed && a->spindle_on == b->spindle_on;
+}
+
+// The invariants every line must keep, whatever it holds
+static bool fuzz_line(gcode_T *gc, const char *line) {
+    gcode_T before = *gc;
+    gcode_result_T result;
+    result.count = -1;
+    bool accepted = gcode_parse_line(gc, line, &result);
+    if (!accepted) {
+        return CHECK(result.error != NULL && result.error[0] != '\0', "fuzz: \"%s\" rejected without a message", line)
+            && CHECK(same_state(&before, gc), "fuzz: \"%s\" rejected but changed the state", line);
+    }
+    if (!CHECK(result.error == NULL, "fuzz: \"%s\" accepted with error \"%s\"", line, result.error)
+        || !CHECK(result.count >= 0 && result.count <= GCODE_MAX_ACTIONS, "fuzz: \"%s\" gave %d actions",
+                  line, result.count)) {
+        return false;
+    }
+    for (int i = 0; i < result.count; i++) {
+        const gcode_action_T *a = &result.actions[i];
+        if (a->type == GCODE_MOVE || a->type == GCODE_ARC) {
+            if (!CHECK(memcmp(a->target, gc->position, sizeof(a->target)) == 0,
+                       "fuzz: \"%s\" moved to (%d %d %d) but left the position at (%d %d %d)", line,
+                       a->target[0], a->target[1], a->target[2],
+                       gc->position[0], gc->position[1], gc->position[2])) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+#ifdef GCODETEST_LIBFUZZER
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    const int32_t origin[GCODE_NUM_AXES] = {0, 0, 0};
+    gcode_T gc;
+    gcode_init(&gc, origin, STEPS_PER_MM);
+    char line[LINE_SIZE];
+    size_t length = 0;
+    for (size_t i = 0; i <= size; i++) {
+        if (i == size || data[i] == '\n' || data[i] == '\0') {
+            line[length] = '\0';
+            if (!fuzz_line(&gc, line)) {
+                abort();
+            }
+            length = 0;
+        } else if (length + 1 < sizeof(line)) {
+            line[length++] = (char)data[i];
+        }
+    }
+    return 0;
+}
+#else
+// One action as written in the test files
+static void format_action(const gcode_action_T *a, char *out, size_t size) {
+    switch (a->type) {
+        case GCODE_MOVE:
+            snprintf(out, size, "move %d %d %d feed %u", a->target[0], a->target[1], a->target[2], a->feed);
+            break;
+        case GCODE_ARC:
+            snprintf(out, size, "arc %d %d %d center %d %d %s feed %u", a->target[0], a->target[1],
+                     a->target[2], a->center[0], a->center[1], a->clockwise ? "cw" : "ccw", a->feed);
+            break;
+        case GCODE_HOME:
+            if (a->has_via) {
+                snprintf(out, size, "home via %d %d %d", a->target[0], a->target[1], a->target[2]);
+            } else {
+                snprintf(out, size, "home");
+            }
+            break;
+        case GCODE_SPINDLE:
+            snprintf(out, size, "spindle %d", a->spindle_speed);
+            break;
+        case GCODE_END:
+            snprintf(out, size, "end");
+            break;
+    }
+}
+
+static void chomp(char *line) {
+    line[strcspn(line, "\r\n")] = '\0';
+}
+
+// Words of an expectation, with runs of blanks squeezed to one space
+static void normalise(const char *in, char *out, size_t size) {
+    size_t n = 0;
+    bool blank = true;
+    for (; *in != '\0' && n + 1 < size; in++) {
+        if (*in == ' ' || *in == '\t') {
+            blank = true;
+            continue;
+        }
+        if (blank && n > 0) {
+            out[n++] = ' ';
+        }
+        blank = false;
+        out[n++] = *in;
+    }
+    out[n] = '\0';
+}
+
+/*
+  Recorded files
+*/
+static char corpus[MAX_CORPUS][LINE_SIZE];
+static int corpus_count = 0;
+
+// Compare the actions of the line before the expectations with them
+static void check_expected(const char *path, int line_no, const char *gcode_line, const gcode_result_T *result,
+  bool accepted, char expected[][LINE_SIZE], int expected_count) {
+    char got[GCODE_MAX_ACTIONS + 1][LINE_SIZE];
+    int got_count = 0;
+    if (!accepted) {
+        snprintf(got[got_count++], LINE_SIZE, "error %s", result->error);
+    } else {
+        for (int i = 0; i < result->count; i++) {
+            format_action(&result->actions[i], got[got_count++], LINE_SIZE);
+        }
+    }
+    bool same = got_count == expected_count;
+    for (int i = 0; same && i < got_count; i++) {
+        same = strcmp(got[i], expected[i]) == 0;
+    }
+    if (!CHECK(same, "%s:%d: \"%s\" does not give the actions after it", path, line_no, gcode_line)) {
+        for (int i = 0; i < got_count || i < expected_count; i++) {
+            fprintf(stderr, "    got  %-40s want %s\n", i < got_count ? got[i] : "-",
+                    i < expected_count ? expected[i] : "-");
+        }
+    }
+}
+
+static void run_file(const char *path) {
+    FILE *in = fopen(path, "r");
+    if (!CHECK(in != NULL, "%s: cannot open", path)) {
+        return;
+    }
+    const int32_t origin[GCODE_NUM_AXES] = {0, 0, 0};
+    gcode_T gc;
+    gcode_init(&gc, origin, STEPS_PER_MM);
+
+    char text[LINE_SIZE];
+    char pending[LINE_SIZE] = "";
+    int pending_no = 0;
+    bool have_pending = false;
+    gcode_result_T result;
+    bool accepted = false;
+    static char expected[GCODE_MAX_ACTIONS + 1][LINE_SIZE];
+    int expected_count = 0;
+    int line_no = 0;
+    int lines = 0;
+    for (;;) {
+        bool more = fgets(text, sizeof(text), in) != NULL;
+        if (more) {
+            line_no++;
+            chomp(text);
+        }
+        if (more && strncmp(text, EXPECT_MARK, strlen(EXPECT_MARK)) == 0) {
+            if (CHECK(have_pending, "%s:%d: expectation before any G-code", path, line_no)
+                && CHECK(expected_count <= GCODE_MAX_ACTIONS, "%s:%d: too many expectations", path, line_no)) {
+                normalise(text + strlen(EXPECT_MARK), expected[expected_count++], LINE_SIZE);
+            }
+            continue;
+        }
+        // A new G-code line (or the end): settle the previous one
+        if (have_pending) {
+            check_expected(path, pending_no, pending, &result, accepted, expected, expected_count);
+        }
+        if (!more) {
+            break;
+        }
+        strcpy(pending, text);
+        pending_no = line_no;
+        have_pending = true;
+        expected_count = 0;
+        accepted = gcode_parse_line(&gc, pending, &result);
+        lines++;
+        if (corpus_count < MAX_CORPUS) {
+            strcpy(corpus[corpus_count++], text);
+        }
+    }
+    fclose(in);
+    printf("%s: %d lines\n", path, lines);
+}
+
+/*
+  Fuzzing
+*/
+static int random_below(int n) {
+    return n > 0 ? rand() % n : 0;
+}
+
+// A corpus line cut and spliced with another, with a few bytes changed
+static void mutate(char *out, size_t size) {
+    static const char alphabet[] = "GMXYZIJRFSN0123456789.-+ ;()*%\t";
+    const char *a = corpus[random_below(corpus_count)];
+    const char *b = corpus[random_below(corpus_count)];
+    size_t cut = (size_t)random_below((int)strlen(a) + 1);
+    size_t from = (size_t)random_below((int)strlen(b) + 1);
+    snprintf(out, size, "%.*s%s", (int)cut, a, b + from);
+
+    int edits = random_below(4);
+    for (int e = 0; e < edits; e++) {
+        size_t length = strlen(out);
+        size_t at = (size_t)random_below((int)length + 1);
+        switch (random_below(4)) {
+            case 0:     // random byte, anything but the terminator
+                if (at < length) {
+                    out[at] = (char)(1 + random_below(255));
+                }
+                break;
+            case 1:     // one more word character
+                if (length + 1 < size) {
+                    memmove(&out[at + 1], &out[at], length - at + 1);
+                    out[at] = alphabet[random_below((int)sizeof(alphabet) - 1)];
+                }
+                break;
+            case 2:     // drop one
+                if (at < length) {
+                    memmove(&out[at], &out[at + 1], length - at);
+                }
+                break;
+            default:    // a long number
+                snprintf(&out[at], size - at, "%s%d%d%d.%d", random_below(2) ? "-" : "", rand(), rand(), rand(),
+                         rand());
+                break;
+        }
+    }
+}
+
+static void fuzz(long count) {
+    if (corpus_count == 0) {
+        return;
+    }
+    const int32_t origin[GCODE_NUM_AXES] = {0, 0, 0};
+    gcode_T gc;
+    gcode_init(&gc, origin, STEPS_PER_MM);
+    char line[LINE_SIZE];
+    int failed = 0;
+    for (long n = 0; n < count && failed < 20; n++) {
+        mutate(line, sizeof(line));
+        failed += !fuzz_line(&gc, line);
+        // Now and then start over, as a new stream does
+        if (random_below(1000) == 0) {
+            gcode_init(&gc, origin, STEPS_PER_MM);
+        }
+    }
+    printf("fuzz: %ld lines\n", count);
+}
+
+int main(int argc, char *argv[]) {
+    long fuzz_count = 200000;
+    unsigned seed = 1;
+    int opt;
+    while ((opt = getopt(argc, argv, "f:s:")) != -1) {
+        switch (opt) {
+            case 'f': fuzz_count = atol(optarg); break;
+            case 's': seed = (unsigned)atol(optarg); break;
+            default:
+                fprintf(stderr, "usage: gcodetest [-f lines] [-s seed] FILE...\n");
+                return 1;
+        }
+    }
+    if (optind >= argc) {
+        fprintf(stderr, "usage: gcodetest [-f lines] [-s seed] FILE...\n");
+        return 1;
+    }
+    for (int i = optind; i < argc; i++) {
+        run_file(argv[i]);
+    }
+    srand(seed);
+    fuzz(fuzz_count);
+    return check_status("gcodetest");
+}
+#endif
@@ -0,0 +1,243 @@
+/**************************************************************
+ * linetest.c
+ * Assignment2 host tools
+ * ***********************************************************/
+
+/*
+  Sweeps the interpolators of stepper.h over random moves and checks the
+  pulses they emit:
+    - lines (line_init/line_next): one slot per step of the longest
+      axis, that axis pulsing in every slot, no axis more than half a
+      step off the ideal line, and the move ending exactly on its
+      target
+    - arcs (arc_init/arc_next, closed with arc_remaining() and a line
+      as dryrun.h does): every point within a step of the circle and
+      the move ending exactly on its target
+  Then times line_next() and arc_next() per slot on this machine.
+
+  USAGE:
+    linetest [-n moves] [-s seed]
+*/
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "check.h"
+#include "stepper.h"
+#include "planner.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#endif
+
+#define RANGE 200000        /* start coordinates, steps */
+#define MOVE_RANGE 20000    /* longest move per axis, steps */
+#define ARC_MAX_RADIUS 5000
+
+// Random coordinate in [-range, range]
+static int32_t random_coord(int32_t range) {
+    return (int32_t)(((int64_t)rand() << 16 ^ rand()) % (2 * (int64_t)range + 1)) - range;
+}
+
+static void apply(int32_t pos[STEPPER_NUM_AXES], uint8_t step_mask, uint8_t dir_mask) {
+    for (int i = 0; i < STEPPER_NUM_AXES; i++) {
+        if (step_mask & (1U << i)) {
+            pos[i] += (dir_mask & (1U << i)) ? 1 : -1;
+        }
+    }
+}
+
+// Walk one line and check every slot; returns the worst deviation in steps
+static double check_line(const int32_t start[STEPPER_NUM_AXES], const int32_t end[STEPPER_NUM_AXES]) {
+    int32_t delta[STEPPER_NUM_AXES];
+    int32_t pos[STEPPER_NUM_AXES];
+    int dominant_axis = 0;
+    uint32_t dominant = 0;
+    for (int i = 0; i < STEPPER_NUM_AXES; i++) {
+        delta[i] = end[i] - start[i];
+        pos[i] = start[i];
+        uint32_t steps = (uint32_t)(delta[i] < 0 ? -delta[i] : delta[i]);
+        if (steps > dominant) {
+            dominant = steps;
+            dominant_axis = i;
+        }
+    }
+
+    line_T line;
+    line_init(&line, delta);
+    uint8_t step_mask;
+    uint32_t slots = 0;
+    int missed = 0;
+    double worst = 0.0;
+    while (line_next(&line, &step_mask)) {
+        slots++;
+        apply(pos, step_mask, line.dir_mask);
+        missed += !(step_mask & (1U << dominant_axis));
+        for (int i = 0; i < STEPPER_NUM_AXES; i++) {
+            double ideal = start[i] + (double)delta[i] * slots / dominant;
+            double off = fabs(pos[i] - ideal);
+            worst = off > worst ? off : worst;
+        }
+    }
+    CHECK(slots == dominant, "line (%d %d %d): %u slots for %u steps",
+          delta[0], delta[1], delta[2], slots, dominant);
+    CHECK(missed == 0, "line (%d %d %d): longest axis idle in %d slots",
+          delta[0], delta[1], delta[2], missed);
+    CHECK(pos[0] == end[0] && pos[1] == end[1] && pos[2] == end[2],
+          "line (%d %d %d): ended at (%d %d %d), target (%d %d %d)",
+          delta[0], delta[1], delta[2], pos[0], pos[1], pos[2], end[0], end[1], end[2]);
+    return worst;
+}
+
+static void test_lines(int count) {
+    // Edge cases first: no move, one axis, exact diagonals, odd ratios, the full range
+    static const int32_t fixed[][STEPPER_NUM_AXES] = {
+        {0, 0, 0}, {1, 0, 0}, {0, -1, 0}, {0, 0, 1800}, {1000, 1000, 0}, {-777, 777, -777},
+        {3, 2, 1}, {1000, 999, 1}, {8000, 5450, 1800}, {-8000, -5450, -1800},
+        {1, 1000000, 0}, {INT32_MAX / 2, -(INT32_MAX / 2), 12345},
+    };
+    const int32_t origin[STEPPER_NUM_AXES] = {0, 0, 0};
+    double worst = 0.0;
+    for (size_t i = 0; i < sizeof(fixed) / sizeof(fixed[0]); i++) {
+        // The last one is too long to walk slot by slot in a test
+        if (i + 1 < sizeof(fixed) / sizeof(fixed[0])) {
+            double off = check_line(origin, fixed[i]);
+            worst = off > worst ? off : worst;
+        }
+    }
+    line_T line;
+    line_init(&line, fixed[sizeof(fixed) / sizeof(fixed[0]) - 1]);
+    CHECK(line.remaining == INT32_MAX / 2, "long line: %u slots", line.remaining);
+
+    for (int n = 0; n < count; n++) {
+        int32_t start[STEPPER_NUM_AXES];
+        int32_t end[STEPPER_NUM_AXES];
+        // Short moves are where rounding shows; keep a third of them within 50 steps
+        int32_t range = n % 3 == 0 ? 50 : MOVE_RANGE;
+        for (int i = 0; i < STEPPER_NUM_AXES; i++) {
+            start[i] = random_coord(RANGE);
+            end[i] = start[i] + random_coord(range);
+        }
+        double off = check_line(start, end);
+        worst = off > worst ? off : worst;
+    }
+    CHECK(worst <= 0.5 + 1e-9, "lines: up to %.3f steps off the ideal line", worst);
+    printf("lines: worst %.3f steps off the ideal line\n", worst);
+}
+
+// Walk one arc and its closing line; returns the worst distance from the circle
+static double check_arc(int32_t radius, double start_angle, double end_angle, bool clockwise, int32_t dz) {
+    int32_t start[2] = {(int32_t)lround(radius * cos(start_angle)), (int32_t)lround(radius * sin(start_angle))};
+    int32_t end[2] = {(int32_t)lround(radius * cos(end_angle)), (int32_t)lround(radius * sin(end_angle))};
+    double r = hypot(start[0], start[1]);
+    double sweep = atan2(end[1], end[0]) - atan2(start[1], start[0]);
+    if (clockwise && sweep >= 0) {
+        sweep -= 2 * M_PI;
+    } else if (!clockwise && sweep <= 0) {
+        sweep += 2 * M_PI;
+    }
+
+    arc_T arc;
+    arc_init(&arc, start, end, dz, clockwise, planner_arc_steps((float)r, (float)atan2(start[1], start[0]),
+                                                                (float)sweep));
+    int32_t pos[STEPPER_NUM_AXES] = {start[0], start[1], 0};
+    uint8_t step_mask, dir_mask;
+    double worst = 0.0;
+    while (arc_next(&arc, &step_mask, &dir_mask)) {
+        apply(pos, step_mask, dir_mask);
+        double off = fabs(hypot(pos[0], pos[1]) - r);
+        worst = off > worst ? off : worst;
+    }
+    int32_t remaining[STEPPER_NUM_AXES];
+    arc_remaining(&arc, remaining);
+    CHECK(abs(remaining[0]) <= 2 && abs(remaining[1]) <= 2,
+          "arc r %d: walk stopped (%d %d) short of the end", radius, remaining[0], remaining[1]);
+    line_T line;
+    line_init(&line, remaining);
+    while (line_next(&line, &step_mask)) {
+        apply(pos, step_mask, line.dir_mask);
+    }
+    CHECK(pos[0] == end[0] && pos[1] == end[1] && pos[2] == dz,
+          "arc r %d: ended at (%d %d %d), target (%d %d %d)",
+          radius, pos[0], pos[1], pos[2], end[0], end[1], dz);
+    return worst;
+}
+
+static void test_arcs(int count) {
+    double worst = 0.0;
+    for (int n = 0; n < count; n++) {
+        int32_t radius = 1 + rand() % ARC_MAX_RADIUS;
+        double a0 = rand() * 2 * M_PI / RAND_MAX;
+        // A fifth are full circles
+        double a1 = n % 5 == 0 ? a0 : rand() * 2 * M_PI / RAND_MAX;
+        int32_t dz = n % 2 ? random_coord(500) : 0;
+        double off = check_arc(radius, a0, a1, rand() % 2, dz);
+        worst = off > worst ? off : worst;
+    }
+    CHECK(worst <= 1.0, "arcs: up to %.3f steps off the circle", worst);
+    printf("arcs: worst %.3f steps off the circle\n", worst);
+}
+
+// Time per slot, in TSC cycles where the machine has one
+static void bench(void) {
+    static volatile uint8_t sink;
+    const int32_t delta[STEPPER_NUM_AXES] = {9000001, -5450003, 1800007};
+    line_T line;
+    uint8_t step_mask, dir_mask;
+    line_init(&line, delta);
+    double start = now_s();
+#ifdef HAVE_TSC
+    uint64_t tsc = __rdtsc();
+#endif
+    while (line_next(&line, &step_mask)) {
+        sink ^= step_mask;
+    }
+    double line_ns = (now_s() - start) * 1e9 / delta[0];
+#ifdef HAVE_TSC
+    double line_cycles = (double)(__rdtsc() - tsc) / delta[0];
+#endif
+
+    arc_T arc;
+    const int32_t from[2] = {ARC_MAX_RADIUS * 100, 0};
+    uint32_t slots = 0;
+    arc_init(&arc, from, from, 1000, false, planner_arc_steps(ARC_MAX_RADIUS * 100.0f, 0.0f, 2 * (float)M_PI));
+    start = now_s();
+#ifdef HAVE_TSC
+    tsc = __rdtsc();
+#endif
+    while (arc_next(&arc, &step_mask, &dir_mask)) {
+        sink ^= step_mask;
+        slots++;
+    }
+    double arc_ns = (now_s() - start) * 1e9 / slots;
+#ifdef HAVE_TSC
+    double arc_cycles = (double)(__rdtsc() - tsc) / slots;
+    printf("line_next %.1f ns (%.1f TSC cycles)/slot, arc_next %.1f ns (%.1f TSC cycles)/slot\n",
+           line_ns, line_cycles, arc_ns, arc_cycles);
+#else
+    printf("line_next %.1f ns/slot, arc_next %.1f ns/slot\n", line_ns, arc_ns);
+#endif
+}
+
+int main(int argc, char *argv[]) {
+    int count = 5000;
+    unsigned seed = 1;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:s:")) != -1) {
+        switch (opt) {
+            case 'n': count = atoi(optarg); break;
+            case 's': seed = (unsigned)atol(optarg); break;
+            default:
+                fprintf(stderr, "usage: linetest [-n moves] [-s seed]\n");
+                return 1;
+        }
+    }
+    srand(seed);
+    test_lines(count);
+    test_arcs(count / 10);
+    bench();
+    return check_status("linetest");
+}
@@ -0,0 +1,172 @@
+/**************************************************************
+ * lookbench.c
+ * Assignment2 host tools
+ * ***********************************************************/
+
+/*
+  Reports how long the built-in prefabs take to cut with and without the
+  look-ahead planner.
+
+  Each prefab is planned as "load" plans it: contours reordered by
+  pathopt.h unless -l is given, every point reached by a Z-up, XY,
+  Z-down rapid as in plan_move() and the circle as one arc. The moves
+  then run through the controller's planner and step generation
+  (dryrun.h) twice:
+    - stopping at every corner, as print_sequence() did when it sent
+      each point through move_to_position(): the buffer is flushed
+      after every segment, so each one starts and ends at rest
+    - through the look-ahead buffer, flushed only at the end
+  Exits with status 1 if the look-ahead is slower for any prefab.
+
+  USAGE:
+    lookbench [-l] [-u z_up] [-d z_down]
+        -l  cut the contours in the order written ("load NAME literal")
+      Heights default to main.c's until "setz": up 150, down 350.
+*/
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "dryrun.h"
+#include "pathopt.h"
+#include "prefab.h"
+
+static const uint32_t max_velocity[MOTION_NUM_AXES] = {XY_MAX_VELOCITY, XY_MAX_VELOCITY, Z_MAX_VELOCITY};
+static const uint32_t max_accel[MOTION_NUM_AXES] = {XY_ACCELERATION, XY_ACCELERATION, Z_ACCELERATION};
+
+static bool stop_at_corners;
+
+// Queue one segment as queue_segment() does, stopping after it if asked
+static void bench_segment(dryrun_T *dry, int32_t pos[3], int32_t dx, int32_t dy, int32_t dz,
+  uint32_t feed) {
+    motion_cmd_T cmd;
+    cmd.type = MOTION_SEGMENT;
+    cmd.feed = feed;
+    cmd.delta[0] = dx;
+    cmd.delta[1] = dy;
+    cmd.delta[2] = dz;
+    for (int i = 0; i < MOTION_NUM_AXES; i++) {
+        cmd.max_velocity[i] = max_velocity[i];
+        cmd.max_accel[i] = max_accel[i];
+        pos[i] += cmd.delta[i];
+    }
+    dryrun_command(dry, &cmd);
+    if (stop_at_corners) {
+        dryrun_finish(dry);
+    }
+}
+
+// Rapid to target the way plan_move() in main.c does: Z up first, XY, then Z down
+static void bench_point(dryrun_T *dry, int32_t pos[3], const int target[3]) {
+    const int32_t to[3] = {target[0], target[1], target[2]};
+    int32_t delta[3][MOTION_NUM_AXES];
+    int moves = motion_rapid_split(pos, to, delta);
+    for (int i = 0; i < moves; i++) {
+        bench_segment(dry, pos, delta[i][0], delta[i][1], delta[i][2], 0);
+    }
+}
+
+// Dry-run a point-list prefab from machine zero; returns microseconds
+static uint64_t bench_prefab(dryrun_T *dry, const prefab_T *prefab, bool literal, int z_up, int z_down) {
+    static int sequence[PREFAB_MAX_POINTS][3];
+    static int ordered[PREFAB_MAX_POINTS][3];
+    static path_plan_T plan;
+    int length = prefab_place(prefab, sequence, z_up, z_down);
+    const int (*points)[3] = sequence;
+    // As run_sequence() in main.c
+    const int from[2] = {0, 0};
+    if (!literal && path_split(&plan, sequence, length, z_up, from)) {
+        path_optimize(&plan);
+        if (path_emit(&plan, ordered, PREFAB_MAX_POINTS) == length) {
+            points = ordered;
+        }
+    }
+
+    int32_t pos[3] = {0, 0, 0};
+    dryrun_init(dry);
+    for (int i = 0; i < length; i++) {
+        bench_point(dry, pos, points[i]);
+    }
+    dryrun_finish(dry);
+    return dry->time_us;
+}
+
+// Dry-run the circle as print_circle() cuts it; returns microseconds
+static uint64_t bench_circle(dryrun_T *dry, int z_up, int z_down) {
+    const int path[][3] = {
+        {PREFAB_CIRCLE_X + PREFAB_CIRCLE_RADIUS, PREFAB_CIRCLE_Y, z_up},
+        {PREFAB_CIRCLE_X + PREFAB_CIRCLE_RADIUS, PREFAB_CIRCLE_Y, z_down},
+    };
+    const int home[3] = {0, 0, z_up};
+    int32_t pos[3] = {0, 0, 0};
+    dryrun_init(dry);
+    bench_point(dry, pos, path[0]);
+    bench_point(dry, pos, path[1]);
+
+    // One full turn back to where it started
+    motion_cmd_T cmd;
+    cmd.type = MOTION_ARC;
+    cmd.feed = 0;
+    cmd.clockwise = false;
+    for (int i = 0; i < MOTION_NUM_AXES; i++) {
+        cmd.delta[i] = 0;
+        cmd.max_velocity[i] = max_velocity[i];
+        cmd.max_accel[i] = max_accel[i];
+    }
+    cmd.center[0] = -PREFAB_CIRCLE_RADIUS;
+    cmd.center[1] = 0;
+    dryrun_command(dry, &cmd);
+    if (stop_at_corners) {
+        dryrun_finish(dry);
+    }
+
+    bench_point(dry, pos, home);
+    dryrun_finish(dry);
+    return dry->time_us;
+}
+
+static void report(const char *name, uint64_t stopping_us, uint64_t blended_us, uint32_t segments) {
+    printf("%-8s %8.1f s %11.1f s %7.1f%% %9lu\n", name, stopping_us / 1e6, blended_us / 1e6,
+           100.0 * ((double)stopping_us - (double)blended_us) / (double)stopping_us, (unsigned long)segments);
+}
+
+int main(int argc, char *argv[]) {
+    bool literal = false;
+    int z_up = 150;
+    int z_down = 350;
+    int opt;
+    while ((opt = getopt(argc, argv, "lu:d:")) != -1) {
+        switch (opt) {
+            case 'l': literal = true; break;
+            case 'u': z_up = atoi(optarg); break;
+            case 'd': z_down = atoi(optarg); break;
+            default:
+                fprintf(stderr, "usage: lookbench [-l] [-u z_up] [-d z_down]\n");
+                return 1;
+        }
+    }
+
+    static dryrun_T dry;
+    int status = 0;
+    printf("prefab   stop at corners  look-ahead   saved  segments\n");
+    for (size_t i = 0; i < PREFAB_COUNT; i++) {
+        stop_at_corners = true;
+        uint64_t stopping_us = bench_prefab(&dry, &prefabs[i], literal, z_up, z_down);
+        stop_at_corners = false;
+        uint64_t blended_us = bench_prefab(&dry, &prefabs[i], literal, z_up, z_down);
+        report(prefabs[i].name, stopping_us, blended_us, dry.segments);
+        if (blended_us > stopping_us) {
+            status = 1;
+        }
+    }
+    stop_at_corners = true;
+    uint64_t stopping_us = bench_circle(&dry, z_up, z_down);
+    stop_at_corners = false;
+    uint64_t blended_us = bench_circle(&dry, z_up, z_down);
+    report("circle", stopping_us, blended_us, dry.segments);
+    if (blended_us > stopping_us) {
+        status = 1;
+    }
+    return status;
+}
@@ -0,0 +1,600 @@
+/**************************************************************
+ * motiontest.c
+ * Assignment2 host tools
+ * ***********************************************************/
+
+/*
+  Runs the two sides of the motion queue (motion.h) on threads and checks
+  that commands come out in order and that aborts always finish.
+
+  One thread is core1 (core1_main() and the executor under it), one the
+  step alarm (stepper_tick() against the wall clock, sped up) and the main
+  thread core0 (send_motion_cmd(), flush_motion(), wait_for_motion(),
+  stop_motion()). Realtime bytes arrive from a fourth thread, as from the
+  UART interrupt. Those functions are copied from main.c with the
+  hardware calls replaced, so keep them in step with it. __wfe()/__sev()
+  become a latched event on a condition variable and
+  save_and_disable_interrupts() a mutex the alarm takes per edge.
+
+  Checks:
+    - every segment core0 pushes is executed once, in order, and the
+      step counters end on the sum of the moves, through flushes and
+      random feed holds and resumes
+    - an abort (Ctrl-X) at a random moment stops with the queue, the
+      look-ahead buffer and the step queue empty, the engine running
+      again and the position on the path already executed
+    - an abort while core0 is blocked on a full queue behind a feed hold
+      finishes
+  A scenario that has not finished after WATCHDOG_S seconds is reported
+  as a deadlock and the test fails.
+
+  USAGE:
+    motiontest [-n rounds] [-s seed]
+*/
+
+#define _DEFAULT_SOURCE
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "check.h"
+#include "motion.h"
+#include "dryrun.h"
+
+#define WATCHDOG_S   20
+#define SPEEDUP      100        /* step alarm runs this much faster than real time */
+#define MAX_DELTA    200        /* steps per axis per segment */
+#define LOG_SIZE     (1U << 16)
+
+// Realtime bytes and limits as in main.c
+#define RT_FEED_HOLD '!'
+#define RT_RESUME    '~'
+#define RT_ABORT     0x18
+static const uint32_t max_velocity[MOTION_NUM_AXES] = {XY_MAX_VELOCITY, XY_MAX_VELOCITY, Z_MAX_VELOCITY};
+static const uint32_t max_accel[MOTION_NUM_AXES] = {XY_ACCELERATION, XY_ACCELERATION, Z_ACCELERATION};
+
+/*
+  Stand-ins for the hardware
+*/
+static pthread_mutex_t irq_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t event_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t event_cond = PTHREAD_COND_INITIALIZER;
+static bool event_flag;
+static volatile bool alarm_armed;
+static volatile bool quit;
+
+// The event register: set by __sev(), consumed by __wfe()
+static void sev(void) {
+    pthread_mutex_lock(&event_lock);
+    event_flag = true;
+    pthread_cond_broadcast(&event_cond);
+    pthread_mutex_unlock(&event_lock);
+}
+
+static void wfe(void) {
+    pthread_mutex_lock(&event_lock);
+    if (!event_flag) {
+        // WFE may also wake for nothing; a timeout stands in for that
+        struct timespec until;
+        clock_gettime(CLOCK_REALTIME, &until);
+        until.tv_nsec += 1000000;
+        if (until.tv_nsec >= 1000000000) {
+            until.tv_sec++;
+            until.tv_nsec -= 1000000000;
+        }
+        pthread_cond_timedwait(&event_cond, &event_lock, &until);
+    }
+    event_flag = false;
+    pthread_mutex_unlock(&event_lock);
+}
+
+static void tight_loop_contents(void) {
+    sched_yield();
+}
+
+/*
+  What went in and what came out
+*/
+static int32_t pushed[LOG_SIZE][MOTION_NUM_AXES];      /* segments core0 queued, in order */
+static volatile uint32_t pushed_count;
+static int32_t executed[LOG_SIZE][MOTION_NUM_AXES];    /* segments core1 planned out, in order */
+static volatile uint32_t executed_count;
+
+/*
+  Core1, as in main.c
+*/
+static stepper_T stepper;
+static planner_T planner;
+static motion_queue_T motion_queue;
+static volatile bool motion_abort = false;
+static volatile bool motion_active = false;
+static volatile bool abort_requested = false;
+
+static void stepper_kick(void) {
+    pthread_mutex_lock(&irq_lock);
+    if (stepper_start(&stepper)) {
+        alarm_armed = true;
+    }
+    pthread_mutex_unlock(&irq_lock);
+}
+
+static bool queue_step(uint8_t step_mask, uint8_t dir_mask, uint32_t interval_us) {
+    while (!stepper_push(&stepper, step_mask, dir_mask, interval_us)) {
+        if (motion_abort) {
+            return false;
+        }
+        stepper_kick();
+        wfe();
+    }
+    stepper_kick();
+    return !motion_abort;
+}
+
+static void emit_segment(const segment_T *seg, uint32_t exit_speed) {
+    seg_walk_T walk;
+    uint8_t step_mask;
+    uint8_t dir_mask;
+    uint32_t interval;
+    seg_walk_init(&walk, seg, exit_speed);
+    while (seg_walk_next(&walk, &step_mask, &dir_mask, &interval)) {
+        if (!queue_step(step_mask, dir_mask, interval)) {
+            return;
+        }
+    }
+}
+
+static void emit_next_segment(void) {
+    segment_T seg;
+    uint32_t exit_speed;
+    if (planner_pop(&planner, &seg, &exit_speed)) {
+        memcpy(executed[executed_count % LOG_SIZE], seg.delta, sizeof(seg.delta));
+        executed_count++;
+        emit_segment(&seg, exit_speed);
+    }
+}
+
+static void discard_motion(void) {
+    planner_init(&planner);
+    motion_discard(&motion_queue);
+    pthread_mutex_lock(&irq_lock);
+    stepper_flush(&stepper);
+    pthread_mutex_unlock(&irq_lock);
+    motion_abort = false;
+}
+
+static void run_motion_cmd(motion_cmd_T *cmd) {
+    switch (cmd->type) {
+        case MOTION_SEGMENT:
+        case MOTION_ARC:
+            while (!planner_push(&planner, cmd->delta, cmd->max_velocity, cmd->max_accel, cmd->feed)) {
+                if (motion_abort) {
+                    return;
+                }
+                emit_next_segment();
+            }
+            break;
+        case MOTION_FLUSH:
+        case MOTION_HOME:
+            while (planner_count(&planner) > 0 && !motion_abort) {
+                emit_next_segment();
+            }
+            break;
+    }
+}
+
+static void *core1_main(void *arg) {
+    (void)arg;
+    while (!quit) {
+        if (motion_abort) {
+            discard_motion();
+            continue;
+        }
+        if (abort_requested) {
+            wfe();
+            continue;
+        }
+        stepper_kick();
+        motion_cmd_T cmd;
+        motion_active = true;
+        if (motion_pop(&motion_queue, &cmd)) {
+            run_motion_cmd(&cmd);
+        } else {
+            motion_active = false;
+            wfe();
+        }
+    }
+    return NULL;
+}
+
+// The step alarm: one edge per call, SPEEDUP times faster than real time
+static void *alarm_main(void *arg) {
+    (void)arg;
+    double due = now_s();
+    while (!quit) {
+        if (!alarm_armed) {
+            tight_loop_contents();
+            due = now_s();
+            continue;
+        }
+        if (now_s() < due) {
+            tight_loop_contents();
+            continue;
+        }
+        pthread_mutex_lock(&irq_lock);
+        uint32_t tail = stepper.tail;
+        uint32_t delay = stepper.running ? stepper_tick(&stepper) : 0;
+        if (delay == 0) {
+            alarm_armed = false;
+        }
+        pthread_mutex_unlock(&irq_lock);
+        due += delay * 1e-6 / SPEEDUP;
+        if (stepper.tail != tail || delay == 0) {
+            sev();      // an interrupt wakes WFE
+        }
+    }
+    return NULL;
+}
+
+/*
+  Core0, as in main.c
+*/
+static bool motion_flushed = true;
+
+static void send_motion_cmd(motion_cmd_T *cmd) {
+    while (!motion_push(&motion_queue, cmd)) {
+        if (abort_requested) {
+            return;
+        }
+        tight_loop_contents();
+    }
+    if (cmd->type == MOTION_SEGMENT) {
+        memcpy(pushed[pushed_count % LOG_SIZE], cmd->delta, sizeof(cmd->delta));
+        pushed_count++;
+    }
+    sev();
+}
+
+static bool motion_busy(void) {
+    return motion_queued(&motion_queue) > 0 || motion_active
+        || planner_count(&planner) > 0 || !stepper_idle(&stepper);
+}
+
+static void queue_segment(const int32_t delta[MOTION_NUM_AXES]) {
+    if (abort_requested) {
+        return;
+    }
+    motion_cmd_T cmd;
+    cmd.type = MOTION_SEGMENT;
+    cmd.feed = 0;
+    for (int i = 0; i < MOTION_NUM_AXES; i++) {
+        cmd.delta[i] = delta[i];
+        cmd.max_velocity[i] = max_velocity[i];
+        cmd.max_accel[i] = max_accel[i];
+    }
+    send_motion_cmd(&cmd);
+    motion_flushed = false;
+}
+
+static void flush_motion(void) {
+    if (motion_flushed) {
+        return;
+    }
+    motion_cmd_T cmd;
+    cmd.type = MOTION_FLUSH;
+    send_motion_cmd(&cmd);
+    motion_flushed = true;
+}
+
+static void wait_for_motion(void) {
+    flush_motion();
+    while (motion_busy() && !abort_requested) {
+        tight_loop_contents();
+    }
+}
+
+static void stop_motion(void) {
+    if (!stepper_idle(&stepper)) {
+        stepper.hold_request = true;
+        while (stepper.hold_state != STEPPER_HELD && !stepper_idle(&stepper)) {
+            tight_loop_contents();
+        }
+    }
+    motion_abort = true;
+    sev();
+    while (motion_abort) {
+        tight_loop_contents();
+    }
+    while (!stepper_idle(&stepper)) {
+        tight_loop_contents();
+    }
+    motion_flushed = true;
+}
+
+// From the UART interrupt
+static bool realtime_command(uint8_t ch) {
+    switch (ch) {
+        case RT_FEED_HOLD:
+            if (motion_busy()) {
+                stepper.hold_request = true;
+            }
+            return true;
+        case RT_RESUME:
+            if (stepper.hold_state != STEPPER_RUN) {
+                stepper.resume_request = true;
+                sev();
+            }
+            stepper.hold_request = false;
+            return true;
+        case RT_ABORT:
+            abort_requested = true;
+            if (stepper.hold_state == STEPPER_HELD || stepper_idle(&stepper)) {
+                motion_abort = true;
+                sev();
+            }
+            return true;
+        default:
+            return false;
+    }
+}
+
+// The abort half of service_realtime()
+static void service_realtime(void) {
+    if (abort_requested) {
+        stop_motion();
+        abort_requested = false;
+    }
+}
+
+/*
+  Scenarios
+*/
+static const char *scenario = "start";
+
+static void on_watchdog(int sig) {
+    (void)sig;
+    char message[256];
+    int length = snprintf(message, sizeof(message),
+                          "motiontest: deadlock in \"%s\": %u queued, %u planned, engine %s, hold state %d, "
+                          "abort requested %d, pending %d\n", scenario, motion_queued(&motion_queue),
+                          planner_count(&planner), stepper_idle(&stepper) ? "idle" : "running",
+                          stepper.hold_state, abort_requested, motion_abort);
+    write(STDERR_FILENO, message, (size_t)length);
+    _exit(1);
+}
+
+static void random_delta(int32_t delta[MOTION_NUM_AXES]) {
+    do {
+        for (int i = 0; i < MOTION_NUM_AXES; i++) {
+            delta[i] = rand() % (2 * MAX_DELTA + 1) - MAX_DELTA;
+        }
+    } while (delta[0] == 0 && delta[1] == 0 && delta[2] == 0);
+}
+
+static void position_now(int32_t pos[MOTION_NUM_AXES]) {
+    for (int i = 0; i < MOTION_NUM_AXES; i++) {
+        pos[i] = stepper.position[i];
+    }
+}
+
+// Everything stopped and empty, ready for the next command
+static void check_quiet(const char *name) {
+    CHECK(motion_queued(&motion_queue) == 0, "%s: %u commands left queued", name, motion_queued(&motion_queue));
+    CHECK(planner_count(&planner) == 0, "%s: %u segments left planned", name, planner_count(&planner));
+    CHECK(stepper_idle(&stepper), "%s: step engine still running", name);
+    CHECK(stepper.hold_state == STEPPER_RUN, "%s: engine left in hold state %d", name, stepper.hold_state);
+    CHECK(!motion_abort, "%s: abort still pending", name);
+}
+
+// Segments executed since from match those pushed since pushed_from, in order
+static uint32_t check_order(const char *name, uint32_t executed_from, uint32_t pushed_from) {
+    uint32_t count = executed_count - executed_from;
+    int wrong = 0;
+    for (uint32_t k = 0; k < count; k++) {
+        wrong += memcmp(executed[(executed_from + k) % LOG_SIZE], pushed[(pushed_from + k) % LOG_SIZE],
+                        sizeof(executed[0])) != 0;
+    }
+    CHECK(wrong == 0, "%s: %d of %u segments executed out of order", name, wrong, count);
+    CHECK(pushed_from + count <= pushed_count, "%s: executed %u segments, only %u pushed",
+          name, count, pushed_count - pushed_from);
+    return count;
+}
+
+// True if pos lies on the pulses of the executed segments from start
+static bool on_path(const int32_t start[MOTION_NUM_AXES], uint32_t executed_from, const int32_t pos[MOTION_NUM_AXES]) {
+    int32_t at[MOTION_NUM_AXES] = {start[0], start[1], start[2]};
+    if (memcmp(at, pos, sizeof(at)) == 0) {
+        return true;
+    }
+    for (uint32_t k = executed_from; k != executed_count; k++) {
+        line_T line;
+        uint8_t step_mask;
+        line_init(&line, executed[k % LOG_SIZE]);
+        while (line_next(&line, &step_mask)) {
+            for (int i = 0; i < MOTION_NUM_AXES; i++) {
+                if (step_mask & (1U << i)) {
+                    at[i] += (line.dir_mask & (1U << i)) ? 1 : -1;
+                }
+            }
+            if (memcmp(at, pos, sizeof(at)) == 0) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// Realtime bytes sent from the "interrupt" thread while a scenario runs
+typedef struct irq_plan {
+    volatile bool pushing;      /* core0 still queueing */
+    int abort_after_us;         /* < 0: no abort */
+    bool holds;                 /* send random holds and resumes */
+}   irq_plan_T;
+
+static void *irq_main(void *arg) {
+    irq_plan_T *plan = arg;
+    double start = now_s();
+    while (plan->pushing) {
+        usleep(200 + rand() % 2000);
+        if (plan->holds) {
+            realtime_command(rand() % 3 ? RT_RESUME : RT_FEED_HOLD);
+        }
+        if (plan->abort_after_us >= 0 && (now_s() - start) * 1e6 >= plan->abort_after_us) {
+            realtime_command(RT_ABORT);
+            return NULL;
+        }
+    }
+    realtime_command(RT_RESUME);
+    return NULL;
+}
+
+// Stream segments with random flushes, holds and resumes; all must run in order
+static void test_stream(int segments, bool holds) {
+    scenario = holds ? "stream with holds" : "stream";
+    alarm(WATCHDOG_S);
+    uint32_t executed_from = executed_count;
+    uint32_t pushed_from = pushed_count;
+    int32_t start[MOTION_NUM_AXES];
+    position_now(start);
+    int64_t sum[MOTION_NUM_AXES] = {start[0], start[1], start[2]};
+
+    irq_plan_T plan = {true, -1, holds};
+    pthread_t irq;
+    pthread_create(&irq, NULL, irq_main, &plan);
+    for (int n = 0; n < segments; n++) {
+        int32_t delta[MOTION_NUM_AXES];
+        random_delta(delta);
+        queue_segment(delta);
+        for (int i = 0; i < MOTION_NUM_AXES; i++) {
+            sum[i] += delta[i];
+        }
+        if (rand() % 16 == 0) {
+            flush_motion();
+        }
+    }
+    plan.pushing = false;
+    pthread_join(irq, NULL);
+    wait_for_motion();
+
+    uint32_t count = check_order(scenario, executed_from, pushed_from);
+    CHECK(count == (uint32_t)segments, "%s: %u of %d segments executed", scenario, count, segments);
+    int32_t end[MOTION_NUM_AXES];
+    position_now(end);
+    CHECK(end[0] == sum[0] && end[1] == sum[1] && end[2] == sum[2],
+          "%s: ended at (%d %d %d), moves add up to (%lld %lld %lld)", scenario,
+          end[0], end[1], end[2], (long long)sum[0], (long long)sum[1], (long long)sum[2]);
+    check_quiet(scenario);
+    alarm(0);
+}
+
+// Abort at a random moment while streaming; then the machine must work again
+static void test_abort(int round, bool holds) {
+    scenario = holds ? "abort during holds" : "abort";
+    alarm(WATCHDOG_S);
+    uint32_t executed_from = executed_count;
+    uint32_t pushed_from = pushed_count;
+    int32_t start[MOTION_NUM_AXES];
+    position_now(start);
+
+    irq_plan_T plan = {true, rand() % 60000, holds};
+    pthread_t irq;
+    pthread_create(&irq, NULL, irq_main, &plan);
+    for (int n = 0; n < 400 && !abort_requested; n++) {
+        int32_t delta[MOTION_NUM_AXES];
+        random_delta(delta);
+        queue_segment(delta);
+        if (rand() % 16 == 0) {
+            flush_motion();
+        }
+    }
+    if (!abort_requested) {
+        wait_for_motion();
+    }
+    plan.pushing = false;
+    pthread_join(irq, NULL);
+    service_realtime();
+
+    check_order(scenario, executed_from, pushed_from);
+    int32_t end[MOTION_NUM_AXES];
+    position_now(end);
+    CHECK(on_path(start, executed_from, end), "%s %d: stopped at (%d %d %d), off the path executed",
+          scenario, round, end[0], end[1], end[2]);
+    check_quiet(scenario);
+    alarm(0);
+}
+
+// Core0 blocked on a full queue behind a feed hold when Ctrl-X arrives
+static void test_held_full_abort(void) {
+    scenario = "abort with core0 blocked behind a hold";
+    alarm(WATCHDOG_S);
+    int32_t delta[MOTION_NUM_AXES] = {MAX_DELTA, MAX_DELTA, 0};
+    // Hold as the job starts, then fill the step queue and the motion
+    // queue behind it so core1 is stuck in queue_step()
+    delta[0] = -delta[0];
+    queue_segment(delta);
+    realtime_command(RT_FEED_HOLD);
+    while (stepper.hold_state != STEPPER_HELD || stepper_queued(&stepper) < STEPPER_QUEUE_SIZE
+           || motion_queued(&motion_queue) < MOTION_QUEUE_SIZE) {
+        if (motion_queued(&motion_queue) < MOTION_QUEUE_SIZE) {
+            delta[0] = -delta[0];
+            queue_segment(delta);
+        } else {
+            tight_loop_contents();
+        }
+    }
+
+    // Send Ctrl-X while core0 waits for room
+    irq_plan_T plan = {true, 1000, false};
+    pthread_t irq;
+    pthread_create(&irq, NULL, irq_main, &plan);
+    queue_segment(delta);
+    plan.pushing = false;
+    pthread_join(irq, NULL);
+
+    CHECK(abort_requested, "%s: core0 got through without the abort", scenario);
+    service_realtime();
+    check_quiet(scenario);
+    alarm(0);
+}
+
+int main(int argc, char *argv[]) {
+    int rounds = 40;
+    unsigned seed = 1;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:s:")) != -1) {
+        switch (opt) {
+            case 'n': rounds = atoi(optarg); break;
+            case 's': seed = (unsigned)atol(optarg); break;
+            default:
+                fprintf(stderr, "usage: motiontest [-n rounds] [-s seed]\n");
+                return 1;
+        }
+    }
+    srand(seed);
+    signal(SIGALRM, on_watchdog);
+    stepper_init(&stepper);
+    planner_init(&planner);
+    motion_queue_init(&motion_queue);
+
+    pthread_t core1, step_alarm;
+    pthread_create(&core1, NULL, core1_main, NULL);
+    pthread_create(&step_alarm, NULL, alarm_main, NULL);
+
+    test_stream(300, false);
+    test_stream(300, true);
+    test_held_full_abort();
+    for (int r = 0; r < rounds; r++) {
+        test_abort(r, r % 2);
+        test_stream(20, r % 3 == 0);
+    }
+
+    quit = true;
+    sev();
+    pthread_join(core1, NULL);
+    pthread_join(step_alarm, NULL);
+    return check_status("motiontest");
+}
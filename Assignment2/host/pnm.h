@@ -0,0 +1,86 @@
+/**************************************************************
+ * pnm.h
+ * Assignment2 host tools
+ * ***********************************************************/
+
+/*
+  PBM and PGM image loading shared by the host tools.
+*/
+
+#ifndef A2_HOST_PNM_H
+#define A2_HOST_PNM_H
+
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Next number of a PNM header, skipping blanks and # comments
+static int pnm_number(FILE *in) {
+    int c = fgetc(in);
+    while (c == '#' || isspace(c)) {
+        if (c == '#') {
+            while (c != '\n' && c != EOF) {
+                c = fgetc(in);
+            }
+        }
+        c = fgetc(in);
+    }
+    int value = 0;
+    bool any = false;
+    while (c != EOF && isdigit(c)) {
+        value = value * 10 + (c - '0');
+        any = true;
+        c = fgetc(in);
+    }
+    return any ? value : -1;
+}
+
+// Load a P1, P2, P4 or P5 image as grey values, 0 black to 255 white
+static uint8_t *pnm_read(FILE *in, int *width, int *height, bool *bitmap) {
+    char magic[2];
+    if (fread(magic, 1, 2, in) != 2 || magic[0] != 'P' || !strchr("1245", magic[1])) {
+        fprintf(stderr, "not a PBM or PGM image\n");
+        return NULL;
+    }
+    *bitmap = magic[1] == '1' || magic[1] == '4';
+    *width = pnm_number(in);
+    *height = pnm_number(in);
+    int max = *bitmap ? 1 : pnm_number(in);
+    if (*width <= 0 || *height <= 0 || max <= 0 || max > 255) {
+        fprintf(stderr, "unsupported image size or depth\n");
+        return NULL;
+    }
+    uint8_t *grey = malloc((size_t)*width * *height);
+    for (int y = 0; y < *height; y++) {
+        for (int x = 0; x < *width; x++) {
+            int value;
+            if (magic[1] == '4') {
+                // Packed rows, eight pixels a byte, 1 is black
+                static int byte;
+                if (x % 8 == 0) {
+                    byte = fgetc(in);
+                }
+                value = byte < 0 ? -1 : !((byte >> (7 - x % 8)) & 1);
+            } else if (magic[1] == '5') {
+                value = fgetc(in);
+            } else {
+                value = pnm_number(in);
+                if (magic[1] == '1' && value >= 0) {
+                    value = !value;
+                }
+            }
+            if (value < 0) {
+                fprintf(stderr, "image ends early\n");
+                free(grey);
+                return NULL;
+            }
+            grey[(size_t)y * *width + x] = (uint8_t)(value * 255 / (*bitmap ? 1 : max));
+        }
+    }
+    return grey;
+}
+
+#endif // A2_HOST_PNM_H
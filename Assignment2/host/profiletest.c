@@ -0,0 +1,245 @@
+/**************************************************************
+ * profiletest.c
+ * Assignment2 host tools
+ * ***********************************************************/
+
+/*
+  Checks the velocity profiles of planner.h against the ideal
+  trapezoid. Each profile's intervals are summed into pulse timestamps
+  and compared with the time the ideal motion reaches the same step,
+  phase by phase:
+    - acceleration: intervals fall, timestamps follow
+      t = (sqrt(v0^2 + 2 a s) - v0) / a
+    - cruise: every interval is the cruise interval
+    - deceleration: intervals rise to the exit speed
+  Profiles too short to cruise must peak where the two ramps meet. A
+  random sweep covers entry and exit speeds between the corners.
+
+  USAGE:
+    profiletest [-n profiles] [-s seed] [-v]
+        -v  print the worst error of each fixed case
+*/
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "check.h"
+#include "planner.h"
+
+#define TIME_TOLERANCE  0.01   /* of the ideal move time */
+#define TIME_SLACK_S    0.0005  /* plus whole-microsecond rounding */
+#define SPEED_TOLERANCE 0.05    /* of the ideal speed at a step */
+#define RAMP_SKIP       16      /* ramp steps next to standstill, where one step is a large share */
+#define AUSTIN_C0       0.676   /* first interval from standstill, of the exact sqrt(2 / a) */
+
+static bool verbose = false;
+
+/*
+  Ideal trapezoid (or triangle) over a move, as planned by
+  profile_init(). Pulse k sits at step k. A move that stops rests on
+  its last pulse, so it covers one step less than one handing over to
+  the next move, whose first pulse comes one step further on. From
+  standstill the shortened first interval puts every later pulse
+  (1 - AUSTIN_C0) sqrt(2 / a) early; stopping does the same to the
+  last one.
+*/
+typedef struct ideal {
+    double v0, vp, v1, a;       /* entry, peak, exit speed; acceleration */
+    double accel_end;           /* step where cruise starts */
+    double decel_start;         /* step where deceleration starts */
+    double t_accel, t_cruise;
+    double lead;                /* how early a ramp from standstill runs */
+}   ideal_T;
+
+static ideal_T ideal_init(uint32_t pulses, uint32_t v_entry, uint32_t v_cruise, uint32_t v_exit, uint32_t accel) {
+    ideal_T m;
+    uint32_t steps = v_exit == 0 ? pulses - 1 : pulses;
+    m.a = accel;
+    m.lead = (1.0 - AUSTIN_C0) * sqrt(2.0 / accel);
+    m.v0 = v_entry < v_cruise ? v_entry : v_cruise;
+    m.v1 = v_exit < v_cruise ? v_exit : v_cruise;
+    m.vp = v_cruise;
+    double accel_steps = (m.vp * m.vp - m.v0 * m.v0) / (2.0 * m.a);
+    double decel_steps = (m.vp * m.vp - m.v1 * m.v1) / (2.0 * m.a);
+    if (accel_steps + decel_steps > steps) {
+        // The ramps meet before reaching cruise speed
+        m.vp = sqrt((2.0 * m.a * steps + m.v0 * m.v0 + m.v1 * m.v1) / 2.0);
+        if (m.vp < m.v0) {
+            m.vp = m.v0;
+        }
+        if (m.vp < m.v1) {
+            m.vp = m.v1;
+        }
+        accel_steps = (m.vp * m.vp - m.v0 * m.v0) / (2.0 * m.a);
+        decel_steps = steps - accel_steps;
+    }
+    m.accel_end = accel_steps;
+    m.decel_start = steps - decel_steps;
+    m.t_accel = (m.vp - m.v0) / m.a;
+    m.t_cruise = (m.decel_start - m.accel_end) / m.vp;
+    return m;
+}
+
+// Time the ideal motion reaches step s
+static double ideal_time(const ideal_T *m, double s) {
+    if (s <= m->accel_end) {
+        return (sqrt(m->v0 * m->v0 + 2.0 * m->a * s) - m->v0) / m->a;
+    }
+    if (s <= m->decel_start) {
+        return m->t_accel + (s - m->accel_end) / m->vp;
+    }
+    double r = s - m->decel_start;
+    double v2 = m->vp * m->vp - 2.0 * m->a * r;
+    return m->t_accel + m->t_cruise + (m->vp - sqrt(v2 > 0.0 ? v2 : 0.0)) / m->a;
+}
+
+// Ideal speed at step s
+static double ideal_speed(const ideal_T *m, double s) {
+    if (s <= m->accel_end) {
+        return sqrt(m->v0 * m->v0 + 2.0 * m->a * s);
+    }
+    if (s <= m->decel_start) {
+        return m->vp;
+    }
+    double v2 = m->vp * m->vp - 2.0 * m->a * (s - m->decel_start);
+    return sqrt(v2 > 0.0 ? v2 : 0.0);
+}
+
+// Run one profile and compare every pulse with the ideal motion
+static void check_profile(const char *name, uint32_t steps, uint32_t v_entry, uint32_t v_cruise,
+  uint32_t v_exit, uint32_t accel) {
+    profile_T p;
+    profile_init(&p, steps, v_entry, v_cruise, v_exit, accel);
+    // Entries slower than the first ramp step start as if from standstill
+    bool from_rest = planner_ramp_step(v_entry, accel) == 0;
+    ideal_T m = ideal_init(steps, from_rest ? 0 : v_entry, v_cruise, v_exit, accel);
+    double total = ideal_time(&m, v_exit == 0 ? steps - 1 : steps);
+    uint32_t cruise_interval = p.c_min >> PLANNER_FRAC_BITS;
+    double start_lead = from_rest ? m.lead : 0.0;
+    // Otherwise the ramp starts, and hands over, up to half a step off the speed
+    double start_slack = from_rest ? 0.0 : 0.5 / v_entry;
+    double end_slack = v_exit == 0 ? 0.0 : 0.5 / v_exit;
+    double slowest = sqrt(2.0 * accel * RAMP_SKIP);
+
+    double t = 0.0;
+    double worst_time = 0.0, worst_speed = 0.0;
+    uint32_t previous = 0;
+    int time_errors = 0, speed_errors = 0, shape_errors = 0;
+    for (uint32_t k = 0; k < steps; k++) {
+        // Pulse k happens at t; the interval leads to pulse k + 1
+        uint32_t interval = profile_next_interval(&p);
+        bool ending = k + RAMP_SKIP >= steps;
+        bool stopping = ending && v_exit == 0;
+        double error = fabs(t - (ideal_time(&m, k) - (k > 0 ? start_lead : 0.0)));
+        if (stopping) {
+            error = error > m.lead ? error - m.lead : 0.0;
+        }
+        error -= TIME_SLACK_S + start_slack + (ending ? end_slack : 0.0);
+        error = error > 0.0 ? error / total : 0.0;
+        worst_time = error > worst_time ? error : worst_time;
+        time_errors += error > TIME_TOLERANCE;
+
+        // Average speed over the interval against the ideal at its middle;
+        // the ramp only has whole steps, so skip speeds within a few of standstill
+        double want = ideal_speed(&m, k + 0.5);
+        if (want > slowest && k + 1 < steps) {
+            double speed = 1e6 / interval;
+            double speed_error = fabs(speed - want) / want;
+            worst_speed = speed_error > worst_speed ? speed_error : worst_speed;
+            speed_errors += speed_error > SPEED_TOLERANCE;
+        }
+
+        // Phase shape: never faster than cruise, falling, flat, then rising
+        if (interval < cruise_interval) {
+            shape_errors++;
+        } else if (k > 0 && k < p.accel_until && interval > previous) {
+            shape_errors++;
+        } else if (k >= p.accel_until && k < p.decel_after && interval != cruise_interval) {
+            shape_errors++;
+        } else if (k > p.decel_after && interval < previous) {
+            shape_errors++;
+        }
+        previous = interval;
+        t += interval * 1e-6;
+    }
+    CHECK(time_errors == 0, "%s: %d timestamps off by over %.0f%% (worst %.2f%%)",
+          name, time_errors, TIME_TOLERANCE * 100, worst_time * 100);
+    CHECK(speed_errors == 0, "%s: %d speeds off by over %.0f%% (worst %.2f%%)",
+          name, speed_errors, SPEED_TOLERANCE * 100, worst_speed * 100);
+    CHECK(shape_errors == 0, "%s: %d intervals out of phase", name, shape_errors);
+    if (verbose) {
+        printf("%-28s %6u steps %7.3f s  time %.3f%%  speed %.2f%%\n",
+               name, steps, total, worst_time * 100, worst_speed * 100);
+    }
+}
+
+static void check_phases(const char *name, uint32_t steps, uint32_t v_entry, uint32_t v_cruise,
+  uint32_t v_exit, uint32_t accel, bool cruises) {
+    profile_T p;
+    profile_init(&p, steps, v_entry, v_cruise, v_exit, accel);
+    ideal_T m = ideal_init(steps, v_entry, v_cruise, v_exit, accel);
+    CHECK(fabs(p.accel_until - m.accel_end) <= 2.0, "%s: accelerates for %u steps, ideal %.1f",
+          name, p.accel_until, m.accel_end);
+    CHECK(fabs(p.decel_after - m.decel_start) <= 2.0, "%s: decelerates after %u steps, ideal %.1f",
+          name, p.decel_after, m.decel_start);
+    CHECK((p.decel_after > p.accel_until) == cruises, "%s: %s a cruise phase", name,
+          cruises ? "lacks" : "has");
+}
+
+int main(int argc, char *argv[]) {
+    int count = 2000;
+    unsigned seed = 1;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:s:v")) != -1) {
+        switch (opt) {
+            case 'n': count = atoi(optarg); break;
+            case 's': seed = (unsigned)atol(optarg); break;
+            case 'v': verbose = true; break;
+            default:
+                fprintf(stderr, "usage: profiletest [-n profiles] [-s seed] [-v]\n");
+                return 1;
+        }
+    }
+
+    // Axis limits from motion.h: XY 2500 steps/s at 5000 steps/s^2, Z half that
+    check_phases("xy traverse", 8000, 0, 2500, 0, 5000, true);
+    check_phases("short xy move", 400, 0, 2500, 0, 5000, false);
+    check_phases("z plunge", 1800, 0, 1250, 0, 2500, true);
+    check_phases("blended corner", 1000, 800, 2000, 1200, 5000, true);
+    check_phases("short blended", 100, 900, 2000, 600, 5000, false);
+
+    check_profile("xy traverse", 8000, 0, 2500, 0, 5000);
+    check_profile("short xy move", 400, 0, 2500, 0, 5000);
+    check_profile("z plunge", 1800, 0, 1250, 0, 2500);
+    check_profile("blended corner", 1000, 800, 2000, 1200, 5000);
+    check_profile("short blended", 100, 900, 2000, 600, 5000);
+    check_profile("slow feed", 3000, 0, 200, 0, 5000);
+    check_profile("entry at cruise", 2000, 2500, 2500, 0, 5000);
+
+    srand(seed);
+    char name[48];
+    for (int i = 0; i < count; i++) {
+        uint32_t steps = 20 + rand() % 6000;
+        uint32_t cruise = 100 + rand() % 2900;
+        uint32_t entry = rand() % 2 ? 0 : rand() % cruise;
+        uint32_t exit_speed = rand() % 2 ? 0 : rand() % cruise;
+        uint32_t accel = 1000 + rand() % 9000;
+        // The planner never asks for a speed change the acceleration cannot
+        // make, and a move that stops covers one step less
+        double distance = exit_speed == 0 ? steps - 1 : steps;
+        double reachable = sqrt((double)exit_speed * exit_speed + 2.0 * accel * distance);
+        if (entry > reachable) {
+            entry = (uint32_t)reachable;
+        }
+        reachable = sqrt((double)entry * entry + 2.0 * accel * distance);
+        if (exit_speed > reachable) {
+            exit_speed = (uint32_t)reachable;
+        }
+        snprintf(name, sizeof(name), "%u steps %u-%u-%u at %u", steps, entry, cruise, exit_speed, accel);
+        check_profile(name, steps, entry, cruise, exit_speed, accel);
+    }
+    return check_status("profiletest");
+}
@@ -0,0 +1,268 @@
+/**************************************************************
+ * prototest.c
+ * Assignment2 host tools
+ * ***********************************************************/
+
+/*
+  Unit tests for the binary protocol (proto.h):
+    - round trips through proto_encode() and proto_decode_byte() for
+      every payload length up to PROTO_MAX_PAYLOAD, with and without
+      zero bytes to stuff
+    - frames one byte too long, bad CRCs, truncated and over-long
+      encodings are dropped as PROTO_BAD, and nothing is written past
+      the frame they are decoded into
+    - the decoder finds the next frame after noise
+    - status payloads and the frame queue
+  Then round-trips random frames.
+
+  USAGE:
+    prototest [-n frames] [-s seed]
+*/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "check.h"
+#include "proto.h"
+
+#define GUARD_BYTE 0xA5
+
+// A frame with bytes after it that decoding must leave alone
+typedef struct guarded_frame {
+    proto_frame_T frame;
+    uint8_t guard[16];
+}   guarded_frame_T;
+
+static void guard_init(guarded_frame_T *g) {
+    memset(g, 0, sizeof(*g));
+    memset(g->guard, GUARD_BYTE, sizeof(g->guard));
+}
+
+static bool guard_intact(const guarded_frame_T *g) {
+    for (size_t i = 0; i < sizeof(g->guard); i++) {
+        if (g->guard[i] != GUARD_BYTE) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Feed wire bytes; returns the last result other than PROTO_NONE, or PROTO_NONE
+static int feed(proto_decoder_T *d, const uint8_t *wire, size_t length, guarded_frame_T *out, int *frames) {
+    int last = PROTO_NONE;
+    *frames = 0;
+    for (size_t i = 0; i < length; i++) {
+        int result = proto_decode_byte(d, wire[i], &out->frame);
+        if (result != PROTO_NONE) {
+            last = result;
+            *frames += result == PROTO_FRAME;
+        }
+    }
+    return last;
+}
+
+// Wire bytes for a raw frame of any length, CRC appended, as a sender would build it
+static size_t encode_raw(const uint8_t *raw, size_t length, uint8_t *wire) {
+    uint8_t framed[PROTO_MAX_FRAME + 16];
+    memcpy(framed, raw, length);
+    uint16_t crc = proto_crc16(raw, length);
+    framed[length] = (uint8_t)crc;
+    framed[length + 1] = (uint8_t)(crc >> 8);
+    size_t n = proto_cobs_encode(framed, length + 2, wire);
+    wire[n++] = PROTO_DELIMITER;
+    return n;
+}
+
+static bool round_trip(const proto_frame_T *in) {
+    uint8_t wire[PROTO_MAX_ENCODED];
+    size_t n = proto_encode(in, wire);
+    bool delimited = n <= PROTO_MAX_ENCODED && wire[n - 1] == PROTO_DELIMITER
+        && memchr(wire, PROTO_DELIMITER, n - 1) == NULL;
+    proto_decoder_T d;
+    proto_decoder_init(&d);
+    guarded_frame_T out;
+    guard_init(&out);
+    int frames;
+    int result = feed(&d, wire, n, &out, &frames);
+    return CHECK(delimited, "length %u: %zu wire bytes, delimiter misplaced", in->length, n)
+        && CHECK(result == PROTO_FRAME && frames == 1, "length %u: decoded as %d", in->length, result)
+        && CHECK(out.frame.type == in->type && out.frame.seq == in->seq && out.frame.length == in->length
+                 && memcmp(out.frame.payload, in->payload, in->length) == 0,
+                 "length %u: frame changed on the way", in->length)
+        && CHECK(guard_intact(&out), "length %u: decoder wrote past the frame", in->length);
+}
+
+static void test_round_trip(void) {
+    proto_frame_T frame;
+    for (int length = 0; length <= PROTO_MAX_PAYLOAD; length++) {
+        frame.type = PROTO_GCODE;
+        frame.seq = (uint8_t)length;
+        frame.length = (uint8_t)length;
+        // No zeros, then all zeros, then a mix
+        memset(frame.payload, 'G', sizeof(frame.payload));
+        round_trip(&frame);
+        memset(frame.payload, 0, sizeof(frame.payload));
+        round_trip(&frame);
+        for (int i = 0; i < length; i++) {
+            frame.payload[i] = (uint8_t)(i % 3 == 0 ? 0 : i);
+        }
+        round_trip(&frame);
+    }
+    // The longest frame has the longest encoding
+    frame.length = PROTO_MAX_PAYLOAD;
+    memset(frame.payload, 0xFF, sizeof(frame.payload));
+    uint8_t wire[PROTO_MAX_ENCODED];
+    size_t n = proto_encode(&frame, wire);
+    CHECK(n <= PROTO_MAX_ENCODED, "longest frame: %zu wire bytes, room for %d", n, PROTO_MAX_ENCODED);
+}
+
+static void test_rejected(void) {
+    proto_decoder_T d;
+    guarded_frame_T out;
+    uint8_t raw[PROTO_MAX_FRAME + 8];
+    uint8_t wire[PROTO_MAX_ENCODED + 16];
+    int frames;
+
+    // Type, seq and PROTO_MAX_PAYLOAD + 1 bytes with a valid CRC still fit the decoder's buffer
+    memset(raw, 'G', sizeof(raw));
+    raw[0] = PROTO_GCODE;
+    raw[1] = 1;
+    size_t n = encode_raw(raw, PROTO_MAX_PAYLOAD + 3, wire);
+    CHECK(n - 1 <= PROTO_MAX_ENCODED, "test frame too long to reach the decoder: %zu bytes", n - 1);
+    proto_decoder_init(&d);
+    guard_init(&out);
+    CHECK(feed(&d, wire, n, &out, &frames) == PROTO_BAD, "payload of %d accepted", PROTO_MAX_PAYLOAD + 1);
+    CHECK(guard_intact(&out), "payload of %d written past the frame", PROTO_MAX_PAYLOAD + 1);
+
+    // Exactly PROTO_MAX_PAYLOAD the same way is fine
+    n = encode_raw(raw, PROTO_MAX_PAYLOAD + 2, wire);
+    CHECK(feed(&d, wire, n, &out, &frames) == PROTO_FRAME && out.frame.length == PROTO_MAX_PAYLOAD,
+          "payload of %d refused", PROTO_MAX_PAYLOAD);
+
+    // Longer than any encoding: skipped to the delimiter
+    memset(wire, 'x', PROTO_MAX_ENCODED + 10);
+    wire[PROTO_MAX_ENCODED + 10] = PROTO_DELIMITER;
+    guard_init(&out);
+    CHECK(feed(&d, wire, PROTO_MAX_ENCODED + 11, &out, &frames) == PROTO_BAD, "over-long encoding accepted");
+    CHECK(guard_intact(&out), "over-long encoding written past the frame");
+
+    // Every single-bit error in a frame is caught by COBS or the CRC
+    proto_frame_T frame = {PROTO_MOVE, 7, 16, {0}};
+    for (int i = 0; i < 16; i++) {
+        frame.payload[i] = (uint8_t)(i * 37);
+    }
+    n = proto_encode(&frame, wire);
+    int missed = 0;
+    for (size_t i = 0; i + 1 < n; i++) {
+        for (int bit = 0; bit < 8; bit++) {
+            uint8_t bad[PROTO_MAX_ENCODED];
+            memcpy(bad, wire, n);
+            bad[i] ^= (uint8_t)(1U << bit);
+            proto_decoder_init(&d);
+            missed += feed(&d, bad, n, &out, &frames) == PROTO_FRAME && frames == 1
+                && memcmp(&out.frame, &frame, sizeof(frame)) != 0;
+        }
+    }
+    CHECK(missed == 0, "%d single-bit errors decoded as a different frame", missed);
+
+    // Too short for type, seq and CRC; invalid COBS
+    static const uint8_t short_frame[] = {0x03, 0x01, 0x02, PROTO_DELIMITER};
+    static const uint8_t bad_code[] = {0x09, 0x01, 0x02, PROTO_DELIMITER};
+    proto_decoder_init(&d);
+    CHECK(feed(&d, short_frame, sizeof(short_frame), &out, &frames) == PROTO_BAD, "short frame accepted");
+    CHECK(feed(&d, bad_code, sizeof(bad_code), &out, &frames) == PROTO_BAD, "invalid COBS accepted");
+}
+
+static void test_resync(void) {
+    proto_frame_T frame = {PROTO_PING, 42, 5, {'h', 'e', 'l', 'l', 'o'}};
+    uint8_t wire[PROTO_MAX_ENCODED * 2 + 8];
+    // Noise, delimiters, then a frame cut short by a lost byte, then a good one
+    size_t n = 0;
+    wire[n++] = 0x13;
+    wire[n++] = 0x37;
+    wire[n++] = PROTO_DELIMITER;
+    wire[n++] = PROTO_DELIMITER;
+    size_t cut = proto_encode(&frame, &wire[n]);
+    memmove(&wire[n + 2], &wire[n + 3], cut - 3);
+    n += cut - 1;
+    n += proto_encode(&frame, &wire[n]);
+
+    proto_decoder_T d;
+    proto_decoder_init(&d);
+    guarded_frame_T out;
+    guard_init(&out);
+    int frames;
+    int result = feed(&d, wire, n, &out, &frames);
+    CHECK(result == PROTO_FRAME && frames == 1 && out.frame.seq == 42 && out.frame.length == 5
+          && memcmp(out.frame.payload, "hello", 5) == 0, "frame after noise lost (%d, %d frames)", result, frames);
+}
+
+static void test_status(void) {
+    proto_status_T in = {{-1, 5450, 1800}, 2500, 321, 2, 255, PROTO_FLAG_MOVING, 0};
+    proto_frame_T frame;
+    proto_put_status(&frame, &in);
+    proto_status_T out;
+    CHECK(proto_get_status(&frame, &out), "status refused");
+    CHECK(out.position[0] == -1 && out.position[1] == 5450 && out.position[2] == 1800 && out.feed == 2500
+          && out.queued == 321 && out.hold_state == 2 && out.spindle == 255 && out.flags == PROTO_FLAG_MOVING,
+          "status changed on the way");
+    frame.length--;
+    CHECK(!proto_get_status(&frame, &out), "short status accepted");
+}
+
+static void test_queue(void) {
+    static proto_queue_T q;
+    proto_queue_init(&q);
+    proto_frame_T frame = {PROTO_FLUSH, 0, 0, {0}};
+    for (uint32_t i = 0; i < PROTO_QUEUE_SIZE; i++) {
+        frame.seq = (uint8_t)i;
+        CHECK(proto_queue_push(&q, &frame), "push %u of %u refused", i + 1, PROTO_QUEUE_SIZE);
+    }
+    CHECK(!proto_queue_push(&q, &frame), "push to a full queue accepted");
+    for (uint32_t i = 0; i < PROTO_QUEUE_SIZE; i++) {
+        CHECK(proto_queue_pop(&q, &frame) && frame.seq == i, "pop %u out of order", i);
+    }
+    CHECK(!proto_queue_pop(&q, &frame), "pop from an empty queue");
+}
+
+static void test_random(int count) {
+    proto_frame_T frame;
+    int failed = 0;
+    for (int n = 0; n < count && failed < 20; n++) {
+        frame.type = (uint8_t)rand();
+        frame.seq = (uint8_t)rand();
+        frame.length = (uint8_t)(rand() % (PROTO_MAX_PAYLOAD + 1));
+        for (int i = 0; i < frame.length; i++) {
+            // Plenty of zeros to stuff
+            frame.payload[i] = rand() % 4 == 0 ? 0 : (uint8_t)rand();
+        }
+        failed += !round_trip(&frame);
+    }
+    printf("random: %d frames\n", count);
+}
+
+int main(int argc, char *argv[]) {
+    int count = 20000;
+    unsigned seed = 1;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:s:")) != -1) {
+        switch (opt) {
+            case 'n': count = atoi(optarg); break;
+            case 's': seed = (unsigned)atol(optarg); break;
+            default:
+                fprintf(stderr, "usage: prototest [-n frames] [-s seed]\n");
+                return 1;
+        }
+    }
+    srand(seed);
+    test_round_trip();
+    test_rejected();
+    test_resync();
+    test_status();
+    test_queue();
+    test_random(count);
+    return check_status("prototest");
+}
@@ -0,0 +1,82 @@
+/**************************************************************
+ * serial.h
+ * Assignment2 host tools
+ * ***********************************************************/
+
+/*
+  Raw serial port setup shared by the host tools.
+*/
+
+#ifndef A2_HOST_SERIAL_H
+#define A2_HOST_SERIAL_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <termios.h>
+#include <unistd.h>
+
+static speed_t serial_speed(int rate) {
+    switch (rate) {
+        case 9600: return B9600;
+        case 19200: return B19200;
+        case 38400: return B38400;
+        case 57600: return B57600;
+        case 115200: return B115200;
+        case 230400: return B230400;
+        case 460800: return B460800;
+        case 921600: return B921600;
+        default: return 0;
+    }
+}
+
+// Open the port raw. With xon_xoff, output is paced by XON/XOFF from the
+// controller; binary data needs it off.
+static int serial_open(const char *path, int baud, bool xon_xoff) {
+    int fd = open(path, O_RDWR | O_NOCTTY);
+    if (fd < 0) {
+        perror(path);
+        return -1;
+    }
+    struct termios tio;
+    if (tcgetattr(fd, &tio) != 0) {
+        perror("tcgetattr");
+        close(fd);
+        return -1;
+    }
+    cfmakeraw(&tio);
+    cfsetispeed(&tio, serial_speed(baud));
+    cfsetospeed(&tio, serial_speed(baud));
+    tio.c_cflag |= CLOCAL | CREAD;
+    if (xon_xoff) {
+        tio.c_iflag |= IXON;
+    }
+    tio.c_cc[VMIN] = 0;
+    tio.c_cc[VTIME] = 1;
+    if (tcsetattr(fd, TCSANOW, &tio) != 0) {
+        perror("tcsetattr");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static bool serial_write_all(int fd, const void *data, size_t len) {
+    const char *p = data;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("write");
+            return false;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+#endif // A2_HOST_SERIAL_H
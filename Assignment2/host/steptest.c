@@ -0,0 +1,315 @@
+/**************************************************************
+ * steptest.c
+ * Assignment2 host tools
+ * ***********************************************************/
+
+/*
+  Drives the step engine (stepper.h) the way main.c does, with the pins
+  and the timer alarm simulated on a virtual microsecond clock, and
+  checks the pulse train it produces:
+    - each slot starts its predecessor's interval after the previous
+      one, or later only if the queue ran dry in between
+    - step pins are high for STEPPER_PULSE_US and show the slot's mask
+    - direction pins never change while a step pin is high and have
+      settled before the next rising edge
+    - the position counters match the pulses issued
+    - a feed hold slows at STEPPER_HOLD_ACCEL, stops with the rest of
+      the queue kept and issues every remaining slot once on resume
+    - a hold requested while the engine is stopped holds the next move
+  Then times stepper_push() and stepper_tick() on this machine.
+
+  USAGE:
+    steptest [-n events] [-s seed]
+*/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "check.h"
+#include "stepper.h"
+
+#define DIR_SETUP_US 5      /* as in main.c */
+
+static stepper_T stepper;
+
+// Simulated hardware: pin levels and one alarm on a virtual clock
+static uint64_t now_us;
+static bool alarm_armed;
+static uint64_t alarm_at;
+static uint8_t step_pins;
+static uint8_t dir_pins;
+static uint64_t dir_changed_at;
+
+// What was pushed, and what the pins did with it
+static step_event_T *expected;
+static uint32_t pushed;
+static uint32_t issued;             /* slots started */
+static uint64_t slot_at;            /* start of the current slot */
+static bool starved;                /* queue ran dry during the current slot */
+static bool exact;                  /* no hold: gaps must match the intervals */
+static uint32_t longest_gap;        /* while holding: gaps must only grow */
+static int32_t position[STEPPER_NUM_AXES];
+
+static void write_axis_pins(uint8_t step_bits, uint8_t dir_bits) {
+    if (dir_bits != dir_pins) {
+        // Changing with the falling edge is fine: drivers time dir from the rising one
+        CHECK(step_bits == 0, "dir pins changed with a step pin high at %llu us",
+              (unsigned long long)now_us);
+        dir_pins = dir_bits;
+        dir_changed_at = now_us;
+    }
+    if (step_pins != 0 && step_bits == 0) {
+        CHECK(now_us - slot_at == STEPPER_PULSE_US, "pulse %u high for %llu us",
+              issued - 1, (unsigned long long)(now_us - slot_at));
+    }
+    step_pins = step_bits;
+}
+
+// Core1's stepper_kick(): start a stopped engine after the dir setup time
+static void kick(void) {
+    if (stepper_start(&stepper)) {
+        write_axis_pins(stepper.step_bits, stepper.dir_bits);
+        alarm_armed = true;
+        alarm_at = now_us + DIR_SETUP_US;
+    }
+}
+
+static bool push(uint8_t step_mask, uint8_t dir_mask, uint32_t interval_us) {
+    if (!stepper_push(&stepper, step_mask, dir_mask, interval_us)) {
+        return false;
+    }
+    step_event_T *e = &expected[pushed++];
+    e->step_mask = step_mask;
+    e->dir_mask = dir_mask;
+    e->interval_us = interval_us < STEPPER_MIN_INTERVAL_US ? STEPPER_MIN_INTERVAL_US : interval_us;
+    return true;
+}
+
+// A slot has just started: compare it with what was pushed
+static void check_slot(void) {
+    const step_event_T *e = &expected[issued];
+    CHECK(stepper.step_bits == e->step_mask, "slot %u pulsed %x, pushed %x",
+          issued, stepper.step_bits, e->step_mask);
+    if (e->step_mask != 0) {
+        CHECK(dir_pins == e->dir_mask, "slot %u dir %x, pushed %x", issued, dir_pins, e->dir_mask);
+        CHECK(now_us - dir_changed_at >= STEPPER_MIN_INTERVAL_US - STEPPER_PULSE_US,
+              "slot %u dir set only %llu us before the pulse",
+              issued, (unsigned long long)(now_us - dir_changed_at));
+    }
+    if (issued > 0) {
+        uint64_t gap = now_us - slot_at;
+        uint32_t planned = expected[issued - 1].interval_us;
+        if (exact && !starved) {
+            CHECK(gap == planned, "slot %u after %llu us, planned %u",
+                  issued, (unsigned long long)gap, planned);
+        } else {
+            CHECK(gap >= planned, "slot %u after %llu us, planned %u",
+                  issued, (unsigned long long)gap, planned);
+        }
+        if (stepper.hold_state == STEPPER_HOLDING) {
+            CHECK(gap >= longest_gap, "slot %u sped up during a hold", issued);
+            longest_gap = (uint32_t)gap;
+        }
+    }
+    for (int i = 0; i < STEPPER_NUM_AXES; i++) {
+        if (e->step_mask & (1U << i)) {
+            position[i] += (e->dir_mask & (1U << i)) ? 1 : -1;
+        }
+    }
+    slot_at = now_us;
+    starved = false;
+    issued++;
+}
+
+// Fire the alarm until the virtual clock reaches t, or until limit slots have started
+static void run_until(uint64_t t, uint32_t limit) {
+    while (alarm_armed && alarm_at <= t && issued < limit) {
+        now_us = alarm_at;
+        uint32_t tail = stepper.tail;
+        uint32_t delay = stepper_tick(&stepper);
+        write_axis_pins(stepper.step_bits, stepper.dir_bits);
+        if (stepper.tail != tail) {
+            check_slot();
+        }
+        if (stepper.tail == stepper.head) {
+            starved = true;
+        }
+        if (delay == 0) {
+            alarm_armed = false;
+        } else {
+            alarm_at += delay;
+        }
+    }
+    if (issued < limit && t != UINT64_MAX && t > now_us) {
+        now_us = t;
+    }
+}
+
+static void reset(void) {
+    stepper_init(&stepper);
+    now_us = 1000;
+    alarm_armed = false;
+    step_pins = 0;
+    dir_pins = 0;
+    dir_changed_at = 0;
+    pushed = 0;
+    issued = 0;
+    starved = true;
+    exact = true;
+    for (int i = 0; i < STEPPER_NUM_AXES; i++) {
+        position[i] = 0;
+    }
+}
+
+static void check_position(const char *test) {
+    for (int i = 0; i < STEPPER_NUM_AXES; i++) {
+        CHECK(stepper.position[i] == position[i], "%s: axis %d at %d, pulses say %d",
+              test, i, stepper.position[i], position[i]);
+    }
+}
+
+// Random slots pushed in bursts at random times, often mid-pulse and with the queue dry
+static void test_random(uint32_t count) {
+    reset();
+    while (pushed < count) {
+        int burst = rand() % 16;
+        for (int i = 0; i < burst && pushed < count; i++) {
+            if (!push(rand() & 7, rand() & 7, rand() % 2000)) {
+                break;
+            }
+        }
+        kick();
+        run_until(now_us + rand() % 20000, UINT32_MAX);
+    }
+    kick();
+    run_until(UINT64_MAX, UINT32_MAX);
+    CHECK(issued == pushed, "random: %u of %u slots issued", issued, pushed);
+    CHECK(stepper_idle(&stepper), "random: engine still running");
+    check_position("random");
+}
+
+// Hold at a steady 2000 steps/s, wait, resume and finish
+static void test_hold(uint32_t count) {
+    reset();
+    const uint32_t interval = 500;
+    while (issued < 100) {
+        while (pushed < count && push(1U << AXIS_X, 1U << AXIS_X, interval)) {
+        }
+        kick();
+        run_until(UINT64_MAX, issued + 64);
+    }
+    uint32_t held_from = issued;
+    uint64_t hold_at = now_us;
+    stepper.hold_request = true;
+    exact = false;
+    longest_gap = interval;
+    // Keep the queue topped up as core1 would; nothing more should be issued once held
+    while (alarm_armed) {
+        while (pushed < count && push(1U << AXIS_X, 1U << AXIS_X, interval)) {
+        }
+        run_until(now_us + 10000, UINT32_MAX);
+    }
+    CHECK(stepper.hold_state == STEPPER_HELD, "hold: state %d after stopping", stepper.hold_state);
+
+    // v^2 = v0^2 - 2 a s from 2000 steps/s down to the hold speed
+    double v0 = 1e6 / interval;
+    double v1 = STEPPER_HOLD_MIN_VELOCITY;
+    double ideal_steps = (v0 * v0 - v1 * v1) / (2.0 * STEPPER_HOLD_ACCEL);
+    double ideal_s = (v0 - v1) / STEPPER_HOLD_ACCEL;
+    double steps = issued - held_from;
+    double seconds = (slot_at - hold_at) * 1e-6;
+    CHECK(steps > ideal_steps * 0.95 && steps < ideal_steps * 1.05,
+          "hold: stopped in %.0f steps, ideal %.0f", steps, ideal_steps);
+    CHECK(seconds > ideal_s * 0.95 && seconds < ideal_s * 1.05,
+          "hold: stopped in %.3f s, ideal %.3f", seconds, ideal_s);
+
+    uint32_t stopped_at = issued;
+    kick();
+    run_until(now_us + 200000, UINT32_MAX);
+    CHECK(issued == stopped_at, "hold: %u slots issued while held", issued - stopped_at);
+
+    stepper.resume_request = true;
+    while (issued < count) {
+        while (pushed < count && push(1U << AXIS_X, 1U << AXIS_X, interval)) {
+        }
+        kick();
+        run_until(now_us + 10000, UINT32_MAX);
+    }
+    run_until(UINT64_MAX, UINT32_MAX);
+    CHECK(stepper.hold_state == STEPPER_RUN, "hold: state %d after resuming", stepper.hold_state);
+    CHECK(issued == count, "hold: %u of %u slots issued", issued, count);
+    check_position("hold");
+}
+
+// A hold that arrives while the engine is stopped between moves
+static void test_latched_hold(void) {
+    reset();
+    stepper.hold_request = true;
+    for (int i = 0; i < 10; i++) {
+        push(1U << AXIS_Y, 0, 300);
+    }
+    kick();
+    run_until(now_us + 100000, UINT32_MAX);
+    CHECK(issued == 0, "latched hold: %u slots issued", issued);
+    CHECK(stepper.hold_state == STEPPER_HELD, "latched hold: state %d", stepper.hold_state);
+    stepper.resume_request = true;
+    exact = false;
+    kick();
+    run_until(UINT64_MAX, UINT32_MAX);
+    CHECK(issued == 10, "latched hold: %u of 10 slots after resume", issued);
+    check_position("latched hold");
+}
+
+// Cost of queueing and issuing a slot on this machine
+static void bench(uint32_t count) {
+    static volatile uint32_t sink;
+    stepper_init(&stepper);
+    double push_s = 0.0, tick_s = 0.0;
+    for (uint32_t done = 0; done < count; done += STEPPER_QUEUE_SIZE) {
+        double start = now_s();
+        for (uint32_t i = 0; i < STEPPER_QUEUE_SIZE; i++) {
+            stepper_push(&stepper, (uint8_t)(i & 7), (uint8_t)(i >> 3 & 7), 100);
+        }
+        double mid = now_s();
+        stepper_start(&stepper);
+        uint32_t delay;
+        while ((delay = stepper_tick(&stepper)) != 0) {
+            sink += delay;
+        }
+        tick_s += now_s() - mid;
+        push_s += mid - start;
+    }
+    printf("stepper_push %.1f ns/slot, stepper_tick %.1f ns/edge\n",
+           push_s * 1e9 / count, tick_s * 1e9 / (2.0 * count));
+}
+
+int main(int argc, char *argv[]) {
+    uint32_t count = 200000;
+    unsigned seed = 1;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:s:")) != -1) {
+        switch (opt) {
+            case 'n': count = (uint32_t)atol(optarg); break;
+            case 's': seed = (unsigned)atol(optarg); break;
+            default:
+                fprintf(stderr, "usage: steptest [-n events] [-s seed]\n");
+                return 1;
+        }
+    }
+    if (count < 2000) {
+        count = 2000;
+    }
+    srand(seed);
+    expected = malloc(sizeof(*expected) * count);
+    if (!expected) {
+        return 1;
+    }
+    test_random(count);
+    test_hold(2000);
+    test_latched_hold();
+    bench(count);
+    free(expected);
+    return check_status("steptest");
+}
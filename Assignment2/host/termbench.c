@@ -0,0 +1,237 @@
+/**************************************************************
+ * termbench.c
+ * Assignment2 host tools
+ * ***********************************************************/
+
+/*
+  Counts what drawing the Assignment2 UI costs on the serial link.
+
+  Draws the same frame as draw_ui() in main.c (clear, five boxes, labels,
+  option list and coordinates) three ways: every call written out on its
+  own, as the old one-printf-per-call code did; buffered through
+  terminal.h, with every colour change sent in full as before and then
+  with only the changes; and through the screen.h diff renderer. For the renderer it
+  also redraws the frame with one coordinate changed, which is what a
+  print_coords() update costs. Reports bytes, write calls and the time
+  the link needs at the given baud rate.
+
+  USAGE:
+    termbench [-b baud] [-w width] [-h height]
+*/
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "screen.h"
+
+#define LEN(arr) ((int) (sizeof (arr) / sizeof (arr)[0]))
+
+typedef struct box {
+    int width;
+    int height;
+    int x_origin;
+    int y_origin;
+    const char *header;
+}   box_T;
+
+// Options
+static int baud = 115200;
+static int win_width = 150;
+static int win_height = 33;
+
+// Write every call out at once, like the old printf() code
+static bool unbuffered = false;
+
+// Send every colour change in full, like the old term_set_color()
+static bool full_sgr = false;
+
+// Draw into this screen instead of the terminal, if set
+static screen_T *target = NULL;
+static screen_T screen;
+
+static void counting_writer(const char *data, size_t length) {
+    (void)data;
+    (void)length;
+}
+
+// One old printf() call
+static void emit(void) {
+    if (unbuffered) {
+        term_flush();
+    }
+}
+
+static void set_color(unsigned short fg, unsigned short bg) {
+    if (target) {
+        screen_set_color(target, fg, bg);
+    } else {
+        if (full_sgr) {
+            term_forget_color();
+        }
+        term_set_color(fg, bg);
+    }
+    emit();
+}
+
+static void move_to(int x, int y) {
+    if (target) {
+        screen_move_to(target, x, y);
+    } else {
+        term_move_to(x, y);
+    }
+    emit();
+}
+
+static void put_text(const char *text) {
+    if (target) {
+        screen_puts(target, text);
+    } else {
+        term_puts(text);
+    }
+    emit();
+}
+
+static void draw_box(box_T b) {
+    set_color(clrGreen, clrBlack);
+    int rows[2] = {b.y_origin, b.y_origin + b.height};
+    for (int r = 0; r < 2; r++) {
+        move_to(b.x_origin, rows[r]);
+        put_text("+");
+        for (int i = 0; i < b.width - 2; i++) {
+            put_text("-");
+        }
+        put_text("+");
+    }
+    for (int i = 1; i < b.height; i++) {
+        move_to(b.x_origin, b.y_origin + i);
+        put_text("|");
+    }
+    for (int i = 1; i < b.height; i++) {
+        move_to(b.x_origin + b.width - 1, b.y_origin + i);
+        put_text("|");
+    }
+    set_color(clrBlack, clrGreen);
+    move_to(b.x_origin + 2, b.y_origin + 1);
+    put_text(b.header);
+}
+
+static void draw_frame(int x_percent) {
+    double x_step = win_width / 9.0;
+    double y_step = win_height / 9.0;
+    box_T win = {win_width, win_height, 5, 5, "CC2511 Assignment 2"};
+    box_T xyz = {(int)round(2 * x_step), (int)round(3 * y_step),
+                 win.x_origin + (int)round(x_step), win.y_origin + (int)round(y_step), "Coordinates"};
+    box_T opt = {(int)round(4 * x_step), xyz.height, 0, xyz.y_origin, "Options"};
+    opt.x_origin = win.x_origin + (int)round(win.width - x_step - opt.width);
+    box_T in = {(int)round(xyz.width + opt.width + x_step), (int)round(1.5 * y_step),
+                xyz.x_origin, win.y_origin + (int)round(xyz.height + 2 * y_step), "Input"};
+    box_T out = {in.width, in.height, in.x_origin, in.y_origin + in.height, "Output"};
+    char text[80];
+
+    // clear_ui(): one character per call
+    if (target) {
+        screen_clear(target, clrBlack);
+    } else {
+        move_to(win.x_origin, win.y_origin);
+        set_color(clrBlack, clrBlack);
+        for (int i = 0; i < win.height + 1; i++) {
+            for (int j = 0; j < win.width + 1; j++) {
+                put_text(" ");
+            }
+            put_text(" \r\n");
+        }
+    }
+    box_T boxes[] = {win, xyz, opt, in, out};
+    for (int i = 0; i < LEN(boxes); i++) {
+        draw_box(boxes[i]);
+    }
+
+    const char *options[] = {"move - manual control", "home - run homing cycle", "load - load prefab",
+                             "zero - set to [0 0 0]", "setz - set spindle height", "resize - resize Window",
+                             "spin - set spindle on/off", "gcode - run G-code", "stream - stream G-code",
+                             "stop - abort motion", "! ~ ^X - hold/resume/abort"};
+    set_color(clrGreen, clrBlack);
+    for (int i = 0; i < 4; i++) {
+        move_to(xyz.x_origin + 4, xyz.y_origin + 3 + i);
+        snprintf(text, sizeof(text), "%c : ", "xyzs"[i]);
+        put_text(text);
+        snprintf(text, sizeof(text), "%03d %%", i == 0 ? x_percent : 0);
+        put_text(text);
+    }
+    for (int i = 0; i < LEN(options); i++) {
+        move_to(opt.x_origin + 3 + (i / 9) * 26, opt.y_origin + 2 + i % 9);
+        put_text(options[i]);
+    }
+    move_to(in.x_origin + 3, in.y_origin + 2);
+    put_text("> ");
+    move_to(out.x_origin + 2, out.y_origin + 2);
+    snprintf(text, sizeof(text), "%68s", "");
+    put_text(text);
+    put_text("Ready for commands...");
+    move_to(in.x_origin + 5, in.y_origin + 2);
+    if (target) {
+        screen_present(target);
+    }
+    term_flush();
+}
+
+static void report(const char *label) {
+    double seconds = term_out.bytes * 10.0 / baud;      // 8N1
+    printf("%-10s %7lu bytes %6lu writes  %6.0f ms on the link\n",
+           label, term_out.bytes, term_out.writes, seconds * 1000.0);
+}
+
+int main(int argc, char *argv[]) {
+    int opt;
+    while ((opt = getopt(argc, argv, "b:w:h:")) != -1) {
+        switch (opt) {
+            case 'b': baud = atoi(optarg); break;
+            case 'w': win_width = atoi(optarg); break;
+            case 'h': win_height = atoi(optarg); break;
+            default:
+                fprintf(stderr, "usage: termbench [-b baud] [-w width] [-h height]\n");
+                return 1;
+        }
+    }
+    if (baud <= 0 || win_width < 20 || win_height < 10) {
+        fprintf(stderr, "bad baud rate or window size\n");
+        return 1;
+    }
+    term_set_writer(counting_writer);
+
+    printf("draw_ui() at %dx%d, %d baud\n", win_width, win_height, baud);
+    unbuffered = true;
+    full_sgr = true;
+    draw_frame(0);
+    report("printf");
+
+    term_out.bytes = 0;
+    term_out.writes = 0;
+    unbuffered = false;
+    draw_frame(0);
+    report("buffered");
+
+    term_out.bytes = 0;
+    term_out.writes = 0;
+    full_sgr = false;
+    term_forget_color();
+    draw_frame(0);
+    report("sgr delta");
+
+    term_out.bytes = 0;
+    term_out.writes = 0;
+    screen_init(&screen);
+    target = &screen;
+    draw_frame(0);
+    report("screen");
+
+    printf("print_coords() with x changed\n");
+    term_out.bytes = 0;
+    term_out.writes = 0;
+    draw_frame(42);
+    report("screen");
+    return 0;
+}
@@ -0,0 +1,31 @@
+; Arcs by centre offset and by radius
+G0 X10 Y0
+;> move 10 0 0 feed 0
+G2 X0 Y-10 I-10 J0 F600
+;> arc 0 -10 0 center 0 0 cw feed 10
+; Equal end points make a full circle
+G3 X0 Y-10 I0 J10
+;> arc 0 -10 0 center 0 0 ccw feed 10
+; Positive R takes the short way round, negative the long way
+G2 X10 Y0 R10
+;> arc 10 0 0 center 10 -10 cw feed 10
+G3 X0 Y-10 R-10
+;> arc 0 -10 0 center 0 0 ccw feed 10
+; Helix
+G2 X0 Y-10 Z-2 I0 J10
+;> arc 0 -10 -2 center 0 0 cw feed 10
+G91 G2 X10 Y10 I10
+;> arc 10 0 -2 center 10 -10 cw feed 10
+G90
+X20
+;> error Arc needs I J or R
+G2 X30 Y0 R1
+;> error Arc radius too small for end point
+G2 X10 Y0 R5
+;> error Arc radius too small for end point
+G2
+;> error Arc without end point
+G3 I5 J5
+;> error Arc without end point
+G1 X20
+;> move 20 0 -2 feed 10
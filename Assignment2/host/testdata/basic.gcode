@@ -0,0 +1,43 @@
+; Straight moves, modes and program offsets, one step per unit
+G21 G90 G17 G94
+G0 X10 Y20
+;> move 10 20 0 feed 0
+G1 Z-3 F600
+;> move 10 20 -3 feed 10
+X30
+;> move 30 20 -3 feed 10
+G91 X5 Y-5
+;> move 35 15 -3 feed 10
+G90
+; Halves round away from zero
+X2.5 Y2.4 Z0
+;> move 3 2 0 feed 10
+X-2.5
+;> move -3 2 0 feed 10
+G92 X0 Y0
+G0 X10 Y10
+;> move 7 12 0 feed 0
+G1 F1200 X0
+;> move -3 12 0 feed 20
+G28
+;> home
+G28 X5 Y5
+;> home via 2 7 0
+N10 G1 X1 Y1 *57
+;> move -2 3 0 feed 20
+G1 X1 Y1 (inline comment) Z2 ; trailing comment
+;> move -2 3 2 feed 20
+g1 x4 y3
+;> move 1 5 2 feed 20
+; A bare motion word only changes the mode
+G0
+X0 Y0 Z0
+;> move -3 2 0 feed 0
+; Feeds too slow for a step per second still move
+G1 X1 F0.01
+;> move -2 2 0 feed 1
+; Numbers past the range clamp
+G0 X99999999999
+;> move 2147481 2 0 feed 0
+
+%
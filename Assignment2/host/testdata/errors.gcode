@@ -0,0 +1,39 @@
+; Rejected lines leave the modal state as it was
+G1 X10
+;> error No feed rate set (F)
+G0 X10
+;> move 10 0 0 feed 0
+G7
+;> error Unsupported G code
+G1.5 X3
+;> error Unsupported G code
+M4
+;> error Unsupported M code
+M3.5
+;> error Unsupported M code
+X10 $
+;> error Unexpected character
+X
+;> error Missing number after letter
+X 10
+;> error Missing number after letter
+G1 X5 Y5 Q
+;> error Missing number after letter
+F0
+;> error Feed must be positive
+F-5
+;> error Feed must be positive
+S-1
+;> error Spindle speed must not be negative
+Q1
+;> error Unsupported word
+G28 G92 X0
+;> error G28 and G92 on the same line
+; Still in G0, no feed set
+X20
+;> move 20 0 0 feed 0
+G1 X5 F600
+;> move 5 0 0 feed 10
+(a comment on its own)
+; so is this
+
@@ -0,0 +1,28 @@
+; A short job as a CAM program writes it
+%
+N1 G90 G21 G17 G94 (setup)
+N2 M3 S1000
+;> spindle 1000
+N3 G0 X1000 Y0 Z150
+;> move 1000 0 150 feed 0
+N4 G1 Z350 F30000
+;> move 1000 0 350 feed 500
+N5 X5000
+;> move 5000 0 350 feed 500
+N6 Y2000 S500
+;> spindle 500
+;> move 5000 2000 350 feed 500
+N7 G3 X3000 Y4000 R2000
+;> arc 3000 4000 350 center 3000 2000 ccw feed 500
+N8 G0 Z150
+;> move 3000 4000 150 feed 0
+N9 M5
+;> spindle 0
+N10 S200
+N11 M3 G0 X0 Y0
+;> spindle 200
+;> move 0 0 150 feed 0
+N12 G28 M30
+;> home
+;> end
+%
@@ -0,0 +1,71 @@
+/** \file isrstat.h
+ *  \defgroup cnc_isrstat
+ *
+ * Timing of an interrupt handler.
+ *
+ * The handler reads a down-counting 24-bit cycle counter (SysTick) on
+ * entry and on exit and adds the difference here, with the number of
+ * bytes it moved. The worst case shows how long other interrupts and the
+ * main loop can be held off. The main loop reads the figures with
+ * interrupts disabled so it never sees half an update. Nothing in here
+ * touches the hardware.
+ */
+
+#ifndef CC2511_ISRSTAT_H
+#define CC2511_ISRSTAT_H
+
+#include <stdint.h>
+
+#define ISRSTAT_COUNTER_MASK 0xFFFFFFU  /* SysTick is 24 bits */
+
+typedef struct isr_stats {
+    uint32_t calls;
+    uint32_t bytes;                 /* bytes moved in total */
+    uint32_t max_bytes;             /* most bytes moved in one call */
+    uint32_t overruns;              /* bytes lost before the handler ran */
+    uint32_t max_cycles;            /* longest call */
+    uint64_t total_cycles;
+}   isr_stats_T;
+
+/*! \brief Cycles between two readings of the down counter.
+ *  \ingroup cnc_isrstat
+ */
+static inline uint32_t isr_cycles(uint32_t start, uint32_t end) {
+    return (start - end) & ISRSTAT_COUNTER_MASK;
+}
+
+/*! \brief Clear the figures.
+ *  \ingroup cnc_isrstat
+ */
+static inline void isr_stats_reset(isr_stats_T *s) {
+    s->calls = 0;
+    s->bytes = 0;
+    s->max_bytes = 0;
+    s->overruns = 0;
+    s->max_cycles = 0;
+    s->total_cycles = 0;
+}
+
+/*! \brief Record one call of the handler.
+ *  \ingroup cnc_isrstat
+ */
+static inline void isr_stats_add(isr_stats_T *s, uint32_t cycles, uint32_t bytes) {
+    s->calls++;
+    s->bytes += bytes;
+    s->total_cycles += cycles;
+    if (cycles > s->max_cycles) {
+        s->max_cycles = cycles;
+    }
+    if (bytes > s->max_bytes) {
+        s->max_bytes = bytes;
+    }
+}
+
+/*! \brief Mean cycles per call.
+ *  \ingroup cnc_isrstat
+ */
+static inline uint32_t isr_stats_mean(const isr_stats_T *s) {
+    return s->calls ? (uint32_t)(s->total_cycles / s->calls) : 0;
+}
+
+#endif //  CC2511_ISRSTAT_H
@@ -0,0 +1,318 @@
+/** \file jobstore.h
+ *  \defgroup cnc_jobstore
+ *
+ * Header-only job library: named toolpaths kept in a reserved region of
+ * flash.
+ *
+ * A job is a header followed by its moves. Each move is what was handed
+ * to the motion queue, stored as differences from the move before:
+ *
+ *   op byte      JOB_OP_SEGMENT or JOB_OP_ARC, plus JOB_HAS_X/Y/Z for
+ *                the axes that move, JOB_NEW_FEED if the feed changes
+ *                and JOB_CLOCKWISE for arcs
+ *   arc centre   x, y from the start of the arc (arcs only)
+ *   deltas       one per axis flagged in the op byte
+ *   feed         steps/s, if flagged
+ *
+ * Numbers are zigzag varints (7 bits a byte), so a typical XY move takes
+ * five bytes instead of twelve. The header holds the absolute position
+ * the job starts from, so replaying it elsewhere cannot shift it.
+ *
+ * The region is split into JOBSTORE_SECTORS erase sectors. A job starts
+ * on a sector with a valid header and runs over as many whole sectors
+ * as it needs; anything else is free. The caller reads the region where
+ * it is mapped and does the erasing and programming; nothing in here
+ * touches the hardware.
+ */
+
+#ifndef CC2511_JOBSTORE_H
+#define CC2511_JOBSTORE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define JOBSTORE_SECTOR_SIZE 4096U          /* flash erase sector */
+#define JOBSTORE_SECTORS     64             /* 256 KB */
+#define JOBSTORE_SIZE        (JOBSTORE_SECTOR_SIZE * JOBSTORE_SECTORS)
+#define JOB_NAME_SIZE        16             /* including the terminator */
+#define JOB_MAGIC            0x31424F4AU    /* "JOB1" */
+
+/* Op byte */
+#define JOB_OP_SEGMENT 0x00
+#define JOB_OP_ARC     0x01
+#define JOB_OP_MASK    0x03
+#define JOB_HAS_X      0x04
+#define JOB_HAS_Y      0x08
+#define JOB_HAS_Z      0x10
+#define JOB_NEW_FEED   0x20
+#define JOB_CLOCKWISE  0x40
+
+typedef struct job_header {
+    uint32_t magic;                 /* JOB_MAGIC */
+    char name[JOB_NAME_SIZE];
+    uint32_t length;                /* bytes of moves after the header */
+    uint32_t moves;
+    int32_t start[3];               /* x, y, z before the first move */
+    uint32_t crc;                   /* job_crc32() of the moves */
+}   job_header_T;
+
+/* One decoded move */
+typedef struct job_move {
+    uint8_t op;                     /* JOB_OP_SEGMENT or JOB_OP_ARC */
+    int32_t delta[3];               /* end minus start */
+    int32_t center[2];              /* arc centre minus start */
+    bool clockwise;
+    uint32_t feed;                  /* steps/s, 0 = rapid */
+}   job_move_T;
+
+/* Encoder for a job being recorded */
+typedef struct job_writer {
+    uint8_t *data;
+    size_t size;
+    size_t length;
+    uint32_t moves;
+    uint32_t feed;                  /* of the last move */
+    bool full;                      /* a move did not fit and was dropped */
+}   job_writer_T;
+
+/* Decoder for a stored job */
+typedef struct job_reader {
+    const uint8_t *data;
+    size_t length;
+    size_t position;
+    uint32_t feed;
+    bool corrupt;                   /* a move ran past the end */
+}   job_reader_T;
+
+/*! \brief CRC-32 (IEEE, bitwise; jobs are checked once per load).
+ *  \ingroup cnc_jobstore
+ */
+static inline uint32_t job_crc32(const uint8_t *data, size_t length) {
+    uint32_t crc = 0xFFFFFFFFU;
+    for (size_t i = 0; i < length; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xEDB88320U & -(crc & 1U));
+        }
+    }
+    return ~crc;
+}
+
+static inline uint32_t job_zigzag(int32_t value) {
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static inline int32_t job_unzigzag(uint32_t value) {
+    return (int32_t)(value >> 1) ^ -(int32_t)(value & 1U);
+}
+
+/* Append a varint to out, returning its length (at most 5) */
+static inline int job_put_varint(uint8_t *out, uint32_t value) {
+    int n = 0;
+    while (value >= 0x80U) {
+        out[n++] = (uint8_t)(value | 0x80U);
+        value >>= 7;
+    }
+    out[n++] = (uint8_t)value;
+    return n;
+}
+
+static inline bool job_get_varint(job_reader_T *r, uint32_t *value) {
+    *value = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        if (r->position >= r->length) {
+            r->corrupt = true;
+            return false;
+        }
+        uint8_t byte = r->data[r->position++];
+        *value |= (uint32_t)(byte & 0x7FU) << shift;
+        if (!(byte & 0x80U)) {
+            return true;
+        }
+    }
+    r->corrupt = true;
+    return false;
+}
+
+/*! \brief Start recording into a buffer.
+ *  \ingroup cnc_jobstore
+ */
+static inline void job_writer_init(job_writer_T *w, uint8_t *data, size_t size) {
+    w->data = data;
+    w->size = size;
+    w->length = 0;
+    w->moves = 0;
+    w->feed = 0;
+    w->full = false;
+}
+
+/*! \brief Record one move.
+ *  \ingroup cnc_jobstore
+ *
+ * \param center Arc centre from the start, or NULL for a straight move
+ * \return false if it did not fit (the job is then marked full)
+ */
+static inline bool job_write_move(job_writer_T *w, const int32_t delta[3], const int32_t *center,
+  bool clockwise, uint32_t feed) {
+    uint8_t move[1 + 6 * 5];
+    int n = 1;
+    uint8_t op = center ? JOB_OP_ARC : JOB_OP_SEGMENT;
+    if (center) {
+        n += job_put_varint(&move[n], job_zigzag(center[0]));
+        n += job_put_varint(&move[n], job_zigzag(center[1]));
+        if (clockwise) {
+            op |= JOB_CLOCKWISE;
+        }
+    }
+    const uint8_t has[3] = {JOB_HAS_X, JOB_HAS_Y, JOB_HAS_Z};
+    for (int i = 0; i < 3; i++) {
+        if (delta[i] != 0) {
+            op |= has[i];
+            n += job_put_varint(&move[n], job_zigzag(delta[i]));
+        }
+    }
+    if (feed != w->feed) {
+        op |= JOB_NEW_FEED;
+        n += job_put_varint(&move[n], feed);
+    }
+    move[0] = op;
+    if (w->full || w->length + n > w->size) {
+        w->full = true;
+        return false;
+    }
+    memcpy(&w->data[w->length], move, n);
+    w->length += n;
+    w->moves++;
+    w->feed = feed;
+    return true;
+}
+
+/*! \brief Start reading the moves of a job.
+ *  \ingroup cnc_jobstore
+ */
+static inline void job_reader_init(job_reader_T *r, const uint8_t *data, size_t length) {
+    r->data = data;
+    r->length = length;
+    r->position = 0;
+    r->feed = 0;
+    r->corrupt = false;
+}
+
+/*! \brief Decode the next move.
+ *  \ingroup cnc_jobstore
+ *
+ * \return false at the end of the job, or if it is corrupt
+ */
+static inline bool job_read_move(job_reader_T *r, job_move_T *move) {
+    if (r->position >= r->length) {
+        return false;
+    }
+    uint8_t op = r->data[r->position++];
+    uint32_t value;
+    move->op = op & JOB_OP_MASK;
+    move->clockwise = (op & JOB_CLOCKWISE) != 0;
+    move->center[0] = 0;
+    move->center[1] = 0;
+    if (move->op > JOB_OP_ARC) {
+        r->corrupt = true;
+        return false;
+    }
+    if (move->op == JOB_OP_ARC) {
+        for (int i = 0; i < 2; i++) {
+            if (!job_get_varint(r, &value)) {
+                return false;
+            }
+            move->center[i] = job_unzigzag(value);
+        }
+    }
+    const uint8_t has[3] = {JOB_HAS_X, JOB_HAS_Y, JOB_HAS_Z};
+    for (int i = 0; i < 3; i++) {
+        move->delta[i] = 0;
+        if (op & has[i]) {
+            if (!job_get_varint(r, &value)) {
+                return false;
+            }
+            move->delta[i] = job_unzigzag(value);
+        }
+    }
+    if (op & JOB_NEW_FEED) {
+        if (!job_get_varint(r, &r->feed)) {
+            return false;
+        }
+    }
+    move->feed = r->feed;
+    return true;
+}
+
+/* Sectors a job of this many bytes of moves takes */
+static inline int job_sectors(uint32_t length) {
+    return (int)((sizeof(job_header_T) + length + JOBSTORE_SECTOR_SIZE - 1) / JOBSTORE_SECTOR_SIZE);
+}
+
+/*! \brief The header starting a sector, or NULL if none is there.
+ *  \ingroup cnc_jobstore
+ */
+static inline const job_header_T *job_at(const uint8_t *region, int sector) {
+    const job_header_T *h = (const job_header_T *)(region + (size_t)sector * JOBSTORE_SECTOR_SIZE);
+    if (h->magic != JOB_MAGIC || memchr(h->name, '\0', JOB_NAME_SIZE) == NULL
+        || h->length > JOBSTORE_SIZE || sector + job_sectors(h->length) > JOBSTORE_SECTORS) {
+        return NULL;
+    }
+    return h;
+}
+
+/*! \brief Step through the stored jobs.
+ *  \ingroup cnc_jobstore
+ *
+ * \param sector Start at 0; on return, where the next search starts
+ * \return the sector of the next job, or -1 after the last
+ */
+static inline int job_next(const uint8_t *region, int *sector) {
+    while (*sector < JOBSTORE_SECTORS) {
+        int here = (*sector)++;
+        const job_header_T *h = job_at(region, here);
+        if (h) {
+            *sector = here + job_sectors(h->length);
+            return here;
+        }
+    }
+    return -1;
+}
+
+/*! \brief Find a job by name.
+ *  \ingroup cnc_jobstore
+ *
+ * \return its first sector, or -1
+ */
+static inline int job_find(const uint8_t *region, const char *name) {
+    int sector = 0;
+    int found;
+    while ((found = job_next(region, &sector)) >= 0) {
+        if (strncmp(job_at(region, found)->name, name, JOB_NAME_SIZE) == 0) {
+            return found;
+        }
+    }
+    return -1;
+}
+
+/*! \brief First run of count sectors not used by any job.
+ *  \ingroup cnc_jobstore
+ *
+ * \return its first sector, or -1 if there is no such run
+ */
+static inline int job_free_run(const uint8_t *region, int count) {
+    int run_start = 0;
+    int sector = 0;
+    int found;
+    while ((found = job_next(region, &sector)) >= 0) {
+        if (found - run_start >= count) {
+            return run_start;
+        }
+        run_start = sector;
+    }
+    return JOBSTORE_SECTORS - run_start >= count ? run_start : -1;
+}
+
+#endif //  CC2511_JOBSTORE_H
@@ -0,0 +1,277 @@
+/** \file layout.h
+ *  \defgroup cnc_layout
+ *
+ * Header-only integer layout engine for the terminal UI.
+ *
+ * The screen is described as a tree of nodes. Each node takes a share
+ * of its parent's space in proportion to its weight, but never less than
+ * its minimum size; shares that would fall below a minimum are fixed at
+ * the minimum and the rest is shared again. The children of a node are
+ * placed side by side (LAYOUT_COLUMNS), one above the other
+ * (LAYOUT_ROWS), or side by side only if their minimum widths fit
+ * (LAYOUT_AUTO), so panels stack on a narrow terminal. Nodes with
+ * weight and no minimum make flexible margins and gaps that disappear
+ * first when space runs out.
+ *
+ * layout_solve() works out every rectangle with integer arithmetic. Run
+ * it when the window changes and keep the result; drawing then only
+ * reads the rectangles. Nothing in here touches the hardware.
+ */
+
+#ifndef CC2511_LAYOUT_H
+#define CC2511_LAYOUT_H
+
+#include <stdbool.h>
+
+#define LAYOUT_MAX_NODES 16
+
+typedef enum layout_flow {
+    LAYOUT_ROWS,        /* children one above the other */
+    LAYOUT_COLUMNS,     /* children side by side */
+    LAYOUT_AUTO         /* side by side if they fit, else stacked */
+}   layout_flow_T;
+
+typedef struct layout_rect {
+    int x;              /* left column (1-based) */
+    int y;              /* top row (1-based) */
+    int width;          /* columns */
+    int height;         /* rows */
+}   layout_rect_T;
+
+typedef struct layout_node {
+    int parent;         /* -1 for the root; parents are added before children */
+    layout_flow_T flow;
+    int weight;         /* share of the parent's space, 0 = minimum only */
+    int min_width;
+    int min_height;
+}   layout_node_T;
+
+typedef struct layout {
+    layout_node_T node[LAYOUT_MAX_NODES];
+    layout_rect_T rect[LAYOUT_MAX_NODES];   /* filled in by layout_solve() */
+    bool across[LAYOUT_MAX_NODES];          /* children were placed side by side */
+    int count;
+}   layout_T;
+
+/*! \brief Start an empty tree.
+ *  \ingroup cnc_layout
+ */
+static inline void layout_clear(layout_T *l) {
+    l->count = 0;
+}
+
+/*! \brief Add a node.
+ *  \ingroup cnc_layout
+ *
+ * \param parent Index returned for the containing node, -1 for the root
+ * \return index of the new node, -1 if the tree is full
+ */
+static inline int layout_add(layout_T *l, int parent, layout_flow_T flow, int weight,
+  int min_width, int min_height) {
+    if (l->count >= LAYOUT_MAX_NODES) {
+        return -1;
+    }
+    layout_node_T *n = &l->node[l->count];
+    n->parent = parent;
+    n->flow = flow;
+    n->weight = weight;
+    n->min_width = min_width;
+    n->min_height = min_height;
+    return l->count++;
+}
+
+static inline int layout_children(const layout_T *l, int node, int *children) {
+    int count = 0;
+    for (int i = node + 1; i < l->count; i++) {
+        if (l->node[i].parent == node) {
+            children[count++] = i;
+        }
+    }
+    return count;
+}
+
+/*! \brief Share total between weights, keeping every minimum.
+ *  \ingroup cnc_layout
+ *
+ * Cells left over from rounding go to the first weighted entries.
+ *
+ * \return false if the minimums alone do not fit
+ */
+static inline bool layout_distribute(int total, int count, const int *weight, const int *min, int *size) {
+    bool fixed[LAYOUT_MAX_NODES];
+    int spare = total;
+    int weights = 0;
+    for (int i = 0; i < count; i++) {
+        fixed[i] = weight[i] <= 0;
+        size[i] = min[i];
+        if (fixed[i]) {
+            spare -= min[i];
+        } else {
+            weights += weight[i];
+        }
+    }
+    // Fix anything whose share is below its minimum until the rest fit
+    bool changed = true;
+    while (changed && weights > 0) {
+        changed = false;
+        for (int i = 0; i < count; i++) {
+            if (!fixed[i] && spare * weight[i] / weights < min[i]) {
+                fixed[i] = true;
+                spare -= min[i];
+                weights -= weight[i];
+                changed = true;
+            }
+        }
+    }
+    if (spare < 0) {
+        return false;
+    }
+    int used = 0;
+    for (int i = 0; i < count; i++) {
+        if (!fixed[i]) {
+            size[i] = spare * weight[i] / weights;
+            used += size[i];
+        }
+    }
+    for (int i = 0; i < count && used < spare; i++) {
+        if (!fixed[i]) {
+            size[i]++;
+            used++;
+        }
+    }
+    return true;
+}
+
+/*! \brief Narrowest a node can be.
+ *  \ingroup cnc_layout
+ *
+ * \param wide Measure LAYOUT_AUTO nodes side by side rather than stacked
+ */
+static inline int layout_min_width(const layout_T *l, int node, bool wide) {
+    int children[LAYOUT_MAX_NODES];
+    int count = layout_children(l, node, children);
+    layout_flow_T flow = l->node[node].flow;
+    int width = 0;
+    for (int i = 0; i < count; i++) {
+        int child = layout_min_width(l, children[i], wide);
+        if (flow == LAYOUT_COLUMNS || (flow == LAYOUT_AUTO && wide)) {
+            width += child;
+        } else if (child > width) {
+            width = child;
+        }
+    }
+    return width > l->node[node].min_width ? width : l->node[node].min_width;
+}
+
+/* Whether the children of a node go side by side at this width */
+static inline bool layout_is_across(const layout_T *l, int node, int width) {
+    if (l->node[node].flow != LAYOUT_AUTO) {
+        return l->node[node].flow == LAYOUT_COLUMNS;
+    }
+    return layout_min_width(l, node, true) <= width;
+}
+
+/* Widths of the children of a node placed side by side. Room for
+   children to go side by side comes before flexible space; they are
+   only stacked when that does not fit. */
+static inline bool layout_widths(const layout_T *l, int width, int count, const int *children, int *size) {
+    int weight[LAYOUT_MAX_NODES];
+    int min[LAYOUT_MAX_NODES];
+    for (int i = 0; i < count; i++) {
+        weight[i] = l->node[children[i]].weight;
+        min[i] = layout_min_width(l, children[i], true);
+    }
+    if (layout_distribute(width, count, weight, min, size)) {
+        return true;
+    }
+    for (int i = 0; i < count; i++) {
+        min[i] = layout_min_width(l, children[i], false);
+    }
+    return layout_distribute(width, count, weight, min, size);
+}
+
+/*! \brief Shortest a node can be at a given width.
+ *  \ingroup cnc_layout
+ */
+static inline int layout_min_height(const layout_T *l, int node, int width) {
+    int children[LAYOUT_MAX_NODES];
+    int size[LAYOUT_MAX_NODES];
+    int count = layout_children(l, node, children);
+    int height = 0;
+    if (layout_is_across(l, node, width)) {
+        layout_widths(l, width, count, children, size);
+        for (int i = 0; i < count; i++) {
+            int child = layout_min_height(l, children[i], size[i]);
+            if (child > height) {
+                height = child;
+            }
+        }
+    } else {
+        for (int i = 0; i < count; i++) {
+            height += layout_min_height(l, children[i], width);
+        }
+    }
+    return height > l->node[node].min_height ? height : l->node[node].min_height;
+}
+
+static inline bool layout_place(layout_T *l, int node, layout_rect_T area) {
+    int children[LAYOUT_MAX_NODES];
+    int size[LAYOUT_MAX_NODES];
+    int count = layout_children(l, node, children);
+    bool fits = true;
+    l->rect[node] = area;
+    l->across[node] = layout_is_across(l, node, area.width);
+    if (count == 0) {
+        return true;
+    }
+    if (l->across[node]) {
+        fits = layout_widths(l, area.width, count, children, size);
+    } else {
+        int weight[LAYOUT_MAX_NODES];
+        int min[LAYOUT_MAX_NODES];
+        for (int i = 0; i < count; i++) {
+            weight[i] = l->node[children[i]].weight;
+            min[i] = layout_min_height(l, children[i], area.width);
+        }
+        fits = layout_distribute(area.height, count, weight, min, size);
+    }
+    layout_rect_T part = area;
+    for (int i = 0; i < count; i++) {
+        if (l->across[node]) {
+            part.width = size[i];
+        } else {
+            part.height = size[i];
+        }
+        fits = layout_place(l, children[i], part) && fits;
+        if (l->across[node]) {
+            part.x += size[i];
+        } else {
+            part.y += size[i];
+        }
+    }
+    return fits;
+}
+
+/*! \brief Work out the rectangle of every node.
+ *  \ingroup cnc_layout
+ *
+ * \param area Space for the root (node 0)
+ * \return false if the minimum sizes do not fit; nodes are then given
+ *         their minimums and run past the area
+ */
+static inline bool layout_solve(layout_T *l, layout_rect_T area) {
+    if (l->count == 0) {
+        return true;
+    }
+    bool fits = area.width >= layout_min_width(l, 0, false) && area.height >= layout_min_height(l, 0, area.width);
+    return layout_place(l, 0, area) && fits;
+}
+
+/*! \brief Offset that centres length cells in space cells (0 if it does not fit).
+ *  \ingroup cnc_layout
+ */
+static inline int layout_center(int space, int length) {
+    return space > length ? (space - length) / 2 : 0;
+}
+
+#endif //  CC2511_LAYOUT_H
@@ -0,0 +1,301 @@
+/** \file lineedit.h
+ *  \defgroup cnc_lineedit
+ *
+ * Header-only line editor for the command prompt.
+ *
+ * Keys are fed in one at a time from the main loop, never from the UART
+ * interrupt. The editor keeps the line and the cursor; drawing them is up
+ * to the caller, which redraws after every batch of keys.
+ *
+ *   Left/Right, Home/End, Ctrl-A/Ctrl-E   move the cursor
+ *   Backspace, Delete, Ctrl-U             delete back, forward, to the start
+ *   Up/Down                               step through the history ring
+ *   Tab                                   complete the first word
+ *   Page Up/Page Down                     passed back to the caller
+ *   Enter                                 finish the line (CR LF counts once)
+ *
+ * Cursor keys are the VT100/ANSI sequences ESC [ x and ESC O x sent by
+ * PuTTY, minicom and the like. Nothing in here touches the hardware.
+ */
+
+#ifndef CC2511_LINEEDIT_H
+#define CC2511_LINEEDIT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define LINEEDIT_SIZE    100    /* including the terminator */
+#define LINEEDIT_HISTORY 8      /* lines kept for Up/Down */
+
+/* lineedit_key() results */
+#define LINEEDIT_EDITING   0    /* keep going */
+#define LINEEDIT_DONE      1    /* Enter: text holds the finished line */
+#define LINEEDIT_AMBIGUOUS 2    /* Tab matched several words, see lineedit_matches() */
+#define LINEEDIT_PAGE_UP   3    /* Page Up, for the caller to scroll */
+#define LINEEDIT_PAGE_DOWN 4    /* Page Down */
+
+/* Completion candidates: the word at index, NULL past the last one */
+typedef const char *(*lineedit_words_T)(int index);
+
+typedef struct lineedit {
+    char text[LINEEDIT_SIZE];
+    int length;
+    int cursor;                             /* 0..length */
+    char history[LINEEDIT_HISTORY][LINEEDIT_SIZE];
+    int history_count;
+    int history_head;                       /* next slot to write */
+    int browse;                             /* history entry shown, -1 = new line */
+    char saved[LINEEDIT_SIZE];              /* new line put aside while browsing */
+    uint8_t escape;                         /* escape sequence state */
+    char escape_digit;
+    bool last_cr;                           /* swallow the LF of CR LF */
+    lineedit_words_T words;                 /* NULL = no completion */
+}   lineedit_T;
+
+enum { LINEEDIT_ESC_NONE, LINEEDIT_ESC_START, LINEEDIT_ESC_CSI, LINEEDIT_ESC_DIGIT };
+
+/*! \brief Empty the line, keeping the history.
+ *  \ingroup cnc_lineedit
+ */
+static inline void lineedit_reset(lineedit_T *e) {
+    e->text[0] = '\0';
+    e->length = 0;
+    e->cursor = 0;
+    e->browse = -1;
+    e->escape = LINEEDIT_ESC_NONE;
+}
+
+/*! \brief Start with an empty line and no history.
+ *  \ingroup cnc_lineedit
+ *
+ * \param words Tab completion candidates, or NULL
+ */
+static inline void lineedit_init(lineedit_T *e, lineedit_words_T words) {
+    e->history_count = 0;
+    e->history_head = 0;
+    e->last_cr = false;
+    e->words = words;
+    lineedit_reset(e);
+}
+
+static inline void lineedit_set(lineedit_T *e, const char *text) {
+    strncpy(e->text, text, LINEEDIT_SIZE - 1);
+    e->text[LINEEDIT_SIZE - 1] = '\0';
+    e->length = (int)strlen(e->text);
+    e->cursor = e->length;
+}
+
+/* History entry, 0 = newest */
+static inline const char *lineedit_history(const lineedit_T *e, int age) {
+    return e->history[(e->history_head - 1 - age + LINEEDIT_HISTORY) % LINEEDIT_HISTORY];
+}
+
+static inline void lineedit_remember(lineedit_T *e) {
+    if (e->length == 0 || (e->history_count > 0 && strcmp(lineedit_history(e, 0), e->text) == 0)) {
+        return;
+    }
+    memcpy(e->history[e->history_head], e->text, LINEEDIT_SIZE);
+    e->history_head = (e->history_head + 1) % LINEEDIT_HISTORY;
+    if (e->history_count < LINEEDIT_HISTORY) {
+        e->history_count++;
+    }
+}
+
+/* Up (older) or down (newer) through the history */
+static inline void lineedit_browse(lineedit_T *e, int step) {
+    int target = e->browse + step;
+    if (target >= e->history_count || target < -1) {
+        return;
+    }
+    if (e->browse == -1) {
+        memcpy(e->saved, e->text, LINEEDIT_SIZE);
+    }
+    e->browse = target;
+    lineedit_set(e, target == -1 ? e->saved : lineedit_history(e, target));
+}
+
+static inline void lineedit_insert(lineedit_T *e, char ch) {
+    if (e->length >= LINEEDIT_SIZE - 1) {
+        return;
+    }
+    memmove(&e->text[e->cursor + 1], &e->text[e->cursor], e->length - e->cursor + 1);
+    e->text[e->cursor++] = ch;
+    e->length++;
+}
+
+/* Remove count characters starting at from */
+static inline void lineedit_delete(lineedit_T *e, int from, int count) {
+    if (from < 0 || count <= 0 || from + count > e->length) {
+        return;
+    }
+    memmove(&e->text[from], &e->text[from + count], e->length - from - count + 1);
+    e->length -= count;
+    if (e->cursor > from) {
+        e->cursor = e->cursor >= from + count ? e->cursor - count : from;
+    }
+}
+
+/* Length of the word being typed, if the cursor is still in the first word */
+static inline int lineedit_first_word(const lineedit_T *e) {
+    for (int i = 0; i < e->cursor; i++) {
+        if (e->text[i] == ' ') {
+            return -1;
+        }
+    }
+    return e->cursor;
+}
+
+/*! \brief Complete the first word against the candidates.
+ *  \ingroup cnc_lineedit
+ *
+ * One match is completed with a space after it. Several are completed
+ * as far as they agree.
+ *
+ * \return number of candidates that match
+ */
+static inline int lineedit_complete(lineedit_T *e) {
+    int typed = lineedit_first_word(e);
+    if (!e->words || typed < 0) {
+        return 0;
+    }
+    const char *first = NULL;
+    int common = 0;
+    int matches = 0;
+    const char *word;
+    for (int i = 0; (word = e->words(i)) != NULL; i++) {
+        if (strncmp(word, e->text, typed) != 0) {
+            continue;
+        }
+        if (matches++ == 0) {
+            first = word;
+            common = (int)strlen(word);
+        } else {
+            int k = typed;
+            while (k < common && word[k] == first[k]) {
+                k++;
+            }
+            common = k;
+        }
+    }
+    for (int k = typed; k < common; k++) {
+        lineedit_insert(e, first[k]);
+    }
+    if (matches == 1 && e->text[e->cursor] != ' ') {
+        lineedit_insert(e, ' ');
+    }
+    return matches;
+}
+
+/*! \brief List the candidates matching the first word, space separated.
+ *  \ingroup cnc_lineedit
+ */
+static inline void lineedit_matches(const lineedit_T *e, char *out, size_t size) {
+    int typed = lineedit_first_word(e);
+    size_t used = 0;
+    out[0] = '\0';
+    const char *word;
+    for (int i = 0; e->words && typed >= 0 && (word = e->words(i)) != NULL; i++) {
+        size_t length = strlen(word);
+        if (strncmp(word, e->text, typed) != 0 || used + length + 2 > size) {
+            continue;
+        }
+        if (used > 0) {
+            out[used++] = ' ';
+        }
+        memcpy(&out[used], word, length + 1);
+        used += length;
+    }
+}
+
+/* Final byte of ESC [ x, ESC O x or ESC [ n ~ */
+static inline void lineedit_escape(lineedit_T *e, char final) {
+    switch (final) {
+        case 'A': lineedit_browse(e, 1); break;
+        case 'B': lineedit_browse(e, -1); break;
+        case 'C': if (e->cursor < e->length) e->cursor++; break;
+        case 'D': if (e->cursor > 0) e->cursor--; break;
+        case 'H': e->cursor = 0; break;
+        case 'F': e->cursor = e->length; break;
+        case '~':
+            switch (e->escape_digit) {
+                case '1': case '7': e->cursor = 0; break;
+                case '4': case '8': e->cursor = e->length; break;
+                case '3': lineedit_delete(e, e->cursor, 1); break;
+            }
+            break;
+    }
+}
+
+/*! \brief Feed one received key.
+ *  \ingroup cnc_lineedit
+ *
+ * \return LINEEDIT_EDITING, LINEEDIT_DONE, LINEEDIT_AMBIGUOUS or a page key
+ */
+static inline int lineedit_key(lineedit_T *e, char ch) {
+    bool after_cr = e->last_cr;
+    e->last_cr = ch == '\r';
+
+    switch (e->escape) {
+        case LINEEDIT_ESC_START:
+            e->escape = (ch == '[' || ch == 'O') ? LINEEDIT_ESC_CSI : LINEEDIT_ESC_NONE;
+            return LINEEDIT_EDITING;
+        case LINEEDIT_ESC_CSI:
+            if (ch >= '0' && ch <= '9') {
+                e->escape_digit = ch;
+                e->escape = LINEEDIT_ESC_DIGIT;
+                return LINEEDIT_EDITING;
+            }
+            e->escape = LINEEDIT_ESC_NONE;
+            lineedit_escape(e, ch);
+            return LINEEDIT_EDITING;
+        case LINEEDIT_ESC_DIGIT:
+            if (ch >= '0' && ch <= '9') {
+                return LINEEDIT_EDITING;            // longer parameters are not used
+            }
+            e->escape = LINEEDIT_ESC_NONE;
+            if (ch == '~' && (e->escape_digit == '5' || e->escape_digit == '6')) {
+                return e->escape_digit == '5' ? LINEEDIT_PAGE_UP : LINEEDIT_PAGE_DOWN;
+            }
+            lineedit_escape(e, ch);
+            return LINEEDIT_EDITING;
+    }
+
+    switch (ch) {
+        case '\n':
+            if (after_cr) {
+                return LINEEDIT_EDITING;
+            }
+            // fall through
+        case '\r':
+            lineedit_remember(e);
+            e->browse = -1;
+            return LINEEDIT_DONE;
+        case 0x1B:
+            e->escape = LINEEDIT_ESC_START;
+            return LINEEDIT_EDITING;
+        case 0x7F:
+        case '\b':
+            lineedit_delete(e, e->cursor - 1, 1);
+            return LINEEDIT_EDITING;
+        case '\t':
+            return lineedit_complete(e) > 1 ? LINEEDIT_AMBIGUOUS : LINEEDIT_EDITING;
+        case 0x01:                              // Ctrl-A
+            e->cursor = 0;
+            return LINEEDIT_EDITING;
+        case 0x05:                              // Ctrl-E
+            e->cursor = e->length;
+            return LINEEDIT_EDITING;
+        case 0x15:                              // Ctrl-U
+            lineedit_delete(e, 0, e->cursor);
+            return LINEEDIT_EDITING;
+        default:
+            if (ch >= ' ' && ch < 0x7F) {
+                lineedit_insert(e, ch);
+            }
+            return LINEEDIT_EDITING;
+    }
+}
+
+#endif //  CC2511_LINEEDIT_H
@@ -38,8 +38,34 @@
 #include "hardware/pwm.h"
 #include "hardware/uart.h"
 #include "hardware/irq.h"
+#include "hardware/sync.h"
+#include "hardware/dma.h"
+#include "hardware/clocks.h"
+#include "hardware/structs/systick.h"
+#include "hardware/flash.h"
+#include "pico/multicore.h"
 #include <string.h>
 #include "terminal.h"
+#include "screen.h"
+#include "telemetry.h"
+#include "stepper.h"
+#include "planner.h"
+#include "gcode.h"
+#include "ring.h"
+#include "stream.h"
+#include "motion.h"
+#include "homing.h"
+#include "proto.h"
+#include "command.h"
+#include "lineedit.h"
+#include "isrstat.h"
+#include "layout.h"
+#include "msglog.h"
+#include "jobstore.h"
+#include "pathopt.h"
+#include "prefab.h"
+#include "raster.h"
+#include "dryrun.h"
 #include <math.h>
 
 
@@ -53,6 +79,8 @@
 // UART using pins 0 and 1
 #define UART_TX_PIN 0
 #define UART_RX_PIN 1
+#define INPUT_BUFFER_SIZE 256   // typed bytes not yet edited, power of two
+#define TERM_QUERY_MS 250       // wait for the terminal to report its size
 
 //Stepper motors
 #define HOME_PIN_Z  2
@@ -68,7 +96,7 @@
 #define DIR_PIN_X   12  // 12
 
 #define ENABLE_PIN  14
-#define FAULT_PIN   15
+#define FAULT_PIN   15  // driver nFAULT, active low
 #define DECAY_PIN   16
 #define SLEEP_PIN   17
 #define RESET_PIN   18
@@ -77,11 +105,43 @@
 #define X_MAX 8000
 #define Y_MAX 5450
 #define Z_MAX 1800 //350 for spindle //1800 for nothing
-#define STEP_SLEEP 800
+#define DIR_SETUP_US 5                  // dir pin settle time before the first pulse
+#define STEP_ALARM_NUM 2                // hardware alarm used by core1 for step timing
+#define TELEMETRY_HZ 20                 // live position panel rate while moving
+#define TELEMETRY_MAX_HZ 100
+#define TELEMETRY_SHARE_PERCENT 10      // most of the UART the panel may use
+
+// Homing (steps/s, steps and ms). Limit switches pull the pin low.
+#define XY_HOME_SEEK_VELOCITY   1000
+#define XY_HOME_LOCATE_VELOCITY 100
+#define XY_HOME_TIMEOUT_MS      12000   // longer than a full-travel seek
+#define Z_HOME_SEEK_VELOCITY    500
+#define Z_HOME_LOCATE_VELOCITY  50
+#define Z_HOME_TIMEOUT_MS       6000
+#define HOME_PULLOFF_STEPS      50
+
+// Realtime bytes, acted on the moment they arrive
+#define RT_FEED_HOLD '!'
+#define RT_RESUME    '~'
+#define RT_ABORT     0x18               // Ctrl-X
 
 #define SPINDLE 22
 #define SPIN_MAX 255
 
+// Raster engraving feeds (steps/s): one feed when grey sets the depth,
+// or from light to dark pixels when grey sets the feed. The tool goes
+// into the material at the plunge feed, never at rapid.
+#define RASTER_FEED        1000
+#define RASTER_LIGHT_FEED  2000
+#define RASTER_DARK_FEED   200
+#define RASTER_PLUNGE_FEED 500
+
+// Job library in the last JOBSTORE_SIZE bytes of flash, clear of the program
+#define JOBSTORE_OFFSET (PICO_FLASH_SIZE_BYTES - JOBSTORE_SIZE)
+#define JOBSTORE_REGION ((const uint8_t*)(XIP_BASE + JOBSTORE_OFFSET))
+#define JOB_RECORD_SIZE 16384   // longest job "save" can record (bytes of moves)
+#define FLASH_XOFF_SETTLE_MS 5  // bytes the host sends after XOFF arrive within this
+
 
 #define LEN(arr) ((int) (sizeof (arr) / sizeof (arr)[0]))   //LEN(arr) for number of rows //LEN(arr[0]) for number of columns
 
@@ -98,8 +158,47 @@ typedef struct box {
     int y_origin;
     char *header;
     bool is_heading_centered;
+    int heading_x;              // set by place_box()
 }   box_T;
 
+// Panel sizes the layout must leave room for
+#define COORD_TEXT_WIDTH    15
+#define COORD_TEXT_HEIGHT   6   // x, y, z, spindle, feed, queue
+#define OPTION_WIDTH        26  // options box column width
+#define OPTION_MIN_ROWS     8
+#define INPUT_MIN_WIDTH     26
+
+// Where the render paths draw, worked out by layout_ui() on every resize
+typedef struct ui_geometry {
+    int coords_x, coords_y;             // first coordinate label
+    int options_x, options_y;           // first options entry
+    int options_rows;
+    int prompt_x, prompt_y;             // "> "
+    int input_x, input_y, input_width;  // line being typed
+    int output_x, output_y, output_width;
+    int output_rows;                    // log lines shown
+}   ui_geometry_T;
+
+layout_T layout;
+ui_geometry_T ui;
+
+// Everything is drawn into a shadow screen; update_screen() sends the changes
+screen_T screen;
+volatile bool binary_mode = false;  // host talks proto.h frames instead
+
+// Commands typed at the prompt (table below, indexed in main)
+command_table_T command_table;
+
+// The prompt line being typed
+lineedit_T editor;
+
+// Messages behind the Output box
+msglog_T output_log;
+uint32_t log_view_end = 0;      // number after the last message shown
+bool log_follow = true;         // keep the newest message in view
+uint32_t log_drawn_end = 0;     // log_view_end when the box was last drawn
+bool log_drawn = false;         // false: draw every line next time
+
 // declare boxes
 box_T win_box;
 box_T xyz_box;
@@ -108,74 +207,63 @@ box_T in_box;
 box_T out_box;
 
 void clear_ui() {
-    term_move_to(win_box.x_origin,win_box.y_origin);
-    term_set_color(clrBlack, clrBlack);
-    for (int i = 0; i < win_box.height + 1; i++)
-    {
-        for (int j = 0; j < win_box.width + 1; j++)
-        {
-            printf(" ");
-            if(j == win_box.width)   {
-                printf(" \r\n");
-            }
-        } 
-    }  
+    screen_clear(&screen, clrBlack);
 }
 
 // Draw heading
 void draw_heading(box_T b) {
     //set colour
-    term_set_color(clrBlack, clrGreen);
+    screen_set_color(&screen, clrBlack, clrGreen);
+    screen_move_to(&screen, b.heading_x, b.y_origin + 1); //1 line below top of box
+    screen_puts(&screen, b.header);
+}
 
-    int x_cursor_location; //set horizontal cursor
-    if(b.is_heading_centered)
+// Fit a box to a layout rectangle; boxes span height + 1 rows
+void place_box(box_T* b, layout_rect_T r, char* header, bool is_heading_centered) {
+    b->width = r.width;
+    b->height = r.height - 1;
+    b->x_origin = r.x;
+    b->y_origin = r.y;
+    b->header = header;
+    b->is_heading_centered = is_heading_centered;
+    if (is_heading_centered)
     {
-        x_cursor_location = round(((b.width+2)-strlen(b.header))/2) + b.x_origin; //set to center of window
+        b->heading_x = b->x_origin + layout_center(b->width, strlen(header));   //center of box
     }
     else
     {
-        x_cursor_location = b.x_origin + 2; //set left aligned
+        b->heading_x = b->x_origin + 2;     //left aligned
     }
-    int y_cursor_location = b.y_origin + 1; //set cursor to 1 line below top of box
-    
-    term_move_to(x_cursor_location, y_cursor_location);
-    printf(b.header);
 }
 
 void draw_box(box_T b)    {
     //set colour
-    term_set_color(clrGreen, clrBlack);
+    screen_set_color(&screen, clrGreen, clrBlack);
 
     //draw top border
-    term_move_to(b.x_origin, b.y_origin);
-    printf("+");
-    for (int i = 0; i < b.width - 2; i++)
-    {
-        printf("-");
-    }
-    printf("+");
+    screen_move_to(&screen, b.x_origin, b.y_origin);
+    screen_putc(&screen, '+');
+    screen_fill(&screen, '-', b.width - 2);
+    screen_putc(&screen, '+');
 
     //draw bottom border
-    term_move_to(b.x_origin, b.y_origin + b.height);
-    printf("+");
-    for (int i = 0; i < b.width - 2; i++)
-    {
-        printf("-");
-    }
-    printf("+");
+    screen_move_to(&screen, b.x_origin, b.y_origin + b.height);
+    screen_putc(&screen, '+');
+    screen_fill(&screen, '-', b.width - 2);
+    screen_putc(&screen, '+');
 
     //draw left border
     for (int i = 1; i < b.height; i++)
     {
-        term_move_to(b.x_origin, b.y_origin + i);
-        printf("|");
+        screen_move_to(&screen, b.x_origin, b.y_origin + i);
+        screen_putc(&screen, '|');
     }
 
     //draw right border
     for (int i = 1; i < b.height; i++)
     {
-        term_move_to(b.x_origin + b.width-1, b.y_origin + i);
-        printf("|");
+        screen_move_to(&screen, b.x_origin + b.width-1, b.y_origin + i);
+        screen_putc(&screen, '|');
     }
 
     if (b.header != "\0")
@@ -184,109 +272,226 @@ void draw_box(box_T b)    {
     }
 }
 
-// Clear input box
-void clr_input()     {
-    term_set_color(clrGreen, clrBlack);
-    int x_cursor = in_box.x_origin + 5;
-    int y_cursor = in_box.y_origin + 2;
-    term_move_to(x_cursor, y_cursor);
-    printf("                                                                    ");
-    term_move_to(x_cursor, y_cursor);
+// Draw the line being typed and leave the cursor where it is edited
+void draw_input()     {
+    screen_set_color(&screen, clrGreen, clrBlack);
+    int width = ui.input_width;
+    // Scroll sideways so the cursor stays in the box
+    int offset = MAX(0, editor.cursor - (width - 1));
+    screen_move_to(&screen, ui.input_x, ui.input_y);
+    screen_write(&screen, editor.text + offset, width);
+    screen_fill(&screen, ' ', width - MIN(editor.length - offset, width));
+    screen_move_to(&screen, ui.input_x + editor.cursor - offset, ui.input_y);
 }
-// Clear output box
-void clr_output()    {
-    term_set_color(clrGreen, clrBlack);
-    int x_cursor = out_box.x_origin + 2;
-    int y_cursor = out_box.y_origin + 2;
-    term_move_to(x_cursor, y_cursor);
-    printf("                                                                    ");
+// Draw one line of the Output box: message number, or blank if there is none
+void draw_log_line(int row, uint32_t number) {
+    const msglog_entry_T* entry = msglog_get(&output_log, number);
+    screen_move_to(&screen, ui.output_x, ui.output_y + row);
+    if (!entry)
+    {
+        screen_set_color(&screen, clrGreen, clrBlack);
+        screen_fill(&screen, ' ', ui.output_width);
+        return;
+    }
+    char line[MSGLOG_TEXT + 8];
+    msglog_stamp(entry, line, sizeof(line));
+    snprintf(line + strlen(line), sizeof(line) - strlen(line), " %s", entry->text);
+    term_color_T colours[] = {clrGreen, TERM_COLOR_256(214), clrRed};     // by msg_level_T; orange, or yellow on 8 colours
+    screen_set_color(&screen, colours[entry->level], clrBlack);
+    screen_write(&screen, line, ui.output_width);
+    screen_fill(&screen, ' ', ui.output_width - MIN((int)strlen(line), ui.output_width));
 }
 
-// Print to output box
-void print_output(char output[])  {
-    clr_output();
-    term_set_color(clrGreen, clrBlack);
-    int x_cursor = out_box.x_origin + 2;
-    int y_cursor = out_box.y_origin + 2;
-    term_move_to(x_cursor, y_cursor);
-    uart_puts(UART_ID, output);
-    clr_input();
-}
-
-const int coord_text_width = 9;
-const int coord_text_height = 4;
-// Print coordinates
-void print_coords(int coords[]) {
-    int normalised_coords[4];
-    int limits[4] = {X_MAX, Y_MAX, Z_MAX, SPIN_MAX};
-     for (int i = 0; i < 4; i++)
+// Draw the Output box. While following the newest message, messages
+// logged since the last draw scroll in at the bottom and nothing else is
+// drawn; paging or a new layout draws every line.
+void draw_log() {
+    int rows = ui.output_rows;
+    if (log_follow)
     {
-        normalised_coords[i] = round(((double)coords[i]/(double)limits[i])*100);    //wrong max value
+        log_view_end = output_log.written;
     }
-    
-    term_set_color(clrGreen, clrBlack);
-    //set cursor position
-    int x_cursor = round(((xyz_box.width+2) - coord_text_width)/2 + xyz_box.x_origin) + 4;
-    int y_cursor = round(((xyz_box.height+2) - coord_text_height)/2 + xyz_box.y_origin);
-    for (int i = 0; i < coord_text_height; i++)
+    uint32_t first = log_view_end > (uint32_t)rows ? log_view_end - rows : 0;
+    uint32_t added = log_view_end - log_drawn_end;
+    if (log_drawn && log_follow && log_view_end >= log_drawn_end && added < (uint32_t)rows)
     {
-        term_move_to(x_cursor, i + y_cursor);
-        if (normalised_coords[i] <= 9)
+        if (added > 0)
         {
-            printf("00%i %%", normalised_coords[i]);
+            screen_set_color(&screen, clrGreen, clrBlack);
+            screen_scroll(&screen, ui.output_y, ui.output_y + rows - 1, added);
         }
-        else if (normalised_coords[i] <= 99)
+        for (int row = rows - added; row < rows; row++)
         {
-            printf("0%i %%", normalised_coords[i]);
+            draw_log_line(row, first + row);
         }
-        else
+    }
+    else if (!log_drawn || log_view_end != log_drawn_end)
+    {
+        for (int row = 0; row < rows; row++)
         {
-            printf("%i %%", normalised_coords[i]);
+            draw_log_line(row, first + row);
         }
     }
-    clr_input();
+    log_drawn = true;
+    log_drawn_end = log_view_end;
+
+    // Count of newer messages on the bottom border while paged back
+    char more[16] = "";
+    if (!log_follow)
+    {
+        snprintf(more, sizeof(more), "[+%lu newer]", (unsigned long)(output_log.written - log_view_end));
+    }
+    int length = (int)strlen(more);
+    screen_set_color(&screen, clrGreen, clrBlack);
+    screen_move_to(&screen, out_box.x_origin + out_box.width - 2 - (int)sizeof(more), out_box.y_origin + out_box.height);
+    screen_fill(&screen, '-', (int)sizeof(more) - length);
+    screen_puts(&screen, more);
 }
 
-// Draw UI
-void draw_ui()  {
-    //the window is made up of a 9x9 grid
-    double width = win_box.width;
-    double height = win_box.height;
-    double x_grid_step = width/9;
-    double y_grid_step = height/9;
-
-    // Configure xyz box
-    xyz_box.width = round(2*x_grid_step);
-    xyz_box.height = round(3*y_grid_step);
-    xyz_box.x_origin = win_box.x_origin + round(1*x_grid_step);
-    xyz_box.y_origin = win_box.y_origin + round(1*y_grid_step);
-    xyz_box.header = "Coordinates";
-    xyz_box.is_heading_centered = true;
-
-    // Configure options box
-    opt_box.width = round(4*x_grid_step);
-    opt_box.height = xyz_box.height;                                  //equal height as xyz_box
-    opt_box.x_origin = win_box.x_origin + round(win_box.width - x_grid_step - opt_box.width);   //equal width as xyz_box
-    opt_box.y_origin = xyz_box.y_origin;                              //vertically aligned with xyz_box
-    opt_box.header = "Options";
-    opt_box.is_heading_centered = true;
-
-    // Configure input box
-    in_box.width = round(xyz_box.width + opt_box.width + x_grid_step);     //same width as left of xyz_box to right of opt_box
-    in_box.height = round(1.5*y_grid_step);                                  
-    in_box.x_origin = xyz_box.x_origin;                                     //aligned horizontally with xyz_box
-    in_box.y_origin = win_box.y_origin + round(xyz_box.height + 2*y_grid_step);                    
-    in_box.header = "Input";
-    in_box.is_heading_centered = false;
-
-    //Configure output box
-    out_box.width = in_box.width;                       //equal width as input box
-    out_box.height = in_box.height;                     //equal height as output box
-    out_box.x_origin = in_box.x_origin;                 //horizontally aligned with input box
-    out_box.y_origin = in_box.y_origin + in_box.height; //just below input box
-    out_box.header = "Output";
-    out_box.is_heading_centered = false;
+// Page the Output box back (negative) or forward through the log
+void scroll_log(int lines) {
+    uint32_t first = msglog_first(&output_log);
+    uint32_t written = output_log.written;
+    // The view cannot start before the oldest message still held
+    int64_t lowest = MIN((int64_t)written, (int64_t)first + ui.output_rows);
+    int64_t end = (int64_t)log_view_end + lines;
+    end = MAX(lowest, MIN(end, (int64_t)written));
+    log_view_end = (uint32_t)end;
+    log_follow = log_view_end == written;
+    draw_log();
+    draw_input();
+}
+
+// Log a message and show it in the Output box
+void log_output(msg_level_T level, const char* output) {
+    msglog_add(&output_log, (uint32_t)(time_us_64()/1000), level, output);
+    draw_log();
+    draw_input();
+}
+
+// Print to output box
+void print_output(char output[])  {
+    log_output(MSG_INFO, output);
+}
+
+void print_warning(char output[])  {
+    log_output(MSG_WARNING, output);
+}
+
+void print_error(char output[])  {
+    log_output(MSG_ERROR, output);
+}
+
+// Share of limit, rounded to the nearest percent
+int percent_of(int value, int limit) {
+    int scaled = 200*value/limit;
+    return (scaled + (scaled < 0 ? -1 : 1))/2;
+}
+
+// Print coordinates in steps, with the share of travel used
+void print_coords(int coords[]) {
+    int limits[4] = {X_MAX, Y_MAX, Z_MAX, SPIN_MAX};
+
+    screen_set_color(&screen, clrGreen, clrBlack);
+    for (int i = 0; i < 4; i++)
+    {
+        screen_move_to(&screen, ui.coords_x + 4, i + ui.coords_y);
+        screen_printf(&screen, "%6d %3d%%", coords[i], percent_of(coords[i], limits[i]));
+    }
+    draw_input();
+}
+
+// Print path speed (steps/s) and the moves and pulses still queued
+void print_motion_status(int feed, int queued) {
+    screen_set_color(&screen, clrGreen, clrBlack);
+    screen_move_to(&screen, ui.coords_x + 4, ui.coords_y + 4);
+    screen_printf(&screen, "%6d /s  ", feed);
+    screen_move_to(&screen, ui.coords_x + 4, ui.coords_y + 5);
+    screen_printf(&screen, "%6d     ", queued);
+    draw_input();
+}
+
+// Entries in the options box: the command table, then the realtime keys
+int list_options(const char* options[]) {
+    int count = 0;
+    for (int i = 0; i < command_table.count; i++)
+    {
+        if (command_table.commands[i].summary)
+        {
+            options[count++] = command_table.commands[i].summary;
+        }
+    }
+    options[count++] = "! ~ ^X - hold/resume/abort";
+    return count;
+}
+
+/*
+    Work out where every box and field goes for the current win_box. The
+    panels keep the proportions of the original 9x9 grid (weights are in
+    half grid steps) while there is room; margins shrink first, then the
+    panels down to their minimums, and the Coordinates and Options boxes
+    stack when they no longer fit side by side. Returns false if the
+    window is too small, leaving the rectangles unusable.
+*/
+bool layout_ui() {
+    const char* options[COMMAND_HASH_SIZE + 1];
+    int num_of_options = list_options(options);
+    int option_columns = (num_of_options + OPTION_MIN_ROWS - 1)/OPTION_MIN_ROWS;
+
+    layout_clear(&layout);
+    int root = layout_add(&layout, -1, LAYOUT_COLUMNS, 0, 0, 0);
+    layout_add(&layout, root, LAYOUT_ROWS, 2, 0, 0);                           // left margin
+    int content = layout_add(&layout, root, LAYOUT_ROWS, 14, 0, 0);
+    layout_add(&layout, root, LAYOUT_ROWS, 2, 0, 0);                           // right margin
+    layout_add(&layout, content, LAYOUT_ROWS, 2, 0, 0);                        // top margin
+    int panels = layout_add(&layout, content, LAYOUT_AUTO, 6, 0, 0);
+    layout_add(&layout, content, LAYOUT_ROWS, 2, 0, 0);                        // gap
+    int input = layout_add(&layout, content, LAYOUT_ROWS, 2, INPUT_MIN_WIDTH, 4);
+    int output = layout_add(&layout, content, LAYOUT_ROWS, 4, INPUT_MIN_WIDTH, 4);     // log lines
+    layout_add(&layout, content, LAYOUT_ROWS, 2, 0, 0);                        // bottom margin
+    int coords = layout_add(&layout, panels, LAYOUT_ROWS, 4, COORD_TEXT_WIDTH + 4, COORD_TEXT_HEIGHT + 4);
+    layout_add(&layout, panels, LAYOUT_ROWS, 2, 1, 1);                         // gap
+    int opts = layout_add(&layout, panels, LAYOUT_ROWS, 8, option_columns*OPTION_WIDTH + 2, OPTION_MIN_ROWS + 4);
+
+    // Inside the window border, below its heading
+    layout_rect_T area = {win_box.x_origin + 1, win_box.y_origin + 2, win_box.width - 2, win_box.height - 2};
+    if (!layout_solve(&layout, area))
+    {
+        return false;
+    }
+    place_box(&win_box, (layout_rect_T){win_box.x_origin, win_box.y_origin, win_box.width, win_box.height + 1},
+              win_box.header, win_box.is_heading_centered);
+    place_box(&xyz_box, layout.rect[coords], "Coordinates", true);
+    place_box(&opt_box, layout.rect[opts], "Options", true);
+    place_box(&in_box, layout.rect[input], "Input", false);
+    place_box(&out_box, layout.rect[output], "Output", false);
+
+    // Contents sit between the heading and the bottom border
+    layout_rect_T r = layout.rect[coords];
+    ui.coords_x = r.x + layout_center(r.width, COORD_TEXT_WIDTH);
+    ui.coords_y = r.y + 2 + layout_center(r.height - 3, COORD_TEXT_HEIGHT);
+    r = layout.rect[opts];
+    ui.options_rows = MIN(num_of_options, r.height - 4);
+    int columns = (num_of_options + ui.options_rows - 1)/ui.options_rows;
+    ui.options_x = r.x + layout_center(r.width, columns*OPTION_WIDTH);
+    ui.options_y = r.y + 2 + layout_center(r.height - 3, ui.options_rows);
+    r = layout.rect[input];
+    ui.prompt_x = r.x + 3;
+    ui.prompt_y = r.y + 2;
+    ui.input_x = r.x + 5;
+    ui.input_y = r.y + 2;
+    ui.input_width = r.width - 6;
+    r = layout.rect[output];
+    ui.output_x = r.x + 2;
+    ui.output_y = r.y + 2;
+    ui.output_width = r.width - 4;
+    ui.output_rows = r.height - 3;
+    log_drawn = false;
+    return true;
+}
 
+// Draw UI, laid out by layout_ui()
+void draw_ui()  {
     // Draw UI frame
     clear_ui();
     draw_box(win_box);
@@ -296,41 +501,45 @@ void draw_ui()  {
     draw_box(out_box);
 
     // Draw coord box contents
-    term_set_color(clrGreen, clrBlack);
-    int x_cursor = round(((xyz_box.width+2) - coord_text_width)/2 + xyz_box.x_origin);
-    int y_cursor = round(((xyz_box.height+2) - coord_text_height)/2 + xyz_box.y_origin);
-    char xyz[] = {'x', 'y', 'z', 's'};
-    for (int i = 0; i < coord_text_height; i++)
+    screen_set_color(&screen, clrGreen, clrBlack);
+    char xyz[] = {'x', 'y', 'z', 's', 'f', 'q'};
+    for (int i = 0; i < COORD_TEXT_HEIGHT; i++)
     {
-        term_move_to(x_cursor, i + y_cursor);
-        printf("%c : ", xyz[i]);
+        screen_move_to(&screen, ui.coords_x, i + ui.coords_y);
+        screen_printf(&screen, "%c : ", xyz[i]);
     }
 
-    // Draw options box contents
-    
-    char options[7][26] = {"move - manual control", "home - move to [0 0 0]", "load - load prefab", "zero - set to [0 0 0]", "setz - set spindle height", "resize - resize Window", "spin - set spindle on/off"};
-    int num_of_options = LEN(options);
-    int max_length = LEN(options[0]);
-    x_cursor = round(((opt_box.width+2) - max_length)/2 + opt_box.x_origin);
-    y_cursor = round(((opt_box.height+2) - num_of_options)/2 + opt_box.y_origin);
+    // Draw options box contents, in columns when the list is taller than the box
+    const char* options[COMMAND_HASH_SIZE + 1];
+    int num_of_options = list_options(options);
     for (int i = 0; i < num_of_options; i++)
     {
-      term_move_to(x_cursor, y_cursor + i);
-      printf(options[i]);
+      screen_move_to(&screen, ui.options_x + (i/ui.options_rows)*OPTION_WIDTH, ui.options_y + i%ui.options_rows);
+      screen_puts(&screen, options[i]);
     }
     
     // Print coordinates
     int zero[4] = {0, 0, 0, 0};
     print_coords(zero);
+    print_motion_status(0, 0);
 
     // Draw input ready
-    x_cursor = in_box.x_origin + 3;
-    y_cursor = in_box.y_origin + 2;
-    term_move_to(x_cursor, y_cursor);
-    printf("> ");
+    screen_move_to(&screen, ui.prompt_x, ui.prompt_y);
+    screen_puts(&screen, "> ");
+
+    draw_log();
+    draw_input();
+}
 
-    print_output("Ready for commands...\n");
-    clr_input();
+// Send whatever changed on screen since the last update
+void update_screen() {
+    // In binary mode the host reads frames only
+    if (binary_mode)
+    {
+        return;
+    }
+    screen_present(&screen);
+    term_flush();
 }
 
 /*
@@ -345,287 +554,2329 @@ int y_current_position = 0;
 int z_current_position = 0;
 
 // uart stuff
-static int chars_rxed = 0;
-volatile char buffer [100];
-volatile unsigned int myIndex = 0; 
-volatile bool input_ready = false;
-
-// Write character
-void send_ch(char ch)   {
-    if(uart_is_writable(UART_ID))   {
-        uart_putc(UART_ID, ch);
+#define UART_RX_FIFO_LEVEL 2    // RX interrupt at 16 of 32 bytes; the timeout catches the rest
+
+// RX interrupt timing, read with interrupts disabled (see isr_snapshot)
+isr_stats_T uart_isr_stats;
+
+// Typed bytes wait here for the line editor, which runs in the main loop
+uint8_t input_storage[INPUT_BUFFER_SIZE];
+ring_T input_ring;
+char input_line[LINEEDIT_SIZE];         // last line entered
+
+// Streamed jobs: bytes go straight into a ring instead of the line editor
+uint8_t stream_storage[STREAM_BUFFER_SIZE];
+ring_T stream_ring;
+volatile bool stream_mode = false;
+volatile bool stream_paused = false;        // XOFF sent
+bool stream_ack = false;                    // answer every line with ok/error
+volatile uint32_t stream_lines_in = 0;      // line ends received
+uint32_t stream_lines_out = 0;              // line ends consumed
+volatile uint32_t stream_overruns = 0;      // bytes dropped on a full ring
+
+// Raster engraving: the stream carries image rows instead of G-code
+bool raster_mode = false;
+bool raster_by_feed = false;                // grey sets the feed, not the depth
+int raster_width;                           // pixels in a row
+int raster_pitch;                           // steps between pixels
+int raster_origin[2];                       // x, y of the first row's left edge
+uint32_t raster_rows;                       // rows engraved
+uint32_t raster_runs;                       // cuts made
+
+// Binary protocol: frames are decoded as they arrive and run in order
+proto_decoder_T proto_decoder;
+proto_queue_T proto_queue;
+volatile uint32_t proto_bad_frames = 0;     // failed COBS or CRC
+volatile uint32_t proto_dropped = 0;        // frames lost on a full queue
+
+// Store a streamed byte and pause the sender when the ring fills up
+void stream_rx(uint8_t ch) {
+    if (!ring_push(&stream_ring, ch))
+    {
+        stream_overruns++;
+        return;
     }
-}
-
-// RX interrupt handler
-void on_uart_rx() {
-    while (uart_is_readable(UART_ID)) {
-        uint8_t ch = uart_getc(UART_ID);
-        // Echo back the character received
-        send_ch(ch);
-        // Detect character
-        switch (ch) {
-            // Check if 'Enter' is pressed
-            case '\n':                          
-                buffer[myIndex] = 0;
-                myIndex = 0;
-                input_ready = true;
-                break;
-            case '\r':
-                buffer[myIndex] = 0;
-                clr_input();
-                myIndex = 0;
-                input_ready = true;
-                break;
-            // Backspace handling
-            case '\177':                        
-                if (myIndex > 0) {
-                    myIndex--;
-                    buffer[myIndex] = '\000';
-                }
-                break;
-            // Save the character to buffer
-            default:
-                if (myIndex <= 98)  {           
-                    buffer[myIndex] = ch;      
-                    myIndex++; 
-                }
-        }
-        chars_rxed++;
+    if (ch == '\n' || ch == '\r')
+    {
+        stream_lines_in++;
+    }
+    if (stream_should_pause(&stream_ring, stream_paused))
+    {
+        stream_paused = true;
+        uart_putc_raw(UART_ID, STREAM_XOFF);
     }
 }
 
-void init_pin(uint pin, bool direction) {
-    gpio_init(pin);
-    gpio_set_dir(pin, direction);
-}
-
-// Define axis struct
-typedef struct axis {
-    int current_position;
-    int target_position;
-    int min_position;
-    int max_position;
-    int steps_to_move; 
-    uint step_pin;
-    uint dir_pin;
-} axis_T;
-
-// declare axes
-axis_T x;
-axis_T y;
-axis_T z;
-
-void move_z_motor(axis_T* z)    {
-    // Set direction
-    gpio_put(z->dir_pin, z->steps_to_move > 0);  
-        
-    // Disregard sign
-    z->steps_to_move = abs(z->steps_to_move);
-
-    // Move motor
-    for (int i = 0; i < z->steps_to_move; i++) {
-        gpio_put(z->step_pin, true);
-        sleep_us(STEP_SLEEP);
-        gpio_put(z->step_pin, false);
-        sleep_us(STEP_SLEEP);
-    }
+// Terminal output is sent by DMA so drawing does not wait on the UART
+int term_dma_channel;
+char term_dma_buffer[TERM_BUFFER_SIZE];
 
-    // Set current position to original target position
-    z->current_position = z->target_position;
-    z->steps_to_move = 0;
+void term_dma_write(const char* data, size_t length) {
+    // The previous chunk must be out before its buffer is reused
+    dma_channel_wait_for_finish_blocking(term_dma_channel);
+    memcpy(term_dma_buffer, data, length);
+    dma_channel_transfer_from_buffer_now(term_dma_channel, term_dma_buffer, length);
+}
 
-    // Output message
-    char message[50];
-    snprintf(message, sizeof(message), "Moved to position: %d\n", z->current_position);
-    print_output(message);
+void init_term_dma() {
+    term_dma_channel = dma_claim_unused_channel(true);
+    dma_channel_config config = dma_channel_get_default_config(term_dma_channel);
+    channel_config_set_transfer_data_size(&config, DMA_SIZE_8);
+    channel_config_set_read_increment(&config, true);
+    channel_config_set_write_increment(&config, false);
+    channel_config_set_dreq(&config, uart_get_dreq(UART_ID, true));
+    dma_channel_configure(term_dma_channel, &config, &uart_get_hw(UART_ID)->dr, term_dma_buffer, 0, false);
+    term_set_writer(term_dma_write);
 }
 
-// Generalized function to move motor to a target position
-void move_to_position(axis_T* x, axis_T* y, axis_T* z) {
-    if (x->target_position < x->min_position || x->target_position > x->max_position) {
-        char message[50];
-        sprintf(message, "Error: x position out of bounds (0-%d).", X_MAX);
-        print_output(message);
+// Feed hold, resume and abort (defined with the motion commands)
+bool realtime_command(uint8_t ch);
+
+// Decode a binary byte. Hold, resume and abort frames act at once; every
+// frame is then queued so the main loop answers them in order.
+void binary_rx(uint8_t ch) {
+    proto_frame_T frame;
+    int result = proto_decode_byte(&proto_decoder, ch, &frame);
+    if (result == PROTO_BAD)
+    {
+        proto_bad_frames++;
         return;
     }
-    if (y->target_position < y->min_position || y->target_position > y->max_position) {
-        char message[50];
-        sprintf(message, "Error: y position out of bounds (0-%d).", Y_MAX);
-        print_output(message);
+    if (result != PROTO_FRAME)
+    {
         return;
     }
-    if (z->target_position < z->min_position || z->target_position > z->max_position) {
-        char message[50];
-        sprintf(message, "Error: z position out of bounds (0-%d).", Z_MAX);
-        print_output(message);
-        return;
+    switch (frame.type)
+    {
+        case PROTO_HOLD:
+            realtime_command(RT_FEED_HOLD);
+            break;
+        case PROTO_RESUME:
+            realtime_command(RT_RESUME);
+            break;
+        case PROTO_ABORT:
+            realtime_command(RT_ABORT);
+            break;
     }
+    if (!proto_queue_push(&proto_queue, &frame))
+    {
+        proto_dropped++;
+    }
+}
 
-    // Calculate steps to move
-    x->steps_to_move = x->target_position - x->current_position;
-    y->steps_to_move = y->target_position - y->current_position;
-    z->steps_to_move = z->target_position - z->current_position;
+// RX interrupt handler. The FIFO interrupts when half full or when the
+// line has gone quiet, and every waiting byte is taken in one go.
+void on_uart_rx() {
+    uint32_t start = systick_hw->cvr;
+    uart_hw_t* hw = uart_get_hw(UART_ID);
+    uint32_t count = 0;
+    while (!(hw->fr & UART_UARTFR_RXFE_BITS)) {
+        uint32_t data = hw->dr;
+        uint8_t ch = (uint8_t)data;
+        count++;
+        if (data & UART_UARTDR_OE_BITS)
+        {
+            uart_isr_stats.overruns++;
+        }
+        // Frames can hold any byte value, so nothing else looks at them
+        if (binary_mode)
+        {
+            binary_rx(ch);
+            continue;
+        }
+        // Realtime bytes never reach the line editor or the stream
+        if (realtime_command(ch))
+        {
+            continue;
+        }
+        // Streamed jobs bypass echo and editing
+        if (stream_mode)
+        {
+            stream_rx(ch);
+            continue;
+        }
+        // Typed input: echo and editing happen in the main loop
+        ring_push(&input_ring, ch);
+    }
+    isr_stats_add(&uart_isr_stats, isr_cycles(start, systick_hw->cvr), count);
+}
 
-    // Do nothing if already at position
-    if (x->steps_to_move == 0 && y->steps_to_move == 0 && z->steps_to_move == 0)
+// Consistent copy of the RX interrupt timing
+void isr_snapshot(isr_stats_T* copy, bool reset) {
+    uint32_t irq_state = save_and_disable_interrupts();
+    *copy = uart_isr_stats;
+    if (reset)
     {
-        print_output("Already at the target position.\n");
-        return;
+        isr_stats_reset(&uart_isr_stats);
     }
-    
-    // Do z motor first if raising spindle
-    if (z->steps_to_move != 0 & z->current_position != 0)
+    restore_interrupts(irq_state);
+}
+
+// Feed typed keys to the line editor. True once a line has been entered;
+// it is left in input_line.
+bool read_input() {
+    uint8_t ch;
+    bool changed = false;
+    while (ring_pop(&input_ring, &ch))
+    {
+        changed = true;
+        int result = lineedit_key(&editor, ch);
+        if (result == LINEEDIT_DONE)
+        {
+            memcpy(input_line, editor.text, LINEEDIT_SIZE);
+            lineedit_reset(&editor);
+            // Back to the newest messages to see what the line does
+            if (!log_follow)
+            {
+                scroll_log(output_log.written - log_view_end);
+            }
+            draw_input();
+            return true;
+        }
+        if (result == LINEEDIT_AMBIGUOUS)
+        {
+            char matches[69];
+            lineedit_matches(&editor, matches, sizeof(matches));
+            print_output(matches);
+        }
+        // Page through the Output box, keeping a line of overlap
+        if (result == LINEEDIT_PAGE_UP || result == LINEEDIT_PAGE_DOWN)
+        {
+            int page = MAX(1, ui.output_rows - 1);
+            scroll_log(result == LINEEDIT_PAGE_UP ? -page : page);
+        }
+    }
+    if (changed)
     {
-        move_z_motor(z);
-        // Set current position to original target position
-        z->current_position = z->target_position;
+        draw_input();
     }
-    
-    // Set direction
-    gpio_put(x->dir_pin, x->steps_to_move > 0);  
-    gpio_put(y->dir_pin, y->steps_to_move > 0);
+    return false;
+}
 
-    // Disregard sign
-    x->steps_to_move = abs(x->steps_to_move);
-    y->steps_to_move = abs(y->steps_to_move);
+// Ask the terminal for its size: CSI 18 t first, then the cursor position
+// report. xterm is set if the first was answered, which goes with 256
+// colours on the terminals that have it (xterm, PuTTY). Keys typed while
+// waiting are dropped. Returns false if neither was answered.
+bool ask_terminal(int* columns, int* rows, bool* xterm) {
+    term_reply_T reply;
+    term_reply_init(&reply);
+    for (int attempt = 0; attempt < 2; attempt++)
+    {
+        if (attempt == 0)
+        {
+            term_query_size();
+        }
+        else
+        {
+            term_query_cursor();
+        }
+        term_flush();
+        uint64_t deadline = time_us_64() + TERM_QUERY_MS*1000;
+        while (time_us_64() < deadline)
+        {
+            uint8_t ch;
+            if (!ring_pop(&input_ring, &ch) || term_reply_byte(&reply, ch) != TERM_REPLY_DONE)
+            {
+                continue;
+            }
+            if (reply.final == 't' && reply.count == 3 && reply.value[0] == 8)
+            {
+                *rows = reply.value[1];
+                *columns = reply.value[2];
+                *xterm = true;
+                return true;
+            }
+            if (reply.final == 'R' && reply.count == 2)
+            {
+                *rows = reply.value[0];
+                *columns = reply.value[1];
+                *xterm = false;
+                return true;
+            }
+        }
+    }
+    return false;
+}
 
-    // N = MIN(delta_x, delta_y)/MIN_STEP
-    double num_of_increments;
-    if (x->steps_to_move == 0)
+// Fill the terminal with the window if it reports its size, and use 256
+// colours if it looks like xterm. Keeps the current window otherwise.
+bool fit_terminal() {
+    int columns, rows;
+    bool xterm;
+    if (!ask_terminal(&columns, &rows, &xterm) || columns < 1 || rows < 2)
     {
-        num_of_increments = y->steps_to_move;
+        return false;
     }
-    else if (y->steps_to_move == 0)
+    term_set_palette(xterm);
+    box_T previous = win_box;
+    win_box.x_origin = 1;
+    win_box.y_origin = 1;
+    win_box.width = MIN(columns, SCREEN_COLS);
+    win_box.height = MIN(rows, SCREEN_ROWS) - 1;    // the box spans height + 1 rows
+    if (!layout_ui())
     {
-        num_of_increments = x->steps_to_move;
+        win_box = previous;
+        layout_ui();
+        return false;
     }
-    else    {
-        num_of_increments = MIN(x->steps_to_move, y->steps_to_move);
+    return true;
+}
+
+void init_pin(uint pin, bool direction) {
+    gpio_init(pin);
+    gpio_set_dir(pin, direction);
+}
+
+/*
+###############################################################
+                        STEP GENERATION
+        Runs on core1: the timer alarm and everything feeding it
+###############################################################
+*/
+// Step engine, fed by the motion core and drained by a timer alarm
+stepper_T stepper;
+alarm_pool_t* step_alarm_pool;
+
+const uint step_pins[STEPPER_NUM_AXES] = {STEP_PIN_X, STEP_PIN_Y, STEP_PIN_Z};
+const uint dir_pins[STEPPER_NUM_AXES] = {DIR_PIN_X, DIR_PIN_Y, DIR_PIN_Z};
+const uint home_pins[STEPPER_NUM_AXES] = {HOME_PIN_X, HOME_PIN_Y, HOME_PIN_Z};
+uint32_t axis_pin_mask = 0;
+
+// Commands from core0 and abort request
+motion_queue_T motion_queue;
+volatile bool motion_abort = false;     // set by core0, cleared by core1 when done
+volatile bool motion_active = false;    // core1 is working on a command
+volatile bool abort_requested = false;  // Ctrl-X or driver fault, handled by service_realtime
+
+// Drive all step and dir pins in a single write
+static inline void write_axis_pins(uint8_t step_bits, uint8_t dir_bits) {
+    uint32_t value = 0;
+    for (int i = 0; i < STEPPER_NUM_AXES; i++)
+    {
+        if (step_bits & (1U << i))
+        {
+            value |= 1U << step_pins[i];
+        }
+        if (dir_bits & (1U << i))
+        {
+            value |= 1U << dir_pins[i];
+        }
     }
+    gpio_put_masked(axis_pin_mask, value);
+}
 
-    double dx = (double)x->steps_to_move/num_of_increments;
-    double dy = (double)y->steps_to_move/num_of_increments;
+// Timer alarm: one call per pulse edge
+int64_t step_alarm_callback(alarm_id_t id, void *user_data) {
+    uint32_t delay = stepper_tick(&stepper);
+    write_axis_pins(stepper.step_bits, stepper.dir_bits);
+    // Negative delay reschedules relative to the last target, so no drift
+    return delay == 0 ? 0 : -(int64_t)delay;
+}
 
-    
+// Start the alarm if the engine is stopped and has work queued
+void stepper_kick() {
+    uint32_t irq_state = save_and_disable_interrupts();
+    if (stepper_start(&stepper))
+    {
+        write_axis_pins(stepper.step_bits, stepper.dir_bits);
+        alarm_pool_add_alarm_in_us(step_alarm_pool, DIR_SETUP_US, step_alarm_callback, NULL, true);
+    }
+    restore_interrupts(irq_state);
+}
 
-    double last_x_position = 0;
-    double last_y_position = 0;
+// Queue one pulse slot, waiting for room if the queue is full
+// Returns false if an abort was requested while waiting
+bool queue_step(uint8_t step_mask, uint8_t dir_mask, uint32_t interval_us) {
+    while (!stepper_push(&stepper, step_mask, dir_mask, interval_us))
+    {
+        if (motion_abort)
+        {
+            return false;
+        }
+        stepper_kick();
+        __wfe();  // Wait for the alarm to free a slot, or a resume from core0
+    }
+    stepper_kick();
+    return !motion_abort;
+}
 
-    for (int N = 0; N < (int)num_of_increments; N++)
+void init_stepper() {
+    for (int i = 0; i < STEPPER_NUM_AXES; i++)
     {
-        double target_x_position = N*dx;
-        double target_y_position = N*dy;
+        axis_pin_mask |= (1U << step_pins[i]) | (1U << dir_pins[i]);
+    }
+    stepper_init(&stepper);
+    motion_queue_init(&motion_queue);
+}
 
-        int actual_dx = round(target_x_position - last_x_position);
-        int actual_dy = round(target_y_position - last_y_position);
+// Moves waiting in the look-ahead buffer
+planner_T planner;
 
-        last_x_position = last_x_position + actual_dx;
-        last_y_position = last_y_position + actual_dy;
+// Homing settings per axis; every switch sits at the zero end
+const homing_axis_T homing_config[STEPPER_NUM_AXES] = {
+    {XY_HOME_SEEK_VELOCITY, XY_HOME_LOCATE_VELOCITY, HOME_PULLOFF_STEPS, XY_HOME_TIMEOUT_MS, false},
+    {XY_HOME_SEEK_VELOCITY, XY_HOME_LOCATE_VELOCITY, HOME_PULLOFF_STEPS, XY_HOME_TIMEOUT_MS, false},
+    {Z_HOME_SEEK_VELOCITY, Z_HOME_LOCATE_VELOCITY, HOME_PULLOFF_STEPS, Z_HOME_TIMEOUT_MS, false}
+};
+volatile homing_phase_T home_result[STEPPER_NUM_AXES];   // outcome of the last cycle per axis
 
-        // Find maximum steps out of x and y axis
-        int max_steps = MAX(actual_dx, actual_dy);
+bool home_switch(int axis) {
+    return !gpio_get(home_pins[axis]);
+}
 
-        // Move x and y motors simultaneously
-        for (int i = 0; i < max_steps; i++) {
-            // Turn x stepper motor on
-            if (i < actual_dx)
-            {
-                gpio_put(x->step_pin, true);
-            }
-            // Turn y stepper motor on
-            if (i < actual_dy)
+// Run the homing cycle on one axis and make where it stops machine zero
+void home_axis(int axis) {
+    homing_T homing;
+    bool forwards;
+    uint32_t interval;
+    homing_start(&homing, &homing_config[axis], home_switch(axis));
+    while (homing_next(&homing, home_switch(axis), &forwards, &interval))
+    {
+        if (!queue_step(1U << axis, forwards ? 1U << axis : 0, interval))
+        {
+            home_result[axis] = HOMING_ABORTED;
+            return;
+        }
+        // One step at a time so the switch is read after every pulse
+        while (!stepper_idle(&stepper))
+        {
+            if (motion_abort)
             {
-                gpio_put(y->step_pin, true);
+                home_result[axis] = HOMING_ABORTED;
+                return;
             }
-            // Turn motor off after a duration
-            sleep_us(STEP_SLEEP);
-            gpio_put(x->step_pin, false);
-            gpio_put(y->step_pin, false);
-            sleep_us(STEP_SLEEP);
-        } 
+            stepper_kick();
+            tight_loop_contents();
+        }
     }
-    
-    // Set current position to original target position
-    x->current_position = x->target_position;
-    y->current_position = y->target_position;
-
-    // Set steps to move to 0
-    x->steps_to_move = 0;
-    y->steps_to_move = 0;
-    
-    // Do z motor last if lowering spindle
-    if (z->steps_to_move != 0 & z->current_position == 0)
+    if (homing.phase == HOMING_DONE)
     {
-        move_z_motor(z);
-        // Set current position to original target position
-        z->current_position = z->target_position;
+        stepper.position[axis] = 0;
     }
-
-    char message[50];
-    snprintf(message, sizeof(message), "Moved to position: x %d, y %d, z %d\n", x->current_position, y->current_position, z->current_position);
-    print_output(message);
+    home_result[axis] = homing.phase;
 }
 
-void print_sequence(int sequence[][3], int sequence_length, axis_T* x, axis_T* y, axis_T* z, int spindle_speed)    {
-    for (int i = 0; i < sequence_length; i++)
+// Turn one planned segment into queued pulses (the dry run walks the same slots)
+void emit_segment(const segment_T* seg, uint32_t exit_speed) {
+    seg_walk_T walk;
+    uint8_t step_mask;
+    uint8_t dir_mask;
+    uint32_t interval;
+    seg_walk_init(&walk, seg, exit_speed);
+    while (seg_walk_next(&walk, &step_mask, &dir_mask, &interval))
     {
-        x->target_position = sequence[i][0];
-        y->target_position = sequence[i][1];
-        z->target_position = sequence[i][2];
-
-        move_to_position(x, y, z);
-        int coords[4];
-        coords[0] = x->current_position;
-        coords[1] = y->current_position;
-        coords[2] = z->current_position;
-        coords[3] = spindle_speed;
-        print_coords(coords);
+        if (!queue_step(step_mask, dir_mask, interval))
+        {
+            return;
+        }
     }
 }
 
-void setup_pwm() {
-    gpio_set_dir(SPINDLE, GPIO_OUT);
-    gpio_set_function(SPINDLE, GPIO_FUNC_PWM);
-    uint spindle_slice_num = pwm_gpio_to_slice_num(SPINDLE);
-    pwm_set_enabled(spindle_slice_num, true);
+// Execute the oldest buffered segment
+void emit_next_segment() {
+    segment_T seg;
+    uint32_t exit_speed;
+    if (planner_pop(&planner, &seg, &exit_speed))
+    {
+        emit_segment(&seg, exit_speed);
+    }
 }
 
-void spindle_on(int spindle_speed) {
-    pwm_set_gpio_level(SPINDLE, spindle_speed);
+// Throw away everything still to be executed; the position counters keep
+// only the pulses that were actually issued
+void discard_motion() {
+    planner_init(&planner);
+    motion_discard(&motion_queue);
+    uint32_t irq_state = save_and_disable_interrupts();
+    stepper_flush(&stepper);
+    restore_interrupts(irq_state);
+    motion_abort = false;
 }
 
-int len_of_text(char arr[]) {
-    int i = 0;
-    while (arr[i] != '\000')
+// Add a segment or arc to the look-ahead buffer; false if it is full
+bool plan_motion_cmd(motion_cmd_T* cmd) {
+    if (cmd->type == MOTION_ARC)
     {
-        i++;
+        return planner_push_arc(&planner, cmd->delta, cmd->center, cmd->clockwise,
+                                cmd->max_velocity, cmd->max_accel, cmd->feed);
     }
-    return i;
+    return planner_push(&planner, cmd->delta, cmd->max_velocity, cmd->max_accel, cmd->feed);
 }
-/*
-#################################################################
-                            Main
-#################################################################
-*/
-int main(void) {
-    // Initialise components
-    stdio_init_all();
 
-    // Initialize GPIO pins
-    // Initialize GPIO pins
-    init_pin(STEP_PIN_X, GPIO_OUT);
-    init_pin(DIR_PIN_X, GPIO_OUT);
-    init_pin(STEP_PIN_Y, GPIO_OUT);
+// Carry out one command from core0
+void run_motion_cmd(motion_cmd_T* cmd) {
+    switch (cmd->type)
+    {
+        case MOTION_SEGMENT:
+        case MOTION_ARC:
+            // Make room by executing the oldest segment once the buffer is full
+            while (!plan_motion_cmd(cmd))
+            {
+                if (motion_abort)
+                {
+                    return;
+                }
+                emit_next_segment();
+            }
+            break;
+        case MOTION_FLUSH:
+            // Execute everything in the look-ahead buffer, stopping at the end
+            while (planner_count(&planner) > 0 && !motion_abort)
+            {
+                emit_next_segment();
+            }
+            break;
+        case MOTION_HOME:
+            while (planner_count(&planner) > 0 && !motion_abort)
+            {
+                emit_next_segment();
+            }
+            if (!motion_abort)
+            {
+                home_axis(cmd->axis);
+            }
+            break;
+    }
+}
+
+// Core1 entry: the motion executor
+void core1_main() {
+    // Let core0 park this core while it writes the job store
+    multicore_lockout_victim_init();
+
+    // Step alarms fire on this core, away from the UI
+    step_alarm_pool = alarm_pool_create(STEP_ALARM_NUM, 4);
+
+    while (true)
+    {
+        if (motion_abort)
+        {
+            discard_motion();
+            continue;
+        }
+        // Start nothing new until core0 has stopped for the abort; a command
+        // it pushed as Ctrl-X came in would otherwise run after the discard
+        if (abort_requested)
+        {
+            __wfe();
+            continue;
+        }
+        // Restart a held engine once a resume has been requested
+        stepper_kick();
+        motion_cmd_T cmd;
+        motion_active = true;
+        if (motion_pop(&motion_queue, &cmd))
+        {
+            run_motion_cmd(&cmd);
+        }
+        else
+        {
+            motion_active = false;
+            __wfe();  // Woken by core0 pushing a command
+        }
+    }
+}
+
+/*
+###############################################################
+                    MOTION COMMANDS (core0)
+###############################################################
+*/
+// Define axis struct
+typedef struct axis {
+    int current_position;   // where queued motion will leave the axis
+    int target_position;
+    int min_position;
+    int max_position;
+    int steps_to_move; 
+    uint step_pin;
+    uint dir_pin;
+    int index;          // AXIS_X, AXIS_Y or AXIS_Z
+    int max_velocity;   // steps/s
+    int acceleration;   // steps/s^2
+} axis_T;
+
+// declare axes
+axis_T x;
+axis_T y;
+axis_T z;
+
+bool motion_flushed = true;     // no segments sent since the last flush
+volatile bool fault_latched = false;    // driver reported a fault
+bool dry_run = false;           // "estimate": motion goes to the dry run, not core1
+dryrun_T dry;
+
+// Hand a command to core1, waiting if its queue is full
+void send_motion_cmd(motion_cmd_T* cmd) {
+    // Estimating: run it against the virtual clock instead
+    if (dry_run)
+    {
+        dryrun_command(&dry, cmd);
+        return;
+    }
+    while (!motion_push(&motion_queue, cmd))
+    {
+        // Core1 may be stuck behind a feed hold; the abort discards the rest anyway
+        if (abort_requested)
+        {
+            return;
+        }
+        tight_loop_contents();
+    }
+    __sev();  // Wake core1
+}
+
+// True while core1 has anything left to do
+bool motion_busy() {
+    return motion_queued(&motion_queue) > 0 || motion_active
+        || planner_count(&planner) > 0 || !stepper_idle(&stepper);
+}
+
+// Fill in the move and the axis limits of a segment or arc command
+void set_motion_axes(motion_cmd_T* cmd, axis_T* x, axis_T* y, axis_T* z, int dx, int dy, int dz) {
+    axis_T* axes[] = {x, y, z};
+    int deltas[] = {dx, dy, dz};
+    for (int i = 0; i < LEN(axes); i++)
+    {
+        cmd->delta[axes[i]->index] = deltas[i];
+        cmd->max_velocity[axes[i]->index] = axes[i]->max_velocity;
+        cmd->max_accel[axes[i]->index] = axes[i]->acceleration;
+    }
+}
+
+// Job being recorded by "save": every move queued is added to it
+bool job_recording = false;
+char job_name[JOB_NAME_SIZE];
+int32_t job_start[3];               // position when recording started
+uint8_t job_buffer[JOB_RECORD_SIZE];
+job_writer_T job_writer;
+
+// Add a straight move to the look-ahead buffer (feed in steps/s, 0 = rapid)
+void queue_segment(axis_T* x, axis_T* y, axis_T* z, int dx, int dy, int dz, uint32_t feed) {
+    // Drop the rest of a job once an abort is pending
+    if (abort_requested)
+    {
+        return;
+    }
+    if (job_recording)
+    {
+        int32_t delta[3] = {dx, dy, dz};
+        job_write_move(&job_writer, delta, NULL, false, feed);
+    }
+    motion_cmd_T cmd;
+    cmd.type = MOTION_SEGMENT;
+    cmd.feed = feed;
+    set_motion_axes(&cmd, x, y, z, dx, dy, dz);
+    send_motion_cmd(&cmd);
+    motion_flushed = false;
+}
+
+// Execute everything in the look-ahead buffer, stopping at the end
+void flush_motion() {
+    if (motion_flushed)
+    {
+        return;
+    }
+    motion_cmd_T cmd;
+    cmd.type = MOTION_FLUSH;
+    send_motion_cmd(&cmd);
+    motion_flushed = true;
+}
+
+// Block until every queued move has been executed (or an abort arrives)
+void wait_for_motion() {
+    flush_motion();
+    update_screen();  // Show what led up to the wait
+    while (motion_busy() && !abort_requested)
+    {
+        tight_loop_contents();
+    }
+}
+
+// Take the axis positions from the pulses actually issued
+void sync_positions() {
+    x.current_position = stepper.position[x.index];
+    y.current_position = stepper.position[y.index];
+    z.current_position = stepper.position[z.index];
+}
+
+// Stop all motion and resynchronise positions. The axes decelerate to a
+// hold first so no steps are lost, unless the driver has faulted.
+void stop_motion() {
+    if (!fault_latched && !stepper_idle(&stepper))
+    {
+        stepper.hold_request = true;
+        while (stepper.hold_state != STEPPER_HELD && !stepper_idle(&stepper) && !fault_latched)
+        {
+            tight_loop_contents();
+        }
+    }
+    motion_abort = true;
+    __sev();
+    while (motion_abort)
+    {
+        tight_loop_contents();
+    }
+    while (!stepper_idle(&stepper))
+    {
+        tight_loop_contents();
+    }
+    motion_flushed = true;
+    sync_positions();
+}
+
+// Realtime byte from the UART interrupt. Returns true if it was consumed.
+bool realtime_command(uint8_t ch) {
+    switch (ch)
+    {
+        case RT_FEED_HOLD:
+            // Latched even between segments; stepper_start() holds the next one
+            if (motion_busy())
+            {
+                stepper.hold_request = true;
+            }
+            return true;
+        case RT_RESUME:
+            if (stepper.hold_state != STEPPER_RUN)
+            {
+                stepper.resume_request = true;
+                __sev();  // Core1 restarts the alarm
+            }
+            stepper.hold_request = false;  // Cancel a hold not yet taken
+            return true;
+        case RT_ABORT:
+            abort_requested = true;
+            // Held axes have nothing to decelerate: release core1 from here, as
+            // core0 may be blocked on a full queue until it lets go
+            if (stepper.hold_state == STEPPER_HELD || stepper_idle(&stepper))
+            {
+                motion_abort = true;
+                __sev();
+            }
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Driver fault: cut the pulses at once, there is nothing to decelerate
+void on_fault(uint gpio, uint32_t events) {
+    fault_latched = true;
+    motion_abort = true;
+    abort_requested = true;
+    __sev();
+}
+
+// Home z first so the tool is lifted clear, then x and y
+bool home_machine() {
+    axis_T* axes[] = {&z, &x, &y};
+    const char names[] = "xyz";
+    for (int i = 0; i < LEN(axes); i++)
+    {
+        int axis = axes[i]->index;
+        home_result[axis] = HOMING_SEEK;
+        flush_motion();
+        motion_cmd_T cmd;
+        cmd.type = MOTION_HOME;
+        cmd.axis = axis;
+        send_motion_cmd(&cmd);
+        wait_for_motion();
+        sync_positions();
+        if (home_result[axis] != HOMING_DONE)
+        {
+            char message[50];
+            snprintf(message, sizeof(message), "Homing %c failed: %s", names[axis],
+                     home_result[axis] == HOMING_TIMEOUT ? "switch not found" : "aborted");
+            print_error(message);
+            return false;
+        }
+    }
+    print_output("Homed: machine zero set at the limit switches");
+    return true;
+}
+
+// Check a target is inside the machine limits
+bool check_bounds(axis_T* x, axis_T* y, axis_T* z) {
+    if (x->target_position < x->min_position || x->target_position > x->max_position) {
+        char message[50];
+        sprintf(message, "Error: x position out of bounds (0-%d).", X_MAX);
+        print_error(message);
+        return false;
+    }
+    if (y->target_position < y->min_position || y->target_position > y->max_position) {
+        char message[50];
+        sprintf(message, "Error: y position out of bounds (0-%d).", Y_MAX);
+        print_error(message);
+        return false;
+    }
+    if (z->target_position < z->min_position || z->target_position > z->max_position) {
+        char message[50];
+        sprintf(message, "Error: z position out of bounds (0-%d).", Z_MAX);
+        print_error(message);
+        return false;
+    }
+    return true;
+}
+
+// Queue the segments that take the tool to the target position
+void plan_move(axis_T* x, axis_T* y, axis_T* z) {
+    // Z up first if the tool is down, XY, then Z down (see motion_rapid_split)
+    int32_t from[3] = {x->current_position, y->current_position, z->current_position};
+    int32_t to[3] = {x->target_position, y->target_position, z->target_position};
+    int32_t delta[3][MOTION_NUM_AXES];
+    int moves = motion_rapid_split(from, to, delta);
+    for (int i = 0; i < moves; i++)
+    {
+        queue_segment(x, y, z, delta[i][0], delta[i][1], delta[i][2], 0);
+    }
+    x->current_position = x->target_position;
+    y->current_position = y->target_position;
+    z->current_position = z->target_position;
+}
+
+// Generalized function to move motor to a target position
+void move_to_position(axis_T* x, axis_T* y, axis_T* z) {
+    if (!check_bounds(x, y, z))
+    {
+        return;
+    }
+
+    // Do nothing if already at position
+    if (x->target_position == x->current_position && y->target_position == y->current_position && z->target_position == z->current_position)
+    {
+        print_warning("Already at the target position.");
+        return;
+    }
+
+    plan_move(x, y, z);
+    flush_motion();
+
+    char message[50];
+    snprintf(message, sizeof(message), "Moving to position: x %d, y %d, z %d\n", x->current_position, y->current_position, z->current_position);
+    print_output(message);
+}
+
+// Run a whole sequence through the look-ahead buffer so corners are blended
+void print_sequence(int sequence[][3], int sequence_length, axis_T* x, axis_T* y, axis_T* z, int spindle_speed)    {
+    for (int i = 0; i < sequence_length; i++)
+    {
+        x->target_position = sequence[i][0];
+        y->target_position = sequence[i][1];
+        z->target_position = sequence[i][2];
+
+        if (check_bounds(x, y, z))
+        {
+            plan_move(x, y, z);
+        }
+    }
+    flush_motion();
+
+    int coords[4];
+    coords[0] = x->current_position;
+    coords[1] = y->current_position;
+    coords[2] = z->current_position;
+    coords[3] = spindle_speed;
+    print_coords(coords);
+}
+
+// The points that decide whether an arc stays inside the limits: its end,
+// then every axis direction it sweeps past, where it bulges beyond its end
+// points. Returns how many were written (1 to 5)
+int arc_extent(const int32_t start[3], const int32_t center[2], const int32_t target[3], bool clockwise, int32_t points[5][3]) {
+    double start_angle = atan2(start[1] - center[1], start[0] - center[0]);
+    double end_angle = atan2(target[1] - center[1], target[0] - center[0]);
+    double radius = hypot(start[0] - center[0], start[1] - center[1]);
+
+    // Sweep in the requested direction; equal end points make a full circle
+    double sweep = end_angle - start_angle;
+    if (clockwise && sweep >= 0)
+    {
+        sweep -= 2*M_PI;
+    }
+    else if (!clockwise && sweep <= 0)
+    {
+        sweep += 2*M_PI;
+    }
+
+    int count = 0;
+    points[count][0] = target[0];
+    points[count][1] = target[1];
+    points[count][2] = target[2];
+    count++;
+    for (int k = 0; k < 4; k++)
+    {
+        double extreme = k*M_PI/2;
+        double travel = clockwise ? start_angle - extreme : extreme - start_angle;
+        travel = fmod(fmod(travel, 2*M_PI) + 2*M_PI, 2*M_PI);
+        if (travel < fabs(sweep))
+        {
+            points[count][0] = center[0] + (int32_t)lround(radius*cos(extreme));
+            points[count][1] = center[1] + (int32_t)lround(radius*sin(extreme));
+            points[count][2] = target[2];
+            count++;
+        }
+    }
+    return count;
+}
+
+// Queue an arc in the XY plane from the current position (z moves along
+// with it for a helix). Equal start and end points make a full circle.
+// Returns false, queueing nothing, if the arc leaves the machine limits or
+// an abort is pending
+bool queue_arc(axis_T* x, axis_T* y, axis_T* z, const int32_t center[2], const int32_t target[3], bool clockwise, uint32_t feed) {
+    int32_t start[3] = {x->current_position, y->current_position, z->current_position};
+    int32_t extent[5][3];
+    int points = arc_extent(start, center, target, clockwise, extent);
+    for (int k = 0; k < points; k++)
+    {
+        x->target_position = extent[k][0];
+        y->target_position = extent[k][1];
+        z->target_position = extent[k][2];
+        if (!check_bounds(x, y, z))
+        {
+            return false;
+        }
+    }
+
+    if (abort_requested)
+    {
+        return false;
+    }
+    motion_cmd_T cmd;
+    cmd.type = MOTION_ARC;
+    cmd.feed = feed;
+    cmd.clockwise = clockwise;
+    cmd.center[0] = center[0] - start[0];
+    cmd.center[1] = center[1] - start[1];
+    set_motion_axes(&cmd, x, y, z, target[0] - start[0], target[1] - start[1], target[2] - start[2]);
+    if (job_recording)
+    {
+        int32_t delta[3] = {target[0] - start[0], target[1] - start[1], target[2] - start[2]};
+        job_write_move(&job_writer, delta, cmd.center, clockwise, feed);
+    }
+    send_motion_cmd(&cmd);
+    motion_flushed = false;
+
+    x->current_position = target[0];
+    y->current_position = target[1];
+    z->current_position = target[2];
+    x->target_position = target[0];
+    y->target_position = target[1];
+    return true;
+}
+
+// Cut a full circle: move above the start point, plunge, go round, lift
+void print_circle(int center_x, int center_y, int radius, int z_up, int z_down, axis_T* x, axis_T* y, axis_T* z, int spindle_speed) {
+    const int path[][3] = {
+        {center_x + radius, center_y, z_up},
+        {center_x + radius, center_y, z_down}
+    };
+    for (int i = 0; i < LEN(path); i++)
+    {
+        x->target_position = path[i][0];
+        y->target_position = path[i][1];
+        z->target_position = path[i][2];
+        if (!check_bounds(x, y, z))
+        {
+            return;
+        }
+        plan_move(x, y, z);
+    }
+
+    int32_t center[2] = {center_x, center_y};
+    int32_t end[3] = {center_x + radius, center_y, z_down};
+    queue_arc(x, y, z, center, end, false, 0);
+
+    // Lift and go home
+    x->target_position = 0;
+    y->target_position = 0;
+    z->target_position = z_up;
+    plan_move(x, y, z);
+    flush_motion();
+
+    int coords[4] = {x->current_position, y->current_position, z->current_position, spindle_speed};
+    print_coords(coords);
+}
+
+void setup_pwm() {
+    gpio_set_dir(SPINDLE, GPIO_OUT);
+    gpio_set_function(SPINDLE, GPIO_FUNC_PWM);
+    uint spindle_slice_num = pwm_gpio_to_slice_num(SPINDLE);
+    pwm_set_enabled(spindle_slice_num, true);
+}
+
+void spindle_on(int spindle_speed) {
+    pwm_set_gpio_level(SPINDLE, spindle_speed);
+}
+
+int len_of_text(char arr[]) {
+    int i = 0;
+    while (arr[i] != '\000')
+    {
+        i++;
+    }
+    return i;
+}
+// G-code interpreter state, kept between lines
+gcode_T gcode;
+bool gcode_mode = false;
+
+// Interpret and execute one line of G-code
+// Motion is left in the look-ahead buffer unless flush is set
+// Returns false if the line was rejected or its motion leaves the limits;
+// what was queued before it still runs to a stop
+bool run_gcode_line(char line[], int* spindle_speed, bool flush) {
+    gcode_result_T result;
+
+    // Other commands may have moved the machine since the last line
+    gcode.position[0] = x.current_position;
+    gcode.position[1] = y.current_position;
+    gcode.position[2] = z.current_position;
+
+    if (!gcode_parse_line(&gcode, line, &result))
+    {
+        char message[60];
+        snprintf(message, sizeof(message), "G-code error: %s", result.error);
+        print_error(message);
+        return false;
+    }
+
+    for (int i = 0; i < result.count; i++)
+    {
+        gcode_action_T* action = &result.actions[i];
+        switch (action->type)
+        {
+            case GCODE_MOVE:
+                x.target_position = action->target[0];
+                y.target_position = action->target[1];
+                z.target_position = action->target[2];
+                if (!check_bounds(&x, &y, &z))
+                {
+                    flush_motion();
+                    return false;
+                }
+                queue_segment(&x, &y, &z,
+                              x.target_position - x.current_position,
+                              y.target_position - y.current_position,
+                              z.target_position - z.current_position, action->feed);
+                x.current_position = x.target_position;
+                y.current_position = y.target_position;
+                z.current_position = z.target_position;
+                break;
+            case GCODE_ARC:
+                if (!queue_arc(&x, &y, &z, action->center, action->target, action->clockwise, action->feed))
+                {
+                    flush_motion();
+                    return false;
+                }
+                break;
+            case GCODE_HOME:
+                if (action->has_via)
+                {
+                    x.target_position = action->target[0];
+                    y.target_position = action->target[1];
+                    z.target_position = action->target[2];
+                    if (!check_bounds(&x, &y, &z))
+                    {
+                        flush_motion();
+                        return false;
+                    }
+                    plan_move(&x, &y, &z);
+                }
+                x.target_position = 0;
+                y.target_position = 0;
+                z.target_position = 0;
+                plan_move(&x, &y, &z);
+                break;
+            case GCODE_SPINDLE:
+                // Spindle changes take effect once queued motion has finished
+                flush_motion();
+                wait_for_motion();
+                *spindle_speed = MIN(action->spindle_speed, SPIN_MAX);
+                spindle_on((*spindle_speed)*(*spindle_speed));
+                break;
+            case GCODE_END:
+                gcode_mode = false;
+                flush = true;
+                print_output("G-code program finished");
+                break;
+        }
+    }
+
+    if (flush)
+    {
+        flush_motion();
+        int coords[4] = {x.current_position, y.current_position, z.current_position, *spindle_speed};
+        print_coords(coords);
+    }
+    return true;
+}
+
+// Live position panel, paced by a timer so core0 can sleep in between
+volatile bool ui_refresh_due = false;
+repeating_timer_t ui_timer;
+telemetry_T telemetry;
+bool telemetry_was_moving = false;
+
+bool ui_timer_callback(repeating_timer_t *rt) {
+    ui_refresh_due = true;
+    return true;
+}
+
+// Change the panel rate (0 = off)
+void set_telemetry_rate(uint32_t rate_hz) {
+    cancel_repeating_timer(&ui_timer);
+    telemetry_set_rate(&telemetry, rate_hz);
+    if (rate_hz > 0)
+    {
+        add_repeating_timer_us(-(int64_t)telemetry.interval_us, ui_timer_callback, NULL, &ui_timer);
+    }
+}
+
+// Show where the tool actually is without disturbing a half-typed command
+void print_live_coords(int spindle_speed) {
+    int coords[4] = {stepper.position[AXIS_X], stepper.position[AXIS_Y], stepper.position[AXIS_Z], spindle_speed};
+    int queued = motion_queued(&motion_queue) + planner_count(&planner) + stepper_queued(&stepper);
+    print_coords(coords);
+    print_motion_status(telemetry.feed, queued);
+}
+
+// Send a panel frame while the machine moves (and one once it stops), as
+// long as the panel stays within its share of the UART
+void service_telemetry(int spindle_speed) {
+    if (!ui_refresh_due)
+    {
+        return;
+    }
+    ui_refresh_due = false;
+    bool moving = motion_busy();
+    uint64_t now = time_us_64();
+    if (!(moving || telemetry_was_moving) || !telemetry_ready(&telemetry, now))
+    {
+        return;
+    }
+    int32_t position[3] = {stepper.position[AXIS_X], stepper.position[AXIS_Y], stepper.position[AXIS_Z]};
+    telemetry_sample(&telemetry, now, position);
+    if (!moving)
+    {
+        telemetry.feed = 0;
+    }
+    unsigned long sent = term_out.bytes + term_out.length;
+    print_live_coords(spindle_speed);
+    update_screen();
+    telemetry_spent(&telemetry, term_out.bytes - sent);
+    telemetry_was_moving = moving;
+}
+
+// Start taking G-code, or image rows in raster mode, from the stream ring
+void start_stream(bool ack) {
+    ring_init(&stream_ring, stream_storage, STREAM_BUFFER_SIZE);
+    stream_lines_in = 0;
+    stream_lines_out = 0;
+    stream_overruns = 0;
+    stream_paused = false;
+    stream_ack = ack;
+    gcode_mode = !raster_mode;
+    stream_mode = true;
+    if (raster_mode)
+    {
+        print_output("Raster: send rows of hex, bottom row first, end with \"exit\"");
+    }
+    else
+    {
+        print_output("Streaming: send G-code, end with M2 or \"exit\"");
+    }
+}
+
+// Leave stream mode and report how it went
+void stop_stream() {
+    stream_mode = false;
+    gcode_mode = false;
+    flush_motion();
+    if (stream_paused)
+    {
+        stream_paused = false;
+        uart_putc_raw(UART_ID, STREAM_XON);
+    }
+    char message[69];
+    if (raster_mode)
+    {
+        raster_mode = false;
+        snprintf(message, sizeof(message), "Raster finished: %lu rows, %lu cuts, %lu bytes dropped",
+                 (unsigned long)raster_rows, (unsigned long)raster_runs, (unsigned long)stream_overruns);
+    }
+    else
+    {
+        snprintf(message, sizeof(message), "Stream finished: %lu lines, %lu bytes dropped",
+                 (unsigned long)stream_lines_out, (unsigned long)stream_overruns);
+    }
+    print_output(message);
+}
+
+// Act on aborts and report feed hold changes
+uint8_t reported_hold_state = STEPPER_RUN;
+
+void service_realtime(int spindle_speed) {
+    if (abort_requested)
+    {
+        stop_motion();
+        abort_requested = false;
+        if (stream_mode)
+        {
+            stop_stream();
+        }
+        gcode_mode = false;
+        char message[60];
+        snprintf(message, sizeof(message), "%s at x %d, y %d, z %d",
+                 fault_latched ? "Driver fault: stopped" : "Aborted",
+                 x.current_position, y.current_position, z.current_position);
+        if (fault_latched)
+        {
+            print_error(message);
+        }
+        else
+        {
+            print_warning(message);
+        }
+        print_live_coords(spindle_speed);
+        fault_latched = false;  // the next falling edge latches again
+    }
+
+    uint8_t hold_state = stepper.hold_state;
+    if (hold_state != reported_hold_state)
+    {
+        if (hold_state == STEPPER_HELD)
+        {
+            print_output("Feed hold: send ~ to resume, Ctrl-X to abort");
+            print_live_coords(spindle_speed);
+        }
+        else if (hold_state == STEPPER_RESUMING)
+        {
+            print_output("Resuming");
+        }
+        reported_hold_state = hold_state;
+    }
+}
+
+// Pull one complete line out of the stream ring
+// A line longer than size - 1 characters is dropped whole: line comes back
+// empty and too_long is set
+bool stream_read_line(char line[], int size, bool* too_long) {
+    if (stream_lines_in == stream_lines_out)
+    {
+        return false;
+    }
+    int length = 0;
+    uint8_t ch;
+    *too_long = false;
+    while (ring_pop(&stream_ring, &ch))
+    {
+        if (ch == '\n' || ch == '\r')
+        {
+            break;
+        }
+        if (length < size - 1)
+        {
+            line[length++] = ch;
+        }
+        else
+        {
+            *too_long = true;
+        }
+    }
+    line[*too_long ? 0 : length] = '\0';
+    stream_lines_out++;
+
+    // Let the sender carry on once there is room again
+    if (stream_should_resume(&stream_ring, stream_paused))
+    {
+        stream_paused = false;
+        uart_putc_raw(UART_ID, STREAM_XON);
+    }
+    return true;
+}
+
+// Engrave the next streamed image row (defined with the commands)
+void service_raster();
+
+// Run the next streamed line, or wait for one
+void service_stream(int* spindle_speed) {
+    service_realtime(*spindle_speed);
+    service_telemetry(*spindle_speed);
+    if (!stream_mode)
+    {
+        return;
+    }
+    if (raster_mode)
+    {
+        service_raster();
+        return;
+    }
+    char line[STREAM_LINE_SIZE];
+    bool too_long;
+    if (!stream_read_line(line, sizeof(line), &too_long))
+    {
+        // Starved: finish what is buffered rather than stall mid-contour
+        flush_motion();
+        update_screen();
+        __asm("wfi");
+        return;
+    }
+    if (too_long)
+    {
+        // Running what fits could cut somewhere else entirely
+        char message[69];
+        snprintf(message, sizeof(message), "Stream: line %lu is over %d characters, stopping",
+                 (unsigned long)stream_lines_out, STREAM_LINE_SIZE - 1);
+        print_error(message);
+        if (stream_ack)
+        {
+            term_puts("error\r\n");
+            term_flush();
+        }
+        stop_stream();
+        return;
+    }
+    if (line[0] == '\0')
+    {
+        return;
+    }
+    if (strcmp(line, "exit") == 0)
+    {
+        stop_stream();
+        return;
+    }
+
+    // Keep the look-ahead buffer full while more lines are waiting
+    bool more_pending = stream_lines_in != stream_lines_out;
+    bool ok = run_gcode_line(line, spindle_speed, !more_pending);
+    if (stream_ack)
+    {
+        term_puts(ok ? "ok\r\n" : "error\r\n");
+        term_flush();
+    }
+    // The rest of the job would cut from the wrong place
+    if (!ok || !gcode_mode)
+    {
+        stop_stream();
+    }
+}
+
+// Hand the UART over to the binary protocol
+void start_binary() {
+    print_output("Binary protocol: the host sends frames until PROTO_EXIT");
+    update_screen();  // Last text the host sees
+    proto_decoder_init(&proto_decoder);
+    proto_queue_init(&proto_queue);
+    proto_bad_frames = 0;
+    proto_dropped = 0;
+    binary_mode = true;
+}
+
+// Back to the text UI, repainted in full as the host owned the terminal
+void stop_binary() {
+    binary_mode = false;
+    flush_motion();
+    screen_invalidate(&screen);
+    char message[60];
+    snprintf(message, sizeof(message), "Binary protocol finished: %lu bad, %lu dropped",
+             (unsigned long)proto_bad_frames, (unsigned long)proto_dropped);
+    print_output(message);
+}
+
+// Queue a frame for the host
+void proto_reply(proto_frame_T* frame) {
+    uint8_t wire[PROTO_MAX_ENCODED];
+    size_t length = proto_encode(frame, wire);
+    term_write((char*)wire, length);
+}
+
+void proto_ack(uint8_t seq, uint8_t result) {
+    proto_frame_T frame;
+    frame.type = PROTO_ACK;
+    frame.seq = seq;
+    frame.length = 1;
+    frame.payload[0] = result;
+    proto_reply(&frame);
+}
+
+// Answer a status request from the pulses actually issued
+void proto_status_reply(proto_frame_T* frame, int spindle_speed) {
+    proto_status_T status;
+    for (int i = 0; i < 3; i++)
+    {
+        status.position[i] = stepper.position[i];
+    }
+    // Path speed averaged since the previous request
+    bool moving = motion_busy();
+    telemetry_sample(&telemetry, time_us_64(), status.position);
+    status.feed = moving ? MIN(telemetry.feed, UINT16_MAX) : 0;
+    int queued = motion_queued(&motion_queue) + planner_count(&planner) + stepper_queued(&stepper);
+    status.queued = MIN(queued, UINT16_MAX);
+    status.hold_state = stepper.hold_state;
+    status.spindle = spindle_speed;
+    status.flags = (moving ? PROTO_FLAG_MOVING : 0) | (fault_latched ? PROTO_FLAG_FAULT : 0);
+    frame->type = PROTO_STATUS_REPLY;
+    proto_put_status(frame, &status);
+    proto_reply(frame);
+}
+
+// Carry out one host frame and answer it
+void run_frame(proto_frame_T* frame, int* spindle_speed) {
+    uint8_t result = PROTO_OK;
+    switch (frame->type)
+    {
+        case PROTO_PING:
+            frame->type = PROTO_PONG;
+            proto_reply(frame);
+            return;
+        case PROTO_STATUS:
+            proto_status_reply(frame, *spindle_speed);
+            return;
+        case PROTO_MOVE:
+            if (frame->length != 16)
+            {
+                result = PROTO_ERR_LENGTH;
+                break;
+            }
+            x.target_position = (int32_t)proto_get_u32(&frame->payload[0]);
+            y.target_position = (int32_t)proto_get_u32(&frame->payload[4]);
+            z.target_position = (int32_t)proto_get_u32(&frame->payload[8]);
+            if (!check_bounds(&x, &y, &z))
+            {
+                result = PROTO_ERR_BOUNDS;
+                break;
+            }
+            queue_segment(&x, &y, &z,
+                          x.target_position - x.current_position,
+                          y.target_position - y.current_position,
+                          z.target_position - z.current_position,
+                          proto_get_u32(&frame->payload[12]));
+            x.current_position = x.target_position;
+            y.current_position = y.target_position;
+            z.current_position = z.target_position;
+            break;
+        case PROTO_FLUSH:
+            flush_motion();
+            break;
+        case PROTO_HOLD:
+        case PROTO_RESUME:
+        case PROTO_ABORT:
+            break;  // Already acted on by binary_rx()
+        case PROTO_GCODE:
+        {
+            char line[PROTO_MAX_PAYLOAD + 1];
+            size_t length = frame->length > PROTO_MAX_PAYLOAD ? PROTO_MAX_PAYLOAD : frame->length;
+            memcpy(line, frame->payload, length);
+            line[length] = '\0';
+            if (!run_gcode_line(line, spindle_speed, false))
+            {
+                result = PROTO_ERR_GCODE;
+            }
+            break;
+        }
+        case PROTO_EXIT:
+            proto_ack(frame->seq, PROTO_OK);
+            term_flush();
+            stop_binary();
+            return;
+        default:
+            result = PROTO_ERR_UNKNOWN;
+            break;
+    }
+    proto_ack(frame->seq, result);
+}
+
+// Run the next host frame, or wait for one
+void service_binary(int* spindle_speed) {
+    service_realtime(*spindle_speed);
+    proto_frame_T frame;
+    if (!proto_queue_pop(&proto_queue, &frame))
+    {
+        // Starved: finish what is buffered, as in stream mode
+        flush_motion();
+        term_flush();
+        __asm("wfi");
+        return;
+    }
+    run_frame(&frame, spindle_speed);
+    // Replies go out together once the frames waiting have been run
+    if (proto_queue.head == proto_queue.tail)
+    {
+        term_flush();
+    }
+}
+
+/*
+###############################################################
+                        JOB STORE
+    Named toolpaths in flash, recorded by "save" and replayed by "load"
+###############################################################
+*/
+// Flash cannot be read while it is erased or programmed and both cores run
+// from it, so core1 is parked and interrupts are off meanwhile, about 50 ms
+// a sector. The 32 byte RX FIFO lasts under 3 ms of that, so the sender is
+// paused with XOFF first. False, touching nothing, while motion is running
+bool job_store_begin() {
+    if (motion_busy())
+    {
+        return false;
+    }
+    uart_putc_raw(UART_ID, STREAM_XOFF);
+    uart_tx_wait_blocking(UART_ID);
+    sleep_ms(FLASH_XOFF_SETTLE_MS);
+    uart_get_hw(UART_ID)->rsr = 0;  // clear the overrun flag
+    return true;
+}
+
+// Let the sender carry on; warn if it did not pause and input was lost
+void job_store_end() {
+    bool lost = uart_get_hw(UART_ID)->rsr & UART_UARTRSR_OE_BITS;
+    uart_putc_raw(UART_ID, STREAM_XON);
+    if (lost)
+    {
+        print_warning("Input typed while flash was written was lost");
+    }
+}
+
+// Write a job (header, then its moves) to whole sectors of the job store.
+// False if motion has not finished
+bool job_store_write(int sector, const job_header_T* header, const uint8_t* moves) {
+    static uint8_t page[JOBSTORE_SECTOR_SIZE];
+    if (!job_store_begin())
+    {
+        return false;
+    }
+    size_t length = sizeof(*header) + header->length;
+    for (size_t done = 0; done < length; done += JOBSTORE_SECTOR_SIZE, sector++)
+    {
+        memset(page, 0xFF, JOBSTORE_SECTOR_SIZE);
+        for (size_t i = 0; i < JOBSTORE_SECTOR_SIZE && done + i < length; i++)
+        {
+            size_t at = done + i;
+            page[i] = at < sizeof(*header) ? ((const uint8_t*)header)[at] : moves[at - sizeof(*header)];
+        }
+        uint32_t offset = JOBSTORE_OFFSET + sector*JOBSTORE_SECTOR_SIZE;
+        multicore_lockout_start_blocking();
+        uint32_t irq_state = save_and_disable_interrupts();
+        flash_range_erase(offset, FLASH_SECTOR_SIZE);
+        flash_range_program(offset, page, FLASH_SECTOR_SIZE);
+        restore_interrupts(irq_state);
+        multicore_lockout_end_blocking();
+    }
+    job_store_end();
+    return true;
+}
+
+// Remove a job by erasing the sector holding its header
+// False if motion has not finished
+bool job_store_erase(int sector) {
+    uint32_t offset = JOBSTORE_OFFSET + sector*JOBSTORE_SECTOR_SIZE;
+    if (!job_store_begin())
+    {
+        return false;
+    }
+    multicore_lockout_start_blocking();
+    uint32_t irq_state = save_and_disable_interrupts();
+    flash_range_erase(offset, FLASH_SECTOR_SIZE);
+    restore_interrupts(irq_state);
+    multicore_lockout_end_blocking();
+    job_store_end();
+    return true;
+}
+
+// Store the recorded job, replacing one of the same name once it is safe
+bool job_store_save(char* message, size_t size) {
+    job_header_T header;
+    memset(&header, 0, sizeof(header));
+    header.magic = JOB_MAGIC;
+    strncpy(header.name, job_name, JOB_NAME_SIZE - 1);
+    header.length = job_writer.length;
+    header.moves = job_writer.moves;
+    memcpy(header.start, job_start, sizeof(header.start));
+    header.crc = job_crc32(job_writer.data, job_writer.length);
+
+    int sectors = job_sectors(header.length);
+    int old = job_find(JOBSTORE_REGION, job_name);
+    int sector = job_free_run(JOBSTORE_REGION, sectors);
+    if (sector < 0)
+    {
+        snprintf(message, size, "save: no room for %d sectors; \"delete\" a job", sectors);
+        return false;
+    }
+    wait_for_motion();
+    if (!job_store_write(sector, &header, job_writer.data))
+    {
+        snprintf(message, size, "save: %s not stored, motion was stopped", job_name);
+        return false;
+    }
+    if (old >= 0)
+    {
+        job_store_erase(old);
+    }
+    snprintf(message, size, "Saved %s: %lu moves, %lu bytes", job_name,
+             (unsigned long)header.moves, (unsigned long)(sizeof(header) + header.length));
+    return true;
+}
+
+// True if a position is inside the machine limits
+bool job_in_bounds(const int32_t position[3]) {
+    axis_T* axes[] = {&x, &y, &z};
+    for (int i = 0; i < 3; i++)
+    {
+        if (position[i] < axes[i]->min_position || position[i] > axes[i]->max_position)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Replay a stored job: check it, go to where it started, then decode it
+// straight into the motion queue. False if there is no job by that name.
+bool run_job(const char* name) {
+    int sector = job_find(JOBSTORE_REGION, name);
+    if (sector < 0)
+    {
+        return false;
+    }
+    const job_header_T* header = job_at(JOBSTORE_REGION, sector);
+    const uint8_t* moves = (const uint8_t*)(header + 1);
+    char message[69];
+    if (job_crc32(moves, header->length) != header->crc)
+    {
+        snprintf(message, sizeof(message), "load: job %s is corrupt", name);
+        print_error(message);
+        return true;
+    }
+
+    // Every end point, and every arc's bulge, must be reachable before
+    // anything moves
+    job_reader_T reader;
+    job_move_T move;
+    int32_t position[3] = {header->start[0], header->start[1], header->start[2]};
+    bool inside = job_in_bounds(position);
+    job_reader_init(&reader, moves, header->length);
+    while (inside && job_read_move(&reader, &move))
+    {
+        if (move.op == JOB_OP_ARC)
+        {
+            int32_t center[2] = {position[0] + move.center[0], position[1] + move.center[1]};
+            int32_t target[3] = {position[0] + move.delta[0], position[1] + move.delta[1],
+                                 position[2] + move.delta[2]};
+            int32_t extent[5][3];
+            int points = arc_extent(position, center, target, move.clockwise, extent);
+            for (int k = 1; k < points && inside; k++)
+            {
+                inside = job_in_bounds(extent[k]);
+            }
+        }
+        for (int i = 0; i < 3; i++)
+        {
+            position[i] += move.delta[i];
+        }
+        inside = inside && job_in_bounds(position);
+    }
+    if (!inside || reader.corrupt)
+    {
+        snprintf(message, sizeof(message), "load: job %s %s", name, inside ? "is corrupt" : "leaves the machine limits");
+        print_error(message);
+        return true;
+    }
+
+    x.target_position = header->start[0];
+    y.target_position = header->start[1];
+    z.target_position = header->start[2];
+    plan_move(&x, &y, &z);
+    job_reader_init(&reader, moves, header->length);
+    unsigned long queued = 0;
+    bool refused = false;
+    while (!refused && job_read_move(&reader, &move) && !abort_requested)
+    {
+        queued++;
+        if (move.op == JOB_OP_ARC)
+        {
+            int32_t center[2] = {x.current_position + move.center[0], y.current_position + move.center[1]};
+            int32_t target[3] = {x.current_position + move.delta[0], y.current_position + move.delta[1],
+                                 z.current_position + move.delta[2]};
+            // The moves after a refused arc are relative to where it would have ended
+            refused = !queue_arc(&x, &y, &z, center, target, move.clockwise, move.feed);
+            continue;
+        }
+        queue_segment(&x, &y, &z, move.delta[0], move.delta[1], move.delta[2], move.feed);
+        x.current_position += move.delta[0];
+        y.current_position += move.delta[1];
+        z.current_position += move.delta[2];
+    }
+    x.target_position = x.current_position;
+    y.target_position = y.current_position;
+    z.target_position = z.current_position;
+    flush_motion();
+    if (refused)
+    {
+        snprintf(message, sizeof(message), "load: job %s stopped at move %lu of %lu", name, queued,
+                 (unsigned long)header->moves);
+        print_error(message);
+        return true;
+    }
+    snprintf(message, sizeof(message), "Job %s: %lu moves queued", name, (unsigned long)header->moves);
+    print_output(message);
+    return true;
+}
+
+// Stop recording when the machine's zero changes under the job
+void cancel_recording(const char* reason) {
+    if (!job_recording)
+    {
+        return;
+    }
+    job_recording = false;
+    char message[69];
+    snprintf(message, sizeof(message), "Recording of %s dropped: %s", job_name, reason);
+    print_warning(message);
+}
+
+/*
+#################################################################
+                            Commands
+#################################################################
+*/
+// Settings shared by the commands
+int spindle_speed = 0;
+int z_down = 350;       // cutting depth, set with setz
+int z_up = 150;         // travel height, 200 above z_down until setz
+
+// Show the position queued motion will leave the machine at
+void show_position() {
+    int coords[4] = {x.current_position, y.current_position, z.current_position, spindle_speed};
+    print_coords(coords);
+}
+
+// Cut a prefab with its contours reordered to shorten the hops between
+// them, unless it is to run as written. Reports the travel either way.
+void run_sequence(const char* name, const int sequence[][3], int length, bool literal) {
+    static int ordered[64][3];
+    static path_plan_T plan;
+    char message[69];
+    int from[2] = {x.current_position, y.current_position};
+    if (!path_split(&plan, sequence, length, z_up, from))
+    {
+        literal = true;
+    }
+    float written = path_travel(&plan);
+    float travel = literal ? written : path_optimize(&plan);
+    if (!literal && path_emit(&plan, ordered, LEN(ordered)) == length)
+    {
+        print_sequence(ordered, length, &x, &y, &z, spindle_speed);
+        snprintf(message, sizeof(message), "Sequence: %s, travel %ld -> %ld steps", name, lroundf(written),
+                 lroundf(travel));
+    }
+    else
+    {
+        print_sequence((int (*)[3])sequence, length, &x, &y, &z, spindle_speed);
+        snprintf(message, sizeof(message), "Sequence: %s, travel %ld steps as written", name, lroundf(written));
+    }
+    print_output(message);
+}
+
+// Queue a raster move from where the last one left the tool
+void raster_queue(int dx, int dy, int dz, uint32_t feed) {
+    if (dx == 0 && dy == 0 && dz == 0)
+    {
+        return;
+    }
+    queue_segment(&x, &y, &z, dx, dy, dz, feed);
+    x.current_position += dx;
+    y.current_position += dy;
+    z.current_position += dz;
+}
+
+// Cut one image row as runs of equal pixels. The tool stays down from
+// one run to the next when they touch and only lifts over the gaps.
+bool engrave_row(const uint8_t level[]) {
+    int row_y = raster_origin[1] + (int)raster_rows*raster_pitch;
+    if (row_y > y.max_position)
+    {
+        return false;
+    }
+    bool reverse = raster_rows & 1;     // back and forth, no return travel
+    int pixel = 0;
+    int edge = -1;                      // where the last cut in this row ended
+    raster_run_T run;
+    while (raster_next_run(level, raster_width, reverse, &pixel, &run))
+    {
+        int depth = raster_by_feed ? z_down : raster_depth(run.level, z_up, z_down);
+        uint32_t feed = raster_by_feed ? raster_feed(run.level, RASTER_LIGHT_FEED, RASTER_DARK_FEED) : RASTER_FEED;
+        if (run.from != edge)
+        {
+            raster_queue(0, 0, z_up - z.current_position, 0);
+            raster_queue(raster_origin[0] + run.from*raster_pitch - x.current_position, row_y - y.current_position, 0, 0);
+        }
+        raster_queue(0, 0, depth - z.current_position, depth > z.current_position ? RASTER_PLUNGE_FEED : 0);
+        raster_queue(raster_origin[0] + run.to*raster_pitch - x.current_position, 0, 0, feed);
+        edge = run.to;
+        raster_runs++;
+    }
+    raster_rows++;
+    return true;
+}
+
+// Engrave the next streamed image row, or wait for one
+void service_raster() {
+    static char line[RASTER_LINE_SIZE];
+    static uint8_t level[RASTER_MAX_WIDTH];
+    bool too_long;
+    if (!stream_read_line(line, sizeof(line), &too_long))
+    {
+        // Starved: finish what is buffered rather than stall mid-row
+        flush_motion();
+        update_screen();
+        __asm("wfi");
+        return;
+    }
+    if (line[0] == '\0' && !too_long)
+    {
+        return;
+    }
+    if (strcmp(line, "exit") == 0)
+    {
+        raster_queue(0, 0, z_up - z.current_position, 0);
+        stop_stream();
+        return;
+    }
+
+    char message[69];
+    bool ok = !too_long && raster_decode_row(line, strlen(line), raster_width, level);
+    if (!ok)
+    {
+        // Keep the rows after it in place
+        snprintf(message, sizeof(message), "raster: row %lu is not %d pixels of hex, skipped",
+                 (unsigned long)raster_rows, raster_width);
+        print_error(message);
+        raster_rows++;
+    }
+    else if (!engrave_row(level))
+    {
+        print_error("raster: the next row is past the Y limit, stopping");
+        raster_queue(0, 0, z_up - z.current_position, 0);
+        stop_stream();
+        return;
+    }
+    // Keep the look-ahead buffer full while more rows are waiting
+    if (stream_lines_in == stream_lines_out)
+    {
+        flush_motion();
+    }
+    if (stream_ack)
+    {
+        term_puts(ok ? "ok\r\n" : "error\r\n");
+        term_flush();
+    }
+}
+
+// MANUAL CONTROL
+void cmd_move(const command_args_T* args) {
+    x.target_position = args->value[0];
+    y.target_position = args->value[1];
+    z.target_position = args->value[2];
+    move_to_position(&x, &y, &z);
+    show_position();
+}
+
+// LOAD
+void cmd_load(const command_args_T* args) {
+    const char* prefab = args->text[0];
+    bool literal = args->text[1] != NULL;
+    if (literal && strcmp(args->text[1], "literal") != 0)
+    {
+        print_error("load: the only option is \"literal\" (cut in written order)");
+        return;
+    }
+    const prefab_T* outline = prefab_find(prefab);
+    if (outline)
+    {
+        static int sequence[PREFAB_MAX_POINTS][3];
+        int length = prefab_place(outline, sequence, z_up, z_down);
+        run_sequence(outline->name, sequence, length, literal);
+    }
+    else if (strcmp(prefab, "circle") == 0)
+    {
+        print_circle(PREFAB_CIRCLE_X, PREFAB_CIRCLE_Y, PREFAB_CIRCLE_RADIUS, z_up, z_down, &x, &y, &z,
+                     spindle_speed);
+        print_output("Sequence: circle, completed");
+    }
+    else if (!run_job(prefab))
+    {
+        print_error("load: no such prefab or job; try \"list\"");
+    }
+}
+
+// True for the names of the compiled-in prefabs, which jobs cannot take
+bool is_prefab(const char* name) {
+    return prefab_find(name) != NULL || strcmp(name, "circle") == 0;
+}
+
+// SAVE: "save name" starts recording the moves that follow, "save" stores them
+void cmd_save(const command_args_T* args) {
+    char message[69];
+    const char* name = args->text[0];
+    if (name)
+    {
+        if (job_recording)
+        {
+            snprintf(message, sizeof(message), "save: already recording %s; \"save\" to store it", job_name);
+            print_error(message);
+            return;
+        }
+        if (strlen(name) >= JOB_NAME_SIZE || is_prefab(name))
+        {
+            print_error("save: names are up to 15 characters and not a prefab's");
+            return;
+        }
+        strcpy(job_name, name);
+        job_start[0] = x.current_position;
+        job_start[1] = y.current_position;
+        job_start[2] = z.current_position;
+        job_writer_init(&job_writer, job_buffer, sizeof(job_buffer));
+        job_recording = true;
+        snprintf(message, sizeof(message), "Recording %s: run the job, then \"save\" to store it", job_name);
+        print_output(message);
+        return;
+    }
+    if (!job_recording)
+    {
+        print_error("save: not recording; \"save [name]\" starts");
+        return;
+    }
+    job_recording = false;
+    if (job_writer.full || job_writer.moves == 0)
+    {
+        snprintf(message, sizeof(message), "save: %s not stored, %s", job_name,
+                 job_writer.full ? "too long to record" : "no moves were made");
+        print_error(message);
+        return;
+    }
+    if (job_store_save(message, sizeof(message)))
+    {
+        print_output(message);
+    }
+    else
+    {
+        print_error(message);
+    }
+}
+
+// LIST
+void cmd_list(const command_args_T* args) {
+    char message[69];
+    int sector = 0;
+    int used = 0;
+    int jobs = 0;
+    int found;
+    while ((found = job_next(JOBSTORE_REGION, &sector)) >= 0)
+    {
+        const job_header_T* header = job_at(JOBSTORE_REGION, found);
+        snprintf(message, sizeof(message), "%-15s %6lu moves %7lu bytes", header->name,
+                 (unsigned long)header->moves, (unsigned long)(sizeof(*header) + header->length));
+        print_output(message);
+        used += job_sectors(header->length);
+        jobs++;
+    }
+    snprintf(message, sizeof(message), "%d jobs, %d of %d KB free; prefabs: house, star, circle", jobs,
+             (JOBSTORE_SECTORS - used)*JOBSTORE_SECTOR_SIZE/1024, JOBSTORE_SIZE/1024);
+    print_output(message);
+}
+
+// DELETE
+void cmd_delete(const command_args_T* args) {
+    char message[69];
+    int sector = job_find(JOBSTORE_REGION, args->text[0]);
+    if (sector < 0)
+    {
+        snprintf(message, sizeof(message), "delete: no job \"%.16s\"", args->text[0]);
+        print_error(message);
+        return;
+    }
+    wait_for_motion();
+    if (!job_store_erase(sector))
+    {
+        print_error("delete: motion was stopped, try again");
+        return;
+    }
+    snprintf(message, sizeof(message), "Deleted %s", args->text[0]);
+    print_output(message);
+}
+
+// ZERO
+void cmd_zero(const command_args_T* args) {
+    cancel_recording("the zero moved");
+    // Let queued pulses finish so the counters agree
+    wait_for_motion();
+    for (int i = 0; i < STEPPER_NUM_AXES; i++)
+    {
+        stepper.position[i] = 0;
+    }
+    x.current_position = 0;
+    y.current_position = 0;
+    z.current_position = 0;
+    print_output("Coordinates zeroed");
+    show_position();
+}
+
+// RESIZE
+void cmd_resize(const command_args_T* args) {
+    box_T previous = win_box;
+    win_box.width = args->value[0];
+    win_box.height = args->value[1];
+    // The origin defaults to [1, 1] unless both are given
+    win_box.x_origin = args->count == 4 ? args->value[2] : 1;
+    win_box.y_origin = args->count == 4 ? args->value[3] : 1;
+    if (!layout_ui())
+    {
+        // Minimum at this width; a narrower window stacks and needs more rows
+        int min_width = layout_min_width(&layout, 0, false) + 2;
+        int min_height = layout_min_height(&layout, 0, MAX(win_box.width - 2, min_width - 2)) + 2;
+        win_box = previous;
+        layout_ui();
+        char message[69];
+        snprintf(message, sizeof(message), "resize: too small, the panels need at least %d x %d", min_width, min_height);
+        print_error(message);
+        return;
+    }
+    draw_ui();
+}
+
+// HOME
+void cmd_home(const command_args_T* args) {
+    cancel_recording("homing moves the zero");
+    home_machine();
+    show_position();
+}
+
+// SETZ
+void cmd_setz(const command_args_T* args) {
+    int depth = args->value[0];
+    char message[50];
+    // Check the depth is reachable from here
+    if ((z.current_position + depth) > Z_MAX)
+    {
+        sprintf(message, "Error: maximum allowed depth at this height is %d", Z_MAX - z.current_position);
+    }
+    else
+    {
+        z_down = z.current_position;
+        z_up = z_down - depth;
+        sprintf(message, "Z up set to %d, Z down set to %d", z_up, z_down);
+    }
+    print_output(message);
+}
+
+// SET SPINDLE SPEED
+void cmd_spin(const command_args_T* args) {
+    spindle_speed = args->value[0];
+    char message[50];
+    sprintf(message, "Spindle speed set to %d", spindle_speed);
+    print_output(message);
+    show_position();
+}
+
+// G-CODE
+void cmd_gcode(const command_args_T* args) {
+    if (args->text[0])
+    {
+        // Run a single line
+        run_gcode_line(args->text[0], &spindle_speed, true);
+    }
+    else
+    {
+        gcode_mode = true;
+        print_output("G-code mode: send program lines, \"exit\" or M2 to leave");
+    }
+}
+
+// STREAM
+void cmd_stream(const command_args_T* args) {
+    if (args->text[0] && strcmp(args->text[0], "ack") != 0)
+    {
+        print_error("stream: the only option is \"ack\"");
+        return;
+    }
+    start_stream(args->text[0] != NULL);
+}
+
+// RASTER: "raster width pitch [depth|feed] [ack]" engraves image rows
+// streamed as hex lines, bottom row first, from the current position
+void cmd_raster(const command_args_T* args) {
+    raster_by_feed = false;
+    bool ack = false;
+    for (int i = 2; i < 4 && args->text[i]; i++)
+    {
+        if (strcmp(args->text[i], "feed") == 0)
+        {
+            raster_by_feed = true;
+        }
+        else if (strcmp(args->text[i], "ack") == 0)
+        {
+            ack = true;
+        }
+        else if (strcmp(args->text[i], "depth") != 0)
+        {
+            print_error("raster: options are \"depth\" or \"feed\", and \"ack\"");
+            return;
+        }
+    }
+    raster_width = args->value[0];
+    raster_pitch = args->value[1];
+    if (x.current_position + raster_width*raster_pitch > x.max_position)
+    {
+        char message[69];
+        snprintf(message, sizeof(message), "raster: %d steps wide from x %d passes the X limit",
+                 raster_width*raster_pitch, x.current_position);
+        print_error(message);
+        return;
+    }
+    raster_origin[0] = x.current_position;
+    raster_origin[1] = y.current_position;
+    raster_rows = 0;
+    raster_runs = 0;
+    raster_mode = true;
+    start_stream(ack);
+}
+
+// ESTIMATE: dry run of "load", reporting how long the job takes and how
+// far it goes without moving anything
+void cmd_estimate(const command_args_T* args) {
+    if (job_recording)
+    {
+        print_error("estimate: not while recording; \"save\" first");
+        return;
+    }
+    // An unknown name would otherwise estimate as nothing at all
+    if (!is_prefab(args->text[0]) && job_find(JOBSTORE_REGION, args->text[0]) < 0)
+    {
+        print_error("estimate: no such prefab or job; try \"list\"");
+        return;
+    }
+    // The job starts from wherever queued motion leaves the machine
+    wait_for_motion();
+    int start[3] = {x.current_position, y.current_position, z.current_position};
+    dryrun_init(&dry);
+    dry_run = true;
+    cmd_load(args);
+    dryrun_finish(&dry);
+    dry_run = false;
+    motion_flushed = true;
+
+    // Nothing moved
+    x.current_position = x.target_position = start[0];
+    y.current_position = y.target_position = start[1];
+    z.current_position = z.target_position = start[2];
+    show_position();
+
+    char message[69];
+    unsigned long ms = (unsigned long)(dry.time_us / 1000);
+    unsigned long rapid_ms = (unsigned long)(dry.rapid_us / 1000);
+    snprintf(message, sizeof(message), "Estimate: %lu.%lu s, %lu.%lu s of it rapid, %lu segments",
+             ms / 1000, ms % 1000 / 100, rapid_ms / 1000, rapid_ms % 1000 / 100, (unsigned long)dry.segments);
+    print_output(message);
+    snprintf(message, sizeof(message), "Cut %lu, rapid %lu steps; pulses x %lu y %lu z %lu",
+             (unsigned long)dry.cut_length, (unsigned long)dry.rapid_length, (unsigned long)dry.steps[AXIS_X],
+             (unsigned long)dry.steps[AXIS_Y], (unsigned long)dry.steps[AXIS_Z]);
+    print_output(message);
+}
+
+// STOP
+void cmd_stop(const command_args_T* args) {
+    stop_motion();
+    char message[60];
+    snprintf(message, sizeof(message), "Stopped at x %d, y %d, z %d", x.current_position, y.current_position, z.current_position);
+    print_output(message);
+    print_live_coords(spindle_speed);
+}
+
+// TELEMETRY
+void cmd_telemetry(const command_args_T* args) {
+    set_telemetry_rate(args->value[0]);
+    char message[60];
+    snprintf(message, sizeof(message), "Telemetry: %d Hz, up to %d%% of the link", (int)args->value[0], TELEMETRY_SHARE_PERCENT);
+    print_output(message);
+}
+
+// BINARY
+void cmd_binary(const command_args_T* args) {
+    start_binary();
+}
+
+// HELP
+void cmd_help(const command_args_T* args) {
+    if (!args->text[0])
+    {
+        print_output("Commands are listed under Options; \"help [command]\" for syntax");
+        return;
+    }
+    const command_T* command = command_find(&command_table, args->text[0], strlen(args->text[0]));
+    char message[69];
+    if (command)
+    {
+        char usage[48];
+        command_usage(command, usage, sizeof(usage));
+        snprintf(message, sizeof(message), "Syntax: \"%s\"", usage);
+    }
+    else
+    {
+        snprintf(message, sizeof(message), "help: no command \"%.16s\"", args->text[0]);
+    }
+    print_output(message);
+}
+
+// ISR
+void cmd_isr(const command_args_T* args) {
+    bool reset = args->text[0] != NULL;
+    if (reset && strcmp(args->text[0], "reset") != 0)
+    {
+        print_error("isr: the only option is \"reset\"");
+        return;
+    }
+    isr_stats_T stats;
+    isr_snapshot(&stats, reset);
+    uint32_t mhz = clock_get_hz(clk_sys) / 1000000;
+    char message[69];
+    snprintf(message, sizeof(message), "RX irq: %lu calls, max %lu us (%lu cyc), mean %lu cyc, %lu B, %lu ovr",
+             (unsigned long)stats.calls, (unsigned long)(stats.max_cycles / mhz), (unsigned long)stats.max_cycles,
+             (unsigned long)isr_stats_mean(&stats), (unsigned long)stats.max_bytes, (unsigned long)stats.overruns);
+    print_output(message);
+}
+
+// LOG
+void cmd_log(const command_args_T* args) {
+    if (args->text[0] && strcmp(args->text[0], "clear") == 0)
+    {
+        msglog_init(&output_log);
+        log_view_end = 0;
+        log_follow = true;
+        log_drawn = false;
+        draw_log();
+        draw_input();
+        return;
+    }
+    if (args->text[0])
+    {
+        print_error("log: the only option is \"clear\"");
+        return;
+    }
+    char message[69];
+    snprintf(message, sizeof(message), "Log: %lu messages, last %u kept; PgUp/PgDn to scroll",
+             (unsigned long)output_log.written, MSGLOG_LINES);
+    print_output(message);
+}
+
+// TERM
+void cmd_term(const command_args_T* args) {
+    if (args->text[0])
+    {
+        if (strcmp(args->text[0], "8") != 0 && strcmp(args->text[0], "256") != 0)
+        {
+            print_error("term: colours are 8 or 256");
+            return;
+        }
+        term_set_palette(strcmp(args->text[0], "256") == 0);
+        screen_invalidate(&screen);     // repaint in the new colours
+    }
+    else
+    {
+        // Over the terminal and back, so the answer is not drawn over
+        update_screen();
+        if (!fit_terminal())
+        {
+            print_error("term: no size reported, or too small for the panels");
+            return;
+        }
+        draw_ui();
+    }
+    char message[69];
+    snprintf(message, sizeof(message), "Terminal: window %dx%d, %s colours", win_box.width, win_box.height + 1,
+             term_attr.palette ? "256" : "8");
+    print_output(message);
+}
+
+// Tab completion: command names, unless lines are going to G-code
+const char* command_word(int index) {
+    if (gcode_mode || index >= command_table.count)
+    {
+        return NULL;
+    }
+    return command_table.commands[index].name;
+}
+
+// Name, options box entry, arguments and handler of every command
+const command_T commands[] = {
+    {"move", "move - manual control",
+        {{"x", ARG_INT, false, MIN_POSITION, X_MAX}, {"y", ARG_INT, false, MIN_POSITION, Y_MAX},
+         {"z", ARG_INT, false, MIN_POSITION, Z_MAX}}, cmd_move},
+    {"home", "home - run homing cycle", {{NULL}}, cmd_home},
+    {"load", "load - prefab or job", {{"job", ARG_WORD, false, 0, 0}, {"order", ARG_WORD, true, 0, 0}}, cmd_load},
+    {"estimate", "estimate - time a load", {{"job", ARG_WORD, false, 0, 0}, {"order", ARG_WORD, true, 0, 0}},
+        cmd_estimate},
+    {"save", "save - record a job", {{"name", ARG_WORD, true, 0, 0}}, cmd_save},
+    {"list", "list - stored jobs", {{NULL}}, cmd_list},
+    {"delete", "delete - remove a job", {{"name", ARG_WORD, false, 0, 0}}, cmd_delete},
+    {"zero", "zero - set to [0 0 0]", {{NULL}}, cmd_zero},
+    {"setz", "setz - set spindle height", {{"depth", ARG_INT, false, -Z_MAX, Z_MAX}}, cmd_setz},
+    {"resize", "resize - resize Window",
+        {{"width", ARG_INT, false, 20, SCREEN_COLS}, {"height", ARG_INT, false, 10, SCREEN_ROWS},
+         {"x", ARG_INT, true, 1, SCREEN_COLS}, {"y", ARG_INT, true, 1, SCREEN_ROWS}}, cmd_resize},
+    {"spin", "spin - set spindle on/off", {{"speed", ARG_INT, false, 0, SPIN_MAX}}, cmd_spin},
+    {"gcode", "gcode - run G-code", {{"line", ARG_TEXT, true, 0, 0}}, cmd_gcode},
+    {"stream", "stream - stream G-code", {{"ack", ARG_WORD, true, 0, 0}}, cmd_stream},
+    {"raster", "raster - engrave image",
+        {{"width", ARG_INT, false, 1, RASTER_MAX_WIDTH}, {"pitch", ARG_INT, false, 1, X_MAX},
+         {"grey", ARG_WORD, true, 0, 0}, {"ack", ARG_WORD, true, 0, 0}}, cmd_raster},
+    {"stop", "stop - abort motion", {{NULL}}, cmd_stop},
+    {"telemetry", "telemetry - panel rate", {{"hz", ARG_INT, false, 0, TELEMETRY_MAX_HZ}}, cmd_telemetry},
+    {"binary", "binary - host protocol", {{NULL}}, cmd_binary},
+    {"isr", "isr - UART irq timing", {{"reset", ARG_WORD, true, 0, 0}}, cmd_isr},
+    {"term", "term - size and colours", {{"colours", ARG_WORD, true, 0, 0}}, cmd_term},
+    {"log", "log - output history", {{"clear", ARG_WORD, true, 0, 0}}, cmd_log},
+    {"help", "help - command syntax", {{"command", ARG_WORD, true, 0, 0}}, cmd_help},
+};
+
+/*
+#################################################################
+                            Main
+#################################################################
+*/
+int main(void) {
+    // Initialise components
+    stdio_init_all();
+
+    // Initialize GPIO pins
+    // Initialize GPIO pins
+    init_pin(STEP_PIN_X, GPIO_OUT);
+    init_pin(DIR_PIN_X, GPIO_OUT);
+    init_pin(STEP_PIN_Y, GPIO_OUT);
     init_pin(DIR_PIN_Y, GPIO_OUT);
     init_pin(STEP_PIN_Z, GPIO_OUT);
     init_pin(DIR_PIN_Z, GPIO_OUT);
     init_pin(RESET_PIN, GPIO_OUT);
     init_pin(SLEEP_PIN, GPIO_OUT);
+    init_pin(FAULT_PIN, GPIO_IN);
+    gpio_pull_up(FAULT_PIN);
+    init_pin(HOME_PIN_X, GPIO_IN);
+    init_pin(HOME_PIN_Y, GPIO_IN);
+    init_pin(HOME_PIN_Z, GPIO_IN);
+    gpio_pull_up(HOME_PIN_X);
+    gpio_pull_up(HOME_PIN_Y);
+    gpio_pull_up(HOME_PIN_Z);
+    init_stepper();
+    planner_init(&planner);
+
+    // Motion executor runs on the second core
+    multicore_launch_core1(core1_main);
 
     // Set direction forward and wake up the driver
     gpio_put(SLEEP_PIN, true);  // Enable driver
     gpio_put(RESET_PIN, true);  // Reset any faults
+    gpio_set_irq_enabled_with_callback(FAULT_PIN, GPIO_IRQ_EDGE_FALL, true, &on_fault);
   
     // Set up UART
     uart_init(UART_ID, BAUD_RATE);
@@ -633,15 +2884,22 @@ int main(void) {
     gpio_set_function(UART_RX_PIN, GPIO_FUNC_UART);
     uart_set_hw_flow(UART_ID, false, false);
     uart_set_format(UART_ID, DATA_BITS, STOP_BITS, PARITY);
-    uart_set_fifo_enabled(UART_ID, false);
+    uart_set_fifo_enabled(UART_ID, true);
+
+    // SysTick counts CPU cycles for the RX interrupt timing
+    systick_hw->rvr = ISRSTAT_COUNTER_MASK;
+    systick_hw->csr = 0x5;      // enabled, processor clock, no interrupt
 
     // Set up a RX interrupt
+    ring_init(&input_ring, input_storage, INPUT_BUFFER_SIZE);
     int UART_IRQ = UART_ID == uart0 ? UART0_IRQ : UART1_IRQ;
     irq_set_exclusive_handler(UART_IRQ, on_uart_rx);
     irq_set_enabled(UART_IRQ, true);
     uart_set_irq_enables(UART_ID, true, false);
-
-    int x_steps = 0;
+    hw_write_masked(&uart_get_hw(UART_ID)->ifls, UART_RX_FIFO_LEVEL << UART_UARTIFLS_RXIFLSEL_LSB,
+                    UART_UARTIFLS_RXIFLSEL_BITS);
+    init_term_dma();
+    screen_init(&screen);
 
     // Configure window box
     // TIP: UI works better when width and height are multiples of 9
@@ -652,7 +2910,19 @@ int main(void) {
     win_box.header = "CC2511 Assignment 2";     //set box header
     win_box.is_heading_centered = true;         //set heading alignment
 
+    command_table_init(&command_table, commands, LEN(commands));
+    lineedit_init(&editor, command_word);
+    msglog_init(&output_log);
+    layout_ui();
+    bool fitted = fit_terminal();
     draw_ui();
+    if (!fitted)
+    {
+        print_warning("Terminal size unknown or too small; \"resize\" to set the window");
+    }
+    print_output("Ready for commands...");
+    telemetry_init(&telemetry, TELEMETRY_HZ, BAUD_RATE, TELEMETRY_SHARE_PERCENT);
+    set_telemetry_rate(TELEMETRY_HZ);
 
     setup_pwm();
     spindle_on(0);
@@ -664,6 +2934,9 @@ int main(void) {
     x.target_position = 0;
     x.step_pin = STEP_PIN_X;
     x.dir_pin = DIR_PIN_X;
+    x.index = AXIS_X;
+    x.max_velocity = XY_MAX_VELOCITY;
+    x.acceleration = XY_ACCELERATION;
 
     y.max_position = Y_MAX;
     y.min_position = MIN_POSITION;
@@ -671,6 +2944,9 @@ int main(void) {
     y.target_position = 0;
     y.step_pin = STEP_PIN_Y;
     y.dir_pin = DIR_PIN_Y;
+    y.index = AXIS_Y;
+    y.max_velocity = XY_MAX_VELOCITY;
+    y.acceleration = XY_ACCELERATION;
 
     z.max_position = Z_MAX;
     z.min_position = MIN_POSITION;
@@ -678,317 +2954,64 @@ int main(void) {
     z.target_position = 0;
     z.step_pin = STEP_PIN_Z;
     z.dir_pin = DIR_PIN_Z;
+    z.index = AXIS_Z;
+    z.max_velocity = Z_MAX_VELOCITY;
+    z.acceleration = Z_ACCELERATION;
 
-    int z_down = 350;
-    int z_up = z_down - 200;
-
-    // Initialize spindle speed
-    int spindle_speed = 0;
-
-    // Initialize coordinate array
-    volatile int coords[] = {x.current_position, y.current_position, z.current_position, spindle_speed};
+    // Initialize G-code interpreter at the current position
+    int32_t gcode_start[3] = {0, 0, 0};
+    gcode_init(&gcode, gcode_start, STEPS_PER_MM);
 
     while (true) {
         spindle_on(spindle_speed*spindle_speed);
-        // Wait for input
-        while (!input_ready) {
-            __asm("wfi");  // Wait for interrupt
-        }
-        // Store commands
-        char option_move[20] = "move";
-        char option_load[20] = "load";
-        char option_zero[20] = "zero";
-        char option_resize[20] = "resize";
-        char option_home[20] = "home";
-        char option_setz[20] = "setz";
-        char option_spin[20] = "spin";
-        // Process input
-        char command[20] = "\000";
-        char argument[20] = "\000";
-        
-        int input = sscanf(buffer, "%s %[^\t\n]", &command, &argument);
-        
-        // MANUAL CONTROL
-        if (strcmp(command, option_move) == 0)
-        {
-            // Set temp coord values
-            coords[0] = 9999;
-            coords[1] = 9999;
-            coords[2] = 9999;
-            coords[3] = spindle_speed;
-
-            // Scan input for target coords
-            input = sscanf(argument, "%d %d %d", &coords[0], &coords[1], &coords[2]);
-            
-            // Check if all coords have been set by user
-            if (coords[0] == 9999 || coords[1] == 9999 || coords[2] == 9999)
-            {
-                // If not then show user the correct syntax
-                print_output("Syntax: \"move [x] [y] [z]\"");
-            }
-            else
-            {
-                // If yes then move to target coords
-                x.target_position = coords[0];
-                y.target_position = coords[1];
-                z.target_position = coords[2];
-                move_to_position(&x, &y, &z);
-                print_coords(coords);
-            }
-        }
-        // LOAD
-        else if (strcmp(command, option_load) == 0)
-        {
-            /*
-            ############################################################
-                                Define Sequences
-            ############################################################
-            */
-            // define house
-            const int house[][3] = {
-                // Outline
-                {1000, 0, z_up},    //arive at start position
-                {1000, 0, z_down},
-                {5000, 0, z_down},
-                {5000, 2000, z_down},
-                {6000, 2000, z_down},
-                {3000, 4000, z_down},
-                {0, 2000, z_down},
-                {1000, 2000, z_down},
-                {1000, 0, z_down},
-                //Chimney
-                {1500, 3000, z_up},
-                {1500, 3000, z_down},
-                {1500, 3500, z_down},
-                {1000, 3500, z_down},
-                {1000, 2667, z_down},
-                //Door
-                {3200, 0, z_up},
-                {3200, 0, z_down},
-                {3200, 1600, z_down},
-                {4200, 1600, z_down},
-                {4200, 0, z_down},
-                //Window
-                {1600, 800, z_up},
-                {1600, 800, z_down},
-                {1600, 1600, z_down},
-                {2400, 1600, z_down},
-                {2400, 800, z_down},
-                {1600, 800, z_down},
-                {2000, 800, z_up},
-                {2000, 800, z_down},
-                {2000, 1600, z_down},
-                {1600, 1200, z_up},
-                {1600, 1200, z_down},
-                {2400, 1200, z_down},
-                // Home
-                {0, 0, z_up}
-            };
-
-            const int star[][3] = {
-                {923, 217, z_up},   //arrive at start position
-                {923, 217, z_down},
-                {1334, 1484, z_down},
-                {257, 2266, z_down},
-                {1589, 2266, z_down},
-                {2000, 3533, z_down},
-                {2411, 2266, z_down},
-                {3743, 2266, z_down},
-                {2666, 1484, z_down},
-                {3077, 217, z_down},
-                {2000, 1000, z_down},
-                {923, 217, z_down},
-                // Home
-                {0, 0, z_up}
-            };
-
-            /*
-            ############################################################
-                            End Sequence Definition
-            ############################################################
-            */
-
-            // Store prefab options
-            char option_house[20] = "house";
-            char option_star[20] = "star";
-            char option_circle[20] = "circle";
-
-            // Preallocate prefab option input
-            char sequence[20];
-            input = sscanf(argument, "%s", &sequence);
-
-            // Check prefabs
-            // house
-            if (strcmp(sequence, option_house) == 0)
-            {
-                print_sequence(house, LEN(house), &x, &y, &z, spindle_speed);
-                print_output("Sequence: house, completed");
-            }
-            else if (strcmp(sequence, option_star) == 0)
-            {
-                print_sequence(star, LEN(star), &x, &y, &z, spindle_speed);
-                print_output("Sequence: star, completed");
-            }
-            else
-            {
-                print_output("Syntax: \"load [prefab]\". Available prefabs are: house, star, circle");
-            }
-        }
-        // ZERO
-        else if (strcmp(command, option_zero) == 0)
-        {
-            x.current_position = 0;
-            y.current_position = 0;
-            z.current_position = 0;
-            print_output("Coordinates zeroed");
-            coords[0] = x.current_position;
-            coords[1] = y.current_position;
-            coords[2] = z.current_position;
-            coords[3] = spindle_speed;
-            print_coords(coords);
-        }
-        // RESIZE
-        else if (strcmp(command, option_resize) == 0)    
-        {
-            // Set temp window parameters
-            uint width = 9999;
-            uint height = 9999;
-            uint x_origin = 9999;
-            uint y_origin = 9999;
-
-            input = sscanf(argument, "%d %d %d %d", &width, &height, &x_origin, &y_origin);
 
-            // Check if crucial parameters have changed
-            if (width == 9999 || height == 9999)
-            {
-                // If unchanged show user correct syntax
-                print_output("Syntax: \"resize [width] [height] [*x origin] [*y origin]\" *optional");
-            }
-            else
-            {
-                // If changed draw new window
-                clear_ui();
-                win_box.height = height;
-                win_box.width = width;
-
-                // Check if origin points are changed
-                if (x_origin == 9999 || y_origin == 9999)
-                {
-                    // If unchanged default origin to [1, 1]
-                    win_box.x_origin = 1;
-                    win_box.y_origin = 1;
-                }
-                else
-                {
-                    win_box.x_origin = x_origin;
-                    win_box.y_origin = y_origin;
-                }
-                
-                draw_ui();
-            }
-        }
-        // HOME
-        else if (strcmp(command, option_home) == 0)
+        // Streamed job: lines come from the ring, not the line editor
+        if (stream_mode)
         {
-            x.target_position = 0;
-            y.target_position = 0;
-            z.target_position = 0;
-            move_to_position(&x, &y, &z);
-            x.current_position = x.target_position;
-            y.current_position = y.target_position;
-            z.current_position = z.target_position;
-            coords[0] = x.current_position;
-            coords[1] = y.current_position;
-            coords[2] = z.current_position;
-            coords[3] = spindle_speed;
-            print_coords(coords);
+            service_stream(&spindle_speed);
+            continue;
         }
-        // SETZ
-        else if (strcmp(command, option_setz) == 0)
+        // Binary protocol: frames from the host, answered in frames
+        if (binary_mode)
         {
-            // Set temp depth value
-            int depth = 9999;
-
-            input = sscanf(argument, "%d", &depth);
+            service_binary(&spindle_speed);
+            continue;
+        }
 
-            // Check if depth is unchanged
-            if (depth == 9999)
+        // Wait for a line, showing live coordinates while the machine moves
+        while (!read_input()) {
+            service_realtime(spindle_speed);
+            service_telemetry(spindle_speed);
+            update_screen();
+            // Sleep unless a key came in meanwhile; a pending interrupt still wakes wfi
+            uint32_t irq_state = save_and_disable_interrupts();
+            if (ring_count(&input_ring) == 0)
             {
-                // If unchanged show user correct syntax
-                print_output("Syntax: \"setz [depth]\"");
-            }
-            else
-            {
-                // If changed check if valid height
-                if ((z.current_position + depth) > Z_MAX)
-                {
-                    char message[50];
-                    sprintf(message, "Error: maximum allowed depth at this height is %d", Z_MAX - z.current_position);
-                    print_output(message);
-                }
-                else
-                {
-                    z_down = z.current_position;
-                    z_up = z_down - depth;
-                    char message[50];
-                    sprintf(message, "Z up set to %d, Z down set to %d", z_up, z_down);
-                    print_output(message);
-                }
+                __asm("wfi");
             }
+            restore_interrupts(irq_state);
         }
-        // SET SPINDLE SPEED
-        else if (strcmp(command, option_spin) == 0)
-        {
-            // Set temp speed
-            int speed = 9999;
 
-            // Process input
-            input = sscanf(argument, "%d", &speed);
-
-            // Check if speed has been changed
-            if (speed == 9999)
-            {
-                // If unchanged show user the correct syntax
-                char message[50];
-                sprintf(message, "Syntax: \"spin [speed]\"", SPIN_MAX);
-                print_output(message);
-            }
-            else if (speed < 0 || speed > SPIN_MAX)
+        // G-code mode: every line goes to the interpreter
+        if (gcode_mode)
+        {
+            if (strcmp(input_line, "exit") == 0)
             {
-                // If speed is out of bounds show error message
-                char message[50];
-                sprintf(message, "Error: spindle speed out of bounds (0-%d)", SPIN_MAX);
-                print_output(message);
+                gcode_mode = false;
+                print_output("Left G-code mode");
             }
-            
             else
             {
-                // If changed set spindle speed
-                spindle_speed = speed;
-                char message[50];
-                sprintf(message, "Spindle speed set to %d", spindle_speed);
-                print_output(message);
-                coords[0] = x.current_position;
-                coords[1] = y.current_position;
-                coords[2] = z.current_position;
-                coords[3] = spindle_speed;
-                print_coords(coords);
-            } 
-        }
-        // INVALID COMMAND
-        else
-        {
-            print_output("Invalid command.");
-            clr_input(in_box);
+                run_gcode_line(input_line, &spindle_speed, true);
+            }
+            continue;
         }
-        
-        for (int i = 0; i < 20; i++)
+        // Look the command up and run it
+        char message[69];
+        if (!command_dispatch(&command_table, input_line, message, sizeof(message)))
         {
-            command[i] = "\000";
-            argument[i] = "\000";
+            print_error(message);
         }
-
-        input_ready = false;  // Reset input flag
         //spindle_on(0);
     }
 }
@@ -0,0 +1,144 @@
+/** \file motion.h
+ *  \defgroup cnc_motion
+ *
+ * Command queue between the user interface core and the motion core.
+ *
+ * Core0 parses input, checks limits and pushes straight segments and arcs (and
+ * flush markers and homing requests) into this queue; core1 pops them into the look-ahead
+ * planner and the step engine. The queue is single producer, single
+ * consumer and lock free: head is only written by core0, tail only by
+ * core1. Nothing in here touches the hardware.
+ */
+
+#ifndef CC2511_MOTION_H
+#define CC2511_MOTION_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define MOTION_NUM_AXES   3
+#define MOTION_QUEUE_SIZE 128U      /* must be a power of two */
+
+/* Axis limits of the mill, shared with the host tools */
+#define XY_MAX_VELOCITY 2500        /* steps/s */
+#define XY_ACCELERATION 5000        /* steps/s^2 */
+#define Z_MAX_VELOCITY  1250
+#define Z_ACCELERATION  2500
+
+/* G-code units are motor steps until the lead screws are calibrated */
+#define STEPS_PER_MM    1
+
+typedef enum motion_cmd_type {
+    MOTION_SEGMENT,     /* straight move into the look-ahead buffer */
+    MOTION_ARC,         /* circular or helical arc, same buffer */
+    MOTION_FLUSH,       /* run out the look-ahead buffer and stop */
+    MOTION_HOME         /* run the homing cycle on one axis */
+}   motion_cmd_type_T;
+
+typedef struct motion_cmd {
+    motion_cmd_type_T type;
+    int32_t delta[MOTION_NUM_AXES];         /* signed steps per axis */
+    uint32_t max_velocity[MOTION_NUM_AXES]; /* steps/s */
+    uint32_t max_accel[MOTION_NUM_AXES];    /* steps/s^2 */
+    uint32_t feed;                          /* path steps/s, 0 = rapid */
+    int32_t center[2];                      /* MOTION_ARC: centre relative to the start */
+    bool clockwise;                         /* MOTION_ARC: direction seen from +Z */
+    uint8_t axis;                           /* MOTION_HOME: axis to home */
+}   motion_cmd_T;
+
+typedef struct motion_queue {
+    motion_cmd_T cmds[MOTION_QUEUE_SIZE];
+    volatile uint32_t head;     /* written by core0 only */
+    volatile uint32_t tail;     /* written by core1 only */
+}   motion_queue_T;
+
+/*! \brief Empty the queue.
+ *  \ingroup cnc_motion
+ */
+static inline void motion_queue_init(motion_queue_T *q) {
+    q->head = 0;
+    q->tail = 0;
+}
+
+/*! \brief Commands waiting for core1.
+ *  \ingroup cnc_motion
+ */
+static inline uint32_t motion_queued(const motion_queue_T *q) {
+    return q->head - q->tail;
+}
+
+/*! \brief Append a command. Producer side only.
+ *  \ingroup cnc_motion
+ *
+ * \return false if the queue is full
+ */
+static inline bool motion_push(motion_queue_T *q, const motion_cmd_T *cmd) {
+    uint32_t head = q->head;
+    if (head - q->tail >= MOTION_QUEUE_SIZE) {
+        return false;
+    }
+    q->cmds[head & (MOTION_QUEUE_SIZE - 1)] = *cmd;
+    __sync_synchronize();   /* command must be visible before head moves */
+    q->head = head + 1;
+    return true;
+}
+
+/*! \brief Remove the oldest command. Consumer side only.
+ *  \ingroup cnc_motion
+ *
+ * \return false if the queue is empty
+ */
+static inline bool motion_pop(motion_queue_T *q, motion_cmd_T *cmd) {
+    uint32_t tail = q->tail;
+    if (tail == q->head) {
+        return false;
+    }
+    __sync_synchronize();   /* read the command only after seeing head */
+    *cmd = q->cmds[tail & (MOTION_QUEUE_SIZE - 1)];
+    __sync_synchronize();
+    q->tail = tail + 1;
+    return true;
+}
+
+/*! \brief Drop everything queued. Consumer side only.
+ *  \ingroup cnc_motion
+ */
+static inline void motion_discard(motion_queue_T *q) {
+    q->tail = q->head;
+}
+
+/*! \brief Split a rapid into the straight moves the mill makes for it.
+ *  \ingroup cnc_motion
+ *
+ * Z goes first if the tool is off Z zero, so it is lifted clear before
+ * travelling, then XY, then Z down to the target height. The XY move is
+ * always there, even if it is zero.
+ *
+ * \param delta Filled with the moves in order, relative
+ * \return the number of moves (1 to 3)
+ */
+static inline int motion_rapid_split(const int32_t from[MOTION_NUM_AXES], const int32_t to[MOTION_NUM_AXES],
+  int32_t delta[3][MOTION_NUM_AXES]) {
+    int32_t dz = to[2] - from[2];
+    int count = 0;
+    if (dz != 0 && from[2] != 0) {
+        delta[count][0] = 0;
+        delta[count][1] = 0;
+        delta[count][2] = dz;
+        count++;
+        dz = 0;
+    }
+    delta[count][0] = to[0] - from[0];
+    delta[count][1] = to[1] - from[1];
+    delta[count][2] = 0;
+    count++;
+    if (dz != 0) {
+        delta[count][0] = 0;
+        delta[count][1] = 0;
+        delta[count][2] = dz;
+        count++;
+    }
+    return count;
+}
+
+#endif //  CC2511_MOTION_H
@@ -0,0 +1,94 @@
+/** \file msglog.h
+ *  \defgroup cnc_msglog
+ *
+ * Header-only message log behind the Output box.
+ *
+ * Messages go into a fixed ring of MSGLOG_LINES entries with the time
+ * they were logged and a severity; the oldest is overwritten when the
+ * ring is full. Entries are numbered from the first message ever logged,
+ * so a view of the log can tell which lines are new since it was last
+ * drawn and stays put while more messages arrive. Nothing in here touches
+ * the hardware.
+ */
+
+#ifndef CC2511_MSGLOG_H
+#define CC2511_MSGLOG_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define MSGLOG_LINES 64U        /* power of two */
+#define MSGLOG_TEXT  72         /* longest message kept, including the terminator */
+
+typedef enum msg_level {
+    MSG_INFO,
+    MSG_WARNING,
+    MSG_ERROR
+}   msg_level_T;
+
+typedef struct msglog_entry {
+    uint32_t time_ms;           /* when it was logged */
+    msg_level_T level;
+    char text[MSGLOG_TEXT];
+}   msglog_entry_T;
+
+typedef struct msglog {
+    msglog_entry_T entry[MSGLOG_LINES];
+    uint32_t written;           /* messages logged so far; the next one's number */
+}   msglog_T;
+
+/*! \brief Start with an empty log.
+ *  \ingroup cnc_msglog
+ */
+static inline void msglog_init(msglog_T *log) {
+    log->written = 0;
+}
+
+/*! \brief Number of the oldest message still held.
+ *  \ingroup cnc_msglog
+ */
+static inline uint32_t msglog_first(const msglog_T *log) {
+    return log->written > MSGLOG_LINES ? log->written - MSGLOG_LINES : 0;
+}
+
+/*! \brief Add a message, cut to MSGLOG_TEXT - 1 characters and to its
+ *  first line.
+ *  \ingroup cnc_msglog
+ *
+ * \return the message's number
+ */
+static inline uint32_t msglog_add(msglog_T *log, uint32_t time_ms, msg_level_T level, const char *text) {
+    msglog_entry_T *e = &log->entry[log->written & (MSGLOG_LINES - 1)];
+    size_t length = strcspn(text, "\r\n");
+    if (length > MSGLOG_TEXT - 1) {
+        length = MSGLOG_TEXT - 1;
+    }
+    memcpy(e->text, text, length);
+    e->text[length] = '\0';
+    e->time_ms = time_ms;
+    e->level = level;
+    return log->written++;
+}
+
+/*! \brief A message by number, NULL if it has been overwritten or not
+ *  logged yet.
+ *  \ingroup cnc_msglog
+ */
+static inline const msglog_entry_T *msglog_get(const msglog_T *log, uint32_t number) {
+    if (number >= log->written || number < msglog_first(log)) {
+        return NULL;
+    }
+    return &log->entry[number & (MSGLOG_LINES - 1)];
+}
+
+/*! \brief Write the time of a message as minutes and seconds since start.
+ *  \ingroup cnc_msglog
+ */
+static inline void msglog_stamp(const msglog_entry_T *e, char *out, size_t size) {
+    uint32_t seconds = e->time_ms / 1000;
+    snprintf(out, size, "%02lu:%02lu", (unsigned long)(seconds / 60 % 100), (unsigned long)(seconds % 60));
+}
+
+#endif //  CC2511_MSGLOG_H
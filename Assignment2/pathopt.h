@@ -0,0 +1,365 @@
+/** \file pathopt.h
+ *  \defgroup cnc_pathopt
+ *
+ * Header-only travel optimiser for jobs made of several contours.
+ *
+ * A job is a list of points the tool visits in turn. Points at the travel
+ * height are hops in the air; each run of points below it is a contour
+ * that is cut. The contours do not depend on each other, so they can be
+ * cut in any order, open contours in either direction, and closed ones
+ * (ending where they start) from any of their points. Points after the
+ * last contour, such as the return to the origin, stay at the end.
+ *
+ * path_optimize() orders the contours by nearest neighbour from where the
+ * tool is, then improves the order with 2-opt (reversing a run of
+ * contours when that shortens the hops around it), by moving single
+ * contours to a better place and by picking the best start of every
+ * closed contour, for at most PATHOPT_MAX_PASSES passes.
+ * The result is never longer than the order the job was written in.
+ * Only XY travel is counted: every contour still costs one lift and one
+ * plunge wherever it is. Nothing in here touches the hardware.
+ */
+
+#ifndef CC2511_PATHOPT_H
+#define CC2511_PATHOPT_H
+
+#include <math.h>
+#include <stdbool.h>
+#include <string.h>
+
+#define PATHOPT_MAX_CONTOURS 32
+#define PATHOPT_MAX_PASSES   8      /* of the improvements; bounds the run time */
+
+typedef struct path_contour {
+    int first;                  /* index of its first point in the job */
+    int count;                  /* points */
+    bool closed;                /* ends where it starts */
+    bool reversed;              /* cut from its last point to its first (open only) */
+    int start;                  /* point a closed contour is cut from, 0 to count - 2 */
+}   path_contour_T;
+
+typedef struct path_plan {
+    const int (*point)[3];      /* the job, x y z */
+    int z_travel;               /* height of the hops between contours */
+    path_contour_T contour[PATHOPT_MAX_CONTOURS];
+    int count;
+    int tail;                   /* first point after the last contour */
+    int length;                 /* points in the job */
+    int from[2];                /* where the tool is before the job */
+}   path_plan_T;
+
+/*! \brief Split a job into its contours.
+ *  \ingroup cnc_pathopt
+ *
+ * \param from XY of the tool before the job
+ * \return false if it has more than PATHOPT_MAX_CONTOURS contours
+ */
+static inline bool path_split(path_plan_T *p, const int (*point)[3], int length, int z_travel, const int from[2]) {
+    p->point = point;
+    p->z_travel = z_travel;
+    p->count = 0;
+    p->tail = 0;
+    p->length = length;
+    p->from[0] = from[0];
+    p->from[1] = from[1];
+    int i = 0;
+    while (i < length) {
+        if (point[i][2] == z_travel) {
+            i++;
+            continue;
+        }
+        if (p->count >= PATHOPT_MAX_CONTOURS) {
+            return false;
+        }
+        path_contour_T *c = &p->contour[p->count++];
+        c->first = i;
+        while (i < length && point[i][2] != z_travel) {
+            i++;
+        }
+        c->count = i - c->first;
+        c->closed = c->count >= 3 && memcmp(point[c->first], point[i - 1], sizeof(point[i - 1])) == 0;
+        c->reversed = false;
+        c->start = 0;
+        p->tail = i;
+    }
+    return true;
+}
+
+/* Point of a contour the cut starts at and the one it ends at */
+static inline const int *path_entry(const path_plan_T *p, const path_contour_T *c) {
+    if (c->closed) {
+        return p->point[c->first + c->start];
+    }
+    return p->point[c->reversed ? c->first + c->count - 1 : c->first];
+}
+
+static inline const int *path_exit(const path_plan_T *p, const path_contour_T *c) {
+    if (c->closed) {
+        return p->point[c->first + c->start];
+    }
+    return p->point[c->reversed ? c->first : c->first + c->count - 1];
+}
+
+static inline float path_distance(const int *a, const int *b) {
+    float dx = (float)(a[0] - b[0]);
+    float dy = (float)(a[1] - b[1]);
+    return sqrtf(dx * dx + dy * dy);
+}
+
+/* Where the tool goes after the last contour, NULL if nowhere */
+static inline const int *path_end(const path_plan_T *p) {
+    return p->tail < p->length ? p->point[p->tail] : NULL;
+}
+
+/*! \brief XY travel of the plan as it stands, in steps.
+ *  \ingroup cnc_pathopt
+ */
+static inline float path_travel(const path_plan_T *p) {
+    const int *end = path_end(p);
+    if (p->count == 0) {
+        return end ? path_distance(p->from, end) : 0.0f;
+    }
+    float travel = path_distance(p->from, path_entry(p, &p->contour[0]));
+    for (int i = 1; i < p->count; i++) {
+        travel += path_distance(path_exit(p, &p->contour[i - 1]), path_entry(p, &p->contour[i]));
+    }
+    if (end) {
+        travel += path_distance(path_exit(p, &p->contour[p->count - 1]), end);
+    }
+    return travel;
+}
+
+/* Entry point of one way of cutting a contour: a start for closed ones,
+   forwards or backwards for open ones */
+static inline const int *path_way(const path_plan_T *p, const path_contour_T *c, int way) {
+    if (c->closed) {
+        return p->point[c->first + way];
+    }
+    return p->point[way ? c->first + c->count - 1 : c->first];
+}
+
+static inline const int *path_way_exit(const path_plan_T *p, const path_contour_T *c, int way) {
+    return c->closed ? path_way(p, c, way) : path_way(p, c, !way);
+}
+
+/* Order the contours by always cutting the nearest way in next */
+static inline void path_nearest(path_plan_T *p) {
+    const int *at = p->from;
+    for (int i = 0; i < p->count; i++) {
+        int best = i;
+        int best_way = 0;
+        float best_distance = INFINITY;
+        for (int j = i; j < p->count; j++) {
+            path_contour_T *c = &p->contour[j];
+            int ways = c->closed ? c->count - 1 : 2;
+            for (int way = 0; way < ways; way++) {
+                float d = path_distance(at, path_way(p, c, way));
+                if (d < best_distance) {
+                    best_distance = d;
+                    best = j;
+                    best_way = way;
+                }
+            }
+        }
+        path_contour_T chosen = p->contour[best];
+        p->contour[best] = p->contour[i];
+        if (chosen.closed) {
+            chosen.start = best_way;
+        } else {
+            chosen.reversed = best_way != 0;
+        }
+        p->contour[i] = chosen;
+        at = path_exit(p, &p->contour[i]);
+    }
+}
+
+/* One pass of 2-opt: cutting contours i..j in the opposite order, each
+   the other way round, when that shortens the hops into and out of the
+   run. Returns true if anything changed. */
+static inline bool path_two_opt(path_plan_T *p) {
+    const int *end = path_end(p);
+    bool improved = false;
+    for (int i = 0; i < p->count - 1; i++) {
+        for (int j = i + 1; j < p->count; j++) {
+            const int *before = i > 0 ? path_exit(p, &p->contour[i - 1]) : p->from;
+            const int *after = j + 1 < p->count ? path_entry(p, &p->contour[j + 1]) : end;
+            const int *in = path_entry(p, &p->contour[i]);
+            const int *out = path_exit(p, &p->contour[j]);
+            float old_cost = path_distance(before, in);
+            float new_cost = path_distance(before, out);
+            if (after) {
+                old_cost += path_distance(out, after);
+                new_cost += path_distance(in, after);
+            }
+            if (new_cost < old_cost - 0.5f) {
+                for (int a = i, b = j; a < b; a++, b--) {
+                    path_contour_T swap = p->contour[a];
+                    p->contour[a] = p->contour[b];
+                    p->contour[b] = swap;
+                }
+                for (int k = i; k <= j; k++) {
+                    p->contour[k].reversed = !p->contour[k].reversed;
+                }
+                improved = true;
+            }
+        }
+    }
+    return improved;
+}
+
+/* One pass of moving single contours: each is taken out and put back
+   wherever, and however round, saves the most travel. Returns true if
+   anything changed. */
+static inline bool path_relocate(path_plan_T *p) {
+    const int *end = path_end(p);
+    bool improved = false;
+    for (int i = 0; i < p->count; i++) {
+        path_contour_T c = p->contour[i];
+        const int *before = i > 0 ? path_exit(p, &p->contour[i - 1]) : p->from;
+        const int *after = i + 1 < p->count ? path_entry(p, &p->contour[i + 1]) : end;
+        float saved = path_distance(before, path_entry(p, &c));
+        if (after) {
+            saved += path_distance(path_exit(p, &c), after) - path_distance(before, after);
+        }
+        // Gaps of the list without contour i: gap k comes before its k-th contour
+        int best_gap = -1;
+        int best_way = 0;
+        float best_gain = 0.5f;
+        int ways = c.closed ? c.count - 1 : 2;
+        for (int gap = 0; gap < p->count; gap++) {
+            int prev = gap - 1 < i ? gap - 1 : gap;
+            int next = gap < i ? gap : gap + 1;
+            const int *left = prev >= 0 ? path_exit(p, &p->contour[prev]) : p->from;
+            const int *right = next < p->count ? path_entry(p, &p->contour[next]) : end;
+            float gap_cost = right ? path_distance(left, right) : 0.0f;
+            for (int way = 0; way < ways; way++) {
+                float cost = path_distance(left, path_way(p, &c, way)) - gap_cost;
+                if (right) {
+                    cost += path_distance(path_way_exit(p, &c, way), right);
+                }
+                if (saved - cost > best_gain) {
+                    best_gain = saved - cost;
+                    best_gap = gap;
+                    best_way = way;
+                }
+            }
+        }
+        if (best_gap < 0) {
+            continue;
+        }
+        if (c.closed) {
+            c.start = best_way;
+        } else {
+            c.reversed = best_way != 0;
+        }
+        if (best_gap > i) {
+            memmove(&p->contour[i], &p->contour[i + 1], sizeof(c) * (best_gap - i));
+        } else {
+            memmove(&p->contour[best_gap + 1], &p->contour[best_gap], sizeof(c) * (i - best_gap));
+        }
+        p->contour[best_gap] = c;
+        improved = true;
+    }
+    return improved;
+}
+
+/* Start every closed contour at the point nearest the hops either side.
+   Returns true if anything changed. */
+static inline bool path_choose_starts(path_plan_T *p) {
+    const int *end = path_end(p);
+    bool improved = false;
+    for (int i = 0; i < p->count; i++) {
+        path_contour_T *c = &p->contour[i];
+        if (!c->closed) {
+            continue;
+        }
+        const int *before = i > 0 ? path_exit(p, &p->contour[i - 1]) : p->from;
+        const int *after = i + 1 < p->count ? path_entry(p, &p->contour[i + 1]) : end;
+        int best = c->start;
+        float best_cost = INFINITY;
+        for (int s = 0; s < c->count - 1; s++) {
+            const int *v = p->point[c->first + s];
+            float cost = path_distance(before, v) + (after ? path_distance(v, after) : 0.0f);
+            if (cost < best_cost - 0.5f || (s == c->start && cost <= best_cost)) {
+                best_cost = cost;
+                best = s;
+            }
+        }
+        if (best != c->start) {
+            c->start = best;
+            improved = true;
+        }
+    }
+    return improved;
+}
+
+/*! \brief Reorder the contours to shorten the travel between them.
+ *  \ingroup cnc_pathopt
+ *
+ * Keeps the order the job was written in if nothing shorter is found.
+ *
+ * \return the travel of the chosen order, in steps
+ */
+static inline float path_optimize(path_plan_T *p) {
+    path_contour_T written[PATHOPT_MAX_CONTOURS];
+    memcpy(written, p->contour, sizeof(written[0]) * p->count);
+    float written_travel = path_travel(p);
+
+    path_nearest(p);
+    path_choose_starts(p);
+    for (int pass = 0; pass < PATHOPT_MAX_PASSES; pass++) {
+        bool improved = path_two_opt(p);
+        improved = path_relocate(p) || improved;
+        improved = path_choose_starts(p) || improved;
+        if (!improved) {
+            break;
+        }
+    }
+    float travel = path_travel(p);
+    if (travel >= written_travel) {
+        memcpy(p->contour, written, sizeof(written[0]) * p->count);
+        return written_travel;
+    }
+    return travel;
+}
+
+/*! \brief Write the job out in the planned order.
+ *  \ingroup cnc_pathopt
+ *
+ * Every contour is reached by a hop at the travel height to its first
+ * point; the points after the last contour follow unchanged.
+ *
+ * \return points written, or -1 if they do not fit in size
+ */
+static inline int path_emit(const path_plan_T *p, int (*out)[3], int size) {
+    int n = 0;
+    for (int i = 0; i < p->count; i++) {
+        const path_contour_T *c = &p->contour[i];
+        if (n + 1 + c->count > size) {
+            return -1;
+        }
+        const int *entry = path_entry(p, c);
+        out[n][0] = entry[0];
+        out[n][1] = entry[1];
+        out[n][2] = p->z_travel;
+        n++;
+        for (int k = 0; k < c->count; k++) {
+            int index;
+            if (c->closed) {
+                index = c->first + (c->start + k) % (c->count - 1);
+            } else {
+                index = c->reversed ? c->first + c->count - 1 - k : c->first + k;
+            }
+            memcpy(out[n++], p->point[index], sizeof(out[0]));
+        }
+    }
+    for (int i = p->tail; i < p->length; i++) {
+        if (n >= size) {
+            return -1;
+        }
+        memcpy(out[n++], p->point[i], sizeof(out[0]));
+    }
+    return n;
+}
+
+#endif //  CC2511_PATHOPT_H
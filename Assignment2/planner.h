@@ -0,0 +1,564 @@
+/** \file planner.h
+ *  \defgroup cnc_planner
+ *
+ * Header-only motion planning for the three axis mill.
+ *
+ * A move is described along its dominant axis (the axis with the most
+ * steps). profile_init() splits it into acceleration, cruise and
+ * deceleration phases and profile_next_interval() then hands out the
+ * time between consecutive pulses using the integer recurrence from
+ * D. Austin, "Generate stepper-motor speed profiles in real time"
+ * (Embedded Systems Programming, 2005), so no per-step division by a
+ * square root or floating point is needed.
+ *
+ * On top of that sits a look-ahead buffer of straight segments. Each new
+ * segment gets a junction speed limit from the angle it makes with the
+ * previous one, and the whole buffer is re-planned so that consecutive
+ * segments hand over at the highest speed that still allows stopping
+ * at the end of the buffer. Contours then run through their corners
+ * instead of stopping at every vertex.
+ *
+ * Arcs go into the same buffer as single segments, so they blend with
+ * the lines around them. Their speed is also held to what the axes can
+ * turn at (v^2 / r within the acceleration limit).
+ *
+ * Units: velocities in steps/s, accelerations in steps/s^2, intervals
+ * in microseconds. Intervals are kept internally with 8 fractional
+ * bits so the recurrence does not stall at low step counts. Segment
+ * speeds are measured along the path (Euclidean steps), profile speeds
+ * along the dominant axis.
+ */
+
+#ifndef CC2511_PLANNER_H
+#define CC2511_PLANNER_H
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define PLANNER_TICK_HZ   1000000U    /* interval units per second (us) */
+#define PLANNER_FRAC_BITS 8
+#define PLANNER_NUM_AXES  3
+#define PLANNER_BUFFER_SIZE 8         /* segments of look-ahead */
+#define PLANNER_JUNCTION_DEVIATION 4.0f /* allowed corner rounding (steps) */
+
+/* Per-move velocity profile along the dominant axis */
+typedef struct profile {
+    uint32_t total_steps;   /* pulses in the move */
+    uint32_t accel_until;   /* steps [0, accel_until) accelerate */
+    uint32_t decel_after;   /* steps [decel_after, total_steps) decelerate */
+    uint32_t step;          /* index of the next pulse */
+    uint32_t n;             /* position on the virtual ramp from standstill */
+    uint32_t c;             /* current interval (us, Q8) */
+    uint32_t c_min;         /* cruise interval (us, Q8) */
+    uint32_t n_exit;        /* ramp position after the last step (0 = stop on it) */
+    uint32_t accel;         /* steps/s^2 */
+}   profile_T;
+
+/*! \brief Integer square root.
+ *  \ingroup cnc_planner
+ */
+static inline uint32_t planner_isqrt(uint64_t v) {
+    uint64_t result = 0;
+    uint64_t bit = 1ULL << 62;
+    while (bit > v) {
+        bit >>= 2;
+    }
+    while (bit != 0) {
+        if (v >= result + bit) {
+            v -= result + bit;
+            result = (result >> 1) + bit;
+        } else {
+            result >>= 1;
+        }
+        bit >>= 2;
+    }
+    return (uint32_t)result;
+}
+
+/*! \brief Interval (us, Q8) for a given speed.
+ *  \ingroup cnc_planner
+ */
+static inline uint32_t planner_interval_q8(uint32_t velocity) {
+    if (velocity == 0) {
+        velocity = 1;
+    }
+    return (uint32_t)(((uint64_t)PLANNER_TICK_HZ << PLANNER_FRAC_BITS) / velocity);
+}
+
+/*! \brief Step of a ramp from standstill that starts nearest speed v.
+ *  \ingroup cnc_planner
+ *
+ * Step n of the ramp starts n steps from standstill, at sqrt(2 a n).
+ */
+static inline uint32_t planner_ramp_step(uint32_t v, uint32_t accel) {
+    return (uint32_t)(((uint64_t)v * v + accel) / (2ULL * accel));
+}
+
+/*! \brief Interval (us, Q8) of step n of a ramp from standstill.
+ *  \ingroup cnc_planner
+ *
+ * The recurrence in profile_next_interval() is linear in the interval,
+ * so it only follows the acceleration if it starts from the interval that
+ * matches its step; any other start stretches or squeezes the whole ramp.
+ */
+static inline uint32_t planner_ramp_q8(uint32_t n, uint32_t accel) {
+    if (n == 0) {
+        // Austin's first interval: 0.676 * sqrt(2 / a), in us Q8; the root is
+        // taken in Q8 too, as every later step inherits its rounding
+        uint32_t root_q8 = planner_isqrt((uint64_t)accel << (2 * PLANNER_FRAC_BITS));
+        return (uint32_t)((956008ULL << (2 * PLANNER_FRAC_BITS)) / root_q8);
+    }
+    // sqrt(2 / a) (sqrt(n + 1) - sqrt(n)) is 1 / sqrt(2 a n + a) to within 1/(32 n^2)
+    uint32_t v_q8 = planner_isqrt((2ULL * accel * n + accel) << (2 * PLANNER_FRAC_BITS));
+    return (uint32_t)(((uint64_t)PLANNER_TICK_HZ << (2 * PLANNER_FRAC_BITS)) / v_q8);
+}
+
+/*! \brief Scale a per-axis limit to the dominant axis of a move.
+ *  \ingroup cnc_planner
+ *
+ * For a straight line every axis moves in proportion to its step count,
+ * so an axis making axis_steps of dominant_steps pulses reaches only
+ * that fraction of the dominant rate. Returns the dominant-axis rate at
+ * which this axis sits exactly at its own limit.
+ */
+static inline uint32_t planner_scale_limit(uint32_t limit, uint32_t axis_steps,
+  uint32_t dominant_steps) {
+    if (axis_steps == 0) {
+        return UINT32_MAX;
+    }
+    uint64_t scaled = (uint64_t)limit * dominant_steps / axis_steps;
+    return scaled > UINT32_MAX ? UINT32_MAX : (uint32_t)scaled;
+}
+
+/*! \brief Plan a trapezoidal profile.
+ *  \ingroup cnc_planner
+ *
+ * If the move is too short to reach v_cruise the cruise phase is dropped
+ * and the profile becomes a triangle peaking where the acceleration and
+ * deceleration ramps meet. A move ending at standstill stops on its last
+ * pulse, so its ramps span one step less than one handing over.
+ *
+ * \param steps     Dominant axis steps in the move
+ * \param v_entry   Speed at the first pulse (0 = from standstill)
+ * \param v_cruise  Target speed
+ * \param v_exit    Speed to be reached at the last pulse
+ * \param accel     Acceleration and deceleration rate
+ */
+static inline void profile_init(profile_T *p, uint32_t steps, uint32_t v_entry,
+  uint32_t v_cruise, uint32_t v_exit, uint32_t accel) {
+    if (accel == 0) {
+        accel = 1;
+    }
+    if (v_cruise == 0) {
+        v_cruise = 1;
+    }
+    if (v_entry > v_cruise) {
+        v_entry = v_cruise;
+    }
+    if (v_exit > v_cruise) {
+        v_exit = v_cruise;
+    }
+
+    uint64_t two_a = 2ULL * accel;
+    uint64_t ve2 = (uint64_t)v_entry * v_entry;
+    uint64_t vc2 = (uint64_t)v_cruise * v_cruise;
+    uint64_t vx2 = (uint64_t)v_exit * v_exit;
+
+    // A move that stops rests on its last pulse, one step short of where
+    // a move handing over puts the next move's first pulse
+    uint32_t distance = (v_exit == 0 && steps > 0) ? steps - 1 : steps;
+    uint64_t accel_steps = (vc2 - ve2) / two_a;
+    uint64_t decel_steps = (vc2 - vx2) / two_a;
+    if (accel_steps + decel_steps > distance) {
+        // Triangle: solve for the crossing point of the two ramps
+        int64_t meet = ((int64_t)(two_a * distance) + (int64_t)vx2 - (int64_t)ve2)
+            / (int64_t)(2 * two_a);
+        if (meet < 0) {
+            meet = 0;
+        }
+        if (meet > (int64_t)distance) {
+            meet = distance;
+        }
+        accel_steps = (uint64_t)meet;
+        decel_steps = distance - accel_steps;
+    }
+
+    p->total_steps = steps;
+    p->accel_until = (uint32_t)accel_steps;
+    p->decel_after = distance - (uint32_t)decel_steps;
+    p->step = 0;
+    p->accel = accel;
+    p->n_exit = v_exit == 0 ? 0 : planner_ramp_step(v_exit, accel) + 1;
+    p->c_min = planner_interval_q8(v_cruise);
+
+    // Join the ramp at the entry speed (standstill is step 0)
+    p->n = planner_ramp_step(v_entry, accel);
+    p->c = planner_ramp_q8(p->n, accel);
+    if (p->c < p->c_min) {
+        p->c = p->c_min;
+    }
+}
+
+/*! \brief Interval between the next pulse and the one after it.
+ *  \ingroup cnc_planner
+ *
+ * Call once per pulse. Past the end of the profile the last interval is
+ * repeated.
+ *
+ * \return microseconds
+ */
+static inline uint32_t profile_next_interval(profile_T *p) {
+    uint32_t k = p->step;
+    if (k < p->total_steps) {
+        p->step = k + 1;
+        if (k < p->accel_until) {
+            // This step takes c(n); the next one c(n+1) = c(n) - 2 c(n) / (4(n+1) + 1),
+            // rounded: truncating lets the error build up over a long ramp
+            uint32_t interval = p->c;
+            p->n++;
+            p->c -= (2 * p->c + 2 * p->n) / (4 * p->n + 1);
+            if (p->c < p->c_min) {
+                p->c = p->c_min;
+            }
+            return interval >> PLANNER_FRAC_BITS;
+        } else if (k >= p->decel_after) {
+            if (k == p->decel_after) {
+                // Rejoin the ramp at the step that runs down to the exit speed
+                p->n = (p->total_steps - k - 1) + p->n_exit;
+                p->c = planner_ramp_q8(p->n, p->accel);
+                if (p->c < p->c_min) {
+                    p->c = p->c_min;
+                }
+            }
+            // c(n-1) = c(n) + 2 c(n) / (4n - 1)
+            if (p->n > 0) {
+                p->c += (2 * p->c + 2 * p->n - 1) / (4 * p->n - 1);
+                p->n--;
+            }
+        } else {
+            p->c = p->c_min;
+        }
+    }
+    return p->c >> PLANNER_FRAC_BITS;
+}
+
+/* Straight segment or arc waiting in the look-ahead buffer */
+typedef struct segment {
+    int32_t delta[PLANNER_NUM_AXES];  /* signed steps per axis */
+    uint32_t steps;                   /* dominant axis steps (arc: slots) */
+    uint32_t length;                  /* path length (steps) */
+    uint32_t nominal;                 /* cruise speed (path steps/s) */
+    uint32_t accel;                   /* path steps/s^2 */
+    uint32_t max_entry;               /* junction limit (path steps/s) */
+    uint32_t entry;                   /* planned entry speed */
+    float unit[PLANNER_NUM_AXES];     /* direction of travel at the start */
+    float exit_unit[PLANNER_NUM_AXES];/* direction of travel at the end */
+    bool arc;                         /* circular move in XY */
+    bool clockwise;
+    int32_t center[2];                /* arc centre relative to the start */
+    uint32_t arc_steps;               /* XY slots of the arc */
+}   segment_T;
+
+/* Look-ahead buffer. Oldest segment at tail, its entry speed is fixed. */
+typedef struct planner {
+    segment_T buffer[PLANNER_BUFFER_SIZE];
+    uint32_t head;
+    uint32_t tail;
+}   planner_T;
+
+/*! \brief Empty the look-ahead buffer.
+ *  \ingroup cnc_planner
+ */
+static inline void planner_init(planner_T *pl) {
+    pl->head = 0;
+    pl->tail = 0;
+}
+
+/*! \brief Number of buffered segments.
+ *  \ingroup cnc_planner
+ */
+static inline uint32_t planner_count(const planner_T *pl) {
+    return pl->head - pl->tail;
+}
+
+/*! \brief True when no more segments can be added.
+ *  \ingroup cnc_planner
+ */
+static inline bool planner_full(const planner_T *pl) {
+    return planner_count(pl) >= PLANNER_BUFFER_SIZE;
+}
+
+static inline segment_T *planner_at(planner_T *pl, uint32_t i) {
+    return &pl->buffer[i % PLANNER_BUFFER_SIZE];
+}
+
+/*! \brief Highest speed at which v_exit is still reachable over length.
+ *  \ingroup cnc_planner
+ */
+static inline uint32_t planner_reachable(uint32_t v_exit, uint32_t accel,
+  uint32_t length) {
+    return planner_isqrt((uint64_t)v_exit * v_exit + 2ULL * accel * length);
+}
+
+/*! \brief Convert a path speed or acceleration to the dominant axis.
+ *  \ingroup cnc_planner
+ */
+static inline uint32_t planner_to_dominant(const segment_T *seg, uint32_t v) {
+    if (seg->length == 0) {
+        return v;
+    }
+    return (uint32_t)((uint64_t)v * seg->steps / seg->length);
+}
+
+/*
+ * Re-plan entry speeds. Backward pass: every segment must be able to
+ * slow down to the next entry (0 after the newest). Forward pass: every
+ * segment must be reachable from the previous one. The oldest entry is
+ * already committed and is left alone.
+ */
+static inline void planner_recalculate(planner_T *pl) {
+    uint32_t count = planner_count(pl);
+    if (count == 0) {
+        return;
+    }
+
+    uint32_t next_entry = 0;
+    for (uint32_t i = pl->head - 1; i != pl->tail; i--) {
+        segment_T *seg = planner_at(pl, i);
+        uint32_t limit = planner_reachable(next_entry, seg->accel, seg->length);
+        seg->entry = seg->max_entry < limit ? seg->max_entry : limit;
+        next_entry = seg->entry;
+    }
+
+    for (uint32_t i = pl->tail; i + 1 != pl->head; i++) {
+        segment_T *seg = planner_at(pl, i);
+        segment_T *next = planner_at(pl, i + 1);
+        uint32_t limit = planner_reachable(seg->entry, seg->accel, seg->length);
+        if (next->entry > limit) {
+            next->entry = limit;
+        }
+    }
+}
+
+/* Junction limit against the previous segment, then append and re-plan */
+static inline void planner_add(planner_T *pl, segment_T *seg) {
+    // Junction limit from the corner angle (junction deviation model)
+    seg->max_entry = 0;
+    if (planner_count(pl) > 0) {
+        segment_T *prev = planner_at(pl, pl->head - 1);
+        float cos_theta = 0.0f;
+        for (int i = 0; i < PLANNER_NUM_AXES; i++) {
+            cos_theta -= prev->exit_unit[i] * seg->unit[i];
+        }
+        uint32_t v_max = seg->nominal < prev->nominal ? seg->nominal : prev->nominal;
+        if (cos_theta < -0.999f) {
+            seg->max_entry = v_max;     // straight on
+        } else if (cos_theta < 0.999f) {
+            float sin_half = sqrtf(0.5f * (1.0f - cos_theta));
+            float v = sqrtf((float)seg->accel * PLANNER_JUNCTION_DEVIATION
+                * sin_half / (1.0f - sin_half));
+            seg->max_entry = v < (float)v_max ? (uint32_t)v : v_max;
+        }
+    }
+    seg->entry = 0;
+
+    pl->head++;
+    planner_recalculate(pl);
+}
+
+/*! \brief Add a straight segment to the look-ahead buffer.
+ *  \ingroup cnc_planner
+ *
+ * \param delta     Signed steps per axis
+ * \param max_vel   Per-axis speed limits (steps/s)
+ * \param max_accel Per-axis acceleration limits (steps/s^2)
+ * \param feed      Requested path speed (steps/s), 0 for the axis limits
+ * \return false if the buffer is full. Zero length segments are dropped
+ *         and reported as accepted.
+ */
+static inline bool planner_push(planner_T *pl, const int32_t delta[PLANNER_NUM_AXES],
+  const uint32_t max_vel[PLANNER_NUM_AXES], const uint32_t max_accel[PLANNER_NUM_AXES],
+  uint32_t feed) {
+    if (planner_full(pl)) {
+        return false;
+    }
+
+    segment_T *seg = planner_at(pl, pl->head);
+    uint64_t length_sq = 0;
+    seg->steps = 0;
+    for (int i = 0; i < PLANNER_NUM_AXES; i++) {
+        uint32_t steps = (uint32_t)(delta[i] < 0 ? -delta[i] : delta[i]);
+        seg->delta[i] = delta[i];
+        if (steps > seg->steps) {
+            seg->steps = steps;
+        }
+        length_sq += (uint64_t)steps * steps;
+    }
+    if (seg->steps == 0) {
+        return true;
+    }
+    seg->length = planner_isqrt(length_sq);
+
+    // Path limits: the requested feed or the tightest axis, whichever is lower
+    seg->nominal = feed == 0 ? UINT32_MAX : feed;
+    seg->accel = UINT32_MAX;
+    for (int i = 0; i < PLANNER_NUM_AXES; i++) {
+        uint32_t steps = (uint32_t)(delta[i] < 0 ? -delta[i] : delta[i]);
+        uint32_t v = planner_scale_limit(max_vel[i], steps, seg->length);
+        uint32_t a = planner_scale_limit(max_accel[i], steps, seg->length);
+        seg->nominal = v < seg->nominal ? v : seg->nominal;
+        seg->accel = a < seg->accel ? a : seg->accel;
+        seg->unit[i] = (float)delta[i] / (float)seg->length;
+    }
+
+    seg->arc = false;
+    for (int i = 0; i < PLANNER_NUM_AXES; i++) {
+        seg->exit_unit[i] = seg->unit[i];
+    }
+    planner_add(pl, seg);
+    return true;
+}
+
+/*! \brief XY slots needed to walk an arc one step at a time.
+ *  \ingroup cnc_planner
+ *
+ * Within each octant one axis steps in every slot and the other only in
+ * some, so the count is the travel of the faster coordinate summed over
+ * the octants the arc passes through (4 sqrt(2) r for a full circle).
+ */
+static inline uint32_t planner_arc_steps(float radius, float start_angle, float sweep) {
+    const float octant = (float)M_PI / 4.0f;
+    float direction = sweep < 0.0f ? -1.0f : 1.0f;
+    float remaining = fabsf(sweep);
+    float angle = start_angle;
+    float total = 0.0f;
+    while (remaining > 0.0f) {
+        // Up to the next octant boundary in the direction of travel
+        float boundary = direction > 0.0f ? (floorf(angle / octant) + 1.0f) * octant
+                                          : (ceilf(angle / octant) - 1.0f) * octant;
+        float step = fabsf(boundary - angle);
+        if (step < 1e-6f) {
+            step = octant;
+        }
+        if (step > remaining) {
+            step = remaining;
+        }
+        float next = angle + direction * step;
+        float mid = angle + direction * step * 0.5f;
+        if (fabsf(sinf(mid)) < fabsf(cosf(mid))) {
+            total += fabsf(sinf(next) - sinf(angle));
+        } else {
+            total += fabsf(cosf(next) - cosf(angle));
+        }
+        angle = next;
+        remaining -= step;
+    }
+    return (uint32_t)(total * radius + 0.5f);
+}
+
+/*! \brief Add a circular or helical arc to the look-ahead buffer.
+ *  \ingroup cnc_planner
+ *
+ * \param delta     Signed steps per axis from start to end
+ * \param center    Centre relative to the start (XY steps)
+ * \param clockwise Direction seen from +Z; equal end points make a full circle
+ * \param max_vel   Per-axis speed limits (steps/s)
+ * \param max_accel Per-axis acceleration limits (steps/s^2)
+ * \param feed      Requested path speed (steps/s), 0 for the axis limits
+ * \return false if the buffer is full
+ */
+static inline bool planner_push_arc(planner_T *pl, const int32_t delta[PLANNER_NUM_AXES],
+  const int32_t center[2], bool clockwise, const uint32_t max_vel[PLANNER_NUM_AXES],
+  const uint32_t max_accel[PLANNER_NUM_AXES], uint32_t feed) {
+    if (planner_full(pl)) {
+        return false;
+    }
+
+    float sx = -(float)center[0];
+    float sy = -(float)center[1];
+    float ex = (float)(delta[0] - center[0]);
+    float ey = (float)(delta[1] - center[1]);
+    float radius = sqrtf(sx * sx + sy * sy);
+    float end_radius = sqrtf(ex * ex + ey * ey);
+    if (radius < 1.0f || end_radius < 1.0f) {
+        return planner_push(pl, delta, max_vel, max_accel, feed);
+    }
+    float start_angle = atan2f(sy, sx);
+    float sweep = atan2f(ey, ex) - start_angle;
+    if (clockwise && sweep >= 0.0f) {
+        sweep -= 2.0f * (float)M_PI;
+    } else if (!clockwise && sweep <= 0.0f) {
+        sweep += 2.0f * (float)M_PI;
+    }
+
+    segment_T *seg = planner_at(pl, pl->head);
+    uint32_t dz = (uint32_t)(delta[2] < 0 ? -delta[2] : delta[2]);
+    float arc_length = radius * fabsf(sweep);
+    float length = sqrtf(arc_length * arc_length + (float)dz * (float)dz);
+    for (int i = 0; i < PLANNER_NUM_AXES; i++) {
+        seg->delta[i] = delta[i];
+    }
+    seg->arc = true;
+    seg->clockwise = clockwise;
+    seg->center[0] = center[0];
+    seg->center[1] = center[1];
+    seg->arc_steps = planner_arc_steps(radius, start_angle, sweep);
+    seg->steps = seg->arc_steps > dz ? seg->arc_steps : dz;
+    seg->length = (uint32_t)(length + 0.5f);
+    if (seg->steps == 0 || seg->length == 0) {
+        seg->steps = 1;
+        seg->length = 1;
+    }
+
+    // Somewhere on the arc each XY axis carries the whole tangential speed
+    uint32_t xy_vel = max_vel[0] < max_vel[1] ? max_vel[0] : max_vel[1];
+    uint32_t xy_accel = max_accel[0] < max_accel[1] ? max_accel[0] : max_accel[1];
+    uint32_t xy_length = (uint32_t)(arc_length + 0.5f);
+    uint32_t limits[4] = {
+        planner_scale_limit(xy_vel, xy_length, seg->length),
+        planner_scale_limit(max_vel[2], dz, seg->length),
+        // Turning: centripetal acceleration v^2 / r within the XY limit
+        planner_isqrt((uint64_t)xy_accel * (uint64_t)radius),
+        feed == 0 ? UINT32_MAX : feed
+    };
+    seg->nominal = UINT32_MAX;
+    for (int i = 0; i < 4; i++) {
+        seg->nominal = limits[i] < seg->nominal ? limits[i] : seg->nominal;
+    }
+    uint32_t a_xy = planner_scale_limit(xy_accel, xy_length, seg->length);
+    uint32_t a_z = planner_scale_limit(max_accel[2], dz, seg->length);
+    seg->accel = a_xy < a_z ? a_xy : a_z;
+
+    // Tangents at both ends, counter-clockwise (-y, x)
+    float turn = clockwise ? -1.0f : 1.0f;
+    float xy_share = arc_length / length;
+    seg->unit[0] = -turn * sy / radius * xy_share;
+    seg->unit[1] = turn * sx / radius * xy_share;
+    seg->exit_unit[0] = -turn * ey / end_radius * xy_share;
+    seg->exit_unit[1] = turn * ex / end_radius * xy_share;
+    seg->unit[2] = (float)delta[2] / length;
+    seg->exit_unit[2] = seg->unit[2];
+
+    planner_add(pl, seg);
+    return true;
+}
+
+/*! \brief Remove the oldest segment for execution.
+ *  \ingroup cnc_planner
+ *
+ * \param out       Segment to execute, entry speed filled in
+ * \param exit_speed Speed to hand over to the next segment (0 if none)
+ * \return false if the buffer is empty
+ */
+static inline bool planner_pop(planner_T *pl, segment_T *out, uint32_t *exit_speed) {
+    if (planner_count(pl) == 0) {
+        return false;
+    }
+    *out = *planner_at(pl, pl->tail);
+    pl->tail++;
+    *exit_speed = planner_count(pl) > 0 ? planner_at(pl, pl->tail)->entry : 0;
+    return true;
+}
+
+#endif //  CC2511_PLANNER_H
@@ -0,0 +1,131 @@
+/** \file prefab.h
+ *  \defgroup cnc_prefab
+ *
+ * Header-only outlines of the compiled-in prefabs that "load" cuts.
+ *
+ * house and star are lists of absolute points the tool visits in turn.
+ * Their Z column only says whether a point is at the travel height or at
+ * the cutting depth; prefab_place() fills in the heights "setz" chose.
+ * circle is one arc round PREFAB_CIRCLE_X/Y.
+ *
+ * Shared by the firmware and the benchmark in host/, so both cut the same
+ * outlines.
+ */
+
+#ifndef CC2511_PREFAB_H
+#define CC2511_PREFAB_H
+
+#include <stddef.h>
+#include <string.h>
+
+#define PREFAB_UP   0           /* Z column: travel height */
+#define PREFAB_DOWN 1           /* Z column: cutting depth */
+
+#define PREFAB_MAX_POINTS 64
+
+#define PREFAB_CIRCLE_X      3000
+#define PREFAB_CIRCLE_Y      2000
+#define PREFAB_CIRCLE_RADIUS 1500
+
+/* A point-list prefab */
+typedef struct prefab {
+    const char *name;
+    const int (*point)[3];
+    int length;
+}   prefab_T;
+
+static const int prefab_house[][3] = {
+    // Outline
+    {1000, 0, PREFAB_UP},       //arive at start position
+    {1000, 0, PREFAB_DOWN},
+    {5000, 0, PREFAB_DOWN},
+    {5000, 2000, PREFAB_DOWN},
+    {6000, 2000, PREFAB_DOWN},
+    {3000, 4000, PREFAB_DOWN},
+    {0, 2000, PREFAB_DOWN},
+    {1000, 2000, PREFAB_DOWN},
+    {1000, 0, PREFAB_DOWN},
+    //Chimney
+    {1500, 3000, PREFAB_UP},
+    {1500, 3000, PREFAB_DOWN},
+    {1500, 3500, PREFAB_DOWN},
+    {1000, 3500, PREFAB_DOWN},
+    {1000, 2667, PREFAB_DOWN},
+    //Door
+    {3200, 0, PREFAB_UP},
+    {3200, 0, PREFAB_DOWN},
+    {3200, 1600, PREFAB_DOWN},
+    {4200, 1600, PREFAB_DOWN},
+    {4200, 0, PREFAB_DOWN},
+    //Window
+    {1600, 800, PREFAB_UP},
+    {1600, 800, PREFAB_DOWN},
+    {1600, 1600, PREFAB_DOWN},
+    {2400, 1600, PREFAB_DOWN},
+    {2400, 800, PREFAB_DOWN},
+    {1600, 800, PREFAB_DOWN},
+    {2000, 800, PREFAB_UP},
+    {2000, 800, PREFAB_DOWN},
+    {2000, 1600, PREFAB_DOWN},
+    {1600, 1200, PREFAB_UP},
+    {1600, 1200, PREFAB_DOWN},
+    {2400, 1200, PREFAB_DOWN},
+    // Home
+    {0, 0, PREFAB_UP}
+};
+
+static const int prefab_star[][3] = {
+    {923, 217, PREFAB_UP},      //arrive at start position
+    {923, 217, PREFAB_DOWN},
+    {1334, 1484, PREFAB_DOWN},
+    {257, 2266, PREFAB_DOWN},
+    {1589, 2266, PREFAB_DOWN},
+    {2000, 3533, PREFAB_DOWN},
+    {2411, 2266, PREFAB_DOWN},
+    {3743, 2266, PREFAB_DOWN},
+    {2666, 1484, PREFAB_DOWN},
+    {3077, 217, PREFAB_DOWN},
+    {2000, 1000, PREFAB_DOWN},
+    {923, 217, PREFAB_DOWN},
+    // Home
+    {0, 0, PREFAB_UP}
+};
+
+static const prefab_T prefabs[] = {
+    {"house", prefab_house, sizeof(prefab_house) / sizeof(prefab_house[0])},
+    {"star", prefab_star, sizeof(prefab_star) / sizeof(prefab_star[0])},
+};
+
+#define PREFAB_COUNT (sizeof(prefabs) / sizeof(prefabs[0]))
+
+/*! \brief Look up a point-list prefab by name.
+ *  \ingroup cnc_prefab
+ *
+ * \return NULL for anything else, circle included
+ */
+static inline const prefab_T *prefab_find(const char *name) {
+    for (size_t i = 0; i < PREFAB_COUNT; i++) {
+        if (strcmp(prefabs[i].name, name) == 0) {
+            return &prefabs[i];
+        }
+    }
+    return NULL;
+}
+
+/*! \brief Copy a prefab's points with real heights in the Z column.
+ *  \ingroup cnc_prefab
+ *
+ * \param out Room for PREFAB_MAX_POINTS points
+ * \return the number of points
+ */
+static inline int prefab_place(const prefab_T *p, int out[][3], int z_up, int z_down) {
+    int length = p->length < PREFAB_MAX_POINTS ? p->length : PREFAB_MAX_POINTS;
+    for (int i = 0; i < length; i++) {
+        out[i][0] = p->point[i][0];
+        out[i][1] = p->point[i][1];
+        out[i][2] = p->point[i][2] == PREFAB_DOWN ? z_down : z_up;
+    }
+    return length;
+}
+
+#endif //  CC2511_PREFAB_H
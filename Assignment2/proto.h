@@ -0,0 +1,343 @@
+/** \file proto.h
+ *  \defgroup cnc_proto
+ *
+ * Compact binary protocol for host programs, as an alternative to the
+ * text UI. Entered with the "binary" command and left with PROTO_EXIT.
+ *
+ * Each message is one frame:
+ *
+ *     type (1) | seq (1) | payload (0..PROTO_MAX_PAYLOAD) | crc16 (2, LE)
+ *
+ * COBS encoded and terminated by a 0x00 byte, so a receiver can always
+ * find the start of the next frame after noise or a lost byte. The CRC
+ * is CRC-16/CCITT-FALSE over type, seq and payload. Integers in payloads
+ * are little-endian.
+ *
+ * The device answers every host frame with one reply carrying the same
+ * seq: PROTO_ACK for commands, PROTO_PONG and PROTO_STATUS_REPLY for
+ * queries. A host keeps at most PROTO_QUEUE_SIZE frames in flight and
+ * waits for acks to pace itself; there is no XON/XOFF in binary mode.
+ * PROTO_HOLD, PROTO_RESUME and PROTO_ABORT take effect as soon as they
+ * are received, like the realtime bytes of the text UI, but are still
+ * acknowledged in order with everything else.
+ *
+ * Shared by the firmware and the host tools in host/.
+ */
+
+#ifndef CC2511_PROTO_H
+#define CC2511_PROTO_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define PROTO_MAX_PAYLOAD 100
+#define PROTO_MAX_FRAME   (PROTO_MAX_PAYLOAD + 4)   /* type, seq, payload, crc */
+#define PROTO_MAX_ENCODED (PROTO_MAX_FRAME + PROTO_MAX_FRAME / 254 + 2)
+#define PROTO_DELIMITER   0x00
+#define PROTO_QUEUE_SIZE  16U       /* frames waiting to be run, power of two */
+
+/* Host to device */
+#define PROTO_PING        0x01  /* any payload, echoed in PROTO_PONG */
+#define PROTO_MOVE        0x02  /* int32 x, y, z (steps), uint32 feed (steps/s, 0 = rapid) */
+#define PROTO_FLUSH       0x03  /* run out the look-ahead buffer */
+#define PROTO_STATUS      0x04  /* ask for PROTO_STATUS_REPLY */
+#define PROTO_HOLD        0x05  /* feed hold */
+#define PROTO_RESUME      0x06
+#define PROTO_ABORT       0x07  /* stop and discard all motion */
+#define PROTO_GCODE       0x08  /* one G-code line, not terminated */
+#define PROTO_EXIT        0x09  /* back to the text UI after the ack */
+
+/* Device to host */
+#define PROTO_ACK          0x81 /* uint8 result (PROTO_OK etc.) */
+#define PROTO_PONG         0x82 /* payload of the PROTO_PING */
+#define PROTO_STATUS_REPLY 0x83 /* see proto_status_T */
+
+/* Results in PROTO_ACK */
+#define PROTO_OK          0
+#define PROTO_ERR_UNKNOWN 1     /* unknown message type */
+#define PROTO_ERR_LENGTH  2     /* payload has the wrong size */
+#define PROTO_ERR_BOUNDS  3     /* target outside the machine limits */
+#define PROTO_ERR_GCODE   4     /* G-code line rejected */
+
+typedef struct proto_frame {
+    uint8_t type;
+    uint8_t seq;
+    uint8_t length;                         /* payload bytes */
+    uint8_t payload[PROTO_MAX_PAYLOAD];
+}   proto_frame_T;
+
+/* PROTO_STATUS_REPLY payload, 20 bytes on the wire */
+typedef struct proto_status {
+    int32_t position[3];                    /* steps actually issued */
+    uint16_t feed;                          /* path speed, steps/s */
+    uint16_t queued;                        /* moves and pulses not yet run */
+    uint8_t hold_state;                     /* STEPPER_RUN etc. */
+    uint8_t spindle;                        /* 0..SPIN_MAX */
+    uint8_t flags;                          /* PROTO_FLAG_* */
+    uint8_t reserved;
+}   proto_status_T;
+
+#define PROTO_STATUS_SIZE 20
+#define PROTO_FLAG_MOVING 0x01
+#define PROTO_FLAG_FAULT  0x02
+
+/* Frame reassembly from a byte stream */
+typedef struct proto_decoder {
+    uint8_t data[PROTO_MAX_ENCODED];
+    size_t length;
+    bool overflow;                          /* frame too long, skip to delimiter */
+}   proto_decoder_T;
+
+/* Decoded frames between the UART interrupt and the main loop, single
+   producer and single consumer like the motion queue */
+typedef struct proto_queue {
+    proto_frame_T frames[PROTO_QUEUE_SIZE];
+    volatile uint32_t head;                 /* written by the producer only */
+    volatile uint32_t tail;                 /* written by the consumer only */
+}   proto_queue_T;
+
+/* proto_decode_byte() results */
+#define PROTO_NONE  0                       /* frame not complete yet */
+#define PROTO_FRAME 1                       /* valid frame decoded */
+#define PROTO_BAD   2                       /* corrupt frame dropped */
+
+/*! \brief CRC-16/CCITT-FALSE.
+ *  \ingroup cnc_proto
+ */
+static inline uint16_t proto_crc16(const uint8_t *data, size_t length) {
+    uint16_t crc = 0xFFFF;
+    for (size_t i = 0; i < length; i++) {
+        crc ^= (uint16_t)data[i] << 8;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+/*! \brief COBS encode, without the delimiter.
+ *  \ingroup cnc_proto
+ *
+ * \param out At least length + length / 254 + 1 bytes
+ * \return encoded length
+ */
+static inline size_t proto_cobs_encode(const uint8_t *in, size_t length, uint8_t *out) {
+    size_t code_at = 0;
+    size_t o = 1;
+    uint8_t code = 1;
+    for (size_t i = 0; i < length; i++) {
+        if (in[i] == 0) {
+            out[code_at] = code;
+            code_at = o++;
+            code = 1;
+            continue;
+        }
+        out[o++] = in[i];
+        if (++code == 0xFF) {
+            out[code_at] = code;
+            code_at = o++;
+            code = 1;
+        }
+    }
+    out[code_at] = code;
+    return o;
+}
+
+/*! \brief COBS decode a frame without its delimiter.
+ *  \ingroup cnc_proto
+ *
+ * \return decoded length, or -1 if the data is not valid COBS
+ */
+static inline int proto_cobs_decode(const uint8_t *in, size_t length, uint8_t *out) {
+    size_t i = 0;
+    size_t o = 0;
+    while (i < length) {
+        uint8_t code = in[i++];
+        if (code == 0 || i + code - 1 > length) {
+            return -1;
+        }
+        for (uint8_t k = 1; k < code; k++) {
+            out[o++] = in[i++];
+        }
+        if (code != 0xFF && i < length) {
+            out[o++] = 0;
+        }
+    }
+    return (int)o;
+}
+
+/*! \brief Build the wire bytes for a frame, delimiter included.
+ *  \ingroup cnc_proto
+ *
+ * \param out At least PROTO_MAX_ENCODED bytes
+ * \return bytes to send
+ */
+static inline size_t proto_encode(const proto_frame_T *frame, uint8_t *out) {
+    uint8_t raw[PROTO_MAX_FRAME];
+    size_t length = frame->length > PROTO_MAX_PAYLOAD ? PROTO_MAX_PAYLOAD : frame->length;
+    raw[0] = frame->type;
+    raw[1] = frame->seq;
+    for (size_t i = 0; i < length; i++) {
+        raw[2 + i] = frame->payload[i];
+    }
+    uint16_t crc = proto_crc16(raw, length + 2);
+    raw[length + 2] = (uint8_t)crc;
+    raw[length + 3] = (uint8_t)(crc >> 8);
+    size_t n = proto_cobs_encode(raw, length + 4, out);
+    out[n++] = PROTO_DELIMITER;
+    return n;
+}
+
+/*! \brief Empty the decoder.
+ *  \ingroup cnc_proto
+ */
+static inline void proto_decoder_init(proto_decoder_T *d) {
+    d->length = 0;
+    d->overflow = false;
+}
+
+/*! \brief Feed one received byte.
+ *  \ingroup cnc_proto
+ *
+ * \param frame Filled in when PROTO_FRAME is returned
+ * \return PROTO_NONE, PROTO_FRAME or PROTO_BAD
+ */
+static inline int proto_decode_byte(proto_decoder_T *d, uint8_t byte, proto_frame_T *frame) {
+    if (byte != PROTO_DELIMITER) {
+        if (d->length < PROTO_MAX_ENCODED) {
+            d->data[d->length++] = byte;
+        } else {
+            d->overflow = true;
+        }
+        return PROTO_NONE;
+    }
+
+    // Delimiter: whatever came before is one frame
+    size_t length = d->length;
+    bool overflow = d->overflow;
+    proto_decoder_init(d);
+    if (length == 0) {
+        return PROTO_NONE;      // back-to-back delimiters are harmless
+    }
+    uint8_t raw[PROTO_MAX_ENCODED];
+    int n = overflow ? -1 : proto_cobs_decode(d->data, length, raw);
+    // PROTO_MAX_ENCODED bytes can decode to one more than PROTO_MAX_FRAME
+    if (n < 4 || n > PROTO_MAX_FRAME) {
+        return PROTO_BAD;
+    }
+    uint16_t crc = (uint16_t)(raw[n - 2] | (raw[n - 1] << 8));
+    if (crc != proto_crc16(raw, (size_t)n - 2)) {
+        return PROTO_BAD;
+    }
+    frame->type = raw[0];
+    frame->seq = raw[1];
+    frame->length = (uint8_t)(n - 4);
+    for (int i = 0; i < n - 4; i++) {
+        frame->payload[i] = raw[2 + i];
+    }
+    return PROTO_FRAME;
+}
+
+/*! \brief Empty the queue.
+ *  \ingroup cnc_proto
+ */
+static inline void proto_queue_init(proto_queue_T *q) {
+    q->head = 0;
+    q->tail = 0;
+}
+
+/*! \brief Append a frame. Producer side only.
+ *  \ingroup cnc_proto
+ *
+ * \return false if the queue is full (the frame is dropped)
+ */
+static inline bool proto_queue_push(proto_queue_T *q, const proto_frame_T *frame) {
+    uint32_t head = q->head;
+    if (head - q->tail >= PROTO_QUEUE_SIZE) {
+        return false;
+    }
+    q->frames[head & (PROTO_QUEUE_SIZE - 1)] = *frame;
+    __sync_synchronize();   /* frame must be visible before head moves */
+    q->head = head + 1;
+    return true;
+}
+
+/*! \brief Remove the oldest frame. Consumer side only.
+ *  \ingroup cnc_proto
+ *
+ * \return false if the queue is empty
+ */
+static inline bool proto_queue_pop(proto_queue_T *q, proto_frame_T *frame) {
+    uint32_t tail = q->tail;
+    if (tail == q->head) {
+        return false;
+    }
+    __sync_synchronize();   /* read the frame only after seeing head */
+    *frame = q->frames[tail & (PROTO_QUEUE_SIZE - 1)];
+    __sync_synchronize();
+    q->tail = tail + 1;
+    return true;
+}
+
+/*! \brief Little-endian payload helpers.
+ *  \ingroup cnc_proto
+ */
+static inline void proto_put_u16(uint8_t *p, uint16_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static inline void proto_put_u32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+static inline uint16_t proto_get_u16(const uint8_t *p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static inline uint32_t proto_get_u32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/*! \brief Serialise a status reply payload.
+ *  \ingroup cnc_proto
+ */
+static inline void proto_put_status(proto_frame_T *frame, const proto_status_T *s) {
+    for (int i = 0; i < 3; i++) {
+        proto_put_u32(&frame->payload[4 * i], (uint32_t)s->position[i]);
+    }
+    proto_put_u16(&frame->payload[12], s->feed);
+    proto_put_u16(&frame->payload[14], s->queued);
+    frame->payload[16] = s->hold_state;
+    frame->payload[17] = s->spindle;
+    frame->payload[18] = s->flags;
+    frame->payload[19] = 0;
+    frame->length = PROTO_STATUS_SIZE;
+}
+
+/*! \brief Read a status reply payload.
+ *  \ingroup cnc_proto
+ *
+ * \return false if the payload has the wrong size
+ */
+static inline bool proto_get_status(const proto_frame_T *frame, proto_status_T *s) {
+    if (frame->length != PROTO_STATUS_SIZE) {
+        return false;
+    }
+    for (int i = 0; i < 3; i++) {
+        s->position[i] = (int32_t)proto_get_u32(&frame->payload[4 * i]);
+    }
+    s->feed = proto_get_u16(&frame->payload[12]);
+    s->queued = proto_get_u16(&frame->payload[14]);
+    s->hold_state = frame->payload[16];
+    s->spindle = frame->payload[17];
+    s->flags = frame->payload[18];
+    s->reserved = 0;
+    return true;
+}
+
+#endif //  CC2511_PROTO_H
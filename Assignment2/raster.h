@@ -0,0 +1,138 @@
+/** \file raster.h
+ *  \defgroup cnc_raster
+ *
+ * Header-only raster engraving: turns image rows into runs of cuts.
+ *
+ * An image is streamed one row per line of hex text, so only the row
+ * being engraved is ever held and images of any height can be cut. A row
+ * is either greyscale, two hex digits a pixel (00 black, FF white), or
+ * 1-bit, one hex digit for every four pixels with the leftmost in the top
+ * bit (1 black). Which one is told from the length of the line. Hex keeps
+ * the flow control and realtime bytes out of the image.
+ *
+ * Every pixel is reduced to one of RASTER_LEVELS darkness levels; level 0
+ * is left alone. Neighbouring pixels of the same level make one run and
+ * are cut as a single move. Rows are cut alternately left to right and
+ * right to left so there is no travel back across the image. Nothing in
+ * here touches the hardware.
+ */
+
+#ifndef CC2511_RASTER_H
+#define CC2511_RASTER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#define RASTER_MAX_WIDTH 1024                   /* pixels in a row */
+#define RASTER_LINE_SIZE (2 * RASTER_MAX_WIDTH + 2)
+#define RASTER_LEVELS    8                      /* darkness levels, 0 = not cut */
+
+/* One run of pixels of the same level, in the order it is cut */
+typedef struct raster_run {
+    int from;           /* pixel edge the cut starts at, 0 to width */
+    int to;             /* pixel edge it ends at */
+    uint8_t level;      /* 1 to RASTER_LEVELS - 1 */
+}   raster_run_T;
+
+static inline int raster_hex(char ch) {
+    if (ch >= '0' && ch <= '9') {
+        return ch - '0';
+    }
+    if (ch >= 'a' && ch <= 'f') {
+        return ch - 'a' + 10;
+    }
+    if (ch >= 'A' && ch <= 'F') {
+        return ch - 'A' + 10;
+    }
+    return -1;
+}
+
+/*! \brief Darkness level of a grey value (0 black to 255 white).
+ *  \ingroup cnc_raster
+ */
+static inline uint8_t raster_level(uint8_t grey) {
+    return (uint8_t)(((255 - grey) * (RASTER_LEVELS - 1) + 127) / 255);
+}
+
+/*! \brief Decode one row of the image into darkness levels.
+ *  \ingroup cnc_raster
+ *
+ * \param line   Hex text of the row, without the line end
+ * \param length Characters in line
+ * \param level  Out: width levels
+ * \return false if the length fits neither format or a digit is not hex
+ */
+static inline bool raster_decode_row(const char *line, int length, int width, uint8_t *level) {
+    if (length == 2 * width) {
+        for (int i = 0; i < width; i++) {
+            int high = raster_hex(line[2 * i]);
+            int low = raster_hex(line[2 * i + 1]);
+            if (high < 0 || low < 0) {
+                return false;
+            }
+            level[i] = raster_level((uint8_t)(high << 4 | low));
+        }
+        return true;
+    }
+    if (length == (width + 3) / 4) {
+        for (int i = 0; i < length; i++) {
+            int bits = raster_hex(line[i]);
+            if (bits < 0) {
+                return false;
+            }
+            for (int b = 0; b < 4 && 4 * i + b < width; b++) {
+                level[4 * i + b] = (bits >> (3 - b)) & 1 ? RASTER_LEVELS - 1 : 0;
+            }
+        }
+        return true;
+    }
+    return false;
+}
+
+/*! \brief Next run of a row in cutting order.
+ *  \ingroup cnc_raster
+ *
+ * \param pixel   Start at 0; moved past the run on return
+ * \param reverse Cut the row right to left
+ * \return false when the row has no more runs
+ */
+static inline bool raster_next_run(const uint8_t *level, int width, bool reverse, int *pixel, raster_run_T *run) {
+    while (*pixel < width) {
+        int i = reverse ? width - 1 - *pixel : *pixel;
+        if (level[i] == 0) {
+            (*pixel)++;
+            continue;
+        }
+        int count = 1;
+        while (*pixel + count < width) {
+            int j = reverse ? i - count : i + count;
+            if (level[j] != level[i]) {
+                break;
+            }
+            count++;
+        }
+        run->level = level[i];
+        run->from = reverse ? i + 1 : i;
+        run->to = reverse ? i + 1 - count : i + count;
+        *pixel += count;
+        return true;
+    }
+    return false;
+}
+
+/*! \brief Depth for a level, in equal steps from z_up to z_down at the darkest.
+ *  \ingroup cnc_raster
+ */
+static inline int raster_depth(uint8_t level, int z_up, int z_down) {
+    return z_up + (z_down - z_up) * level / (RASTER_LEVELS - 1);
+}
+
+/*! \brief Feed for a level, slower for darker so the tool stays longer.
+ *  \ingroup cnc_raster
+ */
+static inline uint32_t raster_feed(uint8_t level, uint32_t light, uint32_t dark) {
+    return light - (light - dark) * (uint32_t)(level - 1) / (RASTER_LEVELS - 2);
+}
+
+#endif //  CC2511_RASTER_H
@@ -0,0 +1,84 @@
+/** \file ring.h
+ *  \defgroup cnc_ring
+ *
+ * Header-only single producer, single consumer byte ring buffer.
+ *
+ * One side (typically an interrupt handler) only ever calls ring_push()
+ * and the other only ring_pop(), so no locking is needed: each index is
+ * written by exactly one side. The size must be a power of two; the
+ * indices run freely and are masked on access.
+ */
+
+#ifndef CC2511_RING_H
+#define CC2511_RING_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct ring {
+    uint8_t *data;
+    uint32_t size;              /* power of two */
+    volatile uint32_t head;     /* written by producer only */
+    volatile uint32_t tail;     /* written by consumer only */
+}   ring_T;
+
+/*! \brief Attach storage to a ring and empty it.
+ *  \ingroup cnc_ring
+ *
+ * \param storage Buffer of size bytes
+ * \param size    Power of two
+ */
+static inline void ring_init(ring_T *r, uint8_t *storage, uint32_t size) {
+    r->data = storage;
+    r->size = size;
+    r->head = 0;
+    r->tail = 0;
+}
+
+/*! \brief Bytes waiting to be read.
+ *  \ingroup cnc_ring
+ */
+static inline uint32_t ring_count(const ring_T *r) {
+    return r->head - r->tail;
+}
+
+/*! \brief Bytes that can still be written.
+ *  \ingroup cnc_ring
+ */
+static inline uint32_t ring_free(const ring_T *r) {
+    return r->size - ring_count(r);
+}
+
+/*! \brief Append a byte. Producer side only.
+ *  \ingroup cnc_ring
+ *
+ * \return false if the ring is full (the byte is dropped)
+ */
+static inline bool ring_push(ring_T *r, uint8_t byte) {
+    uint32_t head = r->head;
+    if (head - r->tail >= r->size) {
+        return false;
+    }
+    r->data[head & (r->size - 1)] = byte;
+    __sync_synchronize();   /* data must be visible before head moves */
+    r->head = head + 1;
+    return true;
+}
+
+/*! \brief Remove the oldest byte. Consumer side only.
+ *  \ingroup cnc_ring
+ *
+ * \return false if the ring is empty
+ */
+static inline bool ring_pop(ring_T *r, uint8_t *byte) {
+    uint32_t tail = r->tail;
+    if (tail == r->head) {
+        return false;
+    }
+    *byte = r->data[tail & (r->size - 1)];
+    __sync_synchronize();   /* read must finish before the slot is released */
+    r->tail = tail + 1;
+    return true;
+}
+
+#endif //  CC2511_RING_H
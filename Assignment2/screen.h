@@ -0,0 +1,323 @@
+/** \file screen.h
+ *  \defgroup cnc_screen
+ *
+ * Header-only differential screen renderer on top of terminal.h.
+ *
+ * Drawing goes into a shadow copy of the screen (character and colours
+ * per cell) instead of straight to the terminal. screen_present() then
+ * compares it with what the terminal is known to show and sends only
+ * the cells that changed, with as little cursor movement as possible:
+ * nothing for the next cell along, a short run of unchanged cells
+ * rewritten when that is cheaper than a jump, otherwise one cursor
+ * move. Colours are only sent when they change.
+ *
+ * Redrawing a whole panel that is mostly the same then costs only the
+ * bytes that differ. Cells outside SCREEN_COLS x SCREEN_ROWS are
+ * clipped.
+ *
+ * screen_scroll() moves a band of rows up. The terminal is told to
+ * scroll the same band on the next present, so a scrolling log costs
+ * the new lines rather than a repaint of every line that moved.
+ */
+
+#ifndef CC2511_SCREEN_H
+#define CC2511_SCREEN_H
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "terminal.h"
+
+#define SCREEN_COLS 160
+#define SCREEN_ROWS 48
+#define SCREEN_MAX_REWRITE 4    /* unchanged cells rewritten instead of a jump */
+
+typedef struct screen_cell {
+    char ch;
+    term_color_T fg;            /* foreground */
+    term_color_T bg;            /* background */
+}   screen_cell_T;
+
+typedef struct screen {
+    screen_cell_T back[SCREEN_ROWS][SCREEN_COLS];   /* frame being drawn */
+    screen_cell_T front[SCREEN_ROWS][SCREEN_COLS];  /* what the terminal shows */
+    bool front_valid;           /* false: terminal contents unknown */
+    int x, y;                   /* drawing position (1-based) */
+    term_color_T fg, bg;        /* drawing colours */
+    int term_x, term_y;         /* terminal cursor, 0 = unknown */
+    term_color_T term_fg;       /* terminal colours, 0 = unknown */
+    term_color_T term_bg;
+    int scroll_top;             /* rows the terminal is to scroll on the next */
+    int scroll_bottom;          /* present (1-based, inclusive) */
+    int scroll_lines;           /* 0 = none */
+}   screen_T;
+
+/* True if the cell looks the same drawn in these colours (a space has
+   no foreground) */
+static inline bool screen_cell_shows(screen_cell_T cell, term_color_T fg, term_color_T bg) {
+    return cell.bg == bg && (cell.fg == fg || cell.ch == ' ');
+}
+
+static inline bool screen_cell_equal(screen_cell_T a, screen_cell_T b) {
+    return a.ch == b.ch && screen_cell_shows(a, b.fg, b.bg);
+}
+
+/*! \brief Fill the frame being drawn with blank cells.
+ *  \ingroup cnc_screen
+ */
+static inline void screen_clear(screen_T *s, term_color_T bg) {
+    screen_cell_T blank = {' ', bg, bg};
+    for (int row = 0; row < SCREEN_ROWS; row++) {
+        for (int col = 0; col < SCREEN_COLS; col++) {
+            s->back[row][col] = blank;
+        }
+    }
+}
+
+/*! \brief Forget what the terminal shows; the next present clears it and
+ *  repaints everything.
+ *  \ingroup cnc_screen
+ */
+static inline void screen_invalidate(screen_T *s) {
+    s->front_valid = false;
+    s->term_x = 0;
+    s->term_y = 0;
+    s->term_fg = 0;
+    s->term_bg = 0;
+    s->scroll_lines = 0;
+    term_forget_color();
+}
+
+/*! \brief Start with a blank frame and an unknown terminal.
+ *  \ingroup cnc_screen
+ */
+static inline void screen_init(screen_T *s) {
+    screen_clear(s, clrBlack);
+    s->x = 1;
+    s->y = 1;
+    s->fg = clrWhite;
+    s->bg = clrBlack;
+    screen_invalidate(s);
+}
+
+/*! \brief Move the drawing position, as term_move_to().
+ *  \ingroup cnc_screen
+ */
+static inline void screen_move_to(screen_T *s, int x, int y) {
+    s->x = x;
+    s->y = y;
+}
+
+/*! \brief Colours for what is drawn next, as term_set_color().
+ *  \ingroup cnc_screen
+ */
+static inline void screen_set_color(screen_T *s, term_color_T foreground, term_color_T background) {
+    s->fg = foreground;
+    s->bg = background;
+}
+
+/*! \brief Draw one character and advance.
+ *  \ingroup cnc_screen
+ *
+ * "\r" returns to column 1 and "\n" moves down a row.
+ */
+static inline void screen_putc(screen_T *s, char ch) {
+    if (ch == '\r') {
+        s->x = 1;
+        return;
+    }
+    if (ch == '\n') {
+        s->y++;
+        return;
+    }
+    if (s->x >= 1 && s->x <= SCREEN_COLS && s->y >= 1 && s->y <= SCREEN_ROWS) {
+        screen_cell_T cell = {ch, s->fg, s->bg};
+        s->back[s->y - 1][s->x - 1] = cell;
+    }
+    s->x++;
+}
+
+/*! \brief Draw up to length characters of a string.
+ *  \ingroup cnc_screen
+ */
+static inline void screen_write(screen_T *s, const char *text, size_t length) {
+    for (size_t i = 0; i < length && text[i] != '\0'; i++) {
+        screen_putc(s, text[i]);
+    }
+}
+
+/*! \brief Draw a string.
+ *  \ingroup cnc_screen
+ */
+static inline void screen_puts(screen_T *s, const char *text) {
+    while (*text) {
+        screen_putc(s, *text++);
+    }
+}
+
+/*! \brief Draw count copies of a character.
+ *  \ingroup cnc_screen
+ */
+static inline void screen_fill(screen_T *s, char ch, int count) {
+    for (int i = 0; i < count; i++) {
+        screen_putc(s, ch);
+    }
+}
+
+/*! \brief Draw formatted text, as printf(). Truncated to one screen width.
+ *  \ingroup cnc_screen
+ */
+static inline void screen_printf(screen_T *s, const char *format, ...) {
+    char text[SCREEN_COLS + 1];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+    screen_puts(s, text);
+}
+
+/*! \brief Move rows top to bottom (1-based, inclusive) up by lines,
+ *  leaving blank rows in the drawing colours at the bottom.
+ *  \ingroup cnc_screen
+ *
+ * Whole rows move, so the band should hold nothing but what is to
+ * scroll, apart from columns that are the same on every row of it (box
+ * borders). Only one band can be waiting for a present; scrolling a
+ * different one first drops the terminal scroll and leaves it to the
+ * cell differences.
+ */
+static inline void screen_scroll(screen_T *s, int top, int bottom, int lines) {
+    if (top < 1 || bottom > SCREEN_ROWS || top > bottom || lines <= 0) {
+        return;
+    }
+    if (lines > bottom - top) {
+        lines = bottom - top + 1;
+    }
+    for (int row = top - 1; row < bottom; row++) {
+        for (int col = 0; col < SCREEN_COLS; col++) {
+            screen_cell_T blank = {' ', s->fg, s->bg};
+            s->back[row][col] = row + lines < bottom ? s->back[row + lines][col] : blank;
+        }
+    }
+    if (s->scroll_lines > 0 && (s->scroll_top != top || s->scroll_bottom != bottom)) {
+        s->scroll_lines = 0;
+        return;
+    }
+    s->scroll_top = top;
+    s->scroll_bottom = bottom;
+    s->scroll_lines += lines;
+}
+
+/* Scroll the terminal as asked for by screen_scroll(), and what it is
+   known to show with it */
+static inline void screen_send_scroll(screen_T *s) {
+    int top = s->scroll_top;
+    int bottom = s->scroll_bottom;
+    int lines = s->scroll_lines;
+    s->scroll_lines = 0;
+    if (lines > bottom - top) {
+        return;                 // the whole band is new; repaint it instead
+    }
+    if (s->term_bg == 0) {
+        term_set_color(clrWhite, clrBlack);
+        s->term_fg = clrWhite;
+        s->term_bg = clrBlack;
+    }
+    // Line feeds at the bottom of a scrolling region scroll just that region
+    term_printf("\033[%d;%dr", top, bottom);
+    term_move_to(1, bottom);
+    term_fill('\n', lines);
+    term_puts("\033[r");     // whole screen again; the cursor goes home
+    screen_cell_T blank = {' ', s->term_bg, s->term_bg};
+    for (int row = top - 1; row < bottom; row++) {
+        for (int col = 0; col < SCREEN_COLS; col++) {
+            s->front[row][col] = row + lines < bottom ? s->front[row + lines][col] : blank;
+        }
+    }
+}
+
+/* Put the terminal cursor on a cell by the cheapest route */
+static inline void screen_seek(screen_T *s, int x, int y) {
+    if (s->term_y == y && s->term_x == x) {
+        return;
+    }
+    if (s->term_y == y && x > s->term_x && s->term_x != 0
+        && x - s->term_x <= SCREEN_MAX_REWRITE) {
+        // Rewriting a few cells is shorter than a jump, if their colours match
+        bool same = true;
+        for (int col = s->term_x; col < x; col++) {
+            same = same && screen_cell_shows(s->front[y - 1][col - 1], s->term_fg, s->term_bg);
+        }
+        if (same) {
+            for (int col = s->term_x; col < x; col++) {
+                term_putc(s->front[y - 1][col - 1].ch);
+            }
+            s->term_x = x;
+            return;
+        }
+    }
+    term_move_to(x, y);
+    s->term_x = x;
+    s->term_y = y;
+}
+
+/*! \brief Send the differences between the frame and the terminal.
+ *  \ingroup cnc_screen
+ *
+ * Leaves the terminal cursor and colours at the drawing position and
+ * colours, where typed input is echoed. Bytes go to the terminal.h
+ * buffer; call term_flush() to send them.
+ *
+ * The cursor is looked up afresh every time, as echoed input moves it
+ * behind the renderer's back.
+ */
+static inline void screen_present(screen_T *s) {
+    s->term_x = 0;
+    s->term_y = 0;
+    if (!s->front_valid) {
+        // Start from a cleared terminal rather than sending every blank
+        screen_cell_T blank = {' ', clrBlack, clrBlack};
+        term_set_color(clrBlack, clrBlack);
+        term_cls();
+        s->term_fg = clrBlack;
+        s->term_bg = clrBlack;
+        for (int row = 0; row < SCREEN_ROWS; row++) {
+            for (int col = 0; col < SCREEN_COLS; col++) {
+                s->front[row][col] = blank;
+            }
+        }
+        s->front_valid = true;
+        s->scroll_lines = 0;
+    }
+    if (s->scroll_lines > 0) {
+        screen_send_scroll(s);
+    }
+    for (int row = 0; row < SCREEN_ROWS; row++) {
+        for (int col = 0; col < SCREEN_COLS; col++) {
+            screen_cell_T cell = s->back[row][col];
+            if (screen_cell_equal(cell, s->front[row][col])) {
+                continue;
+            }
+            screen_seek(s, col + 1, row + 1);
+            if (!screen_cell_shows(cell, s->term_fg, s->term_bg)) {
+                term_set_color(cell.fg, cell.bg);
+                s->term_fg = cell.fg;
+                s->term_bg = cell.bg;
+            }
+            term_putc(cell.ch);
+            s->front[row][col] = cell;
+            // The cursor stays on the last column until the next character
+            s->term_x = col + 1 < SCREEN_COLS ? col + 2 : 0;
+        }
+    }
+
+    screen_seek(s, s->x, s->y);
+    if (s->fg != s->term_fg || s->bg != s->term_bg) {
+        term_set_color(s->fg, s->bg);
+        s->term_fg = s->fg;
+        s->term_bg = s->bg;
+    }
+}
+
+#endif //  CC2511_SCREEN_H
@@ -0,0 +1,513 @@
+/** \file stepper.h
+ *  \defgroup cnc_stepper
+ *
+ * Header-only step pulse engine for the three axis mill.
+ *
+ * Motion code pushes step events into a queue and a hardware timer
+ * alarm pops them, so pulse timing no longer depends on sleep_us() on
+ * the main loop. Each event is one pulse slot: the axes in step_mask
+ * are pulsed together and the next slot starts interval_us later.
+ *
+ * A feed hold can be requested at any time. The alarm then stretches the
+ * queued intervals so the speed falls at STEPPER_HOLD_ACCEL, stops with
+ * the rest of the queue intact, and on resume ramps back up until the
+ * planned intervals take over again. No event is skipped, so the
+ * position stays exact across a hold.
+ *
+ * line_init()/line_next() turn a straight move into those pulse slots
+ * with an integer Bresenham DDA across all three axes. arc_init()/
+ * arc_next() do the same for a circular or helical arc: an integer
+ * midpoint walk round the circle in XY, with Z spread evenly over it.
+ *
+ * The engine itself only decides which bits to drive and how long to
+ * wait; writing the pins and arming the alarm is left to the caller
+ * (see step_alarm_callback() in main.c). Nothing in here touches the
+ * hardware, so the same code can be compiled and driven on a PC.
+ */
+
+#ifndef CC2511_STEPPER_H
+#define CC2511_STEPPER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define STEPPER_NUM_AXES    3
+#define STEPPER_QUEUE_SIZE  256U             /* Must be a power of two */
+#define STEPPER_PULSE_US    4U               /* Step pin high time */
+#define STEPPER_MIN_INTERVAL_US (2U * STEPPER_PULSE_US)
+#define STEPPER_TICK_HZ     1000000U         /* interval units per second */
+#define STEPPER_HOLD_ACCEL  4000U            /* steps/s^2 to stop and restart */
+#define STEPPER_HOLD_MIN_VELOCITY 100U       /* speed at which a hold stops */
+
+/* Feed hold states */
+#define STEPPER_RUN      0
+#define STEPPER_HOLDING  1                   /* decelerating to a hold */
+#define STEPPER_HELD     2                   /* stopped, queue kept */
+#define STEPPER_RESUMING 3                   /* accelerating back to plan */
+
+/* Axis bit positions in step_mask/dir_mask */
+#define AXIS_X 0
+#define AXIS_Y 1
+#define AXIS_Z 2
+
+/* One pulse slot */
+typedef struct step_event {
+    uint8_t step_mask;      /* bit n set = pulse axis n */
+    uint8_t dir_mask;       /* bit n set = axis n moves forwards */
+    uint32_t interval_us;   /* time from this pulse to the next one */
+}   step_event_T;
+
+/* Engine state shared between the producer and the timer alarm */
+typedef struct stepper {
+    step_event_T queue[STEPPER_QUEUE_SIZE];
+    volatile uint32_t head;                     /* written by producer only */
+    volatile uint32_t tail;                     /* written by alarm only */
+    volatile int32_t position[STEPPER_NUM_AXES];/* steps actually issued */
+    volatile bool running;                      /* alarm is armed */
+    bool pulse_high;                            /* step pins currently high */
+    uint32_t low_time_us;                       /* remaining slot time after pulse */
+    uint8_t step_bits;                          /* step pins to drive now */
+    uint8_t dir_bits;                           /* dir pins to drive now */
+    volatile uint8_t hold_state;                /* STEPPER_RUN etc. */
+    volatile bool hold_request;                 /* set by anyone, taken by alarm */
+    volatile bool resume_request;
+    uint32_t hold_velocity;                     /* speed cap while holding/resuming (Q8) */
+}   stepper_T;
+
+/*! \brief Reset the engine to an empty, stopped state.
+ *  \ingroup cnc_stepper
+ */
+static inline void stepper_init(stepper_T *s) {
+    s->head = 0;
+    s->tail = 0;
+    for (int i = 0; i < STEPPER_NUM_AXES; i++) {
+        s->position[i] = 0;
+    }
+    s->running = false;
+    s->pulse_high = false;
+    s->low_time_us = 0;
+    s->step_bits = 0;
+    s->dir_bits = 0;
+    s->hold_state = STEPPER_RUN;
+    s->hold_request = false;
+    s->resume_request = false;
+    s->hold_velocity = 0;
+}
+
+/*! \brief Number of events waiting in the queue.
+ *  \ingroup cnc_stepper
+ */
+static inline uint32_t stepper_queued(const stepper_T *s) {
+    return s->head - s->tail;
+}
+
+/*! \brief True when no events are queued and the alarm has stopped.
+ *  \ingroup cnc_stepper
+ */
+static inline bool stepper_idle(const stepper_T *s) {
+    return !s->running && s->head == s->tail;
+}
+
+/*! \brief Add an event to the queue.
+ *  \ingroup cnc_stepper
+ *
+ * Must only be called from the producer side.
+ *
+ * \return false if the queue is full (nothing is written)
+ */
+static inline bool stepper_push(stepper_T *s, uint8_t step_mask,
+  uint8_t dir_mask, uint32_t interval_us) {
+    uint32_t head = s->head;
+    if (head - s->tail >= STEPPER_QUEUE_SIZE) {
+        return false;
+    }
+    step_event_T *e = &s->queue[head & (STEPPER_QUEUE_SIZE - 1)];
+    e->step_mask = step_mask;
+    e->dir_mask = dir_mask;
+    e->interval_us = interval_us < STEPPER_MIN_INTERVAL_US ?
+        STEPPER_MIN_INTERVAL_US : interval_us;
+    __sync_synchronize();   /* event must be visible before head moves */
+    s->head = head + 1;
+    return true;
+}
+
+/*! \brief Drop every queued event.
+ *  \ingroup cnc_stepper
+ *
+ * Must be called with the alarm interrupt masked, since it moves tail on
+ * the alarm's behalf. A pulse already in progress still completes and
+ * position keeps counting only pulses that were issued.
+ */
+static inline void stepper_flush(stepper_T *s) {
+    s->tail = s->head;
+    s->hold_state = STEPPER_RUN;
+    s->hold_request = false;
+    s->resume_request = false;
+}
+
+/*! \brief Prepare the first edge of a stopped engine.
+ *  \ingroup cnc_stepper
+ *
+ * Latches the direction bits of the next queued event so they are set up
+ * before its pulse. The caller drives dir_bits, then arms the alarm and
+ * lets stepper_tick() do the rest. A held engine only restarts once a
+ * resume has been requested, and a hold requested while stopped is
+ * latched here so the next move does not start.
+ *
+ * \return false if there is nothing to start
+ */
+static inline bool stepper_start(stepper_T *s) {
+    if (s->running || s->head == s->tail) {
+        return false;
+    }
+    // A hold requested between moves takes effect before the first pulse
+    if (s->hold_request && s->hold_state == STEPPER_RUN) {
+        s->hold_request = false;
+        s->resume_request = false;
+        s->hold_state = STEPPER_HELD;
+    }
+    if (s->hold_state == STEPPER_HELD) {
+        if (!s->resume_request) {
+            return false;
+        }
+        s->resume_request = false;
+        s->hold_state = STEPPER_RESUMING;
+        s->hold_velocity = STEPPER_HOLD_MIN_VELOCITY << 8;
+    }
+    s->dir_bits = s->queue[s->tail & (STEPPER_QUEUE_SIZE - 1)].dir_mask;
+    s->step_bits = 0;
+    s->pulse_high = false;
+    s->running = true;
+    return true;
+}
+
+/*! \brief Advance the engine by one edge. Called from the timer alarm.
+ *  \ingroup cnc_stepper
+ *
+ * On a rising edge the next event is popped and its step bits raised.
+ * On the falling edge the step bits are cleared and the direction of the
+ * following event is latched so it has the whole low time to settle. An
+ * event pushed after that gets its direction set one short low time
+ * before its pulse instead.
+ *
+ * \return microseconds until the next call, or 0 when the queue has
+ *         run dry and the alarm should stop
+ */
+static inline uint32_t stepper_tick(stepper_T *s) {
+    if (!s->pulse_high) {
+        uint32_t tail = s->tail;
+        if (tail == s->head) {
+            s->step_bits = 0;
+            s->running = false;
+            return 0;
+        }
+        step_event_T e = s->queue[tail & (STEPPER_QUEUE_SIZE - 1)];
+        uint32_t interval = e.interval_us;
+
+        // Pushed after the last falling edge: set the direction, pulse next time
+        if (e.dir_mask != s->dir_bits) {
+            s->dir_bits = e.dir_mask;
+            s->step_bits = 0;
+            return STEPPER_MIN_INTERVAL_US - STEPPER_PULSE_US;
+        }
+
+        // Feed hold: cap the speed and walk the cap down or up. A resume
+        // clears hold_request, so a hold seen here is newer than any
+        // resume still pending from an earlier hold
+        if (s->hold_request) {
+            s->hold_request = false;
+            s->resume_request = false;
+            if (s->hold_state == STEPPER_RUN) {
+                s->hold_velocity = (STEPPER_TICK_HZ << 8) / interval;
+            }
+            if (s->hold_state != STEPPER_HELD) {
+                s->hold_state = STEPPER_HOLDING;
+            }
+        }
+        if (s->resume_request && s->hold_state == STEPPER_HOLDING) {
+            s->resume_request = false;
+            s->hold_state = STEPPER_RESUMING;
+        }
+        if (s->hold_state == STEPPER_HOLDING
+            && s->hold_velocity <= (STEPPER_HOLD_MIN_VELOCITY << 8)) {
+            s->hold_state = STEPPER_HELD;
+            s->step_bits = 0;
+            s->running = false;
+            return 0;
+        }
+        if (s->hold_state == STEPPER_HOLDING || s->hold_state == STEPPER_RESUMING) {
+            uint32_t capped = (uint32_t)(((uint64_t)STEPPER_TICK_HZ << 8) / s->hold_velocity);
+            if (capped > interval) {
+                interval = capped;
+            }
+            // dv = a * dt, both in Q8 steps/s
+            uint32_t dv = (uint32_t)(((uint64_t)STEPPER_HOLD_ACCEL * interval << 8) / STEPPER_TICK_HZ);
+            if (dv == 0) {
+                dv = 1;
+            }
+            if (s->hold_state == STEPPER_HOLDING) {
+                s->hold_velocity = s->hold_velocity > (STEPPER_HOLD_MIN_VELOCITY << 8) + dv ?
+                    s->hold_velocity - dv : (STEPPER_HOLD_MIN_VELOCITY << 8);
+            } else {
+                s->hold_velocity += dv;
+                if (((uint64_t)STEPPER_TICK_HZ << 8) / s->hold_velocity <= e.interval_us) {
+                    s->hold_state = STEPPER_RUN;
+                }
+            }
+        }
+        s->tail = tail + 1;
+
+        for (int i = 0; i < STEPPER_NUM_AXES; i++) {
+            if (e.step_mask & (1U << i)) {
+                s->position[i] += (e.dir_mask & (1U << i)) ? 1 : -1;
+            }
+        }
+        s->dir_bits = e.dir_mask;
+        s->step_bits = e.step_mask;
+        s->low_time_us = interval - STEPPER_PULSE_US;
+        s->pulse_high = true;
+        return STEPPER_PULSE_US;
+    }
+
+    s->step_bits = 0;
+    s->pulse_high = false;
+    if (s->tail != s->head) {
+        s->dir_bits = s->queue[s->tail & (STEPPER_QUEUE_SIZE - 1)].dir_mask;
+    }
+    return s->low_time_us;
+}
+
+/* Bresenham state for one straight move */
+typedef struct line {
+    uint32_t steps[STEPPER_NUM_AXES];   /* pulses per axis */
+    uint32_t error[STEPPER_NUM_AXES];   /* accumulated fraction of a step */
+    uint32_t dominant;                  /* pulses on the longest axis */
+    uint32_t remaining;                 /* slots left to emit */
+    uint8_t dir_mask;                   /* bit n set = axis n moves forwards */
+}   line_T;
+
+/*! \brief Start interpolating a straight move.
+ *  \ingroup cnc_stepper
+ *
+ * \param delta Signed steps per axis
+ */
+static inline void line_init(line_T *l, const int32_t delta[STEPPER_NUM_AXES]) {
+    l->dominant = 0;
+    l->dir_mask = 0;
+    for (int i = 0; i < STEPPER_NUM_AXES; i++) {
+        l->steps[i] = (uint32_t)(delta[i] < 0 ? -delta[i] : delta[i]);
+        if (l->steps[i] > l->dominant) {
+            l->dominant = l->steps[i];
+        }
+        if (delta[i] > 0) {
+            l->dir_mask |= 1U << i;
+        }
+    }
+    // Start half way so rounding is symmetric about the ideal line
+    for (int i = 0; i < STEPPER_NUM_AXES; i++) {
+        l->error[i] = l->dominant >> 1;
+    }
+    l->remaining = l->dominant;
+}
+
+/*! \brief Axes to pulse in the next slot.
+ *  \ingroup cnc_stepper
+ *
+ * Every call adds steps[i] to each accumulator and pulses the axes that
+ * wrap past dominant. After dominant calls each accumulator has wrapped
+ * exactly steps[i] times, so the move always ends on the target.
+ *
+ * \return false once all slots have been emitted
+ */
+static inline bool line_next(line_T *l, uint8_t *step_mask) {
+    if (l->remaining == 0) {
+        return false;
+    }
+    uint8_t mask = 0;
+    for (int i = 0; i < STEPPER_NUM_AXES; i++) {
+        l->error[i] += l->steps[i];
+        if (l->error[i] >= l->dominant) {
+            l->error[i] -= l->dominant;
+            mask |= 1U << i;
+        }
+    }
+    l->remaining--;
+    *step_mask = mask;
+    return true;
+}
+
+/* Integer circle walk for one arc in the XY plane, Z following along */
+typedef struct arc {
+    int32_t x, y;                       /* position relative to the centre */
+    int32_t end_x, end_y;               /* target relative to the centre */
+    int64_t r2;                         /* squared radius of the start point */
+    bool clockwise;
+    bool done;                          /* end angle reached */
+    uint8_t quadrants;                  /* quadrant boundaries still to cross */
+    uint32_t slots;                     /* planned slots for the whole arc */
+    uint32_t xy_steps;                  /* planned XY steps, <= slots */
+    uint32_t xy_error;
+    uint32_t z_steps;                   /* Z pulses spread over the slots */
+    uint32_t z_left;
+    uint32_t z_error;
+    uint8_t z_dir;                      /* Z bit of dir_mask */
+    uint8_t dir_mask;                   /* directions of the last steps */
+}   arc_T;
+
+/*! \brief Quadrant of a point relative to the centre, counter-clockwise.
+ *  \ingroup cnc_stepper
+ *
+ * Each quadrant includes the axis it starts on, so every point belongs
+ * to exactly one.
+ */
+static inline int arc_quadrant(int32_t x, int32_t y) {
+    if (x > 0 && y >= 0) {
+        return 0;
+    }
+    if (x <= 0 && y > 0) {
+        return 1;
+    }
+    if (x < 0 && y <= 0) {
+        return 2;
+    }
+    return 3;
+}
+
+/* Cross product of the position and the end point, positive while the
+   end still lies ahead in the direction of travel */
+static inline int64_t arc_ahead(const arc_T *a) {
+    int64_t cross = (int64_t)a->x * a->end_y - (int64_t)a->y * a->end_x;
+    return a->clockwise ? -cross : cross;
+}
+
+/*! \brief Start interpolating an arc.
+ *  \ingroup cnc_stepper
+ *
+ * The walk ends at the first point at or past the end angle; whatever
+ * separates it from the exact target (rounding, or a target slightly
+ * off the circle) is left to arc_remaining(). Equal start and end
+ * points make a full circle.
+ *
+ * \param start    Start point relative to the centre
+ * \param end      End point relative to the centre
+ * \param dz       Signed Z steps over the arc
+ * \param xy_steps Expected XY slots (see planner_arc_steps())
+ */
+static inline void arc_init(arc_T *a, const int32_t start[2], const int32_t end[2],
+  int32_t dz, bool clockwise, uint32_t xy_steps) {
+    a->x = start[0];
+    a->y = start[1];
+    a->end_x = end[0];
+    a->end_y = end[1];
+    a->r2 = (int64_t)start[0] * start[0] + (int64_t)start[1] * start[1];
+    a->clockwise = clockwise;
+    a->done = a->r2 == 0;
+
+    int q_start = arc_quadrant(start[0], start[1]);
+    int q_end = arc_quadrant(end[0], end[1]);
+    int crossings = clockwise ? (q_start - q_end) & 3 : (q_end - q_start) & 3;
+    if (crossings == 0 && arc_ahead(a) <= 0) {
+        crossings = 4;      // end is behind the start: go all the way round
+    }
+    a->quadrants = (uint8_t)crossings;
+
+    a->z_steps = (uint32_t)(dz < 0 ? -dz : dz);
+    a->z_left = a->z_steps;
+    a->z_dir = dz > 0 ? 1U << AXIS_Z : 0;
+    a->xy_steps = xy_steps ? xy_steps : 1;
+    a->slots = a->xy_steps > a->z_steps ? a->xy_steps : a->z_steps;
+    a->xy_error = a->slots >> 1;
+    a->z_error = a->slots >> 1;
+    a->dir_mask = a->z_dir;
+}
+
+/* Distance of a point from the circle, as |x^2 + y^2 - r^2| */
+static inline uint64_t arc_deviation(const arc_T *a, int32_t x, int32_t y) {
+    int64_t d = (int64_t)x * x + (int64_t)y * y - a->r2;
+    return (uint64_t)(d < 0 ? -d : d);
+}
+
+/*! \brief Axes to pulse in the next slot.
+ *  \ingroup cnc_stepper
+ *
+ * An XY step always moves along the tangent: one axis or both, whichever
+ * neighbour lies closest to the circle. Every step advances the angle,
+ * so the walk cannot stall, and the error never exceeds half a step.
+ *
+ * \return false once the end angle has been reached
+ */
+static inline bool arc_next(arc_T *a, uint8_t *step_mask, uint8_t *dir_mask) {
+    if (!a->done && a->quadrants == 0 && arc_ahead(a) <= 0) {
+        a->done = true;
+    }
+    if (a->done) {
+        return false;
+    }
+    uint8_t mask = 0;
+
+    a->xy_error += a->xy_steps;
+    if (a->xy_error >= a->slots) {
+        a->xy_error -= a->slots;
+
+        // Tangent direction, counter-clockwise (-y, x)
+        int32_t sx = a->y > 0 ? -1 : a->y < 0 ? 1 : 0;
+        int32_t sy = a->x > 0 ? 1 : a->x < 0 ? -1 : 0;
+        if (a->clockwise) {
+            sx = -sx;
+            sy = -sy;
+        }
+        int32_t nx = a->x + sx;
+        int32_t ny = a->y + sy;
+        if (sx != 0 && sy != 0) {
+            uint64_t both = arc_deviation(a, nx, ny);
+            uint64_t x_only = arc_deviation(a, nx, a->y);
+            uint64_t y_only = arc_deviation(a, a->x, ny);
+            if (x_only < both && x_only <= y_only) {
+                ny = a->y;
+            } else if (y_only < both) {
+                nx = a->x;
+            }
+        }
+
+        int q_before = arc_quadrant(a->x, a->y);
+        int q_after = arc_quadrant(nx, ny);
+        int crossed = a->clockwise ? (q_before - q_after) & 3 : (q_after - q_before) & 3;
+        a->quadrants = crossed > a->quadrants ? 0 : a->quadrants - crossed;
+
+        if (nx != a->x) {
+            mask |= 1U << AXIS_X;
+            a->dir_mask = nx > a->x ? a->dir_mask | (1U << AXIS_X) : a->dir_mask & ~(1U << AXIS_X);
+        }
+        if (ny != a->y) {
+            mask |= 1U << AXIS_Y;
+            a->dir_mask = ny > a->y ? a->dir_mask | (1U << AXIS_Y) : a->dir_mask & ~(1U << AXIS_Y);
+        }
+        a->x = nx;
+        a->y = ny;
+    }
+
+    if (a->z_left > 0) {
+        a->z_error += a->z_steps;
+        if (a->z_error >= a->slots) {
+            a->z_error -= a->slots;
+            a->z_left--;
+            mask |= 1U << AXIS_Z;
+        }
+    }
+    *step_mask = mask;
+    *dir_mask = a->dir_mask;
+    return true;
+}
+
+/*! \brief Steps still needed to land exactly on the target.
+ *  \ingroup cnc_stepper
+ *
+ * Call once arc_next() has returned false and finish with a line.
+ */
+static inline void arc_remaining(const arc_T *a, int32_t delta[STEPPER_NUM_AXES]) {
+    delta[AXIS_X] = a->end_x - a->x;
+    delta[AXIS_Y] = a->end_y - a->y;
+    delta[AXIS_Z] = a->z_dir ? (int32_t)a->z_left : -(int32_t)a->z_left;
+}
+
+#endif //  CC2511_STEPPER_H
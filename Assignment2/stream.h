@@ -0,0 +1,51 @@
+/** \file stream.h
+ *  \defgroup cnc_stream
+ *
+ * Flow control for jobs streamed over the UART.
+ *
+ * Incoming bytes are kept in a ring (see ring.h). The controller sends
+ * XOFF when the ring is nearly full and XON once it has drained, and the
+ * host stops writing in between. Because the host keeps writing for a
+ * short while after XOFF (UART FIFOs, USB adapter buffers), the pause
+ * threshold leaves STREAM_HIGH_WATER bytes of headroom.
+ *
+ * For hosts that cannot honour XON/XOFF, ack mode also answers every
+ * line with "ok" or "error" so the host can count bytes in flight and
+ * never exceed STREAM_BUFFER_SIZE. The reason for an error is shown in
+ * the Output box. A G-code stream stops at its first error, including
+ * a line of STREAM_LINE_SIZE characters or more, which is dropped
+ * whole rather than cut short.
+ *
+ * Shared by the firmware and the host tools in host/.
+ */
+
+#ifndef CC2511_STREAM_H
+#define CC2511_STREAM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "ring.h"
+
+#define STREAM_BUFFER_SIZE 4096U    /* ring size, power of two */
+#define STREAM_LINE_SIZE   100      /* line buffer, terminator included */
+#define STREAM_HIGH_WATER  512U     /* pause when fewer bytes than this are free */
+#define STREAM_LOW_WATER   1024U    /* resume when fewer bytes than this are queued */
+
+#define STREAM_XON  0x11
+#define STREAM_XOFF 0x13
+
+/*! \brief True if the sender should be paused. Producer side.
+ *  \ingroup cnc_stream
+ */
+static inline bool stream_should_pause(const ring_T *r, bool paused) {
+    return !paused && ring_free(r) < STREAM_HIGH_WATER;
+}
+
+/*! \brief True if a paused sender can resume. Consumer side.
+ *  \ingroup cnc_stream
+ */
+static inline bool stream_should_resume(const ring_T *r, bool paused) {
+    return paused && ring_count(r) < STREAM_LOW_WATER;
+}
+
+#endif //  CC2511_STREAM_H
@@ -0,0 +1,106 @@
+/** \file telemetry.h
+ *  \defgroup cnc_telemetry
+ *
+ * Pacing for the live position panel.
+ *
+ * Frames are sent at a set rate while the machine moves. Every frame
+ * also has to fit a byte budget that fills at a fixed share of the UART
+ * bandwidth, so telemetry can never crowd out replies or a streamed job.
+ * When the budget runs out, frames are skipped until it has refilled.
+ *
+ * The path speed is worked out from the distance between consecutive
+ * position samples. The positions are only read, so sampling does not
+ * touch the step timing on the motion core. Nothing in here touches the
+ * hardware.
+ */
+
+#ifndef CC2511_TELEMETRY_H
+#define CC2511_TELEMETRY_H
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define TELEMETRY_NUM_AXES 3
+#define TELEMETRY_BURST_MS 250      /* budget that can be saved up */
+
+typedef struct telemetry {
+    uint32_t interval_us;           /* time between frames, 0 = off */
+    uint32_t byte_rate;             /* bytes/s telemetry may use */
+    int64_t budget;                 /* bytes that may still be sent */
+    uint64_t accrued_us;            /* budget filled up to this time */
+    uint64_t last_us;               /* time of the last sample */
+    int32_t last_position[TELEMETRY_NUM_AXES];
+    uint32_t feed;                  /* path speed, steps/s */
+}   telemetry_T;
+
+/*! \brief Set the frame rate.
+ *  \ingroup cnc_telemetry
+ *
+ * \param rate_hz Frames per second, 0 to stop sending frames
+ */
+static inline void telemetry_set_rate(telemetry_T *t, uint32_t rate_hz) {
+    t->interval_us = rate_hz ? 1000000U / rate_hz : 0;
+}
+
+/*! \brief Set up the pacing.
+ *  \ingroup cnc_telemetry
+ *
+ * \param rate_hz       Frames per second
+ * \param baud          UART baud rate (8N1)
+ * \param share_percent Share of the link telemetry may use
+ */
+static inline void telemetry_init(telemetry_T *t, uint32_t rate_hz, uint32_t baud,
+  uint32_t share_percent) {
+    telemetry_set_rate(t, rate_hz);
+    t->byte_rate = baud / 10U * share_percent / 100U;
+    t->budget = 0;
+    t->accrued_us = 0;
+    t->last_us = 0;
+    t->feed = 0;
+    for (int i = 0; i < TELEMETRY_NUM_AXES; i++) {
+        t->last_position[i] = 0;
+    }
+}
+
+/*! \brief True if a frame may be sent now.
+ *  \ingroup cnc_telemetry
+ */
+static inline bool telemetry_ready(telemetry_T *t, uint64_t now_us) {
+    if (t->interval_us == 0) {
+        return false;
+    }
+    // Fill the budget for the time since the last call, up to one burst
+    int64_t limit = (int64_t)t->byte_rate * TELEMETRY_BURST_MS / 1000;
+    t->budget += (int64_t)((now_us - t->accrued_us) * t->byte_rate / 1000000U);
+    t->accrued_us = now_us;
+    if (t->budget > limit) {
+        t->budget = limit;
+    }
+    return t->budget > 0 && now_us - t->last_us >= t->interval_us;
+}
+
+/*! \brief Take a position sample and update the path speed.
+ *  \ingroup cnc_telemetry
+ */
+static inline void telemetry_sample(telemetry_T *t, uint64_t now_us,
+  const int32_t position[TELEMETRY_NUM_AXES]) {
+    uint64_t elapsed = now_us - t->last_us;
+    float distance_sq = 0.0f;
+    for (int i = 0; i < TELEMETRY_NUM_AXES; i++) {
+        float d = (float)(position[i] - t->last_position[i]);
+        distance_sq += d * d;
+        t->last_position[i] = position[i];
+    }
+    t->feed = elapsed ? (uint32_t)(sqrtf(distance_sq) * 1e6f / (float)elapsed) : 0;
+    t->last_us = now_us;
+}
+
+/*! \brief Charge a sent frame to the budget.
+ *  \ingroup cnc_telemetry
+ */
+static inline void telemetry_spent(telemetry_T *t, uint32_t bytes) {
+    t->budget -= bytes;
+}
+
+#endif //  CC2511_TELEMETRY_H
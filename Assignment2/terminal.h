@@ -2,7 +2,20 @@
  *  \defgroup pico_term
  *
  * Header-only code for simple terminal escape codes.
- * For use with printf(), as provided by pico_stdio. 
+ *
+ * Output is collected in a memory buffer and handed to a writer in large
+ * chunks, instead of one printf() per escape sequence or character. The
+ * buffer is sent when it fills up or when term_flush() is called, so
+ * call term_flush() before waiting for input. The default writer is
+ * stdout (pico_stdio); term_set_writer() can send the chunks elsewhere,
+ * e.g. to the UART by DMA.
+ *
+ * The colours the terminal is set to are remembered, so term_set_color()
+ * sends only what changes, or nothing. Besides the eight clr* colours,
+ * TERM_COLOR_256(n) picks from the 256-colour palette; on a terminal
+ * without it (term_set_palette(false), the default) the nearest of the
+ * eight is sent. term_query_size() and term_reply_byte() ask the
+ * terminal for its size and read the answer.
  *
  * Based on:
  *   https://en.wikipedia.org/wiki/ANSI_escape_code
@@ -13,8 +26,13 @@
 #ifndef CC2511_TERMINAL_H
 #define CC2511_TERMINAL_H
 
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdio.h>
-#include "pico/stdlib.h"
+#include <string.h>
+
+#define TERM_BUFFER_SIZE 1024U          /* bytes collected before a write */
 
 /* Color constants */
 #define   clrBlack   30U                /* Black color */
@@ -26,17 +44,150 @@
 #define   clrCyan    36U                /* Cyan color */
 #define   clrWhite   37U                /* White color */
 
+/* Colour n (0-255) of the 256-colour palette */
+#define TERM_COLOR_256(n) (0x100U | (n))
+
+/* A clr* colour or TERM_COLOR_256(); 0 = unknown */
+typedef unsigned short term_color_T;
+
 /* Character sequence constants */
 static const char term_data_esc_prefix[]  = { 0x1BU, 0x5BU };
 static const char term_data_cls[]         = { 0x32U, 0x4AU };
 
+/* Receives each chunk of buffered output */
+typedef void (*term_writer_T)(const char *data, size_t length);
+
+typedef struct term_out {
+    char data[TERM_BUFFER_SIZE];
+    size_t length;                      /* bytes waiting */
+    term_writer_T writer;               /* NULL = stdout */
+    unsigned long bytes;                /* total bytes written */
+    unsigned long writes;               /* total writer calls */
+}   term_out_T;
+
+static term_out_T term_out;
+
+typedef struct term_attr {
+    term_color_T fg;                    /* colours the terminal is set to, */
+    term_color_T bg;                    /* 0 = unknown */
+    bool palette;                       /* terminal has 256 colours */
+}   term_attr_T;
+
+static term_attr_T term_attr;
+
+/*! \brief Send output to writer instead of stdout.
+ *  \ingroup pico_term
+ *
+ * The writer may keep sending after it returns (DMA), but must be done
+ * with the data before the next call, as the buffer is reused.
+ */
+static inline void term_set_writer(term_writer_T writer) {
+    term_out.writer = writer;
+}
+
+/*! \brief Write out everything buffered so far.
+ *  \ingroup pico_term
+ */
+static inline void term_flush(void) {
+    if (term_out.length == 0) {
+        return;
+    }
+    if (term_out.writer) {
+        term_out.writer(term_out.data, term_out.length);
+    } else {
+        fwrite(term_out.data, 1, term_out.length, stdout);
+        fflush(stdout);
+    }
+    term_out.bytes += term_out.length;
+    term_out.writes++;
+    term_out.length = 0;
+}
+
+/*! \brief Append raw bytes.
+ *  \ingroup pico_term
+ */
+static inline int term_write(const char *data, size_t length) {
+    size_t written = length;
+    while (length > 0) {
+        if (term_out.length == TERM_BUFFER_SIZE) {
+            term_flush();
+        }
+        size_t room = TERM_BUFFER_SIZE - term_out.length;
+        size_t n = length < room ? length : room;
+        memcpy(&term_out.data[term_out.length], data, n);
+        term_out.length += n;
+        data += n;
+        length -= n;
+    }
+    return (int)written;
+}
+
+/*! \brief Append one character.
+ *  \ingroup pico_term
+ */
+static inline int term_putc(char ch) {
+    return term_write(&ch, 1);
+}
+
+/*! \brief Append a string.
+ *  \ingroup pico_term
+ */
+static inline int term_puts(const char *s) {
+    return term_write(s, strlen(s));
+}
+
+/*! \brief Append count copies of a character.
+ *  \ingroup pico_term
+ */
+static inline int term_fill(char ch, int count) {
+    for (int i = 0; i < count; i++) {
+        if (term_out.length == TERM_BUFFER_SIZE) {
+            term_flush();
+        }
+        term_out.data[term_out.length++] = ch;
+    }
+    return count > 0 ? count : 0;
+}
+
+/*! \brief Append formatted text, as printf().
+ *  \ingroup pico_term
+ *
+ * Output longer than TERM_BUFFER_SIZE is truncated.
+ */
+static inline int term_printf(const char *format, ...) {
+    va_list args;
+    size_t room = TERM_BUFFER_SIZE - term_out.length;
+    va_start(args, format);
+    int n = vsnprintf(&term_out.data[term_out.length], room, format, args);
+    va_end(args);
+    if (n < 0) {
+        return n;
+    }
+    if ((size_t)n >= room) {
+        // Did not fit: start a fresh buffer and format again
+        term_flush();
+        va_start(args, format);
+        n = vsnprintf(term_out.data, TERM_BUFFER_SIZE, format, args);
+        va_end(args);
+        if (n < 0) {
+            return n;
+        }
+        if ((size_t)n >= TERM_BUFFER_SIZE) {
+            n = TERM_BUFFER_SIZE - 1;
+        }
+    }
+    term_out.length += (size_t)n;
+    return n;
+}
+
 /*! \brief Clear the terminal.
  *  \ingroup pico_term
  *
  * Clears all content from the screen and returns the cursor to position 1,1.
  */
 static inline int term_cls(void) {
-  return printf("%s%s", term_data_esc_prefix, term_data_cls);
+  return term_write(term_data_esc_prefix, sizeof(term_data_esc_prefix))
+    + term_write(term_data_cls, sizeof(term_data_cls));
 }
 
 /*! \brief Move cursor to position x,y.
@@ -46,30 +197,170 @@ static inline int term_cls(void) {
  * \param y Row number (1-based, top-to-bottom)
  */
 static inline int term_move_to(unsigned short x, unsigned short y) {
-  return printf("%s%d;%dH", term_data_esc_prefix, y, x);
+  return term_write(term_data_esc_prefix, sizeof(term_data_esc_prefix))
+    + term_printf("%d;%dH", y, x);
+}
+
+/*! \brief Forget the terminal's colours, e.g. after something else wrote
+ *  to it; the next term_set_color() sends them in full.
+ *  \ingroup pico_term
+ */
+static inline void term_forget_color(void) {
+    term_attr.fg = 0;
+    term_attr.bg = 0;
+}
+
+/*! \brief Say whether the terminal has the 256-colour palette.
+ *  \ingroup pico_term
+ */
+static inline void term_set_palette(bool palette) {
+    term_attr.palette = palette;
+    term_forget_color();
+}
+
+/* Nearest of the eight colours to a palette entry, as 0-7 */
+static inline unsigned term_basic_color(unsigned n) {
+    if (n < 16) {
+        return n & 7;                   // the eight and their bright forms
+    }
+    if (n >= 232) {
+        return n >= 244 ? 7 : 0;        // grey ramp
+    }
+    n -= 16;                            // 6x6x6 cube, red most significant
+    unsigned red = n / 36 >= 3, green = n / 6 % 6 >= 3, blue = n % 6 >= 3;
+    return red | green << 1 | blue << 2;
+}
+
+/* Append the SGR parameters for one colour; base is 30 or 40 */
+static inline int term_color_code(term_color_T color, unsigned base) {
+    if (color < 0x100U) {
+        return term_printf("%u", color - 30U + base);
+    }
+    unsigned n = color & 0xFFU;
+    if (term_attr.palette) {
+        return term_printf("%u;5;%u", base + 8U, n);
+    }
+    return term_printf("%u", term_basic_color(n) + base);
 }
 
 /*! \brief Set terminal foreground and background colours.
  *  \ingroup pico_term
  *
  *  Colours remain active until instructed otherwise by
- *  calling this function again.
- * 
- * \param foreground Foreground colour (30-37; see clr* listing)
- * \param background Background colour (30-37; see clr* listing)
+ *  calling this function again. Only the colours that differ from the
+ *  last call are sent; nothing is sent if neither does.
+ *
+ * \param foreground Foreground colour (clr* or TERM_COLOR_256())
+ * \param background Background colour (clr* or TERM_COLOR_256())
  */
-static inline int term_set_color(unsigned short foreground, 
-  unsigned short background) {
-  return printf("%s0;%d;%dm", term_data_esc_prefix, foreground, 
-    background + ((background < 40) ? 10 : 0));
+static inline int term_set_color(term_color_T foreground, term_color_T background) {
+  bool fg = foreground != term_attr.fg;
+  bool bg = background != term_attr.bg;
+  if (!fg && !bg) {
+    return 0;
+  }
+  int n = term_write(term_data_esc_prefix, sizeof(term_data_esc_prefix));
+  if (term_attr.fg == 0 || term_attr.bg == 0) {
+    n += term_puts("0;");             // unknown state: reset other attributes too
+    fg = bg = true;
+  }
+  if (fg) {
+    n += term_color_code(foreground, 30U);
+  }
+  if (bg) {
+    n += (fg ? term_putc(';') : 0) + term_color_code(background, 40U);
+  }
+  term_attr.fg = foreground;
+  term_attr.bg = background;
+  return n + term_putc('m');
 }
 
 /*! \brief Erase terminal current line.
  *  \ingroup pico_term
  */
 static inline int term_erase_line(void) {
-  return printf("%sK", term_data_esc_prefix);
+  return term_write(term_data_esc_prefix, sizeof(term_data_esc_prefix))
+    + term_putc('K');
 }
 
-#endif //  CC2511_TERMINAL_H
+/*! \brief Ask the terminal for its size in characters.
+ *  \ingroup pico_term
+ *
+ * xterm-like terminals (PuTTY included) answer ESC [ 8 ; rows ; cols t.
+ * Others may ignore it; term_query_cursor() works on nearly all of them.
+ */
+static inline int term_query_size(void) {
+  return term_puts("\033[18t");
+}
+
+/*! \brief Ask where the cursor is, after moving it as far down and right
+ *  as it goes, which gives the size on terminals without CSI 18 t.
+ *  \ingroup pico_term
+ *
+ * The answer is ESC [ row ; col R. The cursor is put back afterwards.
+ */
+static inline int term_query_cursor(void) {
+  return term_puts("\0337\033[999;999H\033[6n\0338");
+}
+
+/* term_reply_byte() results */
+#define TERM_REPLY_NONE  0      /* not part of a reply; data holds bytes to pass on */
+#define TERM_REPLY_MORE  1      /* kept, wait for more */
+#define TERM_REPLY_DONE  2      /* a whole reply is in the parser */
+
+#define TERM_REPLY_MAX_ARGS 3
 
+/* Reader for ESC [ n ; n ... t|R answers mixed in with typed keys */
+typedef struct term_reply {
+    char data[16];                      /* bytes held back */
+    int length;
+    int value[TERM_REPLY_MAX_ARGS];
+    int count;                          /* values read */
+    char final;                         /* 't' or 'R' when done */
+    bool ended;                         /* the next byte starts afresh */
+}   term_reply_T;
+
+static inline void term_reply_init(term_reply_T *r) {
+    r->length = 0;
+    r->count = 0;
+    r->final = 0;
+    r->ended = false;
+}
+
+/*! \brief Feed one received byte.
+ *  \ingroup pico_term
+ *
+ * Anything that does not turn out to be a reply (cursor keys, typing)
+ * comes back as TERM_REPLY_NONE with the bytes held so far in data and
+ * length, to be handed on in order.
+ */
+static inline int term_reply_byte(term_reply_T *r, char ch) {
+    if (r->ended) {
+        term_reply_init(r);
+    }
+    r->data[r->length++] = ch;
+    int result = TERM_REPLY_NONE;
+    bool room = r->length < (int)sizeof(r->data);
+    if (r->length == 1) {
+        result = ch == 0x1B ? TERM_REPLY_MORE : TERM_REPLY_NONE;
+    } else if (r->length == 2) {
+        if (ch == '[') {
+            r->count = 1;
+            r->value[0] = 0;
+            result = TERM_REPLY_MORE;
+        }
+    } else if (ch >= '0' && ch <= '9' && room) {
+        r->value[r->count - 1] = r->value[r->count - 1] * 10 + (ch - '0');
+        result = TERM_REPLY_MORE;
+    } else if (ch == ';' && r->count < TERM_REPLY_MAX_ARGS && room) {
+        r->value[r->count++] = 0;
+        result = TERM_REPLY_MORE;
+    } else if ((ch == 't' || ch == 'R') && r->length > 3) {
+        r->final = ch;
+        result = TERM_REPLY_DONE;
+    }
+    r->ended = result != TERM_REPLY_MORE;
+    return result;
+}
+
+#endif //  CC2511_TERMINAL_H
@@ -10,7 +10,13 @@
 #include "hardware/pwm.h"
 #include "hardware/uart.h"
 #include "hardware/irq.h"
+#include "hardware/sync.h"
+#include "hardware/clocks.h"
+#include "hardware/structs/systick.h"
 #include "terminal.h"
+#include "ring.h"
+#include "lineedit.h"
+#include "isrstat.h"
 
 // Define GPIO pins
 #define RED_LED                 11
@@ -18,12 +24,16 @@
 #define GREEN_LED               13
 #define TX_PIN                   0
 #define RX_PIN                   1
+#define INPUT_BUFFER_SIZE      256  // power of two
+#define RX_FIFO_LEVEL            2  // interrupt at 16 of 32 bytes
 
 // Define data types
-static int chars_rxed = 0;
-volatile char buffer [100];
-volatile unsigned int buffer_index = 0;
-volatile bool has_command = false;
+isr_stats_T rx_stats;
+char buffer [LINEEDIT_SIZE];
+bool has_command = false;
+uint8_t input_storage[INPUT_BUFFER_SIZE];
+ring_T input_ring;
+lineedit_T editor;
 int red_pwm, green_pwm, blue_pwm = 0;
 unsigned short background;
 unsigned short foreground;
@@ -31,55 +41,84 @@ unsigned short foreground;
 /*
 ########################################################
 
-This function is an RX interupt handler and detects when 
-an event has come through. Had various case statment that 
-analyse if the enter or backspace button was pressed and 
-adjusts buffer and buffer index accordinly. It thens 
-calls sench_ch function to send specific character at 
-each instance. 
+This function is an RX interupt handler. The FIFO 
+interrupts when half full or when the line goes quiet, 
+and every waiting character is stored in the input ring; 
+echo and line editing are done by read_input() in the 
+main loop so the interrupt stays short. SysTick times 
+each call for draw_isr_status().
 
 ########################################################
 */
 
 void on_uart_rx() {
-    while (uart_is_readable(uart0)) {
-      uint8_t ch = uart_getc(uart0);
-        switch (ch) {
-
-          // Detect eneter button pressed
-          case '\r':
-          case '\n':
-            buffer[buffer_index] = 0; // Add trailing null
-            has_command = true; // Enter key has been pressed
-          break;
-
-          // detect backspace button pressed
-          case 0x7f:
-            if (buffer_index > 0) { // check if buffer is empty
-              buffer[buffer_index] = '\0';
-              buffer_index--;
-            }
-            send_ch(0x7f);
-          break;
-
-          // default send character
-          default:
-            if (buffer_index < 99) { // check if buffer is full
-              buffer[buffer_index] = ch;
-              buffer_index++;
-            }
-            send_ch(ch);
-          break;
-        }
-        chars_rxed++;
+    uint32_t start = systick_hw->cvr;
+    uint32_t count = 0;
+    while (!(uart0_hw->fr & UART_UARTFR_RXFE_BITS)) {
+      uint32_t data = uart0_hw->dr;
+      if (data & UART_UARTDR_OE_BITS) {
+        rx_stats.overruns++;
+      }
+      ring_push(&input_ring, (uint8_t) data);
+      count++;
     }
+    isr_stats_add(&rx_stats, isr_cycles(start, systick_hw->cvr), count);
+}
+
+// Tab completion words
+const char *command_word(int index) {
+  static const char *words[] = {"red", "green", "blue", "stop"};
+  return index < 4 ? words[index] : NULL;
+}
+
+// Redraw the line being typed after the prompt
+void draw_input() {
+  term_move_to(3, 16);
+  term_set_color(clrWhite, clrBlack);
+  printf("%s", editor.text);
+  term_erase_line();
+  term_move_to(3 + editor.cursor, 16);
 }
 
-// Function to write character
-void send_ch(char ch){
-   if (uart_is_writable(uart0)) {
-      uart_putc(uart0, ch);
+/*
+########################################################
+
+This function feeds received characters to the line 
+editor (cursor keys, history with up/down, tab 
+completion). When enter is pressed the line is copied to 
+buffer and has_command is set.
+
+########################################################
+*/
+
+void read_input() {
+  uint8_t ch;
+  bool changed = false;
+  while (!has_command && ring_pop(&input_ring, &ch)) {
+    changed = true;
+    switch (lineedit_key(&editor, ch)) {
+
+      // Line finished
+      case LINEEDIT_DONE:
+        strcpy(buffer, editor.text);
+        lineedit_reset(&editor);
+        has_command = true;
+      break;
+
+      // Several commands match, list them under the prompt
+      case LINEEDIT_AMBIGUOUS: {
+        char matches[40];
+        lineedit_matches(&editor, matches, sizeof(matches));
+        term_move_to(1, 18);
+        printf("%s", matches);
+        term_erase_line();
+      }
+      break;
     }
+  }
+  if (changed && !has_command) {
+    draw_input();
+  }
 }
 
 /*
@@ -141,6 +180,20 @@ void draw_pwm_status(int red_pwm, int green_pwm, int blue_pwm) {
   printf("Blue:  %i", blue_pwm);
 }
 
+void draw_isr_status() {
+  isr_stats_T stats;
+  uint32_t irq_state = save_and_disable_interrupts();
+  stats = rx_stats;
+  restore_interrupts(irq_state);
+  uint32_t mhz = clock_get_hz(clk_sys) / 1000000;
+  term_move_to(1, 20);
+  term_set_color(clrGreen, clrBlack);
+  printf("RX irq: %lu calls, max %lu us, mean %lu cycles, %lu bytes/call, %lu overruns",
+         (unsigned long) stats.calls, (unsigned long) (stats.max_cycles / mhz),
+         (unsigned long) isr_stats_mean(&stats), (unsigned long) stats.max_bytes,
+         (unsigned long) stats.overruns);
+}
+
 void print_command() {
   term_move_to(1,15);
   term_set_color(clrWhite, clrBlack);
@@ -161,6 +214,14 @@ int main(void) {
   gpio_set_function(TX_PIN, GPIO_FUNC_UART);
   gpio_set_function(RX_PIN, GPIO_FUNC_UART);
 
+  // SysTick counts CPU cycles to time the RX interrupt
+  systick_hw->rvr = ISRSTAT_COUNTER_MASK;
+  systick_hw->csr = 0x5;
+
+  // Typed characters are queued for the line editor
+  ring_init(&input_ring, input_storage, INPUT_BUFFER_SIZE);
+  lineedit_init(&editor, command_word);
+
   // Select correct interrupt for the UART 
   int UART_IRQ = uart0 == uart0 ? UART0_IRQ : UART1_IRQ;
 
@@ -171,8 +232,10 @@ int main(void) {
   // Now enable the UART to send interrupts - RX only
   uart_set_irq_enables(uart0, true, false);
 
-  // Turn off FIFO's
-  uart_set_fifo_enabled(uart0, false);
+  // Turn on FIFO's and interrupt when half full
+  uart_set_fifo_enabled(uart0, true);
+  hw_write_masked(&uart0_hw->ifls, RX_FIFO_LEVEL << UART_UARTIFLS_RXIFLSEL_LSB,
+                  UART_UARTIFLS_RXIFLSEL_BITS);
 
   // Declare new integer values
   uint red_value, green_value, blue_value = 0;
@@ -213,10 +276,17 @@ int main(void) {
     draw_menu_heading();
     draw_menu();
     draw_pwm_status(red_pwm, green_pwm, blue_pwm);
+    draw_isr_status();
     print_command();
 
-    while (!has_command) { // does nothing while no command
-      __asm ("wfi");
+    while (!has_command) { // edit the line until enter is pressed
+      read_input();
+      // Sleep only if nothing is waiting; a pending interrupt still wakes wfi
+      uint32_t irq_state = save_and_disable_interrupts();
+      if (!has_command && ring_count(&input_ring) == 0) {
+        __asm ("wfi");
+      }
+      restore_interrupts(irq_state);
     }
       
       /*
@@ -257,6 +327,5 @@ int main(void) {
           }
       }
     has_command = false; // Set command back to false
-    buffer_index = 0; // Set buffer index back to 0
   }
 }
\ No newline at end of file